@@ -24,13 +24,17 @@
 
 include(CMakeParseArguments)
 
+# speed tests marked with BENCHMARK are left out of "all" and ctest, they
+# are built and run by this target instead
+add_custom_target(benchmark)
+
 function (add_unit_test)
 
   if (NOT BUILD_TESTING)
     return()
   endif()
 
-  cmake_parse_arguments(ADD_UNIT_TEST "CRITERION;LIBTEST" "TARGET" "SOURCES;DEPENDS;INCLUDES" ${ARGN})
+  cmake_parse_arguments(ADD_UNIT_TEST "CRITERION;LIBTEST;BENCHMARK" "TARGET" "SOURCES;DEPENDS;INCLUDES" ${ARGN})
 
   if (NOT ADD_UNIT_TEST_SOURCES)
     set(ADD_UNIT_TEST_SOURCES "${ADD_UNIT_TEST_TARGET}.c")
@@ -64,6 +68,13 @@ function (add_unit_test)
     target_link_libraries(${ADD_UNIT_TEST_TARGET} libtest)
   endif()
 
+  if (${ADD_UNIT_TEST_BENCHMARK})
+    set_property(TARGET ${ADD_UNIT_TEST_TARGET} PROPERTY EXCLUDE_FROM_ALL TRUE)
+    add_custom_target(${ADD_UNIT_TEST_TARGET}-run COMMAND ${ADD_UNIT_TEST_TARGET})
+    add_dependencies(benchmark ${ADD_UNIT_TEST_TARGET}-run)
+    return()
+  endif()
+
   add_test (${ADD_UNIT_TEST_TARGET} ${ADD_UNIT_TEST_TARGET})
 endfunction ()
 
@@ -29,11 +29,14 @@
 #include "alarms.h"
 #include "stats/stats-registry.h"
 #include "logmsg/logmsg.h"
+#include "logmsg/logmsg-pool.h"
 #include "timeutils.h"
 #include "logsource.h"
 #include "logwriter.h"
 #include "afinter.h"
 #include "template/templates.h"
+#include "filter/filter-re-group.h"
+#include "logmatcher.h"
 #include "hostname.h"
 #include "mainloop-call.h"
 #include "service-management.h"
@@ -171,6 +174,7 @@ app_startup(void)
   value_pairs_global_init();
   service_management_init();
   scratch_buffers_allocator_init();
+  log_msg_pool_allocator_init();
   main_loop_thread_resource_init();
   nondumpable_setlogger(nondumpable_allocator_msg_debug, nondumpable_allocator_msg_fatal);
   secret_storage_init();
@@ -183,6 +187,7 @@ app_finish_app_startup_after_cfg_init(void)
   log_tags_reinit_stats();
   log_msg_stats_global_init();
   scratch_buffers_global_init();
+  log_msg_pool_global_init();
 }
 
 void
@@ -218,6 +223,10 @@ app_shutdown(void)
   secret_storage_deinit();
   scratch_buffers_allocator_deinit();
   scratch_buffers_global_deinit();
+  log_msg_pool_allocator_deinit();
+  log_msg_pool_global_deinit();
+  filter_re_group_thread_deinit();
+  log_matcher_pcre2_thread_deinit();
   value_pairs_global_deinit();
   log_template_global_deinit();
   log_tags_global_deinit();
@@ -259,6 +268,7 @@ void
 app_thread_start(void)
 {
   scratch_buffers_allocator_init();
+  log_msg_pool_allocator_init();
   dns_caching_thread_init();
   main_loop_call_thread_init();
 }
@@ -268,5 +278,8 @@ app_thread_stop(void)
 {
   main_loop_call_thread_deinit();
   dns_caching_thread_deinit();
+  filter_re_group_thread_deinit();
+  log_matcher_pcre2_thread_deinit();
+  log_msg_pool_allocator_deinit();
   scratch_buffers_allocator_deinit();
 }
@@ -200,6 +200,7 @@ extern struct _StatsOptions *last_stats_options;
 %token KW_TYPE                        10083
 %token KW_STATS_MAX_DYNAMIC           10084
 %token KW_MIN_IW_SIZE_PER_READER      10085
+%token KW_LOG_MSG_POOL                10086
 
 %token KW_CHAIN_HOSTNAMES             10090
 %token KW_NORMALIZE_HOSTNAMES         10091
@@ -341,6 +342,10 @@ extern struct _StatsOptions *last_stats_options;
 %token KW_ON_ERROR                    10511
 
 %token KW_RETRIES                     10512
+%token KW_WORKER_PARTITION_KEY        10513
+%token KW_BATCH_LATENCY_TARGET        10514
+%token KW_BATCH_LINES_MIN             10515
+%token KW_MAX_INFLIGHT_BATCHES        10516
 
 /* END_DECLS */
 
@@ -974,6 +979,7 @@ options_item
 	| KW_LOG_IW_SIZE '(' positive_integer ')'	{ msg_warning("WARNING: Support for the global log-iw-size() option was removed, please use a per-source log-iw-size()", cfg_lexer_format_location_tag(lexer, &@1)); }
 	| KW_LOG_FETCH_LIMIT '(' positive_integer ')'	{ msg_warning("WARNING: Support for the global log-fetch-limit() option was removed, please use a per-source log-fetch-limit()", cfg_lexer_format_location_tag(lexer, &@1)); }
 	| KW_LOG_MSG_SIZE '(' positive_integer ')'	{ configuration->log_msg_size = $3; }
+	| KW_LOG_MSG_POOL '(' yesno ')'		{ configuration->log_msg_pool = $3; }
 	| KW_KEEP_TIMESTAMP '(' yesno ')'	{ configuration->keep_timestamp = $3; }
 	| KW_CREATE_DIRS '(' yesno ')'		{ configuration->create_dirs = $3; }
   | KW_CUSTOM_DOMAIN '(' string ')'       { configuration->custom_domain = g_strdup($3); free($3); }
@@ -1189,6 +1195,22 @@ threaded_dest_driver_option
         {
           log_threaded_dest_driver_set_max_retries(last_driver, $3);
         }
+        | KW_WORKER_PARTITION_KEY '(' template_content ')'
+        {
+          log_threaded_dest_driver_set_worker_partition_key(last_driver, $3);
+        }
+        | KW_BATCH_LATENCY_TARGET '(' nonnegative_integer ')'
+        {
+          log_threaded_dest_driver_set_batch_latency_target(last_driver, $3);
+        }
+        | KW_BATCH_LINES_MIN '(' positive_integer ')'
+        {
+          log_threaded_dest_driver_set_batch_lines_min(last_driver, $3);
+        }
+        | KW_MAX_INFLIGHT_BATCHES '(' positive_integer ')'
+        {
+          log_threaded_dest_driver_set_max_inflight_batches(last_driver, $3);
+        }
         | dest_driver_option
         ;
 
@@ -131,6 +131,7 @@ static CfgLexerKeyword main_keywords[] =
   { "log_fetch_limit",    KW_LOG_FETCH_LIMIT },
   { "log_iw_size",        KW_LOG_IW_SIZE },
   { "log_msg_size",       KW_LOG_MSG_SIZE },
+  { "log_msg_pool",       KW_LOG_MSG_POOL },
   { "log_prefix",         KW_LOG_PREFIX, KWS_OBSOLETE, "program_override" },
   { "program_override",   KW_PROGRAM_OVERRIDE },
   { "host_override",      KW_HOST_OVERRIDE },
@@ -159,6 +160,10 @@ static CfgLexerKeyword main_keywords[] =
   { "persist_name",            KW_PERSIST_NAME, VERSION_VALUE_3_8 },
 
   { "retries",            KW_RETRIES },
+  { "worker_partition_key", KW_WORKER_PARTITION_KEY },
+  { "batch_latency_target", KW_BATCH_LATENCY_TARGET },
+  { "batch_lines_min",    KW_BATCH_LINES_MIN },
+  { "max_inflight_batches", KW_MAX_INFLIGHT_BATCHES },
 
   { "read_old_records",   KW_READ_OLD_RECORDS},
   /* filter items */
@@ -30,6 +30,7 @@
 #include "template/templates.h"
 #include "userdb.h"
 #include "logmsg/logmsg.h"
+#include "logmsg/logmsg-pool.h"
 #include "dnscache.h"
 #include "serialize.h"
 #include "plugin.h"
@@ -328,6 +329,7 @@ cfg_init(GlobalConfig *cfg)
     return FALSE;
 
   stats_reinit(&cfg->stats_options);
+  log_msg_pool_set_enabled(cfg->log_msg_pool);
 
   dns_caching_update_options(&cfg->dns_cache_options);
   hostname_reinit(cfg->custom_domain);
@@ -94,6 +94,7 @@ struct _GlobalConfig
 
   gint log_fifo_size;
   gint log_msg_size;
+  gboolean log_msg_pool;
 
   gboolean create_dirs;
   FilePermOptions file_perm_options;
@@ -24,15 +24,89 @@
 #include "filter-call.h"
 #include "cfg.h"
 #include "filter-pipe.h"
+#include "module-config.h"
+
+#define MODULE_CONFIG_KEY "filter-call"
+
+/* assigns per-message cache slots to the named filters of a configuration */
+typedef struct _FilterCallConfig
+{
+  ModuleConfig super;
+  GHashTable *cache_slots;
+} FilterCallConfig;
+
+static void
+filter_call_config_free(ModuleConfig *s)
+{
+  FilterCallConfig *self = (FilterCallConfig *) s;
+
+  g_hash_table_destroy(self->cache_slots);
+  module_config_free_method(s);
+}
+
+static FilterCallConfig *
+filter_call_config_get(GlobalConfig *cfg)
+{
+  FilterCallConfig *self = g_hash_table_lookup(cfg->module_config, MODULE_CONFIG_KEY);
+
+  if (!self)
+    {
+      self = g_new0(FilterCallConfig, 1);
+      self->super.free_fn = filter_call_config_free;
+      self->cache_slots = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+      g_hash_table_insert(cfg->module_config, g_strdup(MODULE_CONFIG_KEY), self);
+    }
+  return self;
+}
+
+/*
+ * Returns the cache slot of @rule, or -1 if it doesn't get one as all of
+ * them are taken.  Calls referencing the same rule share the slot.
+ */
+static gint
+filter_call_config_get_cache_slot(FilterCallConfig *self, const gchar *rule)
+{
+  gpointer value;
+  gint slot;
+
+  if (g_hash_table_lookup_extended(self->cache_slots, rule, NULL, &value))
+    return GPOINTER_TO_INT(value);
+
+  slot = g_hash_table_size(self->cache_slots);
+  if (slot >= LOG_MSG_FILTER_CACHE_SLOTS)
+    slot = -1;
+  g_hash_table_insert(self->cache_slots, g_strdup(rule), GINT_TO_POINTER(slot));
+  return slot;
+}
 
 typedef struct _FilterCall
 {
   FilterExprNode super;
   FilterExprNode *filter_expr;
   gchar *rule;
+  gint cache_slot;
   gboolean visited; /* Used for filter call loop detection */
 } FilterCall;
 
+static gboolean
+filter_call_eval_rule(FilterCall *self, LogMessage **msgs, gint num_msg)
+{
+  LogMessage *msg = msgs[num_msg - 1];
+  gboolean res;
+
+  /* the same rule is often referenced from several log paths, evaluate it
+   * only once as long as the message can't change */
+  if (self->cache_slot < 0 || num_msg > 1)
+    return filter_expr_eval_with_context(self->filter_expr, msgs, num_msg);
+
+  if (log_msg_filter_cache_lookup(msg, self->cache_slot, &res))
+    return res;
+
+  res = filter_expr_eval_with_context(self->filter_expr, msgs, num_msg);
+  log_msg_filter_cache_store(msg, self->cache_slot, res);
+  return res;
+}
+
 static gboolean
 filter_call_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
 {
@@ -42,7 +116,7 @@ filter_call_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
   if (self->filter_expr)
     {
       /* rule is assumed to contain a single filter pipe */
-      res = filter_expr_eval_with_context(self->filter_expr, msgs, num_msg);
+      res = filter_call_eval_rule(self, msgs, num_msg);
     }
 
   if (res)
@@ -90,6 +164,10 @@ filter_call_init(FilterExprNode *s, GlobalConfig *cfg)
         return FALSE;
       self->super.modify = self->filter_expr->modify;
 
+      /* filters storing match groups have a side effect, they can't be skipped */
+      if (!self->super.modify)
+        self->cache_slot = filter_call_config_get_cache_slot(filter_call_config_get(cfg), self->rule);
+
       stats_lock();
       StatsClusterKey sc_key;
       stats_cluster_logpipe_key_set(&sc_key, SCS_FILTER, self->rule, NULL );
@@ -138,6 +216,7 @@ filter_call_new(gchar *rule, GlobalConfig *cfg)
   self->super.free_fn = filter_call_free;
   self->super.type = g_strdup_printf("filter(%s)", rule);
   self->rule = g_strdup(rule);
+  self->cache_slot = -1;
 
   return &self->super;
 }
@@ -24,6 +24,7 @@
 
 #include "filter/filter-expr.h"
 #include "messages.h"
+#include "compat/time.h"
 
 /****************************************************************
  * Filter expression nodes
@@ -41,17 +42,41 @@ filter_expr_node_init_instance(FilterExprNode *self)
  * filter_expr_eval_root() below, but you have to be on a processing path to
  * do that.
  */
-gboolean
-filter_expr_eval_with_context(FilterExprNode *self, LogMessage **msg, gint num_msg)
+static inline guint64
+_profile_clock(void)
 {
-  gboolean res;
+  struct timespec ts;
 
-  g_assert(num_msg > 0);
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * G_GUINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+static gboolean
+_eval_and_sample(FilterExprNode *self, LogMessage **msg, gint num_msg)
+{
+  guint64 start = _profile_clock();
+  gboolean res;
 
   res = self->eval(self, msg, num_msg);
+
+  self->profile.sampled_cost += _profile_clock() - start;
+  self->profile.samples++;
+  if (res)
+    self->profile.true_samples++;
   return res;
 }
 
+gboolean
+filter_expr_eval_with_context(FilterExprNode *self, LogMessage **msg, gint num_msg)
+{
+  g_assert(num_msg > 0);
+
+  if ((++self->profile.evals % FILTER_EXPR_PROFILE_SAMPLE_RATE) != 0)
+    return self->eval(self, msg, num_msg);
+
+  return _eval_and_sample(self, msg, num_msg);
+}
+
 gboolean
 filter_expr_eval(FilterExprNode *self, LogMessage *msg)
 {
@@ -76,6 +101,33 @@ filter_expr_eval_root(FilterExprNode *self, LogMessage **msg, const LogPathOptio
   return filter_expr_eval_root_with_context(self, msg, 1, path_options);
 }
 
+/*
+ * Report (value, string) pairs, so that a message can only match @self if
+ * at least one of the reported values is exactly equal to its associated
+ * string.  This lets the caller skip evaluating the filter for messages
+ * that can't possibly match.
+ *
+ * Returns FALSE if there's no such guarantee (e.g.  the filter is negated
+ * or uses a non-literal pattern), in which case nothing is reported.
+ */
+gboolean
+filter_expr_enumerate_exact_matches(FilterExprNode *self, FilterExprExactMatchFunc func, gpointer user_data)
+{
+  if (self->comp || !self->enumerate_exact_matches)
+    return FALSE;
+
+  return self->enumerate_exact_matches(self, func, user_data);
+}
+
+/* halve the statistics of @self, so that recent behaviour weighs more */
+void
+filter_expr_profile_decay(FilterExprNode *self)
+{
+  self->profile.samples /= 2;
+  self->profile.true_samples /= 2;
+  self->profile.sampled_cost /= 2;
+}
+
 FilterExprNode *
 filter_expr_ref(FilterExprNode *self)
 {
@@ -33,6 +33,26 @@
 struct _GlobalConfig;
 typedef struct _FilterExprNode FilterExprNode;
 
+typedef void (*FilterExprExactMatchFunc)(NVHandle value_handle, const gchar *value, gpointer user_data);
+
+/*
+ * Runtime statistics of a node, used to reorder the operands of and/or
+ * (see filter-op.c).  Every FILTER_EXPR_PROFILE_SAMPLE_RATE-th evaluation
+ * is timed and its result recorded.  The counters are updated without
+ * synchronization, so they are only approximate when a filter is
+ * evaluated by multiple threads, which is fine for their purpose.
+ */
+#define FILTER_EXPR_PROFILE_SAMPLE_RATE 64
+
+typedef struct _FilterExprProfile
+{
+  guint32 evals;
+  guint32 samples;
+  guint32 true_samples;
+  /* nanoseconds spent in the sampled evaluations */
+  guint64 sampled_cost;
+} FilterExprProfile;
+
 struct _FilterExprNode
 {
   guint32 ref_cnt;
@@ -41,9 +61,11 @@ struct _FilterExprNode
   const gchar *type;
   gboolean (*init)(FilterExprNode *self, GlobalConfig *cfg);
   gboolean (*eval)(FilterExprNode *self, LogMessage **msg, gint num_msg);
+  gboolean (*enumerate_exact_matches)(FilterExprNode *self, FilterExprExactMatchFunc func, gpointer user_data);
   void (*free_fn)(FilterExprNode *self);
   StatsCounterItem *matched;
   StatsCounterItem *not_matched;
+  FilterExprProfile profile;
 };
 
 static inline gboolean
@@ -60,6 +82,8 @@ gboolean filter_expr_eval_with_context(FilterExprNode *self, LogMessage **msgs,
 gboolean filter_expr_eval_root(FilterExprNode *self, LogMessage **msg, const LogPathOptions *path_options);
 gboolean filter_expr_eval_root_with_context(FilterExprNode *self, LogMessage **msgs, gint num_msg,
                                             const LogPathOptions *path_options);
+gboolean filter_expr_enumerate_exact_matches(FilterExprNode *self, FilterExprExactMatchFunc func, gpointer user_data);
+void filter_expr_profile_decay(FilterExprNode *self);
 void filter_expr_node_init_instance(FilterExprNode *self);
 FilterExprNode *filter_expr_ref(FilterExprNode *self);
 void filter_expr_unref(FilterExprNode *self);
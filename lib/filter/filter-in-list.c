@@ -21,21 +21,310 @@
  * COPYING for details.
  *
  */
-
 #include "filter-in-list.h"
+#include "netmask-trie.h"
 #include "logmsg/logmsg.h"
-#include "str-utils.h"
+#include "messages.h"
 
-#include <errno.h>
-#include <stdlib.h>
-#include <stdio.h>
+#include <sys/stat.h>
 #include <string.h>
 
+/*
+ * Lists are loaded once per file and shared by all in-list() filters
+ * referring to the same file with the same type.  As a new configuration
+ * is parsed while the old one is still alive, reloads find the lists of
+ * the old configuration here and don't have to load them again, unless
+ * the file has changed in the meantime.
+ */
+
+typedef enum
+{
+  IN_LIST_STRING,
+  IN_LIST_CIDR,
+} InListType;
+
+/* length is never 0 for used slots, as empty lines are not loaded */
+typedef struct _InListSlot
+{
+  guint32 hash;
+  guint32 offset;
+  guint32 length;
+} InListSlot;
+
+typedef struct _InList
+{
+  gint ref_cnt;
+  gchar *key;
+  struct stat st;
+
+  /* IN_LIST_STRING: an open addressing hash set of the lines of the
+   * file, referring to them by offset into our copy of its contents.  The
+   * file is not mapped, as lists are often rewritten in place. */
+  gchar *contents;
+  InListSlot *slots;
+  guint32 mask;
+
+  /* IN_LIST_CIDR */
+  NetmaskTrie *trie;
+} InList;
+
+static GHashTable *in_lists;
+G_LOCK_DEFINE_STATIC(in_lists);
+
+static inline guint32
+_hash(const gchar *value, gsize length)
+{
+  guint32 hash = 2166136261U;
+  gsize i;
+
+  /* FNV-1a */
+  for (i = 0; i < length; i++)
+    {
+      hash ^= (guchar) value[i];
+      hash *= 16777619U;
+    }
+  return hash;
+}
+
+static gboolean
+_string_set_contains(InList *self, const gchar *value, gsize length)
+{
+  const gchar *contents = self->contents;
+  guint32 hash = _hash(value, length);
+  guint32 i;
+
+  for (i = hash & self->mask; self->slots[i].length; i = (i + 1) & self->mask)
+    {
+      InListSlot *slot = &self->slots[i];
+
+      if (slot->hash == hash && slot->length == length && memcmp(contents + slot->offset, value, length) == 0)
+        return TRUE;
+    }
+  return FALSE;
+}
+
+static void
+_string_set_insert(InList *self, guint32 offset, guint32 length)
+{
+  const gchar *contents = self->contents;
+  guint32 hash = _hash(contents + offset, length);
+  guint32 i;
+
+  for (i = hash & self->mask; self->slots[i].length; i = (i + 1) & self->mask)
+    {
+      InListSlot *slot = &self->slots[i];
+
+      if (slot->hash == hash && slot->length == length && memcmp(contents + slot->offset, contents + offset, length) == 0)
+        return;
+    }
+  self->slots[i].hash = hash;
+  self->slots[i].offset = offset;
+  self->slots[i].length = length;
+}
+
+static gboolean
+_in_list_load_strings(InList *self, const gchar *list_file)
+{
+  GError *error = NULL;
+  const gchar *contents, *line, *end;
+  gsize length;
+  guint32 num_lines = 0, num_slots = 16;
+
+  if (!g_file_get_contents(list_file, &self->contents, &length, &error))
+    {
+      msg_error("Error opening in-list filter list file",
+                evt_tag_str("file", list_file),
+                evt_tag_str("error", error->message));
+      g_clear_error(&error);
+      return FALSE;
+    }
+
+  contents = self->contents;
+  if (length > G_MAXUINT32)
+    {
+      msg_error("in-list filter list file is too large",
+                evt_tag_str("file", list_file));
+      return FALSE;
+    }
+
+  end = contents + length;
+  for (line = contents; line < end; line++)
+    {
+      line = memchr(line, '\n', end - line);
+      num_lines++;
+      if (!line)
+        break;
+    }
+
+  /* keep the load factor at or below 50% */
+  while (num_slots < 2 * num_lines)
+    num_slots *= 2;
+  self->slots = g_new0(InListSlot, num_slots);
+  self->mask = num_slots - 1;
+
+  for (line = contents; line < end; )
+    {
+      const gchar *eol = memchr(line, '\n', end - line);
+
+      if (!eol)
+        eol = end;
+      if (eol > line)
+        _string_set_insert(self, line - contents, eol - line);
+      line = eol + 1;
+    }
+  return TRUE;
+}
+
+static gboolean
+_in_list_load_networks(InList *self, const gchar *list_file)
+{
+  GError *error = NULL;
+  gchar *contents;
+  gchar **lines;
+  gboolean success = TRUE;
+  gint i;
+
+  if (!g_file_get_contents(list_file, &contents, NULL, &error))
+    {
+      msg_error("Error opening in-list filter list file",
+                evt_tag_str("file", list_file),
+                evt_tag_str("error", error->message));
+      g_clear_error(&error);
+      return FALSE;
+    }
+
+  self->trie = netmask_trie_new();
+  lines = g_strsplit(contents, "\n", -1);
+  for (i = 0; lines[i] && success; i++)
+    {
+      gchar *network = g_strstrip(lines[i]);
+
+      if (network[0] == 0 || network[0] == '#')
+        continue;
+
+      if (!netmask_trie_add(self->trie, network))
+        {
+          msg_error("Invalid network in in-list filter list file",
+                    evt_tag_str("file", list_file),
+                    evt_tag_int("line", i + 1),
+                    evt_tag_str("network", network));
+          success = FALSE;
+        }
+    }
+  g_strfreev(lines);
+  g_free(contents);
+  return success;
+}
+
+static void
+_in_list_free(InList *self)
+{
+  g_free(self->contents);
+  if (self->trie)
+    netmask_trie_free(self->trie);
+  g_free(self->slots);
+  g_free(self->key);
+  g_free(self);
+}
+
+static gboolean
+_is_same_file(const struct stat *a, const struct stat *b)
+{
+  return a->st_dev == b->st_dev && a->st_ino == b->st_ino &&
+         a->st_size == b->st_size && a->st_mtime == b->st_mtime;
+}
+
+static InList *
+_in_list_lookup(const gchar *key, const struct stat *st)
+{
+  InList *self;
+
+  if (!in_lists)
+    return NULL;
+
+  self = g_hash_table_lookup(in_lists, key);
+  if (!self || !_is_same_file(&self->st, st))
+    return NULL;
+
+  self->ref_cnt++;
+  return self;
+}
+
+static InList *
+_in_list_get(const gchar *list_file, InListType type)
+{
+  gchar *key = g_strdup_printf("%d:%s", type, list_file);
+  struct stat st;
+  InList *self;
+  gboolean loaded;
+
+  if (stat(list_file, &st) < 0)
+    {
+      msg_error("Error opening in-list filter list file",
+                evt_tag_str("file", list_file),
+                evt_tag_error("errno"));
+      g_free(key);
+      return NULL;
+    }
+
+  G_LOCK(in_lists);
+  self = _in_list_lookup(key, &st);
+  G_UNLOCK(in_lists);
+  if (self)
+    {
+      msg_debug("Reusing already loaded in-list filter list file",
+                evt_tag_str("file", list_file));
+      g_free(key);
+      return self;
+    }
+
+  self = g_new0(InList, 1);
+  self->ref_cnt = 1;
+  self->key = key;
+  self->st = st;
+
+  if (type == IN_LIST_CIDR)
+    loaded = _in_list_load_networks(self, list_file);
+  else
+    loaded = _in_list_load_strings(self, list_file);
+
+  if (!loaded)
+    {
+      _in_list_free(self);
+      return NULL;
+    }
+
+  G_LOCK(in_lists);
+  if (!in_lists)
+    in_lists = g_hash_table_new(g_str_hash, g_str_equal);
+  g_hash_table_replace(in_lists, self->key, self);
+  G_UNLOCK(in_lists);
+  return self;
+}
+
+static void
+_in_list_unref(InList *self)
+{
+  G_LOCK(in_lists);
+  if (--self->ref_cnt > 0)
+    {
+      G_UNLOCK(in_lists);
+      return;
+    }
+
+  /* the file may have been loaded again since, leave that one in place */
+  if (g_hash_table_lookup(in_lists, self->key) == self)
+    g_hash_table_remove(in_lists, self->key);
+  G_UNLOCK(in_lists);
+
+  _in_list_free(self);
+}
+
 typedef struct _FilterInList
 {
   FilterExprNode super;
   NVHandle value_handle;
-  GTree *tree;
+  InList *list;
 } FilterInList;
 
 static gboolean
@@ -45,56 +334,81 @@ filter_in_list_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
   LogMessage *msg = msgs[num_msg - 1];
   const gchar *value;
   gssize len = 0;
+  gboolean result;
 
   value = log_msg_get_value(msg, self->value_handle, &len);
-  APPEND_ZERO(value, value, len);
 
-  gboolean result = (g_tree_lookup(self->tree, value) != NULL);
+  result = _string_set_contains(self->list, value, len);
   msg_trace("in-list() evaluation started",
-            evt_tag_str("value", value),
+            evt_tag_printf("value", "%.*s", (gint) len, value),
             evt_tag_printf("msg", "%p", msg));
 
   return result ^ s->comp;
 }
 
+static gboolean
+filter_in_list_cidr_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
+{
+  FilterInList *self = (FilterInList *)s;
+  LogMessage *msg = msgs[num_msg - 1];
+  const gchar *value;
+  gssize len = 0;
+  gint prefix_len;
+
+  if (self->value_handle)
+    {
+      value = log_msg_get_value(msg, self->value_handle, &len);
+      prefix_len = netmask_trie_lookup_string(self->list->trie, value, len);
+    }
+  else
+    {
+      prefix_len = netmask_trie_lookup_msg_sender(self->list->trie, msg);
+    }
+
+  msg_trace("in-list() evaluation started",
+            evt_tag_int("prefix_len", prefix_len),
+            evt_tag_printf("msg", "%p", msg));
+
+  return (prefix_len >= 0) ^ s->comp;
+}
+
 static void
 filter_in_list_free(FilterExprNode *s)
 {
   FilterInList *self = (FilterInList *)s;
 
-  g_tree_destroy(self->tree);
+  _in_list_unref(self->list);
 }
 
-FilterExprNode *
-filter_in_list_new(const gchar *list_file, const gchar *property)
+static FilterExprNode *
+_filter_in_list_new(const gchar *list_file, const gchar *property, InListType type)
 {
   FilterInList *self;
-  FILE *stream;
-  gchar line[16384];
+  InList *list;
 
-  stream = fopen(list_file, "r");
-  if (!stream)
-    {
-      msg_error("Error opening in-list filter list file",
-                evt_tag_str("file", list_file),
-                evt_tag_error("errno"));
-      return NULL;
-    }
+  list = _in_list_get(list_file, type);
+  if (!list)
+    return NULL;
 
   self = g_new0(FilterInList, 1);
   filter_expr_node_init_instance(&self->super);
-  self->value_handle = log_msg_get_value_handle(property);
-  self->tree = g_tree_new_full((GCompareDataFunc)strcmp, NULL, g_free, NULL);
-
-  while (fgets(line, sizeof(line), stream) != NULL)
-    {
-      line[strlen(line) - 1] = '\0';
-      if (line[0])
-        g_tree_insert(self->tree, g_strdup(line), GINT_TO_POINTER(1));
-    }
-  fclose(stream);
+  self->value_handle = property ? log_msg_get_value_handle(property) : LM_V_NONE;
+  self->list = list;
 
-  self->super.eval = filter_in_list_eval;
+  self->super.eval = (type == IN_LIST_CIDR) ? filter_in_list_cidr_eval : filter_in_list_eval;
   self->super.free_fn = filter_in_list_free;
   return &self->super;
 }
+
+FilterExprNode *
+filter_in_list_new(const gchar *list_file, const gchar *property)
+{
+  return _filter_in_list_new(list_file, property, IN_LIST_STRING);
+}
+
+/* @property can be NULL, the address of the sender of the message is looked up then */
+FilterExprNode *
+filter_in_list_cidr_new(const gchar *list_file, const gchar *property)
+{
+  return _filter_in_list_new(list_file, property, IN_LIST_CIDR);
+}
@@ -29,5 +29,7 @@
 
 FilterExprNode *filter_in_list_new(const gchar *list_file,
                                    const gchar *property);
+FilterExprNode *filter_in_list_cidr_new(const gchar *list_file,
+                                        const gchar *property);
 
 #endif
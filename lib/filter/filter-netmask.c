@@ -23,6 +23,7 @@
  */
 
 #include "filter-netmask.h"
+#include "netmask-trie.h"
 #include "gsocket.h"
 #include "logmsg/logmsg.h"
 
@@ -40,24 +41,12 @@ static gboolean
 filter_netmask_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
 {
   FilterNetmask *self = (FilterNetmask *) s;
-  struct in_addr *addr, addr_storage;
+  const struct in_addr *addr;
+  struct in_addr addr_storage;
   LogMessage *msg = msgs[num_msg - 1];
   gboolean res;
 
-  if (msg->saddr && g_sockaddr_inet_check(msg->saddr))
-    {
-      addr = &((struct sockaddr_in *) &msg->saddr->sa)->sin_addr;
-    }
-  else if (!msg->saddr || msg->saddr->sa.sa_family == AF_UNIX)
-    {
-      addr_storage.s_addr = htonl(INADDR_LOOPBACK);
-      addr = &addr_storage;
-    }
-  else
-    {
-      addr = NULL;
-    }
-
+  addr = netmask_get_msg_sender_inet(msg, &addr_storage);
   if (addr)
     res = ((addr->s_addr & self->netmask.s_addr) == (self->address.s_addr));
   else
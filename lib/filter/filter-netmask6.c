@@ -24,6 +24,7 @@
 
 
 #include "filter-netmask6.h"
+#include "netmask-trie.h"
 #include "gsocket.h"
 #include "logmsg/logmsg.h"
 
@@ -107,19 +108,7 @@ _eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
   if (!self->is_valid)
     return s->comp;
 
-  if (msg->saddr && g_sockaddr_inet6_check(msg->saddr))
-    {
-      address = &((struct sockaddr_in6 *) &msg->saddr->sa)->sin6_addr;
-    }
-  else if (!msg->saddr || msg->saddr->sa.sa_family == AF_UNIX)
-    {
-      address = &in6addr_loopback;
-    }
-  else
-    {
-      address = NULL;
-    }
-
+  address = netmask_get_msg_sender_inet6(msg);
   if (address)
     {
       get_network_address(address, self->prefix, &network_address);
@@ -23,10 +23,27 @@
  */
 #include "filter-op.h"
 
+/*
+ * The operands of and/or are commutative as long as neither of them
+ * modifies the message (e.g. stores regexp match groups), so their
+ * evaluation order is adjusted at runtime: every FILTER_OP_REORDER_PERIOD
+ * evaluations the operand that is expected to be cheaper to start with,
+ * based on the sampled cost and true rate of the two (see
+ * FilterExprProfile), is moved to the front.
+ */
+#define FILTER_OP_REORDER_PERIOD 4096
+#define FILTER_OP_REORDER_MIN_SAMPLES 8
+/* only reorder if it is expected to save at least 10% */
+#define FILTER_OP_REORDER_GAIN 0.9
+
 typedef struct _FilterOp
 {
   FilterExprNode super;
   FilterExprNode *left, *right;
+  gboolean reorderable;
+  /* evaluate right before left, accessed atomically as the filter may be
+   * evaluated by multiple threads while it is being reordered */
+  gint swapped;
 } FilterOp;
 
 static gboolean
@@ -44,6 +61,7 @@ fop_init(FilterExprNode *s, GlobalConfig *cfg)
     return FALSE;
 
   self->super.modify = self->left->modify || self->right->modify;
+  self->reorderable = !self->super.modify;
 
   return TRUE;
 }
@@ -57,6 +75,78 @@ fop_free(FilterExprNode *s)
   filter_expr_unref(self->right);
 }
 
+static void
+_ignore_exact_match(NVHandle value_handle, const gchar *value, gpointer user_data)
+{
+}
+
+static gboolean
+_has_exact_matches(FilterExprNode *node)
+{
+  return filter_expr_enumerate_exact_matches(node, _ignore_exact_match, NULL);
+}
+
+static inline void
+_get_operands(FilterOp *self, FilterExprNode **first, FilterExprNode **second)
+{
+  if (g_atomic_int_get(&self->swapped))
+    {
+      *first = self->right;
+      *second = self->left;
+    }
+  else
+    {
+      *first = self->left;
+      *second = self->right;
+    }
+}
+
+static gboolean
+_get_operand_stats(FilterExprNode *node, gdouble *cost, gdouble *true_rate)
+{
+  if (node->profile.samples < FILTER_OP_REORDER_MIN_SAMPLES)
+    return FALSE;
+
+  *cost = (gdouble) node->profile.sampled_cost / node->profile.samples;
+  *true_rate = (gdouble) node->profile.true_samples / node->profile.samples;
+  return TRUE;
+}
+
+/*
+ * The expected cost of evaluating "a" first is cost(a) + P(a doesn't
+ * decide the result) * cost(b), where "a" decides an AND if it is FALSE and
+ * an OR if it is TRUE.
+ */
+static void
+_reorder(FilterOp *self, gboolean decided_by_true)
+{
+  gdouble left_cost, left_true, right_cost, right_true;
+  gdouble left_first, right_first;
+  gboolean swapped = g_atomic_int_get(&self->swapped);
+
+  if (!_get_operand_stats(self->left, &left_cost, &left_true) ||
+      !_get_operand_stats(self->right, &right_cost, &right_true))
+    return;
+
+  left_first = left_cost + (decided_by_true ? 1.0 - left_true : left_true) * right_cost;
+  right_first = right_cost + (decided_by_true ? 1.0 - right_true : right_true) * left_cost;
+
+  if (!swapped && right_first < left_first * FILTER_OP_REORDER_GAIN)
+    g_atomic_int_set(&self->swapped, TRUE);
+  else if (swapped && left_first < right_first * FILTER_OP_REORDER_GAIN)
+    g_atomic_int_set(&self->swapped, FALSE);
+
+  filter_expr_profile_decay(self->left);
+  filter_expr_profile_decay(self->right);
+}
+
+static inline void
+_reorder_periodically(FilterOp *self, gboolean decided_by_true)
+{
+  if (self->reorderable && (self->super.profile.evals % FILTER_OP_REORDER_PERIOD) == 0)
+    _reorder(self, decided_by_true);
+}
+
 static void
 fop_init_instance(FilterOp *self)
 {
@@ -69,9 +159,26 @@ static gboolean
 fop_or_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
 {
   FilterOp *self = (FilterOp *) s;
+  FilterExprNode *first, *second;
 
-  return (filter_expr_eval_with_context(self->left, msgs, num_msg)
-          || filter_expr_eval_with_context(self->right, msgs, num_msg)) ^ s->comp;
+  _reorder_periodically(self, TRUE);
+  _get_operands(self, &first, &second);
+  return (filter_expr_eval_with_context(first, msgs, num_msg)
+          || filter_expr_eval_with_context(second, msgs, num_msg)) ^ s->comp;
+}
+
+/* both sides need to be constrained, the union of their values is reported */
+static gboolean
+fop_or_enumerate_exact_matches(FilterExprNode *s, FilterExprExactMatchFunc func, gpointer user_data)
+{
+  FilterOp *self = (FilterOp *) s;
+
+  if (!_has_exact_matches(self->left) || !_has_exact_matches(self->right))
+    return FALSE;
+
+  filter_expr_enumerate_exact_matches(self->left, func, user_data);
+  filter_expr_enumerate_exact_matches(self->right, func, user_data);
+  return TRUE;
 }
 
 FilterExprNode *
@@ -81,6 +188,7 @@ fop_or_new(FilterExprNode *e1, FilterExprNode *e2)
 
   fop_init_instance(self);
   self->super.eval = fop_or_eval;
+  self->super.enumerate_exact_matches = fop_or_enumerate_exact_matches;
   self->left = e1;
   self->right = e2;
   self->super.type = "OR";
@@ -91,9 +199,24 @@ static gboolean
 fop_and_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
 {
   FilterOp *self = (FilterOp *) s;
+  FilterExprNode *first, *second;
+
+  _reorder_periodically(self, FALSE);
+  _get_operands(self, &first, &second);
+  return (filter_expr_eval_with_context(first, msgs, num_msg)
+          && filter_expr_eval_with_context(second, msgs, num_msg)) ^ s->comp;
+}
+
+/* either side being constrained is enough, the first one that is gets reported */
+static gboolean
+fop_and_enumerate_exact_matches(FilterExprNode *s, FilterExprExactMatchFunc func, gpointer user_data)
+{
+  FilterOp *self = (FilterOp *) s;
+
+  if (_has_exact_matches(self->left))
+    return filter_expr_enumerate_exact_matches(self->left, func, user_data);
 
-  return (filter_expr_eval_with_context(self->left, msgs, num_msg)
-          && filter_expr_eval_with_context(self->right, msgs, num_msg)) ^ s->comp;
+  return filter_expr_enumerate_exact_matches(self->right, func, user_data);
 }
 
 FilterExprNode *
@@ -103,6 +226,7 @@ fop_and_new(FilterExprNode *e1, FilterExprNode *e2)
 
   fop_init_instance(self);
   self->super.eval = fop_and_eval;
+  self->super.enumerate_exact_matches = fop_and_enumerate_exact_matches;
   self->left = e1;
   self->right = e2;
   self->super.type = "AND";
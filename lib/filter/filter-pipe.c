@@ -86,6 +86,21 @@ log_filter_pipe_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_op
             evt_tag_printf("msg", "%p", msg));
 }
 
+/*
+ * Returns FALSE if @s is not a filter pipe, otherwise see
+ * filter_expr_enumerate_exact_matches().
+ */
+gboolean
+log_filter_pipe_enumerate_exact_matches(LogPipe *s, FilterExprExactMatchFunc func, gpointer user_data)
+{
+  LogFilterPipe *self = (LogFilterPipe *) s;
+
+  if (s->queue != log_filter_pipe_queue)
+    return FALSE;
+
+  return filter_expr_enumerate_exact_matches(self->expr, func, user_data);
+}
+
 static LogPipe *
 log_filter_pipe_clone(LogPipe *s)
 {
@@ -44,5 +44,6 @@ typedef struct _LogFilterPipe
 } LogFilterPipe;
 
 LogPipe *log_filter_pipe_new(FilterExprNode *expr, GlobalConfig *cfg);
+gboolean log_filter_pipe_enumerate_exact_matches(LogPipe *s, FilterExprExactMatchFunc func, gpointer user_data);
 
 #endif
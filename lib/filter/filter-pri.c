@@ -57,6 +57,32 @@ filter_facility_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
   return res ^ s->comp;
 }
 
+static gboolean
+filter_facility_enumerate_exact_matches(FilterExprNode *s, FilterExprExactMatchFunc func, gpointer user_data)
+{
+  FilterPri *self = (FilterPri *) s;
+  NVHandle facility_num = log_msg_get_value_handle("FACILITY_NUM");
+  gchar value[16];
+  guint32 fac_num;
+
+  if (G_UNLIKELY(self->valid & 0x80000000))
+    {
+      g_snprintf(value, sizeof(value), "%u", self->valid & ~0x80000000);
+      func(facility_num, value, user_data);
+      return TRUE;
+    }
+
+  for (fac_num = 0; fac_num < 32; fac_num++)
+    {
+      if (self->valid & (1U << fac_num))
+        {
+          g_snprintf(value, sizeof(value), "%u", fac_num);
+          func(facility_num, value, user_data);
+        }
+    }
+  return TRUE;
+}
+
 FilterExprNode *
 filter_facility_new(guint32 facilities)
 {
@@ -64,6 +90,7 @@ filter_facility_new(guint32 facilities)
 
   filter_expr_node_init_instance(&self->super);
   self->super.eval = filter_facility_eval;
+  self->super.enumerate_exact_matches = filter_facility_enumerate_exact_matches;
   self->valid = facilities;
   self->super.type = "facility";
   return &self->super;
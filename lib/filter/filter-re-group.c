@@ -0,0 +1,468 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "filter/filter-re-group.h"
+#include "tls-support.h"
+#include "atomic.h"
+
+#include <string.h>
+
+#define FILTER_RE_GROUP_CACHE_SIZE 8
+#define FRG_NO_STATE G_MAXUINT32
+
+typedef struct _FilterREGroupPattern
+{
+  gchar *literal;
+  gsize len;
+  FilterREGroupMatchMode mode;
+} FilterREGroupPattern;
+
+struct _FilterREGroup
+{
+  GAtomicCounter ref_cnt;
+  gboolean icase;
+  gboolean frozen;
+  GArray *patterns;
+
+  /* the automaton below covers the first num_compiled patterns */
+  guint32 id;
+  gint num_compiled;
+  gint bitmap_words;
+  gint num_classes;
+  guint16 byte_classes[256];
+  /* num_states * num_classes, every transition is resolved */
+  guint32 *transitions;
+  /* patterns ending at state X: outputs[output_index[X]..output_index[X+1]] */
+  guint32 *output_index;
+  guint32 *outputs;
+  GArray *empty_patterns;
+};
+
+typedef struct _FilterREGroupCacheEntry
+{
+  guint32 group_id;
+  gchar *value;
+  gsize value_len;
+  gsize value_size;
+  guint64 *matches;
+  gint matches_size;
+} FilterREGroupCacheEntry;
+
+TLS_BLOCK_START
+{
+  FilterREGroupCacheEntry filter_re_group_cache[FILTER_RE_GROUP_CACHE_SIZE];
+}
+TLS_BLOCK_END;
+
+#define filter_re_group_cache  __tls_deref(filter_re_group_cache)
+
+/* 0 is never assigned, so a zero initialized cache entry never matches */
+static GAtomicCounter filter_re_group_last_id;
+
+static inline FilterREGroupPattern *
+_get_pattern(FilterREGroup *self, gint pattern)
+{
+  return &g_array_index(self->patterns, FilterREGroupPattern, pattern);
+}
+
+static inline guchar
+_fold(FilterREGroup *self, guchar c)
+{
+  return self->icase ? g_ascii_tolower(c) : c;
+}
+
+static void
+_compute_byte_classes(FilterREGroup *self)
+{
+  gboolean used[256] = { 0 };
+  gint i, c;
+
+  for (i = 0; i < self->patterns->len; i++)
+    {
+      FilterREGroupPattern *pattern = _get_pattern(self, i);
+      gsize j;
+
+      for (j = 0; j < pattern->len; j++)
+        used[_fold(self, pattern->literal[j])] = TRUE;
+    }
+
+  /* class 0 stands for all the bytes that don't occur in any of the patterns */
+  self->num_classes = 1;
+  for (c = 0; c < 256; c++)
+    self->byte_classes[c] = used[c] ? self->num_classes++ : 0;
+
+  if (self->icase)
+    {
+      for (c = 0; c < 256; c++)
+        self->byte_classes[c] = self->byte_classes[(guchar) g_ascii_tolower(c)];
+    }
+}
+
+static void
+_free_state_outputs(GArray *outputs)
+{
+  g_array_free(outputs, TRUE);
+}
+
+static guint32
+_add_state(GArray *transitions, GPtrArray *state_outputs, gint num_classes)
+{
+  guint32 state = transitions->len / num_classes;
+  gint i;
+
+  for (i = 0; i < num_classes; i++)
+    {
+      guint32 none = FRG_NO_STATE;
+
+      g_array_append_val(transitions, none);
+    }
+  g_ptr_array_add(state_outputs, g_array_new(FALSE, FALSE, sizeof(guint32)));
+  return state;
+}
+
+static void
+_build_trie(FilterREGroup *self, GArray *transitions, GPtrArray *state_outputs)
+{
+  guint32 i;
+
+  _add_state(transitions, state_outputs, self->num_classes);
+  for (i = 0; i < self->patterns->len; i++)
+    {
+      FilterREGroupPattern *pattern = _get_pattern(self, i);
+      guint32 state = 0;
+      gsize j;
+
+      if (pattern->len == 0)
+        {
+          g_array_append_val(self->empty_patterns, i);
+          continue;
+        }
+
+      for (j = 0; j < pattern->len; j++)
+        {
+          guint32 *next = &g_array_index(transitions, guint32,
+                                         state * self->num_classes + self->byte_classes[(guchar) pattern->literal[j]]);
+
+          if (*next == FRG_NO_STATE)
+            {
+              guint32 new_state = _add_state(transitions, state_outputs, self->num_classes);
+
+              /* _add_state() might have moved the array */
+              next = &g_array_index(transitions, guint32,
+                                    state * self->num_classes + self->byte_classes[(guchar) pattern->literal[j]]);
+              *next = new_state;
+            }
+          state = *next;
+        }
+      g_array_append_val((GArray *) g_ptr_array_index(state_outputs, state), i);
+    }
+}
+
+/* resolves missing transitions via the failure links and merges outputs along them */
+static void
+_link_trie(FilterREGroup *self, guint32 *delta, guint32 num_states, GPtrArray *state_outputs)
+{
+  guint32 *fail = g_new0(guint32, num_states);
+  guint32 *queue = g_new(guint32, num_states);
+  guint32 head = 0, tail = 0;
+  gint c;
+
+  for (c = 0; c < self->num_classes; c++)
+    {
+      guint32 s = delta[c];
+
+      if (s == FRG_NO_STATE)
+        {
+          delta[c] = 0;
+        }
+      else
+        {
+          fail[s] = 0;
+          queue[tail++] = s;
+        }
+    }
+
+  while (head < tail)
+    {
+      guint32 r = queue[head++];
+      GArray *fail_outputs = g_ptr_array_index(state_outputs, fail[r]);
+
+      /* fail[r] is shallower than r, so its outputs are already merged */
+      g_array_append_vals(g_ptr_array_index(state_outputs, r), fail_outputs->data, fail_outputs->len);
+
+      for (c = 0; c < self->num_classes; c++)
+        {
+          guint32 s = delta[r * self->num_classes + c];
+
+          if (s == FRG_NO_STATE)
+            {
+              delta[r * self->num_classes + c] = delta[fail[r] * self->num_classes + c];
+            }
+          else
+            {
+              fail[s] = delta[fail[r] * self->num_classes + c];
+              queue[tail++] = s;
+            }
+        }
+    }
+  g_free(queue);
+  g_free(fail);
+}
+
+static void
+_flatten_outputs(FilterREGroup *self, GPtrArray *state_outputs)
+{
+  guint32 num_outputs = 0;
+  guint32 s;
+
+  self->output_index = g_new(guint32, state_outputs->len + 1);
+  for (s = 0; s < state_outputs->len; s++)
+    {
+      self->output_index[s] = num_outputs;
+      num_outputs += ((GArray *) g_ptr_array_index(state_outputs, s))->len;
+    }
+  self->output_index[state_outputs->len] = num_outputs;
+
+  self->outputs = g_new(guint32, MAX(num_outputs, 1));
+  for (s = 0; s < state_outputs->len; s++)
+    {
+      GArray *outputs = g_ptr_array_index(state_outputs, s);
+
+      memcpy(&self->outputs[self->output_index[s]], outputs->data, outputs->len * sizeof(guint32));
+    }
+}
+
+static void
+_free_automaton(FilterREGroup *self)
+{
+  g_free(self->transitions);
+  g_free(self->output_index);
+  g_free(self->outputs);
+  self->transitions = NULL;
+  self->output_index = NULL;
+  self->outputs = NULL;
+  g_array_set_size(self->empty_patterns, 0);
+  self->num_compiled = 0;
+}
+
+gboolean
+filter_re_group_compile(FilterREGroup *self)
+{
+  GArray *transitions;
+  GPtrArray *state_outputs;
+  guint32 num_states;
+
+  self->frozen = TRUE;
+  if (self->patterns->len < FILTER_RE_GROUP_MIN_PATTERNS)
+    return FALSE;
+
+  if (self->num_compiled == self->patterns->len)
+    return TRUE;
+
+  _free_automaton(self);
+  _compute_byte_classes(self);
+
+  transitions = g_array_new(FALSE, FALSE, sizeof(guint32));
+  state_outputs = g_ptr_array_new_with_free_func((GDestroyNotify) _free_state_outputs);
+
+  _build_trie(self, transitions, state_outputs);
+  num_states = transitions->len / self->num_classes;
+  _link_trie(self, (guint32 *) transitions->data, num_states, state_outputs);
+  _flatten_outputs(self, state_outputs);
+
+  self->transitions = (guint32 *) g_array_free(transitions, FALSE);
+  g_ptr_array_free(state_outputs, TRUE);
+
+  self->num_compiled = self->patterns->len;
+  self->bitmap_words = (self->num_compiled + 63) / 64;
+  self->id = (guint32) g_atomic_counter_exchange_and_add(&filter_re_group_last_id, 1) + 1;
+  return TRUE;
+}
+
+static inline void
+_set_match(guint64 *matches, guint32 pattern)
+{
+  matches[pattern / 64] |= G_GUINT64_CONSTANT(1) << (pattern % 64);
+}
+
+static void
+_scan(FilterREGroup *self, const gchar *value, gsize value_len, guint64 *matches)
+{
+  guint32 state = 0;
+  gsize i;
+  gint e;
+
+  for (e = 0; e < self->empty_patterns->len; e++)
+    {
+      guint32 pattern = g_array_index(self->empty_patterns, guint32, e);
+
+      if (_get_pattern(self, pattern)->mode != FRG_EXACT || value_len == 0)
+        _set_match(matches, pattern);
+    }
+
+  for (i = 0; i < value_len; i++)
+    {
+      guint32 o;
+
+      state = self->transitions[state * self->num_classes + self->byte_classes[(guchar) value[i]]];
+      for (o = self->output_index[state]; o < self->output_index[state + 1]; o++)
+        {
+          FilterREGroupPattern *pattern = _get_pattern(self, self->outputs[o]);
+          gboolean at_start = (i + 1 == pattern->len);
+
+          if (pattern->mode == FRG_SUBSTRING ||
+              (at_start && (pattern->mode == FRG_PREFIX || i + 1 == value_len)))
+            _set_match(matches, self->outputs[o]);
+        }
+    }
+}
+
+static void
+_scan_into_cache(FilterREGroup *self, FilterREGroupCacheEntry *entry, const gchar *value, gsize value_len)
+{
+  if (entry->value_size < value_len)
+    {
+      entry->value_size = MAX(value_len, 256);
+      entry->value = g_realloc(entry->value, entry->value_size);
+    }
+  memcpy(entry->value, value, value_len);
+  entry->value_len = value_len;
+
+  if (entry->matches_size < self->bitmap_words)
+    {
+      entry->matches_size = self->bitmap_words;
+      entry->matches = g_renew(guint64, entry->matches, entry->matches_size);
+    }
+  memset(entry->matches, 0, self->bitmap_words * sizeof(guint64));
+
+  _scan(self, value, value_len, entry->matches);
+  entry->group_id = self->id;
+}
+
+/*
+ * Returns FALSE if @pattern is not covered by the compiled automaton, in
+ * which case the caller has to find out the result on its own.
+ */
+gboolean
+filter_re_group_match(FilterREGroup *self, gint pattern, const gchar *value, gssize value_len, gboolean *result)
+{
+  FilterREGroupCacheEntry *entry;
+
+  if (pattern >= self->num_compiled)
+    return FALSE;
+
+  if (value_len < 0)
+    value_len = strlen(value);
+
+  entry = &filter_re_group_cache[self->id % FILTER_RE_GROUP_CACHE_SIZE];
+  if (entry->group_id != self->id ||
+      entry->value_len != value_len ||
+      (value_len > 0 && memcmp(entry->value, value, value_len) != 0))
+    _scan_into_cache(self, entry, value, value_len);
+
+  *result = (entry->matches[pattern / 64] >> (pattern % 64)) & 1;
+  return TRUE;
+}
+
+/* Returns the index of the new pattern, or -1 if the group is frozen already */
+gint
+filter_re_group_add_pattern(FilterREGroup *self, const gchar *literal, gssize literal_len,
+                            FilterREGroupMatchMode mode)
+{
+  FilterREGroupPattern pattern;
+  gsize i;
+
+  if (self->frozen)
+    return -1;
+
+  if (literal_len < 0)
+    literal_len = strlen(literal);
+
+  pattern.literal = g_strndup(literal, literal_len);
+  pattern.len = literal_len;
+  pattern.mode = mode;
+  for (i = 0; i < pattern.len; i++)
+    pattern.literal[i] = _fold(self, pattern.literal[i]);
+
+  g_array_append_val(self->patterns, pattern);
+  return self->patterns->len - 1;
+}
+
+FilterREGroup *
+filter_re_group_new(gboolean icase)
+{
+  FilterREGroup *self = g_new0(FilterREGroup, 1);
+
+  g_atomic_counter_set(&self->ref_cnt, 1);
+  self->icase = icase;
+  self->patterns = g_array_new(FALSE, FALSE, sizeof(FilterREGroupPattern));
+  self->empty_patterns = g_array_new(FALSE, FALSE, sizeof(guint32));
+  return self;
+}
+
+static void
+filter_re_group_free(FilterREGroup *self)
+{
+  gint i;
+
+  _free_automaton(self);
+  for (i = 0; i < self->patterns->len; i++)
+    g_free(_get_pattern(self, i)->literal);
+  g_array_free(self->patterns, TRUE);
+  g_array_free(self->empty_patterns, TRUE);
+  g_free(self);
+}
+
+FilterREGroup *
+filter_re_group_ref(FilterREGroup *self)
+{
+  g_assert(!self || g_atomic_counter_get(&self->ref_cnt) > 0);
+
+  if (self)
+    g_atomic_counter_inc(&self->ref_cnt);
+  return self;
+}
+
+void
+filter_re_group_unref(FilterREGroup *self)
+{
+  g_assert(!self || g_atomic_counter_get(&self->ref_cnt) > 0);
+
+  if (self && g_atomic_counter_dec_and_test(&self->ref_cnt))
+    filter_re_group_free(self);
+}
+
+void
+filter_re_group_thread_deinit(void)
+{
+  gint i;
+
+  for (i = 0; i < FILTER_RE_GROUP_CACHE_SIZE; i++)
+    {
+      FilterREGroupCacheEntry *entry = &filter_re_group_cache[i];
+
+      g_free(entry->value);
+      g_free(entry->matches);
+      memset(entry, 0, sizeof(*entry));
+    }
+}
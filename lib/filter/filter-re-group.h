@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef FILTER_RE_GROUP_H_INCLUDED
+#define FILTER_RE_GROUP_H_INCLUDED
+
+#include "syslog-ng.h"
+
+/*
+ * A set of literal patterns that are searched for in the same value with
+ * a single pass of an Aho-Corasick automaton.
+ *
+ * Patterns are added at configuration parsing time, the automaton is
+ * built by filter_re_group_compile() once all of them are known, after
+ * which the group is frozen: it is shared by worker threads, further
+ * patterns are refused and have to be matched on their own.  The
+ * result of the last scan is cached per thread, so filters looking at the
+ * same value only scan it once, the rest of them merely compare the value
+ * to the cached one.
+ */
+
+typedef enum
+{
+  FRG_EXACT,
+  FRG_PREFIX,
+  FRG_SUBSTRING,
+} FilterREGroupMatchMode;
+
+/* below this many patterns the individual matchers are just as fast */
+#define FILTER_RE_GROUP_MIN_PATTERNS 4
+
+typedef struct _FilterREGroup FilterREGroup;
+
+FilterREGroup *filter_re_group_new(gboolean icase);
+FilterREGroup *filter_re_group_ref(FilterREGroup *self);
+void filter_re_group_unref(FilterREGroup *self);
+
+gint filter_re_group_add_pattern(FilterREGroup *self, const gchar *literal, gssize literal_len,
+                                 FilterREGroupMatchMode mode);
+gboolean filter_re_group_compile(FilterREGroup *self);
+gboolean filter_re_group_match(FilterREGroup *self, gint pattern, const gchar *value, gssize value_len,
+                               gboolean *result);
+
+void filter_re_group_thread_deinit(void);
+
+#endif
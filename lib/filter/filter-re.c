@@ -25,9 +25,80 @@
 #include "filter-re.h"
 #include "str-utils.h"
 #include "messages.h"
+#include "module-config.h"
+#include "cfg.h"
+#include "mainloop.h"
 
 #include <string.h>
 
+#define MODULE_CONFIG_KEY "filter-re"
+
+#define REGEXP_OPERATORS "\\^$.|?*+()[]{}"
+
+/* holds the literal pattern groups of a configuration, keyed by value handle
+ * and case sensitivity.  They are compiled and frozen when the
+ * configuration is initialized, filters compiled later on (e.g.  the
+ * conditions of patterndb rules) are not grouped. */
+typedef struct _FilterREConfig
+{
+  ModuleConfig super;
+  GHashTable *groups;
+} FilterREConfig;
+
+static void
+_compile_group(gpointer key, FilterREGroup *group, gpointer user_data)
+{
+  filter_re_group_compile(group);
+}
+
+static gboolean
+filter_re_config_init(ModuleConfig *s, GlobalConfig *cfg)
+{
+  FilterREConfig *self = (FilterREConfig *) s;
+
+  g_hash_table_foreach(self->groups, (GHFunc) _compile_group, NULL);
+  return TRUE;
+}
+
+static void
+filter_re_config_free(ModuleConfig *s)
+{
+  FilterREConfig *self = (FilterREConfig *) s;
+
+  g_hash_table_destroy(self->groups);
+  module_config_free_method(s);
+}
+
+static FilterREConfig *
+filter_re_config_get(GlobalConfig *cfg)
+{
+  FilterREConfig *self = g_hash_table_lookup(cfg->module_config, MODULE_CONFIG_KEY);
+
+  if (!self)
+    {
+      self = g_new0(FilterREConfig, 1);
+      self->super.init = filter_re_config_init;
+      self->super.free_fn = filter_re_config_free;
+      self->groups = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) filter_re_group_unref);
+      g_hash_table_insert(cfg->module_config, g_strdup(MODULE_CONFIG_KEY), self);
+    }
+  return self;
+}
+
+static FilterREGroup *
+filter_re_config_get_group(FilterREConfig *self, NVHandle value_handle, gboolean icase)
+{
+  gpointer key = GUINT_TO_POINTER((value_handle << 1) + !!icase);
+  FilterREGroup *group = g_hash_table_lookup(self->groups, key);
+
+  if (!group)
+    {
+      group = filter_re_group_new(icase);
+      g_hash_table_insert(self->groups, key, group);
+    }
+  return group;
+}
+
 static gboolean
 filter_re_eval_string(FilterExprNode *s, LogMessage *msg, gint value_handle, const gchar *str, gssize str_len)
 {
@@ -52,19 +123,86 @@ filter_re_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
   const gchar *value;
   LogMessage *msg = msgs[num_msg - 1];
   gssize len = 0;
+  gboolean result;
 
   value = log_msg_get_value(msg, self->value_handle, &len);
 
+  if (self->group && filter_re_group_match(self->group, self->group_pattern, value, len, &result))
+    {
+      msg_trace("match() evaluation started",
+                evt_tag_str("pattern", self->matcher->pattern),
+                evt_tag_str("value", log_msg_get_value_name(self->value_handle, NULL)),
+                evt_tag_str("matcher", "group"),
+                evt_tag_printf("msg", "%p", msg));
+      return result ^ s->comp;
+    }
+
   APPEND_ZERO(value, value, len);
   return filter_re_eval_string(s, msg, self->value_handle, value, len);
 }
 
+/* a pattern anchored at both ends that doesn't use any regexp operators */
+static gboolean
+_is_anchored_regexp_literal(const gchar *pattern)
+{
+  gsize len = strlen(pattern);
+
+  if (len < 2 || pattern[0] != '^' || pattern[len - 1] != '$')
+    return FALSE;
+
+  return strcspn(pattern + 1, REGEXP_OPERATORS) == len - 2;
+}
+
+static gboolean
+filter_re_enumerate_exact_matches(FilterExprNode *s, FilterExprExactMatchFunc func, gpointer user_data)
+{
+  FilterRE *self = (FilterRE *) s;
+  const gchar *type = self->matcher_options.type;
+  gint flags;
+
+  if (!self->matcher || !self->value_handle)
+    return FALSE;
+
+  flags = self->matcher->flags;
+  if (flags & LMF_ICASE)
+    return FALSE;
+
+  if (strcmp(type, "string") == 0)
+    {
+      if (flags & (LMF_PREFIX + LMF_SUBSTRING))
+        return FALSE;
+
+      func(self->value_handle, self->matcher->pattern, user_data);
+      return TRUE;
+    }
+  else if (strcmp(type, "pcre") == 0)
+    {
+      const gchar *pattern = self->matcher->pattern;
+      gsize literal_len = strlen(pattern) - 2;
+      gchar *literal;
+
+      if ((flags & LMF_NEWLINE) || !_is_anchored_regexp_literal(pattern))
+        return FALSE;
+
+      /* '$' also matches right before a trailing newline */
+      literal = g_strndup(pattern + 1, literal_len + 1);
+      literal[literal_len] = '\n';
+      func(self->value_handle, literal, user_data);
+      literal[literal_len] = 0;
+      func(self->value_handle, literal, user_data);
+      g_free(literal);
+      return TRUE;
+    }
+  return FALSE;
+}
+
 static void
 filter_re_free(FilterExprNode *s)
 {
   FilterRE *self = (FilterRE *) s;
 
   log_matcher_unref(self->matcher);
+  filter_re_group_unref(self->group);
   log_matcher_options_destroy(&self->matcher_options);
 }
 
@@ -79,12 +217,75 @@ filter_re_init(FilterExprNode *s, GlobalConfig *cfg)
   return TRUE;
 }
 
+/* the literal @re is looking for, if it can be matched without a regexp engine */
+static gboolean
+_extract_literal(FilterRE *self, const gchar *re, const gchar **literal, FilterREGroupMatchMode *mode)
+{
+  const gchar *type = self->matcher_options.type;
+  gint flags = self->matcher_options.flags;
+
+  if (strcmp(type, "string") == 0)
+    {
+      /* same precedence as log_matcher_string_match_string() */
+      if ((flags & (LMF_PREFIX + LMF_SUBSTRING)) == 0)
+        *mode = FRG_EXACT;
+      else if (flags & LMF_PREFIX)
+        *mode = FRG_PREFIX;
+      else
+        *mode = FRG_SUBSTRING;
+      *literal = re;
+      return TRUE;
+    }
+  else if (strcmp(type, "pcre") == 0)
+    {
+      gboolean anchored = re[0] == '^';
+
+      if (flags & (LMF_ICASE + LMF_STORE_MATCHES + LMF_NEWLINE))
+        return FALSE;
+
+      if (re[anchored + strcspn(re + anchored, REGEXP_OPERATORS)] != 0)
+        return FALSE;
+
+      *mode = anchored ? FRG_PREFIX : FRG_SUBSTRING;
+      *literal = re + anchored;
+      return TRUE;
+    }
+  return FALSE;
+}
+
+/* only while the configuration is being parsed: groups are shared with
+ * the worker threads once the configuration is running, while filters
+ * compiled at runtime may outlive it */
+static void
+_join_group(FilterRE *self, GlobalConfig *cfg, const gchar *re)
+{
+  FilterREGroupMatchMode mode;
+  const gchar *literal;
+  gboolean icase = (self->matcher_options.flags & LMF_ICASE) != 0;
+  FilterREGroup *group;
+
+  if (!cfg || cfg->tree.compiled || !main_loop_is_main_thread())
+    return;
+
+  if (!self->value_handle || !_extract_literal(self, re, &literal, &mode))
+    return;
+
+  group = filter_re_config_get_group(filter_re_config_get(cfg), self->value_handle, icase);
+  self->group_pattern = filter_re_group_add_pattern(group, literal, -1, mode);
+  if (self->group_pattern >= 0)
+    self->group = filter_re_group_ref(group);
+}
+
 gboolean
 filter_re_compile_pattern(FilterRE *self, GlobalConfig *cfg, const gchar *re, GError **error)
 {
   log_matcher_options_init(&self->matcher_options, cfg);
   self->matcher = log_matcher_new(cfg, &self->matcher_options);
-  return log_matcher_compile(self->matcher, re, error);
+  if (!log_matcher_compile(self->matcher, re, error))
+    return FALSE;
+
+  _join_group(self, cfg, re);
+  return TRUE;
 }
 
 static void
@@ -94,6 +295,7 @@ filter_re_init_instance(FilterRE *self, NVHandle value_handle)
   self->value_handle = value_handle;
   self->super.init = filter_re_init;
   self->super.eval = filter_re_eval;
+  self->super.enumerate_exact_matches = filter_re_enumerate_exact_matches;
   self->super.free_fn = filter_re_free;
   self->super.type = "regexp";
   log_matcher_options_defaults(&self->matcher_options);
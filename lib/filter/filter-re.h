@@ -27,6 +27,7 @@
 
 #include "filter-expr.h"
 #include "logmatcher.h"
+#include "filter/filter-re-group.h"
 
 typedef struct _FilterRE
 {
@@ -34,6 +35,9 @@ typedef struct _FilterRE
   NVHandle value_handle;
   LogMatcherOptions matcher_options;
   LogMatcher *matcher;
+  /* literal patterns are also matched as a part of a group, see filter-re-group.h */
+  FilterREGroup *group;
+  gint group_pattern;
 } FilterRE;
 
 typedef struct _FilterMatch FilterMatch;
@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "netmask-trie.h"
+#include "gsocket.h"
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NETMASK_TRIE_KEY_SIZE 16
+
+#define NETMASK_TRIE_ROOT_INET  0
+#define NETMASK_TRIE_ROOT_INET6 1
+
+/*
+ * Each node stores its full (masked) network address, so that bits skipped
+ * by path compression can be verified during lookup.  Children are indices
+ * into the node array, 0 meaning no child, which is safe as the roots are
+ * never children of any node.
+ */
+typedef struct _NetmaskTrieNode
+{
+  guint8 key[NETMASK_TRIE_KEY_SIZE];
+  guint8 prefix_len;
+  guint8 is_network;
+  guint32 children[2];
+} NetmaskTrieNode;
+
+struct _NetmaskTrie
+{
+  GArray *nodes;
+};
+
+#define _node(self, index) (&g_array_index((self)->nodes, NetmaskTrieNode, (index)))
+
+static inline gint
+_get_bit(const guint8 *key, gint bit)
+{
+  return (key[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+static gint
+_common_prefix_len(const guint8 *a, const guint8 *b, gint max_bits)
+{
+  gint i;
+
+  for (i = 0; i < max_bits; i += 8)
+    {
+      guint8 diff = a[i >> 3] ^ b[i >> 3];
+
+      if (diff)
+        return MIN(i + 7 - g_bit_nth_msf(diff, -1), max_bits);
+    }
+  return max_bits;
+}
+
+static void
+_mask_key(guint8 *key, gint prefix_len)
+{
+  gint i;
+
+  for (i = prefix_len; i < NETMASK_TRIE_KEY_SIZE * 8; i++)
+    key[i >> 3] &= ~(0x80 >> (i & 7));
+}
+
+static guint32
+_new_node(NetmaskTrie *self, const guint8 *key, gint prefix_len, gboolean is_network)
+{
+  NetmaskTrieNode node = { .prefix_len = prefix_len, .is_network = is_network };
+
+  memcpy(node.key, key, sizeof(node.key));
+  _mask_key(node.key, prefix_len);
+  g_array_append_val(self->nodes, node);
+  return self->nodes->len - 1;
+}
+
+/* nodes are referenced by index, as adding a node may move the array */
+static void
+_insert(NetmaskTrie *self, guint32 node_index, const guint8 *key, gint prefix_len)
+{
+  while (TRUE)
+    {
+      NetmaskTrieNode *node = _node(self, node_index);
+      guint8 child_key[NETMASK_TRIE_KEY_SIZE];
+      guint32 child_index, split_index;
+      gint bit, common;
+
+      if (node->prefix_len == prefix_len)
+        {
+          node->is_network = TRUE;
+          return;
+        }
+
+      bit = _get_bit(key, node->prefix_len);
+      child_index = node->children[bit];
+      if (!child_index)
+        {
+          child_index = _new_node(self, key, prefix_len, TRUE);
+          _node(self, node_index)->children[bit] = child_index;
+          return;
+        }
+
+      memcpy(child_key, _node(self, child_index)->key, sizeof(child_key));
+      common = _common_prefix_len(child_key, key, MIN(_node(self, child_index)->prefix_len, prefix_len));
+      if (common == _node(self, child_index)->prefix_len)
+        {
+          node_index = child_index;
+          continue;
+        }
+
+      /* the new network diverges from the child (or contains it), so a
+       * node is needed where they part */
+      split_index = _new_node(self, key, common, common == prefix_len);
+      _node(self, split_index)->children[_get_bit(child_key, common)] = child_index;
+      if (common < prefix_len)
+        {
+          guint32 leaf_index = _new_node(self, key, prefix_len, TRUE);
+          _node(self, split_index)->children[_get_bit(key, common)] = leaf_index;
+        }
+      _node(self, node_index)->children[bit] = split_index;
+      return;
+    }
+}
+
+static gint
+_lookup(NetmaskTrie *self, guint32 node_index, const guint8 *address, gint max_bits)
+{
+  gint longest_match = -1;
+
+  while (TRUE)
+    {
+      NetmaskTrieNode *node = _node(self, node_index);
+
+      if (_common_prefix_len(node->key, address, node->prefix_len) < node->prefix_len)
+        break;
+      if (node->is_network)
+        longest_match = node->prefix_len;
+      if (node->prefix_len == max_bits)
+        break;
+
+      node_index = node->children[_get_bit(address, node->prefix_len)];
+      if (!node_index)
+        break;
+    }
+  return longest_match;
+}
+
+static gboolean
+_parse_prefix_len(const gchar *prefix, gint max_bits, gint *prefix_len)
+{
+  gchar *end;
+
+  if (max_bits == 32 && strchr(prefix, '.'))
+    {
+      struct in_addr netmask;
+      guint32 mask;
+      gint bits;
+
+      if (inet_pton(AF_INET, prefix, &netmask) != 1)
+        return FALSE;
+
+      /* only contiguous netmasks can be represented as a prefix */
+      mask = ntohl(netmask.s_addr);
+      bits = mask ? 32 - g_bit_nth_lsf(mask, -1) : 0;
+      if (bits && mask != (guint32) (G_MAXUINT32 << (32 - bits)))
+        return FALSE;
+
+      *prefix_len = bits;
+      return TRUE;
+    }
+
+  *prefix_len = strtol(prefix, &end, 10);
+  return end != prefix && *end == 0 && *prefix_len >= 0 && *prefix_len <= max_bits;
+}
+
+gboolean
+netmask_trie_add(NetmaskTrie *self, const gchar *cidr)
+{
+  gchar address[INET6_ADDRSTRLEN];
+  guint8 key[NETMASK_TRIE_KEY_SIZE] = { 0 };
+  const gchar *slash = strchr(cidr, '/');
+  gsize address_len = slash ? slash - cidr : strlen(cidr);
+  guint32 root;
+  gint max_bits, prefix_len;
+
+  if (address_len >= sizeof(address))
+    return FALSE;
+  memcpy(address, cidr, address_len);
+  address[address_len] = 0;
+
+  if (inet_pton(AF_INET, address, key) == 1)
+    {
+      root = NETMASK_TRIE_ROOT_INET;
+      max_bits = 32;
+    }
+  else if (inet_pton(AF_INET6, address, key) == 1)
+    {
+      root = NETMASK_TRIE_ROOT_INET6;
+      max_bits = 128;
+    }
+  else
+    return FALSE;
+
+  if (!slash)
+    prefix_len = max_bits;
+  else if (!_parse_prefix_len(slash + 1, max_bits, &prefix_len))
+    return FALSE;
+
+  _mask_key(key, prefix_len);
+  _insert(self, root, key, prefix_len);
+  return TRUE;
+}
+
+gint
+netmask_trie_lookup_inet(NetmaskTrie *self, const struct in_addr *address)
+{
+  guint8 key[NETMASK_TRIE_KEY_SIZE] = { 0 };
+
+  memcpy(key, address, sizeof(*address));
+  return _lookup(self, NETMASK_TRIE_ROOT_INET, key, 32);
+}
+
+gint
+netmask_trie_lookup_inet6(NetmaskTrie *self, const struct in6_addr *address)
+{
+  return _lookup(self, NETMASK_TRIE_ROOT_INET6, address->s6_addr, 128);
+}
+
+gint
+netmask_trie_lookup_string(NetmaskTrie *self, const gchar *address, gssize address_len)
+{
+  gchar buf[INET6_ADDRSTRLEN];
+  struct in_addr inet_address;
+  struct in6_addr inet6_address;
+
+  if (address_len < 0)
+    address_len = strlen(address);
+  if (address_len >= (gssize) sizeof(buf))
+    return -1;
+
+  memcpy(buf, address, address_len);
+  buf[address_len] = 0;
+
+  if (inet_pton(AF_INET, buf, &inet_address) == 1)
+    return netmask_trie_lookup_inet(self, &inet_address);
+  if (inet_pton(AF_INET6, buf, &inet6_address) == 1)
+    return netmask_trie_lookup_inet6(self, &inet6_address);
+  return -1;
+}
+
+gint
+netmask_trie_lookup_msg_sender(NetmaskTrie *self, LogMessage *msg)
+{
+  struct in_addr storage;
+  const struct in_addr *address;
+#if SYSLOG_NG_ENABLE_IPV6
+  const struct in6_addr *address6;
+#endif
+
+  address = netmask_get_msg_sender_inet(msg, &storage);
+  if (address)
+    return netmask_trie_lookup_inet(self, address);
+
+#if SYSLOG_NG_ENABLE_IPV6
+  address6 = netmask_get_msg_sender_inet6(msg);
+  if (address6)
+    return netmask_trie_lookup_inet6(self, address6);
+#endif
+  return -1;
+}
+
+/* local messages are treated as if they were sent from the loopback address */
+const struct in_addr *
+netmask_get_msg_sender_inet(LogMessage *msg, struct in_addr *storage)
+{
+  if (msg->saddr && g_sockaddr_inet_check(msg->saddr))
+    return &((struct sockaddr_in *) &msg->saddr->sa)->sin_addr;
+
+  if (!msg->saddr || msg->saddr->sa.sa_family == AF_UNIX)
+    {
+      storage->s_addr = htonl(INADDR_LOOPBACK);
+      return storage;
+    }
+  return NULL;
+}
+
+#if SYSLOG_NG_ENABLE_IPV6
+const struct in6_addr *
+netmask_get_msg_sender_inet6(LogMessage *msg)
+{
+  if (msg->saddr && g_sockaddr_inet6_check(msg->saddr))
+    return &((struct sockaddr_in6 *) &msg->saddr->sa)->sin6_addr;
+
+  if (!msg->saddr || msg->saddr->sa.sa_family == AF_UNIX)
+    return &in6addr_loopback;
+  return NULL;
+}
+#endif
+
+NetmaskTrie *
+netmask_trie_new(void)
+{
+  NetmaskTrie *self = g_new0(NetmaskTrie, 1);
+  guint8 zero_key[NETMASK_TRIE_KEY_SIZE] = { 0 };
+
+  self->nodes = g_array_new(FALSE, TRUE, sizeof(NetmaskTrieNode));
+  _new_node(self, zero_key, 0, FALSE);
+  _new_node(self, zero_key, 0, FALSE);
+  return self;
+}
+
+void
+netmask_trie_free(NetmaskTrie *self)
+{
+  g_array_free(self->nodes, TRUE);
+  g_free(self);
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef NETMASK_TRIE_H_INCLUDED
+#define NETMASK_TRIE_H_INCLUDED
+
+#include "syslog-ng.h"
+#include "logmsg/logmsg.h"
+
+#include <netinet/in.h>
+
+/*
+ * A path compressed binary trie of IPv4 and IPv6 networks, doing longest
+ * prefix matching on addresses.  Used by in-list(type(cidr)), the helpers
+ * returning the address of the sender of a message are shared with the
+ * netmask() and netmask6() filters.
+ */
+
+typedef struct _NetmaskTrie NetmaskTrie;
+
+NetmaskTrie *netmask_trie_new(void);
+void netmask_trie_free(NetmaskTrie *self);
+
+gboolean netmask_trie_add(NetmaskTrie *self, const gchar *cidr);
+
+/* these return the length of the longest matching prefix, or -1 if there's none */
+gint netmask_trie_lookup_inet(NetmaskTrie *self, const struct in_addr *address);
+gint netmask_trie_lookup_inet6(NetmaskTrie *self, const struct in6_addr *address);
+gint netmask_trie_lookup_string(NetmaskTrie *self, const gchar *address, gssize address_len);
+gint netmask_trie_lookup_msg_sender(NetmaskTrie *self, LogMessage *msg);
+
+const struct in_addr *netmask_get_msg_sender_inet(LogMessage *msg, struct in_addr *storage);
+#if SYSLOG_NG_ENABLE_IPV6
+const struct in6_addr *netmask_get_msg_sender_inet6(LogMessage *msg);
+#endif
+
+#endif
@@ -23,6 +23,8 @@
  */
 #include "filter/filter-call.h"
 #include "filter/filter-expr.h"
+#include "filter/filter-pipe.h"
+#include "cfg-tree.h"
 #include "apphook.h"
 
 #include <criterion/criterion.h>
@@ -38,11 +40,113 @@ Test(filter_call, undefined_filter_ref)
   filter_expr_unref(filter);
 }
 
+typedef struct _CountingFilter
+{
+  FilterExprNode super;
+  gint evals;
+  gboolean result;
+} CountingFilter;
+
+static gboolean
+_counting_filter_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
+{
+  CountingFilter *self = (CountingFilter *) s;
+
+  self->evals++;
+  return self->result;
+}
+
+static CountingFilter *
+_define_counting_rule(const gchar *name, gboolean result)
+{
+  CountingFilter *self = g_new0(CountingFilter, 1);
+  LogExprNode *rule;
+
+  filter_expr_node_init_instance(&self->super);
+  self->super.eval = _counting_filter_eval;
+  self->result = result;
+
+  rule = log_expr_node_new_filter(name,
+                                  log_expr_node_new_pipe(log_filter_pipe_new(&self->super, configuration), NULL),
+                                  NULL);
+  cr_assert(cfg_tree_add_object(&configuration->tree, rule));
+  return self;
+}
+
+static FilterExprNode *
+_create_call(const gchar *rule)
+{
+  FilterExprNode *filter = filter_call_new((gchar *) rule, configuration);
+
+  cr_assert(filter_expr_init(filter, configuration));
+  return filter;
+}
+
+Test(filter_call, results_are_cached_while_the_message_is_write_protected)
+{
+  CountingFilter *security = _define_counting_rule("f_security", TRUE);
+  CountingFilter *noise = _define_counting_rule("f_noise", FALSE);
+  FilterExprNode *calls[] =
+  {
+    _create_call("f_security"),
+    _create_call("f_security"),
+    _create_call("f_noise"),
+    _create_call("f_noise"),
+  };
+  LogMessage *msg = log_msg_new_empty();
+  gint i;
+
+  calls[3]->comp = TRUE;
+
+  log_msg_write_protect(msg);
+  cr_assert(filter_expr_eval(calls[0], msg));
+  cr_assert(filter_expr_eval(calls[1], msg));
+  cr_assert_not(filter_expr_eval(calls[2], msg));
+  cr_assert(filter_expr_eval(calls[3], msg));
+  cr_assert_eq(security->evals, 1);
+  cr_assert_eq(noise->evals, 1);
+  cr_assert_eq(stats_counter_get(calls[0]->matched), 2);
+
+  log_msg_write_unprotect(msg);
+  cr_assert(filter_expr_eval(calls[0], msg));
+  cr_assert(filter_expr_eval(calls[1], msg));
+  cr_assert_eq(security->evals, 3);
+
+  for (i = 0; i < G_N_ELEMENTS(calls); i++)
+    filter_expr_unref(calls[i]);
+  log_msg_unref(msg);
+}
+
+Test(filter_call, writable_clones_start_with_an_empty_cache)
+{
+  CountingFilter *security = _define_counting_rule("f_security", TRUE);
+  FilterExprNode *call = _create_call("f_security");
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg = log_msg_new_empty();
+  LogMessage *clone;
+
+  log_msg_write_protect(msg);
+  cr_assert(filter_expr_eval(call, msg));
+
+  clone = log_msg_ref(msg);
+  log_msg_make_writable(&clone, &path_options);
+  cr_assert_neq(clone, msg);
+  cr_assert(filter_expr_eval(call, clone));
+  cr_assert(filter_expr_eval(call, msg));
+  cr_assert_eq(security->evals, 2);
+
+  log_msg_unref(clone);
+  log_msg_write_unprotect(msg);
+  log_msg_unref(msg);
+  filter_expr_unref(call);
+}
+
 static void
 setup(void)
 {
   app_startup();
   configuration = cfg_new_snippet();
+  configuration->stats_options.level = 1;
 }
 
 static void
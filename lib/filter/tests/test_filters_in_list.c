@@ -141,6 +141,48 @@ test_filter_with_long_line(const char *top_srcdir)
   g_free(list_file_with_long_line);
 }
 
+void
+test_last_line_without_newline(const char *top_srcdir)
+{
+  gchar *list_file = g_strdup_printf(LIST_FILE_DIR "no_trailing_newline.list", top_srcdir);
+  assert_gboolean(evaluate_testcase(MSG_1, filter_in_list_new(list_file, "PROGRAM")),
+                  TRUE,
+                  "in-list filter matches");
+  g_free(list_file);
+}
+
+void
+test_cidr_list_matches_value(const char *top_srcdir)
+{
+  gchar *list_file = g_strdup_printf(LIST_FILE_DIR "networks.list", top_srcdir);
+  assert_gboolean(evaluate_testcase(MSG_3, filter_in_list_cidr_new(list_file, "HOST")),
+                  TRUE,
+                  "in-list cidr filter matches");
+  assert_gboolean(evaluate_testcase(MSG_1, filter_in_list_cidr_new(list_file, "HOST")),
+                  FALSE,
+                  "in-list cidr filter matches a value that is not an address");
+  g_free(list_file);
+}
+
+void
+test_cidr_list_matches_sender_address(const char *top_srcdir)
+{
+  gchar *list_file = g_strdup_printf(LIST_FILE_DIR "networks.list", top_srcdir);
+  assert_gboolean(evaluate_testcase(MSG_3, filter_in_list_cidr_new(list_file, NULL)),
+                  FALSE,
+                  "in-list cidr filter matches the loopback address of a local message");
+  g_free(list_file);
+}
+
+void
+test_cidr_list_with_invalid_network(const char *top_srcdir)
+{
+  gchar *list_file = g_strdup_printf(LIST_FILE_DIR "invalid_networks.list", top_srcdir);
+  assert_null(filter_in_list_cidr_new(list_file, "HOST"),
+              "in-list cidr filter should fail, when the list file contains an invalid network");
+  g_free(list_file);
+}
+
 void
 run_testcases(const char *top_srcdir)
 {
@@ -152,6 +194,10 @@ run_testcases(const char *top_srcdir)
   test_list_file_contains_lot_of_lines(top_srcdir);
   test_filter_with_ip_address(top_srcdir);
   test_filter_with_long_line(top_srcdir);
+  test_last_line_without_newline(top_srcdir);
+  test_cidr_list_matches_value(top_srcdir);
+  test_cidr_list_matches_sender_address(top_srcdir);
+  test_cidr_list_with_invalid_network(top_srcdir);
 }
 
 int
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "filter/filter-op.h"
+#include "apphook.h"
+#include "cfg.h"
+
+#define NUM_EVALS 20000
+
+typedef struct _CountingNode
+{
+  FilterExprNode super;
+  gboolean result;
+  gboolean expensive;
+  gint evals;
+} CountingNode;
+
+static gboolean
+_counting_node_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
+{
+  CountingNode *self = (CountingNode *) s;
+
+  self->evals++;
+  if (self->expensive)
+    {
+      gint64 start = g_get_monotonic_time();
+
+      while (g_get_monotonic_time() - start < 2)
+        ;
+    }
+  return self->result ^ s->comp;
+}
+
+static CountingNode *
+_counting_node_new(gboolean result, gboolean expensive)
+{
+  CountingNode *self = g_new0(CountingNode, 1);
+
+  filter_expr_node_init_instance(&self->super);
+  self->super.eval = _counting_node_eval;
+  self->super.type = "counting";
+  self->result = result;
+  self->expensive = expensive;
+  return self;
+}
+
+static void
+_eval_repeatedly(FilterExprNode *expr, gboolean expected)
+{
+  LogMessage *msg = log_msg_new_empty();
+  gint i;
+
+  cr_assert(filter_expr_init(expr, configuration));
+  for (i = 0; i < NUM_EVALS; i++)
+    cr_assert_eq(filter_expr_eval(expr, msg), expected, "Unexpected result at evaluation %d", i);
+  log_msg_unref(msg);
+}
+
+Test(filter_op_reorder, selective_and_operand_is_moved_to_the_front)
+{
+  CountingNode *expensive = _counting_node_new(TRUE, TRUE);
+  CountingNode *cheap = _counting_node_new(FALSE, FALSE);
+  FilterExprNode *expr = fop_and_new(&expensive->super, &cheap->super);
+
+  _eval_repeatedly(expr, FALSE);
+
+  cr_assert_eq(cheap->evals, NUM_EVALS);
+  cr_assert_lt(expensive->evals, NUM_EVALS / 2,
+               "Expensive operand was evaluated %d times out of %d", expensive->evals, NUM_EVALS);
+  filter_expr_unref(expr);
+}
+
+Test(filter_op_reorder, selective_or_operand_is_moved_to_the_front)
+{
+  CountingNode *expensive = _counting_node_new(FALSE, TRUE);
+  CountingNode *cheap = _counting_node_new(TRUE, FALSE);
+  FilterExprNode *expr = fop_or_new(&expensive->super, &cheap->super);
+
+  _eval_repeatedly(expr, TRUE);
+
+  cr_assert_eq(cheap->evals, NUM_EVALS);
+  cr_assert_lt(expensive->evals, NUM_EVALS / 2,
+               "Expensive operand was evaluated %d times out of %d", expensive->evals, NUM_EVALS);
+  filter_expr_unref(expr);
+}
+
+Test(filter_op_reorder, negated_operands_are_reordered_by_their_result)
+{
+  CountingNode *expensive = _counting_node_new(TRUE, TRUE);
+  CountingNode *cheap = _counting_node_new(TRUE, FALSE);
+  FilterExprNode *expr;
+
+  cheap->super.comp = TRUE;
+  expr = fop_and_new(&expensive->super, &cheap->super);
+  _eval_repeatedly(expr, FALSE);
+
+  cr_assert_lt(expensive->evals, NUM_EVALS / 2);
+  filter_expr_unref(expr);
+}
+
+Test(filter_op_reorder, operands_modifying_the_message_are_left_in_place)
+{
+  CountingNode *expensive = _counting_node_new(TRUE, TRUE);
+  CountingNode *cheap = _counting_node_new(FALSE, FALSE);
+  FilterExprNode *expr;
+
+  cheap->super.modify = TRUE;
+  expr = fop_and_new(&expensive->super, &cheap->super);
+  _eval_repeatedly(expr, FALSE);
+
+  cr_assert_eq(expensive->evals, NUM_EVALS);
+  cr_assert_eq(cheap->evals, NUM_EVALS);
+  filter_expr_unref(expr);
+}
+
+Test(filter_op_reorder, well_ordered_operands_are_kept)
+{
+  CountingNode *cheap = _counting_node_new(FALSE, FALSE);
+  CountingNode *expensive = _counting_node_new(TRUE, TRUE);
+  FilterExprNode *expr = fop_and_new(&cheap->super, &expensive->super);
+
+  _eval_repeatedly(expr, FALSE);
+
+  cr_assert_eq(cheap->evals, NUM_EVALS);
+  cr_assert_eq(expensive->evals, 0);
+  filter_expr_unref(expr);
+}
+
+static void
+setup(void)
+{
+  app_startup();
+  configuration = cfg_new_snippet();
+}
+
+static void
+teardown(void)
+{
+  cfg_free(configuration);
+  app_shutdown();
+}
+
+TestSuite(filter_op_reorder, .init = setup, .fini = teardown);
@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "filter/filter-re.h"
+#include "filter/filter-re-group.h"
+#include "apphook.h"
+#include "cfg.h"
+
+static gboolean
+_group_match(FilterREGroup *group, gint pattern, const gchar *value)
+{
+  gboolean result = FALSE;
+
+  cr_assert(filter_re_group_match(group, pattern, value, -1, &result));
+  return result;
+}
+
+Test(filter_re_group, match_modes_are_honoured)
+{
+  FilterREGroup *group = filter_re_group_new(FALSE);
+  gint exact = filter_re_group_add_pattern(group, "sshd", -1, FRG_EXACT);
+  gint prefix = filter_re_group_add_pattern(group, "ssh", -1, FRG_PREFIX);
+  gint substring = filter_re_group_add_pattern(group, "shd", -1, FRG_SUBSTRING);
+  gint overlapping = filter_re_group_add_pattern(group, "hd", -1, FRG_SUBSTRING);
+  gint empty = filter_re_group_add_pattern(group, "", -1, FRG_SUBSTRING);
+
+  cr_assert(filter_re_group_compile(group));
+
+  cr_assert(_group_match(group, exact, "sshd"));
+  cr_assert(_group_match(group, prefix, "sshd"));
+  cr_assert(_group_match(group, substring, "sshd"));
+  cr_assert(_group_match(group, overlapping, "sshd"));
+  cr_assert(_group_match(group, empty, "sshd"));
+
+  cr_assert_not(_group_match(group, exact, "sshd2"));
+  cr_assert(_group_match(group, prefix, "sshd2"));
+
+  cr_assert_not(_group_match(group, exact, "xsshd"));
+  cr_assert_not(_group_match(group, prefix, "xsshd"));
+  cr_assert(_group_match(group, substring, "xsshd"));
+
+  cr_assert_not(_group_match(group, substring, "SSHD"));
+  cr_assert(_group_match(group, empty, ""));
+
+  filter_re_group_unref(group);
+}
+
+Test(filter_re_group, case_insensitive_groups_fold_ascii_letters)
+{
+  FilterREGroup *group = filter_re_group_new(TRUE);
+  gint i;
+
+  filter_re_group_add_pattern(group, "Error", -1, FRG_SUBSTRING);
+  for (i = 1; i < FILTER_RE_GROUP_MIN_PATTERNS; i++)
+    filter_re_group_add_pattern(group, "unused", -1, FRG_SUBSTRING);
+  cr_assert(filter_re_group_compile(group));
+
+  cr_assert(_group_match(group, 0, "an ERROR occurred"));
+  cr_assert(_group_match(group, 0, "an error occurred"));
+  cr_assert_not(_group_match(group, 0, "an err0r occurred"));
+
+  filter_re_group_unref(group);
+}
+
+Test(filter_re_group, small_groups_are_not_compiled)
+{
+  FilterREGroup *group = filter_re_group_new(FALSE);
+  gboolean result;
+
+  filter_re_group_add_pattern(group, "foo", -1, FRG_SUBSTRING);
+  cr_assert_not(filter_re_group_compile(group));
+  cr_assert_not(filter_re_group_match(group, 0, "foo", -1, &result));
+
+  filter_re_group_unref(group);
+}
+
+Test(filter_re_group, patterns_beyond_the_first_bitmap_word)
+{
+  FilterREGroup *group = filter_re_group_new(FALSE);
+  gchar pattern[32];
+  gint i;
+
+  for (i = 0; i < 200; i++)
+    {
+      g_snprintf(pattern, sizeof(pattern), "word%d;", i);
+      cr_assert_eq(filter_re_group_add_pattern(group, pattern, -1, FRG_SUBSTRING), i);
+    }
+  cr_assert(filter_re_group_compile(group));
+
+  for (i = 0; i < 200; i++)
+    {
+      gboolean expected = (i == 3 || i == 130 || i == 199);
+
+      cr_assert_eq(_group_match(group, i, "word3; word130; word199;"), expected,
+                   "Unexpected result for pattern %d", i);
+    }
+  filter_re_group_unref(group);
+}
+
+static FilterRE *
+_create_message_filter(const gchar *type, const gchar *pattern, const gchar *flag)
+{
+  FilterRE *filter = filter_re_new(LM_V_MESSAGE);
+
+  if (type)
+    cr_assert(log_matcher_options_set_type(&filter->matcher_options, type));
+  if (flag)
+    cr_assert(log_matcher_options_process_flag(&filter->matcher_options, flag));
+  cr_assert(filter_re_compile_pattern(filter, configuration, pattern, NULL));
+  return filter;
+}
+
+static gboolean
+_eval(FilterRE *filter, const gchar *message)
+{
+  LogMessage *msg = log_msg_new_empty();
+  gboolean result;
+
+  log_msg_set_value(msg, LM_V_MESSAGE, message, -1);
+  result = filter_expr_eval(&filter->super, msg);
+  log_msg_unref(msg);
+  return result;
+}
+
+Test(filter_re_group, literal_filters_on_the_same_value_share_a_group)
+{
+  FilterRE *filters[] =
+  {
+    _create_message_filter(NULL, "disk full", NULL),
+    _create_message_filter(NULL, "^kernel:", NULL),
+    _create_message_filter("string", "timeout", "substring"),
+    _create_message_filter("string", "reboot", NULL),
+    _create_message_filter("string", "ssh", "prefix"),
+    _create_message_filter(NULL, "fail(ed|ure)", NULL),
+    _create_message_filter(NULL, "Disk", "ignore-case"),
+  };
+  gint i;
+
+  cr_assert(cfg_init(configuration));
+
+  for (i = 0; i < 5; i++)
+    cr_assert_not_null(filters[i]->group, "Literal filter %d was not grouped", i);
+  cr_assert_eq(filters[0]->group, filters[4]->group);
+  cr_assert_null(filters[5]->group);
+  cr_assert_null(filters[6]->group);
+
+  cr_assert(_eval(filters[0], "kernel: disk full on /var"));
+  cr_assert(_eval(filters[1], "kernel: disk full on /var"));
+  cr_assert_not(_eval(filters[2], "kernel: disk full on /var"));
+  cr_assert_not(_eval(filters[3], "kernel: disk full on /var"));
+  cr_assert_not(_eval(filters[4], "kernel: disk full on /var"));
+  cr_assert(_eval(filters[5], "authentication failed"));
+
+  cr_assert_not(_eval(filters[1], "foo kernel: bar"));
+  cr_assert(_eval(filters[2], "connection timeout"));
+  cr_assert(_eval(filters[3], "reboot"));
+  cr_assert_not(_eval(filters[3], "reboot now"));
+  cr_assert(_eval(filters[4], "sshd started"));
+
+  filters[0]->super.comp = TRUE;
+  cr_assert_not(_eval(filters[0], "disk full"));
+  cr_assert(_eval(filters[0], "all good"));
+
+  for (i = 0; i < G_N_ELEMENTS(filters); i++)
+    filter_expr_unref(&filters[i]->super);
+  cfg_deinit(configuration);
+}
+
+Test(filter_re_group, filters_compiled_at_runtime_are_not_grouped)
+{
+  FilterRE *filters[FILTER_RE_GROUP_MIN_PATTERNS];
+  FilterRE *runtime_filter;
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS(filters); i++)
+    filters[i] = _create_message_filter("string", "disk full", "substring");
+  cr_assert(cfg_init(configuration));
+  cr_assert_not_null(filters[0]->group);
+
+  /* e.g. the conditions of patterndb rules, loaded after the configuration was initialized */
+  runtime_filter = _create_message_filter("string", "disk full", "substring");
+  cr_assert_null(runtime_filter->group);
+  cr_assert(_eval(runtime_filter, "kernel: disk full on /var"));
+  cr_assert_not(_eval(runtime_filter, "all good"));
+
+  filter_expr_unref(&runtime_filter->super);
+  for (i = 0; i < G_N_ELEMENTS(filters); i++)
+    filter_expr_unref(&filters[i]->super);
+  cfg_deinit(configuration);
+}
+
+Test(filter_re_group, frozen_groups_refuse_new_patterns)
+{
+  FilterREGroup *group = filter_re_group_new(FALSE);
+  gint i;
+
+  for (i = 0; i < FILTER_RE_GROUP_MIN_PATTERNS; i++)
+    cr_assert_eq(filter_re_group_add_pattern(group, "foo", -1, FRG_SUBSTRING), i);
+  cr_assert(filter_re_group_compile(group));
+  cr_assert_eq(filter_re_group_add_pattern(group, "bar", -1, FRG_SUBSTRING), -1);
+
+  filter_re_group_unref(group);
+}
+
+static void
+setup(void)
+{
+  app_startup();
+  configuration = cfg_new_snippet();
+}
+
+static void
+teardown(void)
+{
+  cfg_free(configuration);
+  app_shutdown();
+}
+
+TestSuite(filter_re_group, .init = setup, .fini = teardown);
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "filter/netmask-trie.h"
+#include "apphook.h"
+
+static NetmaskTrie *
+_create_trie(const gchar *networks[])
+{
+  NetmaskTrie *trie = netmask_trie_new();
+  gint i;
+
+  for (i = 0; networks[i]; i++)
+    cr_assert(netmask_trie_add(trie, networks[i]), "Failed to add network: %s", networks[i]);
+  return trie;
+}
+
+Test(netmask_trie, longest_prefix_is_matched)
+{
+  const gchar *networks[] = { "10.0.0.0/8", "10.1.0.0/16", "10.1.2.0/24", "10.1.2.3", "192.168.0.0/255.255.0.0", NULL };
+  NetmaskTrie *trie = _create_trie(networks);
+
+  cr_assert_eq(netmask_trie_lookup_string(trie, "10.1.2.3", -1), 32);
+  cr_assert_eq(netmask_trie_lookup_string(trie, "10.1.2.4", -1), 24);
+  cr_assert_eq(netmask_trie_lookup_string(trie, "10.1.3.4", -1), 16);
+  cr_assert_eq(netmask_trie_lookup_string(trie, "10.2.3.4", -1), 8);
+  cr_assert_eq(netmask_trie_lookup_string(trie, "192.168.100.1", -1), 16);
+  cr_assert_eq(netmask_trie_lookup_string(trie, "11.1.2.3", -1), -1);
+  cr_assert_eq(netmask_trie_lookup_string(trie, "10.1.2.3xxx", 8), 32);
+  cr_assert_eq(netmask_trie_lookup_string(trie, "not-an-address", -1), -1);
+
+  netmask_trie_free(trie);
+}
+
+Test(netmask_trie, families_are_kept_apart)
+{
+  const gchar *networks[] = { "0.0.0.0/0", "2001:db8::/32", "2001:db8:1::/48", "::1", NULL };
+  NetmaskTrie *trie = _create_trie(networks);
+
+  cr_assert_eq(netmask_trie_lookup_string(trie, "1.2.3.4", -1), 0);
+  cr_assert_eq(netmask_trie_lookup_string(trie, "2001:db8:1::5", -1), 48);
+  cr_assert_eq(netmask_trie_lookup_string(trie, "2001:db8:2::5", -1), 32);
+  cr_assert_eq(netmask_trie_lookup_string(trie, "::1", -1), 128);
+  cr_assert_eq(netmask_trie_lookup_string(trie, "::2", -1), -1);
+  cr_assert_eq(netmask_trie_lookup_string(trie, "2001:db9::", -1), -1);
+
+  netmask_trie_free(trie);
+}
+
+Test(netmask_trie, invalid_networks_are_rejected)
+{
+  NetmaskTrie *trie = netmask_trie_new();
+
+  cr_assert_not(netmask_trie_add(trie, "10.0.0.0/33"));
+  cr_assert_not(netmask_trie_add(trie, "10.0.0.0/255.0.255.0"));
+  cr_assert_not(netmask_trie_add(trie, "10.0.0.0/"));
+  cr_assert_not(netmask_trie_add(trie, "2001:db8::/129"));
+  cr_assert_not(netmask_trie_add(trie, "example.com"));
+
+  netmask_trie_free(trie);
+}
+
+Test(netmask_trie, local_messages_are_looked_up_as_loopback)
+{
+  const gchar *networks[] = { "127.0.0.0/8", NULL };
+  NetmaskTrie *trie = _create_trie(networks);
+  LogMessage *msg = log_msg_new_empty();
+
+  cr_assert_eq(netmask_trie_lookup_msg_sender(trie, msg), 8);
+
+  log_msg_unref(msg);
+  netmask_trie_free(trie);
+}
+
+static void
+setup(void)
+{
+  app_startup();
+}
+
+static void
+teardown(void)
+{
+  app_shutdown();
+}
+
+TestSuite(netmask_trie, .init = setup, .fini = teardown);
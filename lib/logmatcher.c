@@ -28,6 +28,12 @@
 #include "str-utils.h"
 #include "compat/string.h"
 #include "compat/pcre.h"
+#include "tls-support.h"
+
+#if SYSLOG_NG_HAVE_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#endif
 
 static gboolean
 _shall_set_values_indirectly(NVHandle value_handle)
@@ -626,6 +632,364 @@ log_matcher_pcre_re_new(GlobalConfig *cfg, const LogMatcherOptions *options)
   return &self->super;
 }
 
+#if SYSLOG_NG_HAVE_PCRE2
+
+/* libpcre2 support */
+
+#define LOG_MATCHER_PCRE2_JIT_STACK_START (32 * 1024)
+#define LOG_MATCHER_PCRE2_JIT_STACK_MAX   (512 * 1024)
+
+typedef struct _LogMatcherPcre2Re
+{
+  LogMatcher super;
+  pcre2_code *pattern;
+  guint32 match_options;
+
+  /* pattern metadata, queried once at compile time */
+  guint32 num_pairs;
+  guint32 name_count;
+  guint32 name_entry_size;
+  PCRE2_SPTR name_table;
+} LogMatcherPcre2Re;
+
+/*
+ * Match data, match context and the JIT stack are not tied to a specific
+ * pattern, so a single set is kept per thread and shared by all pcre2
+ * matchers.  The match data is grown to hold the captures of the pattern
+ * with the most groups, the JIT stack is assigned to the match context
+ * once, when it is created.
+ */
+TLS_BLOCK_START
+{
+  pcre2_match_data *pcre2_thread_match_data;
+  guint32 pcre2_thread_match_pairs;
+  pcre2_match_context *pcre2_thread_match_context;
+  pcre2_jit_stack *pcre2_thread_jit_stack;
+}
+TLS_BLOCK_END;
+
+#define pcre2_thread_match_data     __tls_deref(pcre2_thread_match_data)
+#define pcre2_thread_match_pairs    __tls_deref(pcre2_thread_match_pairs)
+#define pcre2_thread_match_context  __tls_deref(pcre2_thread_match_context)
+#define pcre2_thread_jit_stack      __tls_deref(pcre2_thread_jit_stack)
+
+static pcre2_match_data *
+_pcre2_get_match_data(guint32 num_pairs)
+{
+  if (pcre2_thread_match_pairs < num_pairs)
+    {
+      if (pcre2_thread_match_data)
+        pcre2_match_data_free(pcre2_thread_match_data);
+      pcre2_thread_match_data = pcre2_match_data_create(num_pairs, NULL);
+      pcre2_thread_match_pairs = num_pairs;
+    }
+  return pcre2_thread_match_data;
+}
+
+static pcre2_match_context *
+_pcre2_get_match_context(void)
+{
+  if (!pcre2_thread_match_context)
+    {
+      pcre2_thread_match_context = pcre2_match_context_create(NULL);
+
+      /* NULL if JIT is not supported, the default stack is used then */
+      pcre2_thread_jit_stack = pcre2_jit_stack_create(LOG_MATCHER_PCRE2_JIT_STACK_START,
+                                                      LOG_MATCHER_PCRE2_JIT_STACK_MAX, NULL);
+      if (pcre2_thread_match_context && pcre2_thread_jit_stack)
+        pcre2_jit_stack_assign(pcre2_thread_match_context, NULL, pcre2_thread_jit_stack);
+    }
+  return pcre2_thread_match_context;
+}
+
+void
+log_matcher_pcre2_thread_deinit(void)
+{
+  if (pcre2_thread_match_data)
+    pcre2_match_data_free(pcre2_thread_match_data);
+  if (pcre2_thread_match_context)
+    pcre2_match_context_free(pcre2_thread_match_context);
+  if (pcre2_thread_jit_stack)
+    pcre2_jit_stack_free(pcre2_thread_jit_stack);
+
+  pcre2_thread_match_data = NULL;
+  pcre2_thread_match_pairs = 0;
+  pcre2_thread_match_context = NULL;
+  pcre2_thread_jit_stack = NULL;
+}
+
+static gboolean
+log_matcher_pcre2_re_compile(LogMatcher *s, const gchar *re, GError **error)
+{
+  LogMatcherPcre2Re *self = (LogMatcherPcre2Re *) s;
+  pcre2_compile_context *compile_context = NULL;
+  guint32 flags = 0;
+  guint32 capture_count;
+  PCRE2_SIZE erroffset;
+  gint rc;
+
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+  log_matcher_store_pattern(s, re);
+
+  if (self->super.flags & LMF_ICASE)
+    flags |= PCRE2_CASELESS;
+
+  if (self->super.flags & LMF_UTF8)
+    {
+      guint32 support;
+
+      flags |= PCRE2_UTF | PCRE2_NO_UTF_CHECK;
+      self->match_options |= PCRE2_NO_UTF_CHECK;
+
+      pcre2_config(PCRE2_CONFIG_UNICODE, &support);
+      if (!support)
+        {
+          g_set_error(error, LOG_TEMPLATE_ERROR, 0, "PCRE2 library is compiled without Unicode support and utf8 flag was present");
+          return FALSE;
+        }
+    }
+
+  if (self->super.flags & LMF_NEWLINE)
+    {
+      compile_context = pcre2_compile_context_create(NULL);
+      pcre2_set_newline(compile_context, PCRE2_NEWLINE_ANYCRLF);
+    }
+
+  self->pattern = pcre2_compile((PCRE2_SPTR) re, PCRE2_ZERO_TERMINATED, flags, &rc, &erroffset, compile_context);
+  if (compile_context)
+    pcre2_compile_context_free(compile_context);
+
+  if (!self->pattern)
+    {
+      PCRE2_UCHAR errmsg[256];
+
+      pcre2_get_error_message(rc, errmsg, sizeof(errmsg));
+      g_set_error(error, LOG_TEMPLATE_ERROR, 0, "Error while compiling PCRE2 expression, error=%s, error_at=%d",
+                  (gchar *) errmsg, (gint) erroffset);
+      return FALSE;
+    }
+
+  /* JIT is only an optimization, pcre2_match() falls back to the interpreter without it */
+  rc = pcre2_jit_compile(self->pattern, PCRE2_JIT_COMPLETE);
+  if (rc < 0 && rc != PCRE2_ERROR_JIT_BADOPTION)
+    msg_debug("Error while JIT compiling PCRE2 expression, using the interpreter",
+              evt_tag_str("pattern", re),
+              evt_tag_int("error_code", rc));
+
+  pcre2_pattern_info(self->pattern, PCRE2_INFO_CAPTURECOUNT, &capture_count);
+  self->num_pairs = MIN(capture_count, RE_MAX_MATCHES) + 1;
+
+  pcre2_pattern_info(self->pattern, PCRE2_INFO_NAMECOUNT, &self->name_count);
+  if (self->name_count > 0)
+    {
+      pcre2_pattern_info(self->pattern, PCRE2_INFO_NAMETABLE, &self->name_table);
+      pcre2_pattern_info(self->pattern, PCRE2_INFO_NAMEENTRYSIZE, &self->name_entry_size);
+    }
+  return TRUE;
+}
+
+static void
+log_matcher_pcre2_re_feed_backrefs(LogMatcherPcre2Re *self, LogMessage *msg, gint value_handle,
+                                   PCRE2_SIZE *ovector, gint match_num, const gchar *value)
+{
+  gint i;
+  gboolean indirect = _shall_set_values_indirectly(value_handle);
+
+  for (i = 0; i < (RE_MAX_MATCHES) && i < match_num; i++)
+    {
+      PCRE2_SIZE begin_index = ovector[2 * i];
+      PCRE2_SIZE end_index = ovector[2 * i + 1];
+
+      if (begin_index == PCRE2_UNSET || end_index == PCRE2_UNSET)
+        continue;
+
+      if (indirect)
+        {
+          log_msg_set_match_indirect(msg, i, value_handle, 0, begin_index, end_index - begin_index);
+        }
+      else
+        {
+          log_msg_set_match(msg, i, &value[begin_index], end_index - begin_index);
+        }
+    }
+}
+
+static void
+log_matcher_pcre2_re_feed_named_substrings(LogMatcherPcre2Re *self, LogMessage *msg,
+                                           PCRE2_SIZE *ovector, gint match_num, const gchar *value)
+{
+  PCRE2_SPTR tabptr = self->name_table;
+  guint32 i;
+
+  for (i = 0; i < self->name_count; i++, tabptr += self->name_entry_size)
+    {
+      gint n = (tabptr[0] << 8) | tabptr[1];
+      PCRE2_SIZE begin_index, end_index;
+
+      if (n >= match_num)
+        continue;
+
+      begin_index = ovector[2 * n];
+      end_index = ovector[2 * n + 1];
+      if (begin_index == PCRE2_UNSET || end_index == PCRE2_UNSET)
+        continue;
+
+      log_msg_set_value_by_name(msg, (const gchar *) tabptr + 2, value + begin_index, end_index - begin_index);
+    }
+}
+
+static void
+log_matcher_pcre2_re_feed_matches(LogMatcherPcre2Re *self, LogMessage *msg, gint value_handle,
+                                  pcre2_match_data *match_data, gint rc, const gchar *value)
+{
+  PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+
+  /* the match data was too small to hold all captures, use what we have */
+  if (rc == 0)
+    rc = pcre2_get_ovector_count(match_data);
+
+  log_matcher_pcre2_re_feed_backrefs(self, msg, value_handle, ovector, rc, value);
+  log_matcher_pcre2_re_feed_named_substrings(self, msg, ovector, rc, value);
+}
+
+static gboolean
+log_matcher_pcre2_re_match(LogMatcher *s, LogMessage *msg, gint value_handle, const gchar *value, gssize value_len)
+{
+  LogMatcherPcre2Re *self = (LogMatcherPcre2Re *) s;
+  pcre2_match_data *match_data = _pcre2_get_match_data(self->num_pairs);
+  gint rc;
+
+  if (value_len == -1)
+    value_len = strlen(value);
+
+  rc = pcre2_match(self->pattern, (PCRE2_SPTR) value, value_len, 0, self->match_options,
+                   match_data, _pcre2_get_match_context());
+  if (rc < 0)
+    {
+      if (rc != PCRE2_ERROR_NOMATCH)
+        msg_error("Error while matching regexp",
+                  evt_tag_int("error_code", rc));
+      return FALSE;
+    }
+
+  if ((s->flags & LMF_STORE_MATCHES))
+    log_matcher_pcre2_re_feed_matches(self, msg, value_handle, match_data, rc, value);
+  return TRUE;
+}
+
+static gchar *
+log_matcher_pcre2_re_replace(LogMatcher *s, LogMessage *msg, gint value_handle, const gchar *value, gssize value_len,
+                             LogTemplate *replacement, gssize *new_length)
+{
+  LogMatcherPcre2Re *self = (LogMatcherPcre2Re *) s;
+  GString *new_value = NULL;
+  pcre2_match_data *match_data;
+  PCRE2_SIZE *ovector;
+  PCRE2_SIZE match_start, match_end;
+  PCRE2_SIZE start_offset, last_offset;
+  guint32 options;
+  gboolean last_match_was_empty;
+  gint rc;
+
+  if (value_len == -1)
+    value_len = strlen(value);
+
+  last_offset = start_offset = 0;
+  last_match_was_empty = FALSE;
+  do
+    {
+      /* see log_matcher_pcre_re_replace() on how zero-length matches
+       * are handled, this loop does the same */
+
+      if (last_match_was_empty)
+        options = PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED;
+      else
+        options = 0;
+
+      /* the replacement template may use pcre2 matchers on its own,
+       * which reuse the per-thread match data, so fetch it every time and
+       * don't touch it once the template was formatted */
+      match_data = _pcre2_get_match_data(self->num_pairs);
+      rc = pcre2_match(self->pattern, (PCRE2_SPTR) value, value_len, start_offset,
+                       self->match_options | options, match_data, _pcre2_get_match_context());
+      if (rc < 0 && rc != PCRE2_ERROR_NOMATCH)
+        {
+          msg_error("Error while matching regexp",
+                    evt_tag_int("error_code", rc));
+          break;
+        }
+      else if (rc < 0)
+        {
+          if ((options & PCRE2_NOTEMPTY_ATSTART) == 0)
+            break;
+
+          /* skip one character to avoid looping over the same zero-length match */
+          start_offset = start_offset + 1;
+          last_match_was_empty = FALSE;
+          continue;
+        }
+
+      log_matcher_pcre2_re_feed_matches(self, msg, value_handle, match_data, rc, value);
+
+      ovector = pcre2_get_ovector_pointer(match_data);
+      match_start = ovector[0];
+      match_end = ovector[1];
+
+      if (!new_value)
+        new_value = g_string_sized_new(value_len);
+      /* append non-matching portion */
+      g_string_append_len(new_value, &value[last_offset], match_start - last_offset);
+      /* replacement */
+      log_template_append_format(replacement, msg, NULL, LTZ_LOCAL, 0, NULL, new_value);
+
+      last_match_was_empty = (match_start == match_end);
+      start_offset = last_offset = match_end;
+    }
+  while (self->super.flags & LMF_GLOBAL && start_offset < (PCRE2_SIZE) value_len);
+
+  if (new_value)
+    {
+      /* append the last literal */
+      g_string_append_len(new_value, &value[last_offset], value_len - last_offset);
+      if (new_length)
+        *new_length = new_value->len;
+      return g_string_free(new_value, FALSE);
+    }
+  return NULL;
+}
+
+static void
+log_matcher_pcre2_re_free(LogMatcher *s)
+{
+  LogMatcherPcre2Re *self = (LogMatcherPcre2Re *) s;
+
+  pcre2_code_free(self->pattern);
+  log_matcher_free_method(s);
+}
+
+LogMatcher *
+log_matcher_pcre2_re_new(GlobalConfig *cfg, const LogMatcherOptions *options)
+{
+  LogMatcherPcre2Re *self = g_new0(LogMatcherPcre2Re, 1);
+
+  log_matcher_init(&self->super, options);
+  self->super.compile = log_matcher_pcre2_re_compile;
+  self->super.match = log_matcher_pcre2_re_match;
+  self->super.replace = log_matcher_pcre2_re_replace;
+  self->super.free_fn = log_matcher_pcre2_re_free;
+
+  return &self->super;
+}
+
+#else
+
+void
+log_matcher_pcre2_thread_deinit(void)
+{
+}
+
+#endif
+
 typedef LogMatcher *(*LogMatcherConstructFunc)(GlobalConfig *cfg, const LogMatcherOptions *options);
 
 struct
@@ -635,6 +999,9 @@ struct
 } matcher_types[] =
 {
   { "pcre", log_matcher_pcre_re_new },
+#if SYSLOG_NG_HAVE_PCRE2
+  { "pcre2", log_matcher_pcre2_re_new },
+#endif
   { "string", log_matcher_string_new },
   { "glob", log_matcher_glob_new },
   { NULL, NULL },
@@ -110,11 +110,16 @@ log_matcher_is_replace_supported(LogMatcher *s)
 LogMatcher *log_matcher_pcre_re_new(GlobalConfig *cfg, const LogMatcherOptions *options);
 LogMatcher *log_matcher_string_new(GlobalConfig *cfg, const LogMatcherOptions *options);
 LogMatcher *log_matcher_glob_new(GlobalConfig *cfg, const LogMatcherOptions *options);
+#if SYSLOG_NG_HAVE_PCRE2
+LogMatcher *log_matcher_pcre2_re_new(GlobalConfig *cfg, const LogMatcherOptions *options);
+#endif
 
 LogMatcher *log_matcher_new(GlobalConfig *cfg, const LogMatcherOptions *options);
 LogMatcher *log_matcher_ref(LogMatcher *s);
 void log_matcher_unref(LogMatcher *s);
 
+void log_matcher_pcre2_thread_deinit(void);
+
 
 gboolean log_matcher_options_set_type(LogMatcherOptions *options, const gchar *type);
 gboolean log_matcher_options_process_flag(LogMatcherOptions *self, const gchar *flag);
@@ -23,6 +23,171 @@
  */
 
 #include "logmpx.h"
+#include "filter/filter-pipe.h"
+#include "str-utils.h"
+
+#include <string.h>
+
+/* below this many indexed branches evaluating the filters one-by-one is just as fast */
+#define LOG_MULTIPLEXER_DISPATCH_MIN_BRANCHES 8
+
+typedef struct _LogMultiplexerDispatchField
+{
+  NVHandle value_handle;
+  /* value -> bitmap of the branches that accept that value */
+  GHashTable *branches_by_value;
+} LogMultiplexerDispatchField;
+
+struct _LogMultiplexerDispatch
+{
+  gint bitmap_words;
+  /* branches that are not indexed, these are visited for every message */
+  guint64 *unconditional;
+  GArray *fields;
+};
+
+typedef struct _LogMultiplexerDispatchBuildState
+{
+  LogMultiplexerDispatch *dispatch;
+  gint branch;
+} LogMultiplexerDispatchBuildState;
+
+static inline void
+_bitmap_set(guint64 *bitmap, gint bit)
+{
+  bitmap[bit / 64] |= G_GUINT64_CONSTANT(1) << (bit % 64);
+}
+
+static inline gboolean
+_bitmap_test(const guint64 *bitmap, gint bit)
+{
+  return (bitmap[bit / 64] & (G_GUINT64_CONSTANT(1) << (bit % 64))) != 0;
+}
+
+static LogMultiplexerDispatchField *
+_dispatch_get_field(LogMultiplexerDispatch *self, NVHandle value_handle)
+{
+  LogMultiplexerDispatchField new_field;
+  gint i;
+
+  for (i = 0; i < self->fields->len; i++)
+    {
+      LogMultiplexerDispatchField *field = &g_array_index(self->fields, LogMultiplexerDispatchField, i);
+
+      if (field->value_handle == value_handle)
+        return field;
+    }
+
+  new_field.value_handle = value_handle;
+  new_field.branches_by_value = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  g_array_append_val(self->fields, new_field);
+  return &g_array_index(self->fields, LogMultiplexerDispatchField, self->fields->len - 1);
+}
+
+static void
+_dispatch_add_exact_match(NVHandle value_handle, const gchar *value, gpointer user_data)
+{
+  LogMultiplexerDispatchBuildState *state = (LogMultiplexerDispatchBuildState *) user_data;
+  LogMultiplexerDispatchField *field = _dispatch_get_field(state->dispatch, value_handle);
+  guint64 *branches;
+
+  branches = g_hash_table_lookup(field->branches_by_value, value);
+  if (!branches)
+    {
+      branches = g_new0(guint64, state->dispatch->bitmap_words);
+      g_hash_table_insert(field->branches_by_value, g_strdup(value), branches);
+    }
+  _bitmap_set(branches, state->branch);
+}
+
+/* the first element of the branch that does something besides forwarding */
+static LogPipe *
+_find_branch_gate(LogPipe *branch_head)
+{
+  LogPipe *p;
+
+  for (p = branch_head; p; p = p->pipe_next)
+    {
+      /* drop-unmatched turns a filtered out message into a matching one */
+      if (p->flags & PIF_DROP_UNMATCHED)
+        return NULL;
+
+      if (p->queue)
+        return p;
+    }
+  return NULL;
+}
+
+static void
+_dispatch_free(LogMultiplexerDispatch *self)
+{
+  gint i;
+
+  for (i = 0; i < self->fields->len; i++)
+    g_hash_table_destroy(g_array_index(self->fields, LogMultiplexerDispatchField, i).branches_by_value);
+  g_array_free(self->fields, TRUE);
+  g_free(self->unconditional);
+  g_free(self);
+}
+
+static LogMultiplexerDispatch *
+_dispatch_new(GPtrArray *next_hops)
+{
+  LogMultiplexerDispatch *self = g_new0(LogMultiplexerDispatch, 1);
+  LogMultiplexerDispatchBuildState state = { self, 0 };
+  gint indexed_branches = 0;
+
+  self->bitmap_words = (next_hops->len + 63) / 64;
+  self->unconditional = g_new0(guint64, self->bitmap_words);
+  self->fields = g_array_new(FALSE, FALSE, sizeof(LogMultiplexerDispatchField));
+
+  for (state.branch = 0; state.branch < next_hops->len; state.branch++)
+    {
+      LogPipe *gate = _find_branch_gate(g_ptr_array_index(next_hops, state.branch));
+
+      if (gate && log_filter_pipe_enumerate_exact_matches(gate, _dispatch_add_exact_match, &state))
+        indexed_branches++;
+      else
+        _bitmap_set(self->unconditional, state.branch);
+    }
+
+  if (indexed_branches < LOG_MULTIPLEXER_DISPATCH_MIN_BRANCHES)
+    {
+      _dispatch_free(self);
+      return NULL;
+    }
+  return self;
+}
+
+/*
+ * NOTE: indexed branches that are skipped this way don't see the message
+ * at all, thus the not_matched counter of their filter is not incremented
+ * either.
+ */
+static void
+_dispatch_collect_candidates(LogMultiplexerDispatch *self, LogMessage *msg, guint64 *candidates)
+{
+  gint i, w;
+
+  memcpy(candidates, self->unconditional, self->bitmap_words * sizeof(guint64));
+  for (i = 0; i < self->fields->len; i++)
+    {
+      LogMultiplexerDispatchField *field = &g_array_index(self->fields, LogMultiplexerDispatchField, i);
+      const gchar *value;
+      gssize value_len;
+      guint64 *branches;
+
+      value = log_msg_get_value(msg, field->value_handle, &value_len);
+      APPEND_ZERO(value, value, value_len);
+
+      branches = g_hash_table_lookup(field->branches_by_value, value);
+      if (!branches)
+        continue;
+
+      for (w = 0; w < self->bitmap_words; w++)
+        candidates[w] |= branches[w];
+    }
+}
 
 
 void
@@ -52,12 +217,23 @@ log_multiplexer_init(LogPipe *s)
           self->fallback_exists = TRUE;
         }
     }
+
+  if (self->dispatch)
+    _dispatch_free(self->dispatch);
+  self->dispatch = _dispatch_new(self->next_hops);
   return TRUE;
 }
 
 static gboolean
-log_multiplexer_deinit(LogPipe *self)
+log_multiplexer_deinit(LogPipe *s)
 {
+  LogMultiplexer *self = (LogMultiplexer *) s;
+
+  if (self->dispatch)
+    {
+      _dispatch_free(self->dispatch);
+      self->dispatch = NULL;
+    }
   return TRUE;
 }
 
@@ -70,12 +246,20 @@ log_multiplexer_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_op
   gboolean matched;
   gboolean delivered = FALSE;
   gint fallback;
+  guint64 *candidates = NULL;
 
   local_options.matched = &matched;
   if (self->next_hops->len > 1)
     {
       log_msg_write_protect(msg);
     }
+
+  /* the debugger needs to see every branch being evaluated */
+  if (self->dispatch && G_LIKELY(!pipe_single_step_hook))
+    {
+      candidates = g_alloca(self->dispatch->bitmap_words * sizeof(guint64));
+      _dispatch_collect_candidates(self->dispatch, msg, candidates);
+    }
   for (fallback = 0; (fallback == 0) || (fallback == 1 && self->fallback_exists && !delivered); fallback++)
     {
       for (i = 0; i < self->next_hops->len; i++)
@@ -90,6 +274,10 @@ log_multiplexer_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_op
             {
               continue;
             }
+          else if (candidates && !_bitmap_test(candidates, i))
+            {
+              continue;
+            }
 
           matched = TRUE;
           log_msg_add_ack(msg, &local_options);
@@ -134,6 +322,8 @@ log_multiplexer_free(LogPipe *s)
 {
   LogMultiplexer *self = (LogMultiplexer *) s;
 
+  if (self->dispatch)
+    _dispatch_free(self->dispatch);
   g_ptr_array_free(self->next_hops, TRUE);
   log_pipe_free_method(s);
 }
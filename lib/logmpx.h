@@ -27,6 +27,8 @@
 
 #include "logpipe.h"
 
+typedef struct _LogMultiplexerDispatch LogMultiplexerDispatch;
+
 /**
  * This class encapsulates a fork of the message pipe-line. It receives
  * messages via its queue() method and forwards them to its list of
@@ -35,12 +37,19 @@
  *
  * This object is used for example for each source to send messages to all
  * log pipelines that refer to the source.
+ *
+ * Branches that start with a filter only accepting exact values of a
+ * single field (e.g.  program("^foo$") or facility(mail)) are indexed by
+ * those values at init time, so that each message is only handed over to
+ * the branches it can possibly match.  The remaining branches are always
+ * visited and branch order is kept in both cases.
  **/
 typedef struct _LogMultiplexer
 {
   LogPipe super;
   GPtrArray *next_hops;
   gboolean fallback_exists;
+  LogMultiplexerDispatch *dispatch;
 } LogMultiplexer;
 
 LogMultiplexer *log_multiplexer_new(GlobalConfig *cfg);
@@ -0,0 +1,434 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "logmsg/logmsg-pool.h"
+#include "stats/stats-registry.h"
+#include "stats/stats-cluster-single.h"
+#include "tls-support.h"
+
+#include <string.h>
+
+/*
+ * Design notes:
+ *
+ *   - every allocation is prefixed with a LogMsgPoolChunk header, which
+ *     records the pool the chunk belongs to (NULL if it was allocated with
+ *     g_malloc() directly) and its size class.
+ *
+ *   - the free lists of a pool are only accessed by its owner thread, so
+ *     the allocation fast path doesn't need any atomic operations.
+ *
+ *   - a chunk freed by a foreign thread is added to a per-thread batch
+ *     associated with its origin pool.  Once the batch is full, it is
+ *     pushed to the "returned" list of the origin pool using a single
+ *     compare-and-exchange.  The owner grabs the complete returned list
+ *     whenever its own free list runs dry.
+ *
+ *   - pools are never freed while the process is running: chunks may
+ *     outlive the thread that allocated them.  The pool of an exiting thread
+ *     is put on a spare list and adopted by the next thread that starts.
+ *     The number of pools is therefore bounded by the maximum number of
+ *     concurrent threads.
+ */
+
+#define LOG_MSG_POOL_NUM_CLASSES         6
+#define LOG_MSG_POOL_MIN_CLASS_SIZE      512
+#define LOG_MSG_POOL_MAX_CACHED_BYTES    (1024 * 1024)
+#define LOG_MSG_POOL_REMOTE_BATCHES      4
+#define LOG_MSG_POOL_REMOTE_BATCH_SIZE   32
+
+/* update the stats counters once every this many operations */
+#define LOG_MSG_POOL_STATS_UPDATE_PERIOD 256
+
+typedef struct _LogMsgPool LogMsgPool;
+typedef struct _LogMsgPoolChunk LogMsgPoolChunk;
+
+struct _LogMsgPoolChunk
+{
+  LogMsgPool *origin;
+  guint32 size_class;
+  guint32 __reserved;
+  /* the allocated area follows, while the chunk is cached, it starts with
+   * the pointer to the next chunk */
+};
+
+struct _LogMsgPool
+{
+  /* owner only */
+  LogMsgPoolChunk *free_list[LOG_MSG_POOL_NUM_CLASSES];
+  gsize free_bytes[LOG_MSG_POOL_NUM_CLASSES];
+
+  /* chunks handed back by other threads, accessed atomically */
+  LogMsgPoolChunk *returned;
+
+  LogMsgPool *next_spare;
+};
+
+typedef struct _LogMsgPoolRemoteBatch
+{
+  LogMsgPool *origin;
+  LogMsgPoolChunk *head;
+  LogMsgPoolChunk *tail;
+  gint count;
+  gsize bytes;
+} LogMsgPoolRemoteBatch;
+
+TLS_BLOCK_START
+{
+  LogMsgPool *log_msg_pool;
+  LogMsgPoolRemoteBatch log_msg_pool_remote_batches[LOG_MSG_POOL_REMOTE_BATCHES];
+  glong log_msg_pool_pending_hits;
+  glong log_msg_pool_pending_misses;
+  glong log_msg_pool_pending_resident_bytes;
+  gint log_msg_pool_pending_ops;
+}
+TLS_BLOCK_END;
+
+#define log_msg_pool                        __tls_deref(log_msg_pool)
+#define log_msg_pool_remote_batches         __tls_deref(log_msg_pool_remote_batches)
+#define log_msg_pool_pending_hits           __tls_deref(log_msg_pool_pending_hits)
+#define log_msg_pool_pending_misses         __tls_deref(log_msg_pool_pending_misses)
+#define log_msg_pool_pending_resident_bytes __tls_deref(log_msg_pool_pending_resident_bytes)
+#define log_msg_pool_pending_ops            __tls_deref(log_msg_pool_pending_ops)
+
+static gboolean log_msg_pool_enabled;
+static GStaticMutex log_msg_pool_spares_lock = G_STATIC_MUTEX_INIT;
+static LogMsgPool *log_msg_pool_spares;
+
+/* accessed by the test program */
+StatsCounterItem *stats_msg_pool_hits;
+StatsCounterItem *stats_msg_pool_misses;
+StatsCounterItem *stats_msg_pool_resident_bytes;
+
+#define _chunk_next(chunk) (*((LogMsgPoolChunk **) ((chunk) + 1)))
+
+static inline gsize
+_class_size(gint size_class)
+{
+  return LOG_MSG_POOL_MIN_CLASS_SIZE << size_class;
+}
+
+static inline gint
+_lookup_size_class(gsize chunk_size)
+{
+  gint size_class;
+
+  for (size_class = 0; size_class < LOG_MSG_POOL_NUM_CLASSES; size_class++)
+    {
+      if (chunk_size <= _class_size(size_class))
+        return size_class;
+    }
+  return -1;
+}
+
+void
+log_msg_pool_update_stats(void)
+{
+  stats_counter_add(stats_msg_pool_hits, log_msg_pool_pending_hits);
+  stats_counter_add(stats_msg_pool_misses, log_msg_pool_pending_misses);
+  stats_counter_add(stats_msg_pool_resident_bytes, log_msg_pool_pending_resident_bytes);
+  log_msg_pool_pending_hits = 0;
+  log_msg_pool_pending_misses = 0;
+  log_msg_pool_pending_resident_bytes = 0;
+  log_msg_pool_pending_ops = 0;
+}
+
+static inline void
+_lazy_update_stats(void)
+{
+  if (++log_msg_pool_pending_ops >= LOG_MSG_POOL_STATS_UPDATE_PERIOD)
+    log_msg_pool_update_stats();
+}
+
+static void
+_release_chunk(LogMsgPoolChunk *chunk)
+{
+  log_msg_pool_pending_resident_bytes -= _class_size(chunk->size_class);
+  g_free(chunk);
+}
+
+/* the chunk is already accounted as resident */
+static void
+_cache_resident_chunk(LogMsgPool *self, LogMsgPoolChunk *chunk)
+{
+  gsize size = _class_size(chunk->size_class);
+
+  if (self->free_bytes[chunk->size_class] + size > LOG_MSG_POOL_MAX_CACHED_BYTES)
+    {
+      _release_chunk(chunk);
+      return;
+    }
+  _chunk_next(chunk) = self->free_list[chunk->size_class];
+  self->free_list[chunk->size_class] = chunk;
+  self->free_bytes[chunk->size_class] += size;
+}
+
+static void
+_reclaim_returned_chunks(LogMsgPool *self)
+{
+  LogMsgPoolChunk *chunk, *next;
+
+  do
+    {
+      chunk = g_atomic_pointer_get(&self->returned);
+    }
+  while (chunk && !g_atomic_pointer_compare_and_exchange(&self->returned, chunk, NULL));
+
+  for (; chunk; chunk = next)
+    {
+      next = _chunk_next(chunk);
+      _cache_resident_chunk(self, chunk);
+    }
+}
+
+static void
+_push_returned_chunks(LogMsgPool *origin, LogMsgPoolChunk *head, LogMsgPoolChunk *tail, gsize bytes)
+{
+  LogMsgPoolChunk *old_head;
+
+  /* only whole lists are ever removed from "returned", so there's no ABA problem here */
+  do
+    {
+      old_head = g_atomic_pointer_get(&origin->returned);
+      _chunk_next(tail) = old_head;
+    }
+  while (!g_atomic_pointer_compare_and_exchange(&origin->returned, old_head, head));
+  log_msg_pool_pending_resident_bytes += bytes;
+}
+
+static void
+_flush_remote_batch(LogMsgPoolRemoteBatch *batch)
+{
+  if (!batch->count)
+    return;
+
+  _push_returned_chunks(batch->origin, batch->head, batch->tail, batch->bytes);
+  memset(batch, 0, sizeof(*batch));
+}
+
+static void
+_return_to_origin(LogMsgPoolChunk *chunk)
+{
+  LogMsgPoolRemoteBatch *batch;
+  gsize size = _class_size(chunk->size_class);
+
+  if (!log_msg_pool)
+    {
+      /* a thread without a pool of its own, don't keep anything behind */
+      _push_returned_chunks(chunk->origin, chunk, chunk, size);
+      return;
+    }
+
+  batch = &log_msg_pool_remote_batches[(GPOINTER_TO_SIZE(chunk->origin) >> 6) % LOG_MSG_POOL_REMOTE_BATCHES];
+  if (batch->origin != chunk->origin)
+    {
+      _flush_remote_batch(batch);
+      batch->origin = chunk->origin;
+    }
+
+  if (!batch->tail)
+    batch->tail = chunk;
+  _chunk_next(chunk) = batch->head;
+  batch->head = chunk;
+  batch->count++;
+  batch->bytes += size;
+
+  if (batch->count >= LOG_MSG_POOL_REMOTE_BATCH_SIZE)
+    _flush_remote_batch(batch);
+}
+
+gpointer
+log_msg_pool_alloc(gsize *size)
+{
+  LogMsgPool *pool = log_msg_pool;
+  gsize chunk_size = *size + sizeof(LogMsgPoolChunk);
+  LogMsgPoolChunk *chunk;
+  gint size_class;
+
+  if (!log_msg_pool_enabled || !pool || (size_class = _lookup_size_class(chunk_size)) < 0)
+    {
+      chunk = g_malloc(chunk_size);
+      chunk->origin = NULL;
+      chunk->size_class = 0;
+      return chunk + 1;
+    }
+
+  chunk = pool->free_list[size_class];
+  if (!chunk)
+    {
+      _reclaim_returned_chunks(pool);
+      chunk = pool->free_list[size_class];
+    }
+
+  if (chunk)
+    {
+      pool->free_list[size_class] = _chunk_next(chunk);
+      pool->free_bytes[size_class] -= _class_size(size_class);
+      log_msg_pool_pending_resident_bytes -= _class_size(size_class);
+      log_msg_pool_pending_hits++;
+    }
+  else
+    {
+      chunk = g_malloc(_class_size(size_class));
+      chunk->origin = pool;
+      chunk->size_class = size_class;
+      log_msg_pool_pending_misses++;
+    }
+  _lazy_update_stats();
+
+  /* let the caller use the slack at the end of the size class */
+  *size = _class_size(size_class) - sizeof(LogMsgPoolChunk);
+  return chunk + 1;
+}
+
+void
+log_msg_pool_free(gpointer ptr)
+{
+  LogMsgPoolChunk *chunk = ((LogMsgPoolChunk *) ptr) - 1;
+
+  if (!chunk->origin || !log_msg_pool_enabled)
+    {
+      g_free(chunk);
+      return;
+    }
+
+  if (chunk->origin == log_msg_pool)
+    {
+      log_msg_pool_pending_resident_bytes += _class_size(chunk->size_class);
+      _cache_resident_chunk(chunk->origin, chunk);
+    }
+  else
+    {
+      _return_to_origin(chunk);
+    }
+  _lazy_update_stats();
+}
+
+void
+log_msg_pool_set_enabled(gboolean enabled)
+{
+  log_msg_pool_enabled = enabled;
+}
+
+gboolean
+log_msg_pool_is_enabled(void)
+{
+  return log_msg_pool_enabled;
+}
+
+static void
+_release_cached_chunks(LogMsgPool *self)
+{
+  gint size_class;
+
+  _reclaim_returned_chunks(self);
+  for (size_class = 0; size_class < LOG_MSG_POOL_NUM_CLASSES; size_class++)
+    {
+      LogMsgPoolChunk *chunk, *next;
+
+      for (chunk = self->free_list[size_class]; chunk; chunk = next)
+        {
+          next = _chunk_next(chunk);
+          _release_chunk(chunk);
+        }
+      self->free_list[size_class] = NULL;
+      self->free_bytes[size_class] = 0;
+    }
+}
+
+void
+log_msg_pool_allocator_init(void)
+{
+  LogMsgPool *pool;
+
+  g_static_mutex_lock(&log_msg_pool_spares_lock);
+  pool = log_msg_pool_spares;
+  if (pool)
+    log_msg_pool_spares = pool->next_spare;
+  g_static_mutex_unlock(&log_msg_pool_spares_lock);
+
+  if (!pool)
+    pool = g_new0(LogMsgPool, 1);
+  pool->next_spare = NULL;
+  log_msg_pool = pool;
+}
+
+void
+log_msg_pool_allocator_deinit(void)
+{
+  LogMsgPool *pool = log_msg_pool;
+  gint i;
+
+  if (!pool)
+    return;
+
+  for (i = 0; i < LOG_MSG_POOL_REMOTE_BATCHES; i++)
+    _flush_remote_batch(&log_msg_pool_remote_batches[i]);
+
+  _release_cached_chunks(pool);
+  log_msg_pool = NULL;
+  log_msg_pool_update_stats();
+
+  g_static_mutex_lock(&log_msg_pool_spares_lock);
+  pool->next_spare = log_msg_pool_spares;
+  log_msg_pool_spares = pool;
+  g_static_mutex_unlock(&log_msg_pool_spares_lock);
+}
+
+void
+log_msg_pool_global_init(void)
+{
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "msg_pool_hits", NULL);
+  stats_register_counter(1, &sc_key, SC_TYPE_SINGLE_VALUE, &stats_msg_pool_hits);
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "msg_pool_misses", NULL);
+  stats_register_counter(1, &sc_key, SC_TYPE_SINGLE_VALUE, &stats_msg_pool_misses);
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "msg_pool_resident_bytes", NULL);
+  stats_register_counter(1, &sc_key, SC_TYPE_SINGLE_VALUE, &stats_msg_pool_resident_bytes);
+  stats_unlock();
+}
+
+void
+log_msg_pool_global_deinit(void)
+{
+  StatsClusterKey sc_key;
+  LogMsgPool *pool;
+
+  /* chunks returned to the pools of exited threads since they stopped */
+  g_static_mutex_lock(&log_msg_pool_spares_lock);
+  for (pool = log_msg_pool_spares; pool; pool = pool->next_spare)
+    _release_cached_chunks(pool);
+  g_static_mutex_unlock(&log_msg_pool_spares_lock);
+  log_msg_pool_update_stats();
+
+  stats_lock();
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "msg_pool_hits", NULL);
+  stats_unregister_counter(&sc_key, SC_TYPE_SINGLE_VALUE, &stats_msg_pool_hits);
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "msg_pool_misses", NULL);
+  stats_unregister_counter(&sc_key, SC_TYPE_SINGLE_VALUE, &stats_msg_pool_misses);
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "msg_pool_resident_bytes", NULL);
+  stats_unregister_counter(&sc_key, SC_TYPE_SINGLE_VALUE, &stats_msg_pool_resident_bytes);
+  stats_unlock();
+}
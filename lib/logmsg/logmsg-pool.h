@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef LOGMSG_POOL_H_INCLUDED
+#define LOGMSG_POOL_H_INCLUDED
+
+#include "syslog-ng.h"
+
+/*
+ * Per-thread memory pool for LogMessage instances.
+ *
+ * log_msg_pool_alloc() rounds the requested size up to one of a few size
+ * classes and serves the allocation from the free list of the calling
+ * thread.  Chunks freed by another thread are collected into batches and
+ * handed back to their origin pool with a single atomic operation.
+ *
+ * The pool is disabled by default, in which case allocations are simply
+ * forwarded to g_malloc(), the chunks remain compatible with
+ * log_msg_pool_free() in both cases.
+ */
+
+gpointer log_msg_pool_alloc(gsize *size);
+void log_msg_pool_free(gpointer ptr);
+
+void log_msg_pool_set_enabled(gboolean enabled);
+gboolean log_msg_pool_is_enabled(void);
+
+/* lazy stats update */
+void log_msg_pool_update_stats(void);
+
+void log_msg_pool_allocator_init(void);
+void log_msg_pool_allocator_deinit(void);
+
+void log_msg_pool_global_init(void);
+void log_msg_pool_global_deinit(void);
+
+#endif
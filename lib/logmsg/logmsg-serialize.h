@@ -66,6 +66,11 @@ typedef enum _LogMessageVersion
 } LogMessageVersion;
 
 gboolean log_msg_deserialize(LogMessage *self, SerializeArchive *sa);
+
+/* NOTE: archives that support write_bytes_ref (e.g.
+ * serialize_iov_archive_new()) reference the payload of the message
+ * instead of copying it: keep a reference to the message and don't modify
+ * it until the archive contents are consumed. */
 gboolean log_msg_serialize_with_ts_processed(LogMessage *self, SerializeArchive *sa, const LogStamp *processed);
 gboolean log_msg_serialize(LogMessage *self, SerializeArchive *sa);
 
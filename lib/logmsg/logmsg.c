@@ -29,6 +29,7 @@
 #include "logpipe.h"
 #include "timeutils.h"
 #include "logmsg/nvtable.h"
+#include "logmsg/logmsg-pool.h"
 #include "stats/stats-registry.h"
 #include "stats/stats-cluster-single.h"
 #include "template/templates.h"
@@ -204,6 +205,8 @@ NVRegistry *logmsg_registry;
 const char logmsg_sd_prefix[] = ".SDATA.";
 const gint logmsg_sd_prefix_len = sizeof(logmsg_sd_prefix) - 1;
 gint logmsg_queue_node_max = 1;
+/* number of index entries preallocated in a new payload */
+#define LOGMSG_PAYLOAD_INDEX_SIZE_HINT 16
 /* statistics */
 static StatsCounterItem *count_msg_clones;
 static StatsCounterItem *count_payload_reallocs;
@@ -221,6 +224,8 @@ void
 log_msg_write_unprotect(LogMessage *self)
 {
   self->protect_cnt--;
+  if (self->protect_cnt == 0)
+    log_msg_filter_cache_clear(self);
 }
 
 LogMessage *
@@ -495,6 +500,48 @@ log_msg_free_queue_node(LogMessageQueueNode *node)
     g_slice_free(LogMessageQueueNode, node);
 }
 
+static inline void
+_count_payload_realloc(LogMessage *self)
+{
+  if (self->num_payload_reallocs < G_MAXUINT8)
+    self->num_payload_reallocs++;
+}
+
+/*
+ * Returns the payload size (in the same unit log_msg_new_with_size_hint()
+ * expects) that would have been sufficient to hold the current payload of
+ * the message without growing it.
+ */
+gsize
+log_msg_get_payload_length(LogMessage *self)
+{
+  NVTable *payload = self->payload;
+  gsize length = payload->used;
+
+  if (payload->index_size > LOGMSG_PAYLOAD_INDEX_SIZE_HINT)
+    length += (payload->index_size - LOGMSG_PAYLOAD_INDEX_SIZE_HINT) * sizeof(NVIndexEntry);
+  return length;
+}
+
+/*
+ * The payload of a cloned message is shared with the original until the
+ * first change, that's when the clone gets its own copy, which is a cheap
+ * overlay for larger payloads (see nv_table_clone_cow()).  The original
+ * is referenced and write protected by the clone, so it remains a valid
+ * base for the overlay.
+ */
+static void
+log_msg_make_payload_writable(LogMessage *self, gsize additional_space)
+{
+  if (log_msg_chk_flag(self, LF_STATE_OWN_PAYLOAD))
+    return;
+
+  self->payload = nv_table_clone_cow(self->payload, additional_space);
+  log_msg_set_flag(self, LF_STATE_OWN_PAYLOAD);
+  self->allocated_bytes += self->payload->size;
+  stats_counter_add(count_allocated_bytes, self->payload->size);
+}
+
 static gboolean
 _log_name_value_updates(LogMessage *self)
 {
@@ -532,13 +579,7 @@ log_msg_set_value(LogMessage *self, NVHandle handle, const gchar *value, gssize
   if (value_len < 0)
     value_len = strlen(value);
 
-  if (!log_msg_chk_flag(self, LF_STATE_OWN_PAYLOAD))
-    {
-      self->payload = nv_table_clone(self->payload, name_len + value_len + 2);
-      log_msg_set_flag(self, LF_STATE_OWN_PAYLOAD);
-      self->allocated_bytes += self->payload->size;
-      stats_counter_add(count_allocated_bytes, self->payload->size);
-    }
+  log_msg_make_payload_writable(self, name_len + value_len + 2);
 
   /* we need a loop here as a single realloc may not be enough. Might help
    * if we pass how much bytes we need though. */
@@ -559,6 +600,7 @@ log_msg_set_value(LogMessage *self, NVHandle handle, const gchar *value, gssize
       self->allocated_bytes += (new_size - old_size);
       stats_counter_add(count_allocated_bytes, new_size-old_size);
       stats_counter_inc(count_payload_reallocs);
+      _count_payload_realloc(self);
     }
 
   if (new_entry)
@@ -570,7 +612,22 @@ log_msg_set_value(LogMessage *self, NVHandle handle, const gchar *value, gssize
 void
 log_msg_unset_value(LogMessage *self, NVHandle handle)
 {
-  nv_table_unset_value(self->payload, handle);
+  if (!nv_table_is_value_set(self->payload, handle))
+    return;
+
+  log_msg_make_payload_writable(self, 0);
+  while (!nv_table_unset_value(self->payload, handle))
+    {
+      /* the overlay has to be flattened to hide the value */
+      if (!nv_table_realloc(self->payload, &self->payload))
+        {
+          msg_info("Cannot unset value for this log message, maximum size has been reached",
+                   evt_tag_str("name", log_msg_get_value_name(handle, NULL)));
+          break;
+        }
+      stats_counter_inc(count_payload_reallocs);
+      _count_payload_realloc(self);
+    }
 }
 
 void
@@ -607,11 +664,7 @@ log_msg_set_value_indirect(LogMessage *self, NVHandle handle, NVHandle ref_handl
                 evt_tag_int("len", len));
     }
 
-  if (!log_msg_chk_flag(self, LF_STATE_OWN_PAYLOAD))
-    {
-      self->payload = nv_table_clone(self->payload, name_len + 1);
-      log_msg_set_flag(self, LF_STATE_OWN_PAYLOAD);
-    }
+  log_msg_make_payload_writable(self, name_len + 1);
 
   NVReferencedSlice referenced_slice =
   {
@@ -633,6 +686,7 @@ log_msg_set_value_indirect(LogMessage *self, NVHandle handle, NVHandle ref_handl
           break;
         }
       stats_counter_inc(count_payload_reallocs);
+      _count_payload_realloc(self);
     }
 
   if (new_entry)
@@ -1129,6 +1183,7 @@ log_msg_clear(LogMessage *self)
       g_sockaddr_unref(self->saddr);
     }
   self->saddr = NULL;
+  log_msg_filter_cache_clear(self);
 
   self->flags |= LF_STATE_OWN_MASK;
 }
@@ -1137,7 +1192,8 @@ static inline LogMessage *
 log_msg_alloc(gsize payload_size)
 {
   LogMessage *msg;
-  gsize payload_space = payload_size ? nv_table_get_alloc_size(LM_V_MAX, 16, payload_size) : 0;
+  gsize payload_space = payload_size ? nv_table_get_alloc_size(LM_V_MAX, LOGMSG_PAYLOAD_INDEX_SIZE_HINT,
+                                                              payload_size) : 0;
   gsize alloc_size, payload_ofs = 0;
 
   /* NOTE: logmsg_node_max is updated from parallel threads without locking. */
@@ -1151,7 +1207,11 @@ log_msg_alloc(gsize payload_size)
       payload_ofs = alloc_size;
       alloc_size += payload_space;
     }
-  msg = g_malloc(alloc_size);
+  msg = log_msg_pool_alloc(&alloc_size);
+
+  /* the pool may round up the allocation, give the slack to the payload */
+  if (payload_size)
+    payload_space = alloc_size - payload_ofs;
 
   memset(msg, 0, sizeof(LogMessage));
 
@@ -1227,6 +1287,7 @@ log_msg_clone_cow(LogMessage *msg, const LogPathOptions *path_options)
                                                 0) + LOGMSG_REFCACHE_ABORT_TO_VALUE(0);
   self->cur_node = 0;
   self->protect_cnt = 0;
+  log_msg_filter_cache_clear(self);
 
   log_msg_add_ack(self, path_options);
   if (!path_options->ack_needed)
@@ -1246,7 +1307,7 @@ log_msg_clone_cow(LogMessage *msg, const LogPathOptions *path_options)
 }
 
 static gsize
-_determine_payload_size(gint length, MsgFormatOptions *parse_options)
+_determine_payload_size(gint length, MsgFormatOptions *parse_options, gsize payload_size_hint)
 {
   gsize payload_size;
 
@@ -1255,6 +1316,7 @@ _determine_payload_size(gint length, MsgFormatOptions *parse_options)
   else
     payload_size = length * 2;
 
+  payload_size = MAX(payload_size, payload_size_hint);
   return MAX(payload_size, 256);
 }
 
@@ -1272,7 +1334,24 @@ log_msg_new(const gchar *msg, gint length,
             GSockAddr *saddr,
             MsgFormatOptions *parse_options)
 {
-  LogMessage *self = log_msg_alloc(_determine_payload_size(length, parse_options));
+  return log_msg_new_with_size_hint(msg, length, saddr, parse_options, 0);
+}
+
+/**
+ * log_msg_new_with_size_hint:
+ * @payload_size_hint: expected size of the payload, as returned by log_msg_get_payload_length()
+ *
+ * Same as log_msg_new(), but preallocates at least @payload_size_hint
+ * bytes for the payload, so that values added by parsers later on would
+ * not need to grow the NVTable.
+ **/
+LogMessage *
+log_msg_new_with_size_hint(const gchar *msg, gint length,
+                           GSockAddr *saddr,
+                           MsgFormatOptions *parse_options,
+                           gsize payload_size_hint)
+{
+  LogMessage *self = log_msg_alloc(_determine_payload_size(length, parse_options, payload_size_hint));
 
   log_msg_init(self, saddr);
 
@@ -1377,7 +1456,7 @@ log_msg_free(LogMessage *self)
 
   stats_counter_sub(count_allocated_bytes, self->allocated_bytes);
 
-  g_free(self);
+  log_msg_pool_free(self);
 }
 
 /**
@@ -204,9 +204,15 @@ struct _LogMessage
   guint8 num_nodes;
   guint8 cur_node;
   guint8 protect_cnt;
+  /* number of times the payload had to be grown, saturates at 255 */
+  guint8 num_payload_reallocs;
 
   guint64 rcptid;
 
+  /* results of named filter() references, see log_msg_filter_cache_lookup() */
+  guint32 filter_cache_valid;
+  guint32 filter_cache_results;
+
   /* preallocated LogQueueNodes used to insert this message into a LogQueue */
   LogMessageQueueNode nodes[0];
 
@@ -232,6 +238,49 @@ log_msg_is_write_protected(const LogMessage *self)
 LogMessage *log_msg_clone_cow(LogMessage *msg, const LogPathOptions *path_options);
 LogMessage *log_msg_make_writable(LogMessage **pmsg, const LogPathOptions *path_options);
 
+/*
+ * Per-message cache of named filter() results.
+ *
+ * Results are only cached while the message is write protected, as it
+ * can't change in that state.  The cache is cleared when the last write
+ * protection is dropped, clones made by log_msg_make_writable() start with
+ * an empty one.
+ */
+#define LOG_MSG_FILTER_CACHE_SLOTS 32
+
+static inline gboolean
+log_msg_filter_cache_lookup(const LogMessage *self, gint slot, gboolean *result)
+{
+  guint32 mask = 1U << slot;
+
+  if (!(self->filter_cache_valid & mask))
+    return FALSE;
+
+  *result = !!(self->filter_cache_results & mask);
+  return TRUE;
+}
+
+static inline void
+log_msg_filter_cache_store(LogMessage *self, gint slot, gboolean result)
+{
+  guint32 mask = 1U << slot;
+
+  if (!log_msg_is_write_protected(self))
+    return;
+
+  self->filter_cache_valid |= mask;
+  if (result)
+    self->filter_cache_results |= mask;
+  else
+    self->filter_cache_results &= ~mask;
+}
+
+static inline void
+log_msg_filter_cache_clear(LogMessage *self)
+{
+  self->filter_cache_valid = 0;
+}
+
 gboolean log_msg_write(LogMessage *self, SerializeArchive *sa);
 gboolean log_msg_read(LogMessage *self, SerializeArchive *sa);
 
@@ -332,6 +381,10 @@ void log_msg_merge_context(LogMessage *self, LogMessage **context, gsize context
 LogMessage *log_msg_new(const gchar *msg, gint length,
                         GSockAddr *saddr,
                         MsgFormatOptions *parse_options);
+LogMessage *log_msg_new_with_size_hint(const gchar *msg, gint length,
+                                       GSockAddr *saddr,
+                                       MsgFormatOptions *parse_options,
+                                       gsize payload_size_hint);
 LogMessage *log_msg_new_mark(void);
 LogMessage *log_msg_new_internal(gint prio, const gchar *msg);
 LogMessage *log_msg_new_empty(void);
@@ -357,5 +410,6 @@ void log_msg_registry_foreach(GHFunc func, gpointer user_data);
 gint log_msg_lookup_time_stamp_name(const gchar *name);
 
 gssize log_msg_get_size(LogMessage *self);
+gsize log_msg_get_payload_length(LogMessage *self);
 
 #endif
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "logmsg/name-index.h"
+#include "tls-support.h"
+#include "atomic.h"
+
+#include <string.h>
+
+#define NAME_INDEX_CACHE_SIZE 64
+
+typedef struct _NameIndexCacheEntry
+{
+  guint32 index_id;
+  gint generation;
+  guint32 hash;
+  guint32 value;
+  const gchar *name;
+} NameIndexCacheEntry;
+
+TLS_BLOCK_START
+{
+  NameIndexCacheEntry name_index_cache[NAME_INDEX_CACHE_SIZE];
+}
+TLS_BLOCK_END;
+
+#define name_index_cache  __tls_deref(name_index_cache)
+
+/* 0 is never assigned, so a zero initialized cache entry never matches */
+static GAtomicCounter name_index_last_id;
+
+static NameIndexTable *
+_table_new(guint32 size)
+{
+  NameIndexTable *table;
+
+  table = g_malloc0(sizeof(NameIndexTable) + size * sizeof(NameIndexSlot));
+  table->size = size;
+  return table;
+}
+
+/* the table is private to the writer at this point, no need for atomics */
+static void
+_table_insert_unpublished(NameIndexTable *table, const gchar *name, guint32 hash, gint value)
+{
+  guint32 mask = table->size - 1;
+  guint32 i;
+
+  for (i = hash & mask; table->slots[i].name; i = (i + 1) & mask)
+    ;
+  table->slots[i].hash = hash;
+  table->slots[i].value = value;
+  table->slots[i].name = name;
+  table->used++;
+}
+
+static void
+_grow(NameIndex *self)
+{
+  NameIndexTable *old_table = self->table;
+  NameIndexTable *new_table = _table_new(old_table->size * 2);
+  guint32 i;
+
+  for (i = 0; i < old_table->size; i++)
+    {
+      NameIndexSlot *slot = &old_table->slots[i];
+
+      if (slot->name)
+        _table_insert_unpublished(new_table, slot->name, slot->hash, slot->value);
+    }
+
+  g_atomic_pointer_set(&self->table, new_table);
+
+  /* readers might still be probing the old table */
+  g_ptr_array_add(self->retired_tables, old_table);
+}
+
+static NameIndexSlot *
+_lookup_slot(NameIndexTable *table, const gchar *name, guint32 hash)
+{
+  guint32 mask = table->size - 1;
+  guint32 i;
+
+  for (i = hash & mask; ; i = (i + 1) & mask)
+    {
+      NameIndexSlot *slot = &table->slots[i];
+      const gchar *slot_name = g_atomic_pointer_get(&slot->name);
+
+      if (!slot_name)
+        return NULL;
+      if (slot->hash == hash && strcmp(slot_name, name) == 0)
+        return slot;
+    }
+}
+
+gboolean
+name_index_lookup(NameIndex *self, const gchar *name, guint32 *value)
+{
+  guint32 hash = g_str_hash(name);
+  gint generation = g_atomic_int_get(&self->generation);
+  NameIndexCacheEntry *cached = &name_index_cache[hash & (NAME_INDEX_CACHE_SIZE - 1)];
+  NameIndexSlot *slot;
+
+  if (cached->index_id == self->id &&
+      cached->generation == generation &&
+      cached->hash == hash &&
+      strcmp(cached->name, name) == 0)
+    {
+      *value = cached->value;
+      return TRUE;
+    }
+
+  slot = _lookup_slot(g_atomic_pointer_get(&self->table), name, hash);
+  if (!slot)
+    return FALSE;
+
+  *value = (guint32) g_atomic_int_get(&slot->value);
+
+  cached->index_id = self->id;
+  cached->generation = generation;
+  cached->hash = hash;
+  cached->value = *value;
+  cached->name = slot->name;
+  return TRUE;
+}
+
+void
+name_index_insert(NameIndex *self, const gchar *name, guint32 value)
+{
+  guint32 hash = g_str_hash(name);
+  NameIndexTable *table = self->table;
+  NameIndexSlot *slot;
+  guint32 mask;
+  guint32 i;
+
+  slot = _lookup_slot(table, name, hash);
+  if (slot)
+    {
+      if ((guint32) slot->value != value)
+        {
+          g_atomic_int_set(&slot->value, (gint) value);
+          g_atomic_int_inc(&self->generation);
+        }
+      return;
+    }
+
+  /* keep the load factor below 50%, so probe sequences remain short */
+  if ((table->used + 1) * 2 > table->size)
+    {
+      _grow(self);
+      table = self->table;
+    }
+
+  mask = table->size - 1;
+  for (i = hash & mask; table->slots[i].name; i = (i + 1) & mask)
+    ;
+
+  slot = &table->slots[i];
+  slot->hash = hash;
+  slot->value = (gint) value;
+  table->used++;
+
+  /* publish the slot only after its payload is in place */
+  g_atomic_pointer_set(&slot->name, name);
+}
+
+NameIndex *
+name_index_new(guint32 initial_size)
+{
+  NameIndex *self = g_new0(NameIndex, 1);
+  guint32 size = 16;
+
+  while (size < initial_size)
+    size *= 2;
+
+  self->table = _table_new(size);
+  self->retired_tables = g_ptr_array_new_with_free_func(g_free);
+  self->id = (guint32) g_atomic_counter_exchange_and_add(&name_index_last_id, 1) + 1;
+  return self;
+}
+
+void
+name_index_free(NameIndex *self)
+{
+  g_free(self->table);
+  g_ptr_array_free(self->retired_tables, TRUE);
+  g_free(self);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef NAME_INDEX_H_INCLUDED
+#define NAME_INDEX_H_INCLUDED
+
+#include "syslog-ng.h"
+
+/*
+ * NameIndex: a read-mostly name -> numeric id map
+ *
+ * Lookups are lock-free: they probe an open addressing hash table that is
+ * only ever appended to, slots are published with an atomic store once
+ * they are fully initialized.  When the table needs to grow, a new, larger
+ * table is built and swapped in atomically, the old one is retained until
+ * the index is freed, as concurrent readers may still be probing it.
+ *
+ * Insertions are NOT synchronized, the caller has to serialize them (e.g.
+ * by holding the lock that protects the authoritative map).  The index
+ * does not own the names, they must remain valid while the index exists.
+ *
+ * Successful lookups are also stored in a small, per-thread, direct-mapped
+ * cache, so that the hottest names are resolved without touching shared
+ * cache lines at all.
+ */
+
+#define NAME_INDEX_INITIAL_SIZE 256
+
+typedef struct _NameIndexSlot
+{
+  const gchar *name;
+  guint32 hash;
+  gint value;
+} NameIndexSlot;
+
+typedef struct _NameIndexTable
+{
+  guint32 size;
+  guint32 used;
+  NameIndexSlot slots[0];
+} NameIndexTable;
+
+typedef struct _NameIndex
+{
+  NameIndexTable *table;
+  GPtrArray *retired_tables;
+  /* unique identifier of this index, used to validate per-thread cache entries */
+  guint32 id;
+  /* bumped whenever an existing name is rebound to a different value */
+  gint generation;
+} NameIndex;
+
+NameIndex *name_index_new(guint32 initial_size);
+void name_index_free(NameIndex *self);
+
+gboolean name_index_lookup(NameIndex *self, const gchar *name, guint32 *value);
+void name_index_insert(NameIndex *self, const gchar *name, guint32 value);
+
+#endif
@@ -317,6 +317,7 @@ nv_table_deserialize_22(SerializeArchive *sa)
     return NULL;
 
   res->ref_cnt = 1;
+  res->overlay = FALSE;
   res->borrowed = FALSE;
 
   if (!_deserialize_struct_22(sa, res))
@@ -452,6 +453,7 @@ nv_table_deserialize_legacy(SerializeArchive *sa)
   if (!res)
     return NULL;
 
+  res->overlay = FALSE;
   res->borrowed = FALSE;
   res->ref_cnt = 1;
 
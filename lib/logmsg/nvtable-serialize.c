@@ -149,6 +149,7 @@ _read_header(SerializeArchive *sa, NVTable **nvtable)
   if (!nv_table_alloc_check(res, 0))
     goto error;
 
+  res->overlay = FALSE;
   res->borrowed = FALSE;
   res->ref_cnt = 1;
   *nvtable = res;
@@ -231,13 +232,18 @@ _fill_meta_data(NVTable *self, NVTableMetaData *meta_data)
 }
 
 static void
-_write_payload(SerializeArchive *sa, NVTable *self)
+_write_payload(SerializeArchive *sa, NVTable *self, gboolean borrow_payload)
 {
-  serialize_write_blob(sa, NV_TABLE_ADDR(self, self->size - self->used), self->used);
+  /* the payload is stored in network independent format, so it can be
+   * referenced in place, as long as the table outlives the archive */
+  if (borrow_payload)
+    serialize_write_blob_ref(sa, NV_TABLE_ADDR(self, self->size - self->used), self->used);
+  else
+    serialize_write_blob(sa, NV_TABLE_ADDR(self, self->size - self->used), self->used);
 }
 
-gboolean
-nv_table_serialize(LogMessageSerializationState *state, NVTable *self)
+static gboolean
+_serialize_table(LogMessageSerializationState *state, NVTable *self, gboolean borrow_payload)
 {
   NVTableMetaData meta_data = { 0 };
   SerializeArchive *sa = state->sa;
@@ -247,6 +253,26 @@ nv_table_serialize(LogMessageSerializationState *state, NVTable *self)
 
   _write_struct(sa, self);
 
-  _write_payload(sa, self);
+  _write_payload(sa, self, borrow_payload);
   return TRUE;
 }
+
+gboolean
+nv_table_serialize(LogMessageSerializationState *state, NVTable *self)
+{
+  if (self->overlay)
+    {
+      /* overlays are written in the same format as any other table, the
+       * flattened copy is temporary, so its payload cannot be borrowed */
+      NVTable *flattened = nv_table_flatten(self, 0);
+      gboolean result;
+
+      if (!flattened)
+        return FALSE;
+      result = _serialize_table(state, flattened, FALSE);
+      nv_table_unref(flattened);
+      return result;
+    }
+
+  return _serialize_table(state, self, TRUE);
+}
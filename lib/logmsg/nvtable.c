@@ -27,6 +27,13 @@
 #include <string.h>
 #include <stdlib.h>
 
+/* smaller tables are simply copied by nv_table_clone_cow() */
+#define NV_TABLE_OVERLAY_MIN_BASE_SIZE 1024
+/* initial size of an overlay as compared to the used bytes of its base, the
+ * overlay is flattened once it outgrows this */
+#define NV_TABLE_OVERLAY_RATIO 4
+#define NV_TABLE_OVERLAY_INDEX_SIZE_HINT 4
+
 GStaticMutex nv_registry_lock = G_STATIC_MUTEX_INIT;
 
 const gchar *null_string = "";
@@ -34,11 +41,10 @@ const gchar *null_string = "";
 NVHandle
 nv_registry_get_handle(NVRegistry *self, const gchar *name)
 {
-  gpointer p;
+  guint32 handle;
 
-  p = g_hash_table_lookup(self->name_map, name);
-  if (p)
-    return GPOINTER_TO_UINT(p);
+  if (name_index_lookup(self->name_index, name, &handle))
+    return handle;
   return 0;
 }
 
@@ -50,6 +56,11 @@ nv_registry_alloc_handle(NVRegistry *self, const gchar *name)
   gsize len;
   NVHandle res = 0;
 
+  /* fast path: names are registered only once, but resolved for every
+   * message, so don't serialize on the lock if it is already known */
+  if (name_index_lookup(self->name_index, name, &res))
+    return res;
+
   g_static_mutex_lock(&nv_registry_lock);
   p = g_hash_table_lookup(self->name_map, name);
   if (p)
@@ -87,6 +98,7 @@ nv_registry_alloc_handle(NVRegistry *self, const gchar *name)
   nvhandle_desc_array_append(self->names, &stored);
   g_hash_table_insert(self->name_map, stored.name, GUINT_TO_POINTER(self->names->len));
   res = self->names->len;
+  name_index_insert(self->name_index, stored.name, res);
 exit:
   g_static_mutex_unlock(&nv_registry_lock);
   return res;
@@ -100,8 +112,15 @@ exit:
 void
 nv_registry_add_alias(NVRegistry *self, NVHandle handle, const gchar *alias)
 {
+  gpointer stored_alias;
+
   g_static_mutex_lock(&nv_registry_lock);
   g_hash_table_insert(self->name_map, g_strdup(alias), GUINT_TO_POINTER((glong) handle));
+
+  /* name_index references the key stored in name_map, which remains the
+   * original one if the alias was registered earlier */
+  g_hash_table_lookup_extended(self->name_map, alias, &stored_alias, NULL);
+  name_index_insert(self->name_index, stored_alias, handle);
   g_static_mutex_unlock(&nv_registry_lock);
 }
 
@@ -132,6 +151,7 @@ nv_registry_new(const gchar **static_names, guint32 nvhandle_max_value)
   self->nvhandle_max_value = nvhandle_max_value;
   self->name_map = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
   self->names = nvhandle_desc_array_new(NVHANDLE_DESC_ARRAY_INITIAL_SIZE);
+  self->name_index = name_index_new(NAME_INDEX_INITIAL_SIZE);
   for (i = 0; static_names[i]; i++)
     {
       nv_registry_alloc_handle(self, static_names[i]);
@@ -143,6 +163,7 @@ void
 nv_registry_free(NVRegistry *self)
 {
   nvhandle_desc_array_free(self->names);
+  name_index_free(self->name_index);
   g_hash_table_destroy(self->name_map);
   g_free(self);
 }
@@ -365,12 +386,21 @@ nv_table_add_value(NVTable *self, NVHandle handle, const gchar *name, gsize name
   NVEntry *entry;
   guint32 ofs;
   NVIndexEntry *index_entry;
+  gboolean inherited = FALSE;
 
   if (value_len > NV_TABLE_MAX_BYTES)
     value_len = NV_TABLE_MAX_BYTES;
   if (new_entry)
     *new_entry = FALSE;
   entry = nv_table_get_entry(self, handle, &index_entry);
+  if (G_UNLIKELY(entry && !nv_table_is_own_entry(self, entry)))
+    {
+      /* indirect entries of the base refer to this value, the overlay
+       * needs to be flattened by nv_table_realloc() first */
+      if (entry->referenced)
+        return FALSE;
+      inherited = TRUE;
+    }
   if (G_UNLIKELY(entry && !entry->indirect && entry->referenced))
     {
       gpointer data[2] = { self, GUINT_TO_POINTER((glong) handle) };
@@ -383,7 +413,7 @@ nv_table_add_value(NVTable *self, NVHandle handle, const gchar *name, gsize name
           return FALSE;
         }
     }
-  if (G_UNLIKELY(entry && (((guint) entry->alloc_len)) >= value_len + NV_ENTRY_DIRECT_HDR + name_len + 2))
+  if (G_UNLIKELY(entry && !inherited && (((guint) entry->alloc_len)) >= value_len + NV_ENTRY_DIRECT_HDR + name_len + 2))
     {
       gchar *dst;
       /* this value already exists and the new value fits in the old space */
@@ -438,14 +468,27 @@ nv_table_add_value(NVTable *self, NVHandle handle, const gchar *name, gsize name
   return TRUE;
 }
 
-void
+/* returns FALSE if the table needs to be reallocated */
+gboolean
 nv_table_unset_value(NVTable *self, NVHandle handle)
 {
   NVIndexEntry *index_entry;
   NVEntry *entry = nv_table_get_entry(self, handle, &index_entry);
 
   if (!entry)
-    return;
+    return TRUE;
+
+  if (G_UNLIKELY(!nv_table_is_own_entry(self, entry)))
+    {
+      /* shadow the value of the base with an unset entry */
+      if (entry->unset)
+        return TRUE;
+      if (entry->referenced)
+        return FALSE;
+      if (!nv_table_add_value(self, handle, nv_entry_get_name(entry), entry->name_len, null_string, 0, NULL))
+        return FALSE;
+      entry = nv_table_get_own_entry(self, handle, &index_entry);
+    }
   entry->unset = TRUE;
 
   /* make sure the actual value is also set to the null_string just in case
@@ -461,6 +504,7 @@ nv_table_unset_value(NVTable *self, NVHandle handle)
       entry->vdirect.value_len = 0;
       entry->vdirect.data[entry->name_len + 1] = 0;
     }
+  return TRUE;
 }
 
 static void
@@ -517,6 +561,7 @@ nv_table_add_value_indirect(NVTable *self, NVHandle handle, const gchar *name, g
   NVEntry *entry, *ref_entry;
   NVIndexEntry *index_entry;
   guint32 ofs;
+  gboolean inherited = FALSE;
 
   if (new_entry)
     *new_entry = FALSE;
@@ -529,8 +574,20 @@ nv_table_add_value_indirect(NVTable *self, NVHandle handle, const gchar *name, g
       return nv_table_copy_referenced_value(self, ref_entry, handle, name, name_len, referenced_slice, new_entry);
     }
 
+  if (ref_entry && !nv_table_is_own_entry(self, ref_entry))
+    {
+      /* the base of an overlay is read-only, we can't mark the entry as
+       * referenced, copy the value instead */
+      return nv_table_copy_referenced_value(self, ref_entry, handle, name, name_len, referenced_slice, new_entry);
+    }
 
   entry = nv_table_get_entry(self, handle, &index_entry);
+  if (G_UNLIKELY(entry && !nv_table_is_own_entry(self, entry)))
+    {
+      if (entry->referenced)
+        return FALSE;
+      inherited = TRUE;
+    }
   if ((!entry && !new_entry && referenced_slice->len == 0) || !ref_entry)
     {
       /* we don't store zero length matches unless the caller is
@@ -549,7 +606,7 @@ nv_table_add_value_indirect(NVTable *self, NVHandle handle, const gchar *name, g
         return FALSE;
     }
 
-  if (entry && (((guint) entry->alloc_len) >= NV_ENTRY_INDIRECT_HDR + name_len + 1))
+  if (entry && !inherited && (((guint) entry->alloc_len) >= NV_ENTRY_INDIRECT_HDR + name_len + 1))
     {
       /* this value already exists and the new reference fits in the old space */
       nv_table_set_indirect_entry(self, handle, entry, name, name_len, referenced_slice);
@@ -603,9 +660,55 @@ nv_table_foreach(NVTable *self, NVRegistry *registry, NVTableForeachFunc func, g
   return nv_table_foreach_entry(self, nv_table_call_foreach, data);
 }
 
+/* iterates the dynamic entries of an overlay and its base in handle order */
+static gboolean
+nv_table_foreach_overlay_index_entry(NVTable *self, NVTable *base, NVTableForeachEntryFunc func, gpointer user_data)
+{
+  NVIndexEntry *index_table = nv_table_get_index(self);
+  NVIndexEntry *base_index_table = nv_table_get_index(base);
+  NVIndexEntry *index_entry;
+  NVEntry *entry;
+  gint i = 0, j = 0;
+
+  while (i < self->index_size || j < base->index_size)
+    {
+      if (j >= base->index_size ||
+          (i < self->index_size && index_table[i].handle < base_index_table[j].handle))
+        {
+          index_entry = &index_table[i++];
+          entry = nv_table_get_entry_at_ofs(self, index_entry->ofs);
+        }
+      else if (i >= self->index_size || base_index_table[j].handle < index_table[i].handle)
+        {
+          index_entry = &base_index_table[j++];
+          entry = nv_table_get_entry_at_ofs(base, index_entry->ofs);
+        }
+      else
+        {
+          /* present in both, the overlay shadows the base */
+          index_entry = &index_table[i++];
+          entry = nv_table_get_entry_at_ofs(self, index_entry->ofs);
+          if (!entry)
+            {
+              index_entry = &base_index_table[j];
+              entry = nv_table_get_entry_at_ofs(base, index_entry->ofs);
+            }
+          j++;
+        }
+
+      if (!entry)
+        continue;
+
+      if (func(index_entry->handle, entry, index_entry, user_data))
+        return TRUE;
+    }
+  return FALSE;
+}
+
 gboolean
 nv_table_foreach_entry(NVTable *self, NVTableForeachEntryFunc func, gpointer user_data)
 {
+  NVTable *base = nv_table_get_base(self);
   NVIndexEntry *index_table;
   NVEntry *entry;
   gint i;
@@ -613,6 +716,8 @@ nv_table_foreach_entry(NVTable *self, NVTableForeachEntryFunc func, gpointer use
   for (i = 0; i < self->num_static_entries; i++)
     {
       entry = nv_table_get_entry_at_ofs(self, self->static_entries[i]);
+      if (!entry && base)
+        entry = nv_table_get_entry_at_ofs(base, base->static_entries[i]);
       if (!entry)
         continue;
 
@@ -620,6 +725,9 @@ nv_table_foreach_entry(NVTable *self, NVTableForeachEntryFunc func, gpointer use
         return TRUE;
     }
 
+  if (base)
+    return nv_table_foreach_overlay_index_entry(self, base, func, user_data);
+
   index_table = nv_table_get_index(self);
   for (i = 0; i < self->index_size; i++)
     {
@@ -644,6 +752,7 @@ nv_table_init(NVTable *self, gsize alloc_length, gint num_static_entries)
   self->index_size = 0;
   self->num_static_entries = num_static_entries;
   self->ref_cnt = 1;
+  self->overlay = FALSE;
   self->borrowed = FALSE;
   memset(&self->static_entries[0], 0, self->num_static_entries * sizeof(self->static_entries[0]));
 }
@@ -680,6 +789,18 @@ nv_table_realloc(NVTable *self, NVTable **new)
   gsize old_size = self->size;
   gsize new_size;
 
+  if (self->overlay)
+    {
+      NVTable *flattened = nv_table_flatten(self, self->size);
+
+      if (!flattened)
+        return FALSE;
+
+      nv_table_unref(self);
+      *new = flattened;
+      return TRUE;
+    }
+
   /* double the size of the current allocation */
   new_size = ((gsize) self->size) << 1;
   if (new_size > NV_TABLE_MAX_BYTES)
@@ -729,10 +850,23 @@ nv_table_unref(NVTable *self)
 {
   if ((--self->ref_cnt == 0) && !self->borrowed)
     {
-      g_free(self);
+      if (self->overlay)
+        g_free(((NVTable **) self) - 1);
+      else
+        g_free(self);
     }
 }
 
+static NVTable *
+nv_table_alloc_overlay(NVTable *base, gsize alloc_length)
+{
+  NVTable **base_ref = g_malloc(sizeof(NVTable *) + alloc_length);
+
+  /* the base pointer precedes the struct, see nv_table_get_base() */
+  *base_ref = base;
+  return (NVTable *) (base_ref + 1);
+}
+
 /**
  * nv_table_clone:
  * @self: payload to clone
@@ -754,7 +888,10 @@ nv_table_clone(NVTable *self, gint additional_space)
   if (new_size > NV_TABLE_MAX_BYTES)
     new_size = NV_TABLE_MAX_BYTES;
 
-  new = g_malloc(new_size);
+  if (self->overlay)
+    new = nv_table_alloc_overlay(nv_table_get_base(self), new_size);
+  else
+    new = g_malloc(new_size);
   memcpy(new, self, sizeof(NVTable) + self->num_static_entries * sizeof(self->static_entries[0]) + self->index_size *
          sizeof(NVIndexEntry));
   new->size = new_size;
@@ -767,3 +904,104 @@ nv_table_clone(NVTable *self, gint additional_space)
 
   return new;
 }
+
+/**
+ * nv_table_clone_cow:
+ * @self: payload to clone
+ * @additional_space: specifies how much additional space is needed in
+ *                    the newly allocated clone
+ *
+ * Returns a writable copy of @self, which is an overlay on top of @self
+ * for larger tables.  The caller must ensure that @self is neither
+ * changed nor freed as long as the returned instance exists.
+ **/
+NVTable *
+nv_table_clone_cow(NVTable *self, gint additional_space)
+{
+  NVTable *new;
+  gsize alloc_length;
+
+  /* overlays are not stacked, the clone of an overlay shares its base */
+  if (self->overlay || self->used < NV_TABLE_OVERLAY_MIN_BASE_SIZE)
+    return nv_table_clone(self, additional_space);
+
+  alloc_length = nv_table_get_alloc_size(self->num_static_entries, NV_TABLE_OVERLAY_INDEX_SIZE_HINT,
+                                         MAX(additional_space, self->used / NV_TABLE_OVERLAY_RATIO));
+  new = nv_table_alloc_overlay(self, alloc_length);
+  nv_table_init(new, alloc_length, self->num_static_entries);
+  new->overlay = TRUE;
+  return new;
+}
+
+static gboolean
+nv_table_measure_entry(NVHandle handle, NVEntry *entry, NVIndexEntry *index_entry, gpointer user_data)
+{
+  NVTable *self = (NVTable *) ((gpointer *) user_data)[0];
+  gsize *used = (gsize *) ((gpointer *) user_data)[1];
+  gint *index_size = (gint *) ((gpointer *) user_data)[2];
+
+  *used += entry->alloc_len;
+  if (handle > self->num_static_entries)
+    (*index_size)++;
+  return FALSE;
+}
+
+static gboolean
+nv_table_copy_entry(NVHandle handle, NVEntry *entry, NVIndexEntry *index_entry, gpointer user_data)
+{
+  NVTable *self = (NVTable *) user_data;
+  NVEntry *new_entry;
+  guint32 ofs;
+
+  new_entry = nv_table_alloc_value(self, entry->alloc_len);
+  memcpy(new_entry, entry, entry->alloc_len);
+  ofs = nv_table_get_ofs_for_an_entry(self, new_entry);
+
+  if (handle <= self->num_static_entries)
+    {
+      self->static_entries[handle - 1] = ofs;
+    }
+  else
+    {
+      /* entries are iterated in handle order, so the index remains sorted */
+      NVIndexEntry *index_table = nv_table_get_index(self);
+
+      index_table[self->index_size].handle = handle;
+      index_table[self->index_size].ofs = ofs;
+      self->index_size++;
+    }
+  return FALSE;
+}
+
+/**
+ * nv_table_flatten:
+ * @self: payload to flatten
+ * @additional_space: specifies how much additional space is needed in
+ *                    the newly allocated table
+ *
+ * Returns a standalone copy of @self, merging the base into overlays.
+ * Returns NULL if the result would exceed NV_TABLE_MAX_BYTES.
+ **/
+NVTable *
+nv_table_flatten(NVTable *self, gint additional_space)
+{
+  NVTable *new;
+  gsize used = 0;
+  gint index_size = 0;
+  gpointer data[3] = { self, &used, &index_size };
+  gsize alloc_length;
+
+  nv_table_foreach_entry(self, nv_table_measure_entry, data);
+
+  if (used + additional_space > NV_TABLE_MAX_BYTES)
+    return NULL;
+  alloc_length = nv_table_get_alloc_size(self->num_static_entries, index_size, used + additional_space);
+  if (used + sizeof(NVTable) + self->num_static_entries * sizeof(self->static_entries[0]) +
+      index_size * sizeof(NVIndexEntry) > alloc_length)
+    return NULL;
+
+  new = (NVTable *) g_malloc(alloc_length);
+  nv_table_init(new, alloc_length, self->num_static_entries);
+  nv_table_foreach_entry(self, nv_table_copy_entry, new);
+  return new;
+}
@@ -27,6 +27,7 @@
 
 #include "syslog-ng.h"
 #include "nvhandle-descriptors.h"
+#include "name-index.h"
 
 typedef struct _NVTable NVTable;
 typedef struct _NVRegistry NVRegistry;
@@ -60,7 +61,10 @@ struct _NVRegistry
   /* number of static names that are statically allocated in each payload */
   gint num_static_names;
   NVHandleDescArray *names;
+  /* owns the names, only accessed while holding nv_registry_lock */
   GHashTable *name_map;
+  /* lock-free mirror of name_map, used to resolve already registered names */
+  NameIndex *name_index;
   guint32 nvhandle_max_value;
 };
 
@@ -212,6 +216,32 @@ nv_entry_get_name(NVEntry *self)
  *   - It is possible to clone an NVTable, which basically copies the
  *     underlying memory contents.
  *
+ * Overlays
+ * ========
+ *   - nv_table_clone_cow() does not copy larger tables, rather it creates
+ *     an overlay: an initially empty table that refers to the original
+ *     (base) table and only stores the values changed in the clone.
+ *
+ *   - lookups fall back to the base table for values not present in the
+ *     overlay, unset values are represented by entries with the unset flag
+ *     in the overlay.
+ *
+ *   - the base table is never changed through the overlay and it is not
+ *     reference counted by the overlay either: it is the caller's
+ *     responsibility to keep it alive and unchanged (LogMessage does that
+ *     by referencing and write protecting the original message).
+ *
+ *   - the pointer to the base table is stored right in front of the
+ *     struct, so the layout of the NVTable itself remains unchanged.
+ *
+ *   - once the overlay runs out of space, nv_table_realloc() flattens it
+ *     into a standalone table, just like an ordinary clone would have
+ *     been.  Values referenced by indirect entries of the base are not
+ *     shadowed in the overlay, in that case the table is flattened too.
+ *
+ *   - serialization always writes flattened tables, so the on-disk format
+ *     is not affected.
+ *
  * Limits
  * ======
  * There might be various assumptions here and there in the code that fields
@@ -235,7 +265,8 @@ struct _NVTable
    * versions, but index_size is a more descriptive name */
   guint16 index_size;
   guint8 num_static_entries;
-  guint8 ref_cnt:7,
+  guint8 ref_cnt:6,
+         overlay:1,  /* the table is an overlay on top of a base table, see above */
          borrowed:1; /* specifies if the memory used by NVTable was borrowed from the container struct */
 
   /* variable data, see memory layout in the comment above */
@@ -260,7 +291,7 @@ struct _NVTable
 
 gboolean nv_table_add_value(NVTable *self, NVHandle handle, const gchar *name, gsize name_len, const gchar *value,
                             gsize value_len, gboolean *new_entry);
-void nv_table_unset_value(NVTable *self, NVHandle handle);
+gboolean nv_table_unset_value(NVTable *self, NVHandle handle);
 gboolean nv_table_add_value_indirect(NVTable *self, NVHandle handle, const gchar *name, gsize name_len,
                                      NVReferencedSlice *referenced_slice, gboolean *new_entry);
 
@@ -271,6 +302,8 @@ NVTable *nv_table_new(gint num_static_values, gint index_size_hint, gint init_le
 NVTable *nv_table_init_borrowed(gpointer space, gsize space_len, gint num_static_entries);
 gboolean nv_table_realloc(NVTable *self, NVTable **new);
 NVTable *nv_table_clone(NVTable *self, gint additional_space);
+NVTable *nv_table_clone_cow(NVTable *self, gint additional_space);
+NVTable *nv_table_flatten(NVTable *self, gint additional_space);
 NVTable *nv_table_ref(NVTable *self);
 void nv_table_unref(NVTable *self);
 
@@ -321,6 +354,20 @@ NVEntry *nv_table_get_entry_slow(NVTable *self, NVHandle handle, NVIndexEntry **
 const gchar *nv_table_resolve_indirect(NVTable *self, NVEntry *entry, gssize *len);
 
 
+static inline NVTable *
+nv_table_get_base(NVTable *self)
+{
+  if (G_LIKELY(!self->overlay))
+    return NULL;
+  return ((NVTable **) self)[-1];
+}
+
+static inline gboolean
+nv_table_is_own_entry(NVTable *self, NVEntry *entry)
+{
+  return !self->overlay || ((gchar *) entry > (gchar *) self && (gchar *) entry < nv_table_get_top(self));
+}
+
 static inline NVEntry *
 __nv_table_get_entry(NVTable *self, NVHandle handle, guint16 num_static_entries, NVIndexEntry **index_entry)
 {
@@ -346,12 +393,32 @@ __nv_table_get_entry(NVTable *self, NVHandle handle, guint16 num_static_entries,
     }
 }
 
+/* only looks at the entries stored in @self, even if it is an overlay */
 static inline NVEntry *
-nv_table_get_entry(NVTable *self, NVHandle handle, NVIndexEntry **index_entry)
+nv_table_get_own_entry(NVTable *self, NVHandle handle, NVIndexEntry **index_entry)
 {
   return __nv_table_get_entry(self, handle, self->num_static_entries, index_entry);
 }
 
+/*
+ * NOTE: for overlays the returned entry may belong to the base table, in
+ * which case @index_entry is NULL, use nv_table_is_own_entry() before
+ * changing the entry.
+ */
+static inline NVEntry *
+nv_table_get_entry(NVTable *self, NVHandle handle, NVIndexEntry **index_entry)
+{
+  NVEntry *entry = nv_table_get_own_entry(self, handle, index_entry);
+
+  if (G_UNLIKELY(!entry && self->overlay))
+    {
+      NVIndexEntry *base_index_entry;
+
+      return nv_table_get_own_entry(nv_table_get_base(self), handle, &base_index_entry);
+    }
+  return entry;
+}
+
 static inline gboolean
 nv_table_is_value_set(NVTable *self, NVHandle handle)
 {
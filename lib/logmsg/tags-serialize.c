@@ -53,7 +53,8 @@ static gboolean
 _callback(const LogMessage *msg, LogTagId tag_id, const gchar *name, gpointer user_data)
 {
   SerializeArchive *sa = ( SerializeArchive *)user_data;
-  serialize_write_cstring(sa, name, strlen(name));
+  /* tag names are never freed while messages exist, no need to copy them */
+  serialize_write_cstring_ref(sa, name, strlen(name));
   return TRUE;
 }
 
@@ -24,6 +24,7 @@
  */
 
 #include "tags.h"
+#include "name-index.h"
 #include "messages.h"
 #include "stats/stats-registry.h"
 
@@ -35,12 +36,69 @@ typedef struct _LogTag
   StatsCounterItem *counter;
 } LogTag;
 
-static LogTag *log_tags_list = NULL;
-static GHashTable *log_tags_hash = NULL;
-static guint32 log_tags_num = 0;
-static guint32 log_tags_list_size = 4;
+/*
+ * Tags are stored in fixed size chunks, so that their address remains
+ * stable as new tags are added.  This makes it possible to access
+ * existing tags without locking: log_tags_num is only incremented once
+ * the new entry is filled in, and log_tags_index publishes the name only
+ * after that.
+ *
+ * log_tags_lock serializes the registration of new tags.
+ */
+#define LOG_TAGS_CHUNK_BITS 8
+#define LOG_TAGS_CHUNK_SIZE (1 << LOG_TAGS_CHUNK_BITS)
+#define LOG_TAGS_CHUNK_MASK (LOG_TAGS_CHUNK_SIZE - 1)
+
+static LogTag *log_tags_chunks[LOG_TAGS_MAX / LOG_TAGS_CHUNK_SIZE];
+static NameIndex *log_tags_index = NULL;
+static gint log_tags_num = 0;
 static GStaticMutex log_tags_lock = G_STATIC_MUTEX_INIT;
 
+static inline LogTag *
+_get_tag(LogTagId id)
+{
+  LogTag *chunk = g_atomic_pointer_get(&log_tags_chunks[id >> LOG_TAGS_CHUNK_BITS]);
+
+  return &chunk[id & LOG_TAGS_CHUNK_MASK];
+}
+
+static inline gboolean
+_is_valid_id(LogTagId id)
+{
+  return id < (guint) g_atomic_int_get(&log_tags_num);
+}
+
+static void
+_register_counter(LogTag *tag)
+{
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_logpipe_key_set(&sc_key, SCS_TAG, tag->name, NULL );
+  stats_register_counter(3, &sc_key, SC_TYPE_PROCESSED, &tag->counter);
+  stats_unlock();
+}
+
+/* must be called with log_tags_lock held */
+static LogTag *
+_add_tag(const gchar *name)
+{
+  LogTagId id = log_tags_num;
+  LogTag **chunk = &log_tags_chunks[id >> LOG_TAGS_CHUNK_BITS];
+  LogTag *tag;
+
+  if (!*chunk)
+    g_atomic_pointer_set(chunk, g_new0(LogTag, LOG_TAGS_CHUNK_SIZE));
+
+  tag = _get_tag(id);
+  tag->id = id;
+  tag->name = g_strdup(name);
+  tag->counter = NULL;
+
+  g_atomic_int_set(&log_tags_num, id + 1);
+  name_index_insert(log_tags_index, tag->name, id);
+  return tag;
+}
 
 /*
  * log_tags_get_by_name
@@ -50,51 +108,38 @@ static GStaticMutex log_tags_lock = G_STATIC_MUTEX_INIT;
  *
  * The function returns the tag id associated with the name.
  *
+ * Looking up an existing tag is lock-free, so it is cheap enough to be
+ * called for every message.
+ *
  * @name:   the name of the tag
  *
  */
 LogTagId
 log_tags_get_by_name(const gchar *name)
 {
-  /* If log_tags_hash() is NULL, this unit is already deinitialized
+  /* If log_tags_index is NULL, this unit is already deinitialized
      but other thread may refer the tag structure.
 
      If name is empty, it is an extremal element.
 
      In both cases the return value is 0.
    */
-  guint id;
+  LogTag *new_tag = NULL;
+  guint32 id;
+
+  g_assert(log_tags_index != NULL);
 
-  g_assert(log_tags_hash != NULL);
+  if (name_index_lookup(log_tags_index, name, &id))
+    return id;
 
   g_static_mutex_lock(&log_tags_lock);
 
-  id = GPOINTER_TO_UINT(g_hash_table_lookup(log_tags_hash, name)) - 1;
-  if (id == 0xffffffff)
+  if (!name_index_lookup(log_tags_index, name, &id))
     {
       if (log_tags_num < LOG_TAGS_MAX - 1)
         {
-          id = log_tags_num++;
-          if (id == log_tags_list_size)
-            {
-              log_tags_list_size *= 2;
-              log_tags_list = g_renew(LogTag, log_tags_list, log_tags_list_size);
-            }
-          log_tags_list[id].id = id;
-          log_tags_list[id].name = g_strdup(name);
-          log_tags_list[id].counter = NULL;
-
-          /* NOTE: stats-level may not be set for calls that happen during
-           * config file parsing, those get fixed up by
-           * log_tags_reinit_stats() below */
-
-          stats_lock();
-          StatsClusterKey sc_key;
-          stats_cluster_logpipe_key_set(&sc_key, SCS_TAG, name, NULL );
-          stats_register_counter(3, &sc_key, SC_TYPE_PROCESSED, &log_tags_list[id].counter);
-          stats_unlock();
-
-          g_hash_table_insert(log_tags_hash, log_tags_list[id].name, GUINT_TO_POINTER(log_tags_list[id].id + 1));
+          new_tag = _add_tag(name);
+          id = new_tag->id;
         }
       else
         id = 0;
@@ -102,6 +147,14 @@ log_tags_get_by_name(const gchar *name)
 
   g_static_mutex_unlock(&log_tags_lock);
 
+  /* NOTE: the counter is registered once per tag, outside of
+   * log_tags_lock, so concurrent lookups are not held up by stats_lock().
+   * stats-level may not be set for calls that happen during config file
+   * parsing, those get fixed up by log_tags_reinit_stats() below */
+
+  if (new_tag)
+    _register_counter(new_tag);
+
   return id;
 }
 
@@ -120,39 +173,24 @@ log_tags_get_by_name(const gchar *name)
 const gchar *
 log_tags_get_by_id(LogTagId id)
 {
-  gchar *name = NULL;
-
-  g_static_mutex_lock(&log_tags_lock);
+  if (!_is_valid_id(id))
+    return NULL;
 
-  if (id < log_tags_num)
-    name = log_tags_list[id].name;
-
-  g_static_mutex_unlock(&log_tags_lock);
-
-  return name;
+  return _get_tag(id)->name;
 }
 
 void
 log_tags_inc_counter(LogTagId id)
 {
-  g_static_mutex_lock(&log_tags_lock);
-
-  if (id < log_tags_num)
-    stats_counter_inc(log_tags_list[id].counter);
-
-  g_static_mutex_unlock(&log_tags_lock);
+  if (_is_valid_id(id))
+    stats_counter_inc(g_atomic_pointer_get(&_get_tag(id)->counter));
 }
 
 void
 log_tags_dec_counter(LogTagId id)
 {
-  /* Reader lock because the log_tag_list is not written */
-  g_static_mutex_lock(&log_tags_lock);
-
-  if (id < log_tags_num)
-    stats_counter_dec(log_tags_list[id].counter);
-
-  g_static_mutex_unlock(&log_tags_lock);
+  if (_is_valid_id(id))
+    stats_counter_dec(g_atomic_pointer_get(&_get_tag(id)->counter));
 }
 
 /*
@@ -168,20 +206,20 @@ log_tags_dec_counter(LogTagId id)
 void
 log_tags_reinit_stats(void)
 {
-  gint id;
+  gint id, num = g_atomic_int_get(&log_tags_num);
 
   stats_lock();
 
-  for (id = 0; id < log_tags_num; id++)
+  for (id = 0; id < num; id++)
     {
-      const gchar *name = log_tags_list[id].name;
+      LogTag *tag = _get_tag(id);
       StatsClusterKey sc_key;
-      stats_cluster_logpipe_key_set(&sc_key, SCS_TAG, name, NULL );
+      stats_cluster_logpipe_key_set(&sc_key, SCS_TAG, tag->name, NULL );
 
       if (stats_check_level(3))
-        stats_register_counter(3, &sc_key, SC_TYPE_PROCESSED, &log_tags_list[id].counter);
+        stats_register_counter(3, &sc_key, SC_TYPE_PROCESSED, &tag->counter);
       else
-        stats_unregister_counter(&sc_key, SC_TYPE_PROCESSED, &log_tags_list[id].counter);
+        stats_unregister_counter(&sc_key, SC_TYPE_PROCESSED, &tag->counter);
     }
 
   stats_unlock();
@@ -193,13 +231,9 @@ log_tags_global_init(void)
   /* Necessary only in case of reinitialized tags */
   g_static_mutex_lock(&log_tags_lock);
 
-  log_tags_hash = g_hash_table_new(g_str_hash, g_str_equal);
-
-  log_tags_list_size = 4;
+  log_tags_index = name_index_new(NAME_INDEX_INITIAL_SIZE);
   log_tags_num = 0;
 
-  log_tags_list = g_new0(LogTag, log_tags_list_size);
-
   g_static_mutex_unlock(&log_tags_lock);
 }
 
@@ -210,22 +244,28 @@ log_tags_global_deinit(void)
 
   g_static_mutex_lock(&log_tags_lock);
 
-  g_hash_table_destroy(log_tags_hash);
+  name_index_free(log_tags_index);
 
   stats_lock();
   StatsClusterKey sc_key;
   for (i = 0; i < log_tags_num; i++)
     {
-      stats_cluster_logpipe_key_set(&sc_key, SCS_TAG, log_tags_list[i].name, NULL );
-      stats_unregister_counter(&sc_key, SC_TYPE_PROCESSED, &log_tags_list[i].counter);
-      g_free(log_tags_list[i].name);
+      LogTag *tag = _get_tag(i);
+
+      stats_cluster_logpipe_key_set(&sc_key, SCS_TAG, tag->name, NULL );
+      stats_unregister_counter(&sc_key, SC_TYPE_PROCESSED, &tag->counter);
+      g_free(tag->name);
     }
   stats_unlock();
 
+  for (i = 0; i < G_N_ELEMENTS(log_tags_chunks); i++)
+    {
+      g_free(log_tags_chunks[i]);
+      log_tags_chunks[i] = NULL;
+    }
+
   log_tags_num = 0;
-  g_free(log_tags_list);
-  log_tags_list = NULL;
-  log_tags_hash = NULL;
+  log_tags_index = NULL;
 
   g_static_mutex_unlock(&log_tags_lock);
 }
@@ -525,6 +525,48 @@ Test(log_message, test_message_size)
   log_msg_unref(msg);
 }
 
+static void
+_add_many_values(LogMessage *msg)
+{
+  gchar name[32];
+  gint i;
+
+  for (i = 0; i < 64; i++)
+    {
+      g_snprintf(name, sizeof(name), "json.key%d", i);
+      log_msg_set_value_by_name(msg, name, "some longer value extracted by a parser", -1);
+    }
+}
+
+Test(log_message, test_payload_reallocs_are_counted)
+{
+  LogMessage *msg = _construct_log_message();
+
+  cr_assert_eq(msg->num_payload_reallocs, 0);
+  _add_many_values(msg);
+  cr_assert_gt(msg->num_payload_reallocs, 0);
+  log_msg_unref(msg);
+}
+
+Test(log_message, test_payload_size_hint_avoids_payload_reallocs)
+{
+  const gchar *raw_msg = "foo";
+  LogMessage *msg;
+  gsize payload_length;
+
+  msg = _construct_log_message();
+  _add_many_values(msg);
+  payload_length = log_msg_get_payload_length(msg);
+  log_msg_unref(msg);
+
+  msg = log_msg_new_with_size_hint(raw_msg, strlen(raw_msg), NULL, &parse_options, payload_length);
+  log_msg_set_value(msg, LM_V_HOST, raw_msg, -1);
+  _add_many_values(msg);
+  cr_assert_eq(msg->num_payload_reallocs, 0);
+  cr_assert_leq(log_msg_get_payload_length(msg), payload_length);
+  log_msg_unref(msg);
+}
+
 Test(log_message, when_get_indirect_value_with_null_value_len_abort_instead_of_sigsegv, .signal=SIGABRT)
 {
   LogMessageTestParams *params = log_message_test_params_new();
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "logmsg/logmsg.h"
+#include "logmsg/logmsg-pool.h"
+#include "stats/stats-registry.h"
+#include "apphook.h"
+
+extern StatsCounterItem *stats_msg_pool_hits;
+extern StatsCounterItem *stats_msg_pool_misses;
+extern StatsCounterItem *stats_msg_pool_resident_bytes;
+
+static LogMessage *
+_create_message(void)
+{
+  LogMessage *msg = log_msg_new_empty();
+
+  log_msg_set_value(msg, LM_V_MESSAGE, "pooled message", -1);
+  return msg;
+}
+
+static gpointer
+_unref_message_in_thread(gpointer user_data)
+{
+  LogMessage *msg = (LogMessage *) user_data;
+
+  app_thread_start();
+  log_msg_unref(msg);
+  app_thread_stop();
+  return NULL;
+}
+
+Test(logmsg_pool, messages_are_not_pooled_by_default)
+{
+  LogMessage *msg;
+
+  log_msg_pool_set_enabled(FALSE);
+
+  msg = _create_message();
+  log_msg_unref(msg);
+  msg = _create_message();
+  log_msg_unref(msg);
+  log_msg_pool_update_stats();
+
+  cr_assert_eq(stats_counter_get(stats_msg_pool_hits), 0);
+  cr_assert_eq(stats_counter_get(stats_msg_pool_misses), 0);
+}
+
+Test(logmsg_pool, freed_messages_are_reused_by_the_same_thread)
+{
+  LogMessage *msg;
+
+  msg = _create_message();
+  log_msg_unref(msg);
+  log_msg_pool_update_stats();
+  cr_assert_eq(stats_counter_get(stats_msg_pool_misses), 1);
+  cr_assert_eq(stats_counter_get(stats_msg_pool_hits), 0);
+  cr_assert_gt(stats_counter_get(stats_msg_pool_resident_bytes), 0);
+
+  msg = _create_message();
+  cr_assert_str_eq(log_msg_get_value(msg, LM_V_MESSAGE, NULL), "pooled message");
+  log_msg_unref(msg);
+  log_msg_pool_update_stats();
+  cr_assert_eq(stats_counter_get(stats_msg_pool_misses), 1);
+  cr_assert_eq(stats_counter_get(stats_msg_pool_hits), 1);
+}
+
+Test(logmsg_pool, messages_freed_by_another_thread_are_returned_to_their_origin)
+{
+  LogMessage *msg;
+  GThread *thread;
+
+  msg = _create_message();
+  thread = g_thread_create(_unref_message_in_thread, msg, TRUE, NULL);
+  g_thread_join(thread);
+
+  msg = _create_message();
+  log_msg_unref(msg);
+  log_msg_pool_update_stats();
+  cr_assert_eq(stats_counter_get(stats_msg_pool_misses), 1);
+  cr_assert_eq(stats_counter_get(stats_msg_pool_hits), 1);
+}
+
+Test(logmsg_pool, resident_bytes_are_released_when_the_thread_stops)
+{
+  LogMessage *msg;
+
+  msg = _create_message();
+  log_msg_unref(msg);
+
+  log_msg_pool_allocator_deinit();
+  cr_assert_eq(stats_counter_get(stats_msg_pool_resident_bytes), 0);
+  log_msg_pool_allocator_init();
+}
+
+static void
+setup(void)
+{
+  app_startup();
+  log_msg_pool_global_init();
+  log_msg_pool_set_enabled(TRUE);
+}
+
+static void
+teardown(void)
+{
+  log_msg_pool_set_enabled(FALSE);
+  app_shutdown();
+}
+
+TestSuite(logmsg_pool, .init = setup, .fini = teardown);
@@ -29,6 +29,7 @@
 #include "cfg.h"
 #include "plugin.h"
 #include "logmsg/logmsg-serialize.h"
+#include "logpipe.h"
 #include <criterion/criterion.h>
 
 GlobalConfig *cfg;
@@ -253,6 +254,86 @@ Test(logmsg_serialize, simple_serialization)
   g_string_free(stream, TRUE);
 }
 
+Test(logmsg_serialize, serialize_clone_with_overlay_payload)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT_NOACK;
+  LogMessage *msg = _create_message_to_be_serialized(RAW_MSG, strlen(RAW_MSG));
+  LogMessage *clone = log_msg_clone_cow(msg, &path_options);
+  GString *stream = g_string_sized_new(512);
+  SerializeArchive *sa = serialize_string_archive_new(stream);
+
+  log_msg_set_value(clone, LM_V_HOST, "otherhost", -1);
+  log_msg_set_value_by_name(clone, ".normal.dynamic.field3", "changed", -1);
+  cr_assert(clone->payload->overlay, ERROR_MSG);
+
+  log_msg_serialize(clone, sa);
+  log_msg_unref(clone);
+
+  clone = log_msg_new_empty();
+  cr_assert(log_msg_deserialize(clone, sa), ERROR_MSG);
+  cr_assert_not(clone->payload->overlay, ERROR_MSG);
+
+  cr_assert_str_eq(log_msg_get_value(clone, LM_V_HOST, NULL), "otherhost", ERROR_MSG);
+  cr_assert_str_eq(log_msg_get_value(clone, LM_V_PROGRAM, NULL), "evntslog", ERROR_MSG);
+  cr_assert_str_eq(log_msg_get_value_by_name(clone, ".normal.dynamic.field3", NULL), "changed", ERROR_MSG);
+  cr_assert_str_eq(log_msg_get_value_by_name(clone, ".normal.dynamic.field4", NULL), "value", ERROR_MSG);
+  cr_assert_str_eq(log_msg_get_value_by_name(clone, "aaa", NULL), "test_value", ERROR_MSG);
+  cr_assert_null(log_msg_get_value_if_set(clone, log_msg_get_value_handle("unset_value"), NULL), ERROR_MSG);
+
+  cr_assert_str_eq(log_msg_get_value(msg, LM_V_HOST, NULL), "mymachine", ERROR_MSG);
+  cr_assert_str_eq(log_msg_get_value_by_name(msg, ".normal.dynamic.field3", NULL), "value", ERROR_MSG);
+
+  log_msg_unref(clone);
+  log_msg_unref(msg);
+  serialize_archive_free(sa);
+  g_string_free(stream, TRUE);
+}
+
+Test(logmsg_serialize, serialize_to_iov_archive)
+{
+  LogMessage *msg = _create_message_to_be_serialized(RAW_MSG, strlen(RAW_MSG));
+  GString *stream = g_string_sized_new(512);
+  SerializeArchive *string_sa = serialize_string_archive_new(stream);
+  SerializeArchive *sa = serialize_iov_archive_new();
+  const struct iovec *iov;
+  const gchar *payload_start;
+  gboolean payload_borrowed = FALSE;
+  GString *gathered = g_string_sized_new(512);
+  gint iovcnt, i;
+
+  log_msg_set_tag_by_name(msg, "a-rather-long-tag-name-that-exceeds-the-copy-threshold-of-the-archive");
+  log_msg_serialize(msg, string_sa);
+  log_msg_serialize(msg, sa);
+
+  /* the iovecs concatenated give the same stream as the string archive */
+  iov = serialize_iov_archive_get_iov(sa, &iovcnt);
+  payload_start = NV_TABLE_ADDR(msg->payload, msg->payload->size - msg->payload->used);
+  for (i = 0; i < iovcnt; i++)
+    {
+      g_string_append_len(gathered, iov[i].iov_base, iov[i].iov_len);
+      if (iov[i].iov_base == payload_start)
+        payload_borrowed = TRUE;
+    }
+  cr_assert(payload_borrowed, "NVTable payload was copied instead of being referenced");
+  cr_assert_eq(gathered->len, stream->len, ERROR_MSG);
+  cr_assert_eq(serialize_iov_archive_get_length(sa), stream->len, ERROR_MSG);
+  cr_assert_arr_eq(gathered->str, stream->str, stream->len, ERROR_MSG);
+
+  /* the referenced data belongs to msg, which has to be alive while reading it back */
+  LogMessage *read_back = log_msg_new_empty();
+  cr_assert(log_msg_deserialize(read_back, sa), ERROR_MSG);
+  _check_deserialized_message(read_back, sa);
+  cr_assert(log_msg_is_tag_by_name(read_back, "a-rather-long-tag-name-that-exceeds-the-copy-threshold-of-the-archive"),
+            ERROR_MSG);
+
+  log_msg_unref(read_back);
+  log_msg_unref(msg);
+  serialize_archive_free(sa);
+  serialize_archive_free(string_sa);
+  g_string_free(gathered, TRUE);
+  g_string_free(stream, TRUE);
+}
+
 Test(logmsg_serialize, given_ts_processed)
 {
   LogMessage *msg = _create_message_to_be_serialized(RAW_MSG, strlen(RAW_MSG));
@@ -140,6 +140,73 @@ Test(nvtable, test_nv_registry)
   nv_registry_free(reg);
 }
 
+Test(nvtable, test_nv_registry_alias_can_be_rebound)
+{
+  const gchar *builtins[] = { "BUILTIN1", "BUILTIN2", NULL };
+  NVRegistry *reg = nv_registry_new(builtins, TEST_NVHANDLE_MAX_VALUE);
+
+  nv_registry_add_alias(reg, 1, "ALIAS");
+  cr_assert_eq(nv_registry_get_handle(reg, "ALIAS"), 1);
+
+  /* the per-thread lookup cache must not return the stale handle */
+  nv_registry_add_alias(reg, 2, "ALIAS");
+  cr_assert_eq(nv_registry_get_handle(reg, "ALIAS"), 2);
+  cr_assert_eq(nv_registry_alloc_handle(reg, "ALIAS"), 2);
+
+  nv_registry_free(reg);
+}
+
+#define CONCURRENT_REGISTRY_THREADS 8
+#define CONCURRENT_REGISTRY_NAMES 2000
+
+static gpointer
+_register_names_thread(gpointer user_data)
+{
+  NVRegistry *reg = (NVRegistry *) user_data;
+  NVHandle *handles = g_new0(NVHandle, CONCURRENT_REGISTRY_NAMES);
+  gint i;
+
+  for (i = 0; i < CONCURRENT_REGISTRY_NAMES; i++)
+    {
+      gchar name[32];
+
+      g_snprintf(name, sizeof(name), "DYN%05d", i);
+      handles[i] = nv_registry_alloc_handle(reg, name);
+    }
+  return handles;
+}
+
+Test(nvtable, test_nv_registry_concurrent_registrations_map_to_the_same_handle)
+{
+  const gchar *builtins[] = { "BUILTIN1", NULL };
+  NVRegistry *reg = nv_registry_new(builtins, NVHANDLE_MAX_VALUE);
+  GThread *threads[CONCURRENT_REGISTRY_THREADS];
+  NVHandle *handles[CONCURRENT_REGISTRY_THREADS];
+  gint i, j;
+
+  for (i = 0; i < CONCURRENT_REGISTRY_THREADS; i++)
+    threads[i] = g_thread_create(_register_names_thread, reg, TRUE, NULL);
+
+  for (i = 0; i < CONCURRENT_REGISTRY_THREADS; i++)
+    handles[i] = g_thread_join(threads[i]);
+
+  for (j = 0; j < CONCURRENT_REGISTRY_NAMES; j++)
+    {
+      gchar name[32];
+
+      g_snprintf(name, sizeof(name), "DYN%05d", j);
+      cr_assert_neq(handles[0][j], 0);
+      cr_assert_str_eq(nv_registry_get_handle_name(reg, handles[0][j], NULL), name);
+      cr_assert_eq(nv_registry_get_handle(reg, name), handles[0][j]);
+      for (i = 1; i < CONCURRENT_REGISTRY_THREADS; i++)
+        cr_assert_eq(handles[i][j], handles[0][j], "name resolved to different handles in different threads, name=%s", name);
+    }
+
+  for (i = 0; i < CONCURRENT_REGISTRY_THREADS; i++)
+    g_free(handles[i]);
+  nv_registry_free(reg);
+}
+
 /*
  *  - NVTable direct values
  *    - set/get static NV entries
@@ -1021,3 +1088,162 @@ Test(nvtable, test_nvtable_unset_values)
 
   nv_table_unref(tab);
 }
+
+/* overlays */
+
+#define FILLER_HANDLE (DYN_HANDLE + 2)
+#define FILLER_NAME "VAL19"
+#define OTHER_DYN_HANDLE (DYN_HANDLE + 4)
+#define OTHER_DYN_NAME "VAL21"
+
+static NVTable *
+_create_overlay_base(void)
+{
+  NVTable *tab;
+  gchar filler[2048];
+
+  memset(filler, 'x', sizeof(filler));
+  tab = nv_table_new(STATIC_VALUES, STATIC_VALUES, 4096);
+  cr_assert(nv_table_add_value(tab, STATIC_HANDLE, STATIC_NAME, strlen(STATIC_NAME), "static", 6, NULL));
+  cr_assert(nv_table_add_value(tab, DYN_HANDLE, DYN_NAME, strlen(DYN_NAME), "dynamic", 7, NULL));
+  cr_assert(nv_table_add_value(tab, FILLER_HANDLE, FILLER_NAME, strlen(FILLER_NAME), filler, sizeof(filler), NULL));
+  return tab;
+}
+
+static gboolean
+_collect_handles(NVHandle handle, const gchar *name, const gchar *value, gssize value_len, gpointer user_data)
+{
+  GArray *handles = (GArray *) user_data;
+
+  g_array_append_val(handles, handle);
+  return FALSE;
+}
+
+Test(nvtable, test_nvtable_clone_cow_of_small_tables_is_a_copy)
+{
+  NVTable *tab, *tab_clone;
+
+  tab = nv_table_new(STATIC_VALUES, STATIC_VALUES, 64);
+  cr_assert(nv_table_add_value(tab, STATIC_HANDLE, STATIC_NAME, strlen(STATIC_NAME), "value", 5, NULL));
+
+  tab_clone = nv_table_clone_cow(tab, 64);
+  cr_assert_not(tab_clone->overlay);
+  assert_nvtable(tab_clone, STATIC_HANDLE, "value", 5);
+
+  nv_table_unref(tab_clone);
+  nv_table_unref(tab);
+}
+
+Test(nvtable, test_nvtable_overlay_inherits_the_values_of_its_base)
+{
+  NVTable *tab, *overlay;
+
+  tab = _create_overlay_base();
+  overlay = nv_table_clone_cow(tab, 64);
+
+  cr_assert(overlay->overlay);
+  cr_assert_eq(nv_table_get_base(overlay), tab);
+  cr_assert_lt(overlay->size, tab->size);
+  assert_nvtable(overlay, STATIC_HANDLE, "static", 6);
+  assert_nvtable(overlay, DYN_HANDLE, "dynamic", 7);
+  cr_assert_not(nv_table_is_value_set(overlay, OTHER_DYN_HANDLE));
+
+  nv_table_unref(overlay);
+  nv_table_unref(tab);
+}
+
+Test(nvtable, test_nvtable_overlay_changes_leave_the_base_intact)
+{
+  NVTable *tab, *overlay;
+  gboolean new_entry;
+
+  tab = _create_overlay_base();
+  overlay = nv_table_clone_cow(tab, 64);
+
+  cr_assert(nv_table_add_value(overlay, STATIC_HANDLE, STATIC_NAME, strlen(STATIC_NAME), "changed", 7, &new_entry));
+  cr_assert_not(new_entry);
+  cr_assert(nv_table_add_value(overlay, DYN_HANDLE, DYN_NAME, strlen(DYN_NAME), "changed", 7, &new_entry));
+  cr_assert_not(new_entry);
+  cr_assert(nv_table_add_value(overlay, OTHER_DYN_HANDLE, OTHER_DYN_NAME, strlen(OTHER_DYN_NAME), "new", 3,
+                               &new_entry));
+  cr_assert(new_entry);
+  cr_assert(nv_table_unset_value(overlay, FILLER_HANDLE));
+
+  assert_nvtable(overlay, STATIC_HANDLE, "changed", 7);
+  assert_nvtable(overlay, DYN_HANDLE, "changed", 7);
+  assert_nvtable(overlay, OTHER_DYN_HANDLE, "new", 3);
+  cr_assert_null(nv_table_get_value_if_set(overlay, FILLER_HANDLE, NULL));
+
+  assert_nvtable(tab, STATIC_HANDLE, "static", 6);
+  assert_nvtable(tab, DYN_HANDLE, "dynamic", 7);
+  cr_assert_not(nv_table_is_value_set(tab, OTHER_DYN_HANDLE));
+  cr_assert_not_null(nv_table_get_value_if_set(tab, FILLER_HANDLE, NULL));
+
+  nv_table_unref(overlay);
+  nv_table_unref(tab);
+}
+
+Test(nvtable, test_nvtable_overlay_foreach_merges_the_base_in_handle_order)
+{
+  NVTable *tab, *overlay;
+  GArray *handles = g_array_new(FALSE, FALSE, sizeof(NVHandle));
+  NVHandle expected[] = { STATIC_HANDLE, DYN_HANDLE, FILLER_HANDLE, OTHER_DYN_HANDLE };
+
+  tab = _create_overlay_base();
+  overlay = nv_table_clone_cow(tab, 64);
+  cr_assert(nv_table_add_value(overlay, OTHER_DYN_HANDLE, OTHER_DYN_NAME, strlen(OTHER_DYN_NAME), "new", 3, NULL));
+  cr_assert(nv_table_add_value(overlay, DYN_HANDLE, DYN_NAME, strlen(DYN_NAME), "changed", 7, NULL));
+
+  nv_table_foreach(overlay, logmsg_registry, _collect_handles, handles);
+  cr_assert_eq(handles->len, G_N_ELEMENTS(expected));
+  cr_assert_arr_eq(handles->data, expected, sizeof(expected));
+
+  g_array_free(handles, TRUE);
+  nv_table_unref(overlay);
+  nv_table_unref(tab);
+}
+
+Test(nvtable, test_nvtable_overlay_is_flattened_when_it_grows)
+{
+  NVTable *tab, *overlay;
+
+  tab = _create_overlay_base();
+  overlay = nv_table_clone_cow(tab, 64);
+  cr_assert(nv_table_add_value(overlay, DYN_HANDLE, DYN_NAME, strlen(DYN_NAME), "changed", 7, NULL));
+  cr_assert(nv_table_unset_value(overlay, STATIC_HANDLE));
+
+  cr_assert(nv_table_realloc(overlay, &overlay));
+  cr_assert_not(overlay->overlay);
+  cr_assert_null(nv_table_get_base(overlay));
+  cr_assert_null(nv_table_get_value_if_set(overlay, STATIC_HANDLE, NULL));
+  assert_nvtable(overlay, DYN_HANDLE, "changed", 7);
+  cr_assert_not_null(nv_table_get_value_if_set(overlay, FILLER_HANDLE, NULL));
+
+  nv_table_unref(tab);
+  cr_assert(nv_table_add_value(overlay, OTHER_DYN_HANDLE, OTHER_DYN_NAME, strlen(OTHER_DYN_NAME), "new", 3, NULL));
+  assert_nvtable(overlay, OTHER_DYN_HANDLE, "new", 3);
+  nv_table_unref(overlay);
+}
+
+Test(nvtable, test_nvtable_overlay_values_referenced_by_the_base_need_flattening)
+{
+  NVTable *tab, *overlay;
+  NVReferencedSlice ref_slice = { .handle = DYN_HANDLE, .ofs = 0, .len = 3, .type = 0 };
+
+  tab = _create_overlay_base();
+  cr_assert(nv_table_add_value_indirect(tab, OTHER_DYN_HANDLE, OTHER_DYN_NAME, strlen(OTHER_DYN_NAME), &ref_slice,
+                                        NULL));
+  assert_nvtable(tab, OTHER_DYN_HANDLE, "dyn", 3);
+
+  overlay = nv_table_clone_cow(tab, 64);
+  cr_assert_not(nv_table_add_value(overlay, DYN_HANDLE, DYN_NAME, strlen(DYN_NAME), "changed", 7, NULL));
+  cr_assert(nv_table_realloc(overlay, &overlay));
+  cr_assert(nv_table_add_value(overlay, DYN_HANDLE, DYN_NAME, strlen(DYN_NAME), "changed", 7, NULL));
+
+  assert_nvtable(overlay, DYN_HANDLE, "changed", 7);
+  assert_nvtable(overlay, OTHER_DYN_HANDLE, "dyn", 3);
+  assert_nvtable(tab, DYN_HANDLE, "dynamic", 7);
+
+  nv_table_unref(overlay);
+  nv_table_unref(tab);
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "logmsg/nvtable.h"
+#include "libtest/stopwatch.h"
+
+#define NAMES 128
+#define LOOKUPS_PER_THREAD 2000000
+
+static NVRegistry *registry;
+static gchar names[NAMES][32];
+
+static GMutex *thread_lock;
+static GCond *thread_ping;
+static gboolean thread_start;
+
+static gpointer
+_lookup_thread(gpointer user_data)
+{
+  gint i;
+
+  g_mutex_lock(thread_lock);
+  while (!thread_start)
+    g_cond_wait(thread_ping, thread_lock);
+  g_mutex_unlock(thread_lock);
+
+  for (i = 0; i < LOOKUPS_PER_THREAD; i++)
+    {
+      /* the same call json-parser & co. perform for every extracted key */
+      NVHandle handle = nv_registry_alloc_handle(registry, names[i % NAMES]);
+
+      cr_assert_neq(handle, 0);
+    }
+  return NULL;
+}
+
+static void
+perftest_lookups(gint num_threads)
+{
+  GThread *threads[32];
+  gint i;
+
+  g_assert(num_threads <= G_N_ELEMENTS(threads));
+
+  thread_start = FALSE;
+  for (i = 0; i < num_threads; i++)
+    threads[i] = g_thread_create(_lookup_thread, NULL, TRUE, NULL);
+
+  start_stopwatch();
+  g_mutex_lock(thread_lock);
+  thread_start = TRUE;
+  g_cond_broadcast(thread_ping);
+  g_mutex_unlock(thread_lock);
+
+  for (i = 0; i < num_threads; i++)
+    g_thread_join(threads[i]);
+
+  /* with lookups scaling linearly, the runtime remains constant */
+  stop_stopwatch_and_display_result(num_threads * LOOKUPS_PER_THREAD,
+                                    "NVRegistry lookups, threads=%d", num_threads);
+}
+
+Test(nvtable_speed, test_nv_registry_lookup_speed)
+{
+  const gchar *builtins[] = { "HOST", "MESSAGE", "PROGRAM", NULL };
+  gint i;
+
+  registry = nv_registry_new(builtins, NVHANDLE_MAX_VALUE);
+  thread_lock = g_mutex_new();
+  thread_ping = g_cond_new();
+
+  for (i = 0; i < NAMES; i++)
+    {
+      g_snprintf(names[i], sizeof(names[i]), "json.key%d", i);
+      nv_registry_alloc_handle(registry, names[i]);
+    }
+
+  perftest_lookups(1);
+  perftest_lookups(2);
+  perftest_lookups(4);
+  perftest_lookups(8);
+  perftest_lookups(16);
+  perftest_lookups(32);
+
+  g_cond_free(thread_ping);
+  g_mutex_free(thread_lock);
+  nv_registry_free(registry);
+}
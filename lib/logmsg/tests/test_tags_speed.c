@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "logmsg/logmsg.h"
+#include "logmsg/tags.h"
+#include "apphook.h"
+#include "libtest/stopwatch.h"
+
+#define TAGS 64
+#define TAGGINGS_PER_THREAD 1000000
+
+static gchar tag_names[TAGS][32];
+
+static GMutex *thread_lock;
+static GCond *thread_ping;
+static gboolean thread_start;
+
+static gpointer
+_tagging_thread(gpointer user_data)
+{
+  LogMessage *msg = (LogMessage *) user_data;
+  gint i;
+
+  g_mutex_lock(thread_lock);
+  while (!thread_start)
+    g_cond_wait(thread_ping, thread_lock);
+  g_mutex_unlock(thread_lock);
+
+  for (i = 0; i < TAGGINGS_PER_THREAD; i++)
+    {
+      /* the same call patterndb and tags-parser perform for every message */
+      log_msg_set_tag_by_name(msg, tag_names[i % TAGS]);
+    }
+  return NULL;
+}
+
+static void
+perftest_tagging(gint num_threads)
+{
+  GThread *threads[32];
+  LogMessage *msgs[32];
+  gint i;
+
+  g_assert(num_threads <= G_N_ELEMENTS(threads));
+
+  thread_start = FALSE;
+  for (i = 0; i < num_threads; i++)
+    {
+      msgs[i] = log_msg_new_empty();
+      threads[i] = g_thread_create(_tagging_thread, msgs[i], TRUE, NULL);
+    }
+
+  start_stopwatch();
+  g_mutex_lock(thread_lock);
+  thread_start = TRUE;
+  g_cond_broadcast(thread_ping);
+  g_mutex_unlock(thread_lock);
+
+  for (i = 0; i < num_threads; i++)
+    g_thread_join(threads[i]);
+
+  stop_stopwatch_and_display_result(num_threads * TAGGINGS_PER_THREAD,
+                                    "Tagging messages by name, threads=%d", num_threads);
+
+  for (i = 0; i < num_threads; i++)
+    {
+      cr_assert(log_msg_is_tag_by_name(msgs[i], tag_names[TAGS - 1]));
+      log_msg_unref(msgs[i]);
+    }
+}
+
+Test(tags_speed, test_tagging_speed)
+{
+  gint i;
+
+  thread_lock = g_mutex_new();
+  thread_ping = g_cond_new();
+
+  for (i = 0; i < TAGS; i++)
+    {
+      g_snprintf(tag_names[i], sizeof(tag_names[i]), ".classifier.tag%d", i);
+      log_tags_get_by_name(tag_names[i]);
+    }
+
+  perftest_tagging(1);
+  perftest_tagging(8);
+  perftest_tagging(32);
+
+  g_cond_free(thread_ping);
+  g_mutex_free(thread_lock);
+}
+
+TestSuite(tags_speed, .init = app_startup, .fini = app_shutdown);
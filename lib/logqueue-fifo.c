@@ -43,43 +43,60 @@ QueueType log_queue_fifo_type = "FIFO";
  *
  *   - has a per-thread, unlocked input queue where threads can put their items
  *
- *   - has a locked wait-queue where items go once the per-thread input
- *     would be overflown or if the input thread goes to sleep (e.g.  one
- *     lock acquisition per a longer period)
+ *   - has a lock-free wait-queue where items go once the per-thread input
+ *     would be overflown or if the input thread goes to sleep
  *
  *   - has an unlocked output queue where items from the wait queue go, once
  *     it becomes depleted.
  *
  * This means that items flow in this sequence from one list to the next:
  *
- *    input queue (per-thread) -> wait queue (locked) -> output queue (single-threaded)
+ *    input queue (per-thread) -> wait queue (lock-free) -> output queue (single-threaded)
  *
  * Fastpath is:
  *   - input threads putting elements on their per-thread queue (lockless)
  *   - output threads removing elements from the output queue (lockless)
  *
  * Slowpath:
- *   - input queue is overflown (or the input thread goes to sleep), wait
- *     queue mutex is grabbed, all elements are put to the wait queue.
+ *   - input queue is overflown (or the input thread goes to sleep), all
+ *     elements are pushed to the wait queue as a single segment, using a
+ *     compare-and-swap on its head.
  *
- *   - output queue is depleted, wait queue mutex is grabbed, all elements
- *     on the wait queue is put to the output queue
+ *   - output queue is depleted, the output thread takes all segments from
+ *     the wait queue with a compare-and-swap and appends them to the output
+ *     queue in the order they were pushed.
+ *
+ *   - the LogQueue lock is only grabbed by input threads if the output
+ *     thread is waiting for items, in order to notify it.
  *
  * Threading assumptions:
  *   - the head of the queue is only manipulated from the output thread
  *   - the tail of the queue is only manipulated from the input threads
+ *   - the wait queue may be taken over by the output thread of another
+ *     queue, see log_queue_fifo_steal_tail(). Taking items off the wait
+ *     queue is serialized by qoverflow_wait_lock, pushing remains lock-free.
  *
  */
 
 
+/* a chain of items pushed to the wait queue at once */
+typedef struct _LogQueueFifoSegment LogQueueFifoSegment;
+struct _LogQueueFifoSegment
+{
+  LogQueueFifoSegment *next;
+  struct iv_list_head items;
+  gint len;
+};
+
 typedef struct _LogQueueFifo
 {
   LogQueue super;
 
   /* scalable qoverflow implementation */
   struct iv_list_head qoverflow_output;
-  struct iv_list_head qoverflow_wait;
-  gint qoverflow_wait_len;
+  LogQueueFifoSegment *qoverflow_wait; /* LIFO of segments, accessed atomically */
+  gint qoverflow_wait_len;             /* accessed atomically */
+  GStaticMutex qoverflow_wait_lock;    /* held while taking segments off qoverflow_wait */
   gint qoverflow_output_len;
   gint qoverflow_size; /* in number of elements */
 
@@ -121,7 +138,94 @@ log_queue_fifo_get_length(LogQueue *s)
 {
   LogQueueFifo *self = (LogQueueFifo *) s;
 
-  return self->qoverflow_wait_len + self->qoverflow_output_len;
+  return g_atomic_int_get(&self->qoverflow_wait_len) + self->qoverflow_output_len;
+}
+
+/* wakes up the output thread if it waits for items, see log_queue_check_items() */
+static void
+log_queue_fifo_notify(LogQueueFifo *self)
+{
+  if (!g_atomic_pointer_get(&self->super.parallel_push_notify))
+    return;
+
+  g_static_mutex_lock(&self->super.lock);
+  log_queue_push_notify(&self->super);
+  g_static_mutex_unlock(&self->super.lock);
+}
+
+/*
+ * Pushes @items to the wait queue as a single segment, @items is empty
+ * afterwards.  Can be called from any number of threads in parallel.
+ *
+ * The length is increased before the segment becomes visible, so that the
+ * output thread, which decreases it after taking the segments, never
+ * brings it below zero.
+ */
+static void
+log_queue_fifo_push_wait(LogQueueFifo *self, struct iv_list_head *items, gint len)
+{
+  LogQueueFifoSegment *segment;
+
+  if (len == 0)
+    return;
+
+  segment = g_new(LogQueueFifoSegment, 1);
+  INIT_IV_LIST_HEAD(&segment->items);
+  iv_list_splice_tail_init(items, &segment->items);
+  segment->len = len;
+
+  g_atomic_int_add(&self->qoverflow_wait_len, len);
+  do
+    {
+      segment->next = g_atomic_pointer_get(&self->qoverflow_wait);
+    }
+  while (!g_atomic_pointer_compare_and_exchange(&self->qoverflow_wait, segment->next, segment));
+
+  log_queue_fifo_notify(self);
+}
+
+/*
+ * Moves all items on the wait queue to the output queue.
+ *
+ * Can only run from the output thread.  The lock only matters while a
+ * sibling is stealing: the segments it puts back must not end up behind
+ * newer ones taken here in the meantime.
+ */
+static void
+log_queue_fifo_move_wait(LogQueueFifo *self)
+{
+  LogQueueFifoSegment *segment, *next, *pushed_order = NULL;
+  gint len = 0;
+
+  g_static_mutex_lock(&self->qoverflow_wait_lock);
+  do
+    {
+      segment = g_atomic_pointer_get(&self->qoverflow_wait);
+    }
+  while (segment && !g_atomic_pointer_compare_and_exchange(&self->qoverflow_wait, segment, NULL));
+  g_static_mutex_unlock(&self->qoverflow_wait_lock);
+
+  /* the last pushed segment is the first one, reverse them */
+  for (; segment; segment = next)
+    {
+      next = segment->next;
+      segment->next = pushed_order;
+      pushed_order = segment;
+    }
+
+  for (segment = pushed_order; segment; segment = next)
+    {
+      next = segment->next;
+      iv_list_splice_tail_init(&segment->items, &self->qoverflow_output);
+      len += segment->len;
+      g_free(segment);
+    }
+
+  if (len == 0)
+    return;
+
+  self->qoverflow_output_len += len;
+  g_atomic_int_add(&self->qoverflow_wait_len, -len);
 }
 
 gboolean
@@ -129,20 +233,18 @@ log_queue_fifo_is_empty_racy(LogQueue *s)
 {
   LogQueueFifo *self = (LogQueueFifo *) s;
   gboolean has_message_in_queue = FALSE;
-  g_static_mutex_lock(&self->super.lock);
-  if (log_queue_fifo_get_length(s) > 0)
-    {
-      has_message_in_queue = TRUE;
-    }
-  else
+  gint i;
+
+  /* input threads clear finish_cb_registered only after their items were
+   * counted in the length of the wait queue, so check them first */
+  for (i = 0; i < log_queue_max_threads && !has_message_in_queue; i++)
     {
-      gint i;
-      for (i = 0; i < log_queue_max_threads && !has_message_in_queue; i++)
-        {
-          has_message_in_queue |= self->qoverflow_input[i].finish_cb_registered;
-        }
+      has_message_in_queue |= self->qoverflow_input[i].finish_cb_registered;
     }
-  g_static_mutex_unlock(&self->super.lock);
+
+  if (log_queue_fifo_get_length(s) > 0)
+    has_message_in_queue = TRUE;
+
   return !has_message_in_queue;
 }
 
@@ -154,9 +256,9 @@ log_queue_fifo_keep_on_reload(LogQueue *s)
   return log_queue_fifo_get_length(s) > 0 || self->qbacklog_len > 0;
 }
 
-/* move items from the per-thread input queue to the lock-protected "wait" queue */
+/* move items from the per-thread input queue to the lock-free "wait" queue */
 static void
-log_queue_fifo_move_input_unlocked(LogQueueFifo *self, gint thread_id)
+log_queue_fifo_move_input_to_wait(LogQueueFifo *self, gint thread_id)
 {
   gint queue_len;
 
@@ -211,15 +313,13 @@ log_queue_fifo_move_input_unlocked(LogQueueFifo *self, gint thread_id)
   log_queue_queued_messages_add(&self->super, self->qoverflow_input[thread_id].len);
   iv_list_update_msg_size(self, &self->qoverflow_input[thread_id].items);
 
-  iv_list_splice_tail_init(&self->qoverflow_input[thread_id].items, &self->qoverflow_wait);
-  self->qoverflow_wait_len += self->qoverflow_input[thread_id].len;
+  log_queue_fifo_push_wait(self, &self->qoverflow_input[thread_id].items, self->qoverflow_input[thread_id].len);
   self->qoverflow_input[thread_id].len = 0;
 }
 
-/* move items from the per-thread input queue to the lock-protected
- * "wait" queue, but grabbing locks first. This is registered as a
- * callback to be called when the input worker thread finishes its
- * job.
+/* move items from the per-thread input queue to the "wait" queue. This is
+ * registered as a callback to be called when the input worker thread
+ * finishes its job.
  */
 static gpointer
 log_queue_fifo_move_input(gpointer user_data)
@@ -231,15 +331,23 @@ log_queue_fifo_move_input(gpointer user_data)
 
   g_assert(thread_id >= 0);
 
-  g_static_mutex_lock(&self->super.lock);
-  log_queue_fifo_move_input_unlocked(self, thread_id);
-  log_queue_push_notify(&self->super);
-  g_static_mutex_unlock(&self->super.lock);
+  log_queue_fifo_move_input_to_wait(self, thread_id);
   self->qoverflow_input[thread_id].finish_cb_registered = FALSE;
   log_queue_unref(&self->super);
   return NULL;
 }
 
+static void
+log_queue_fifo_drop_message(LogQueueFifo *self, LogMessage *msg, const LogPathOptions *path_options)
+{
+  stats_counter_inc(self->super.dropped_messages);
+
+  if (path_options->flow_control_requested)
+    log_msg_drop(msg, path_options, AT_SUSPENDED);
+  else
+    log_msg_drop(msg, path_options, AT_PROCESSED);
+}
+
 /**
  * Assumed to be called from one of the input threads. If the thread_id
  * cannot be determined, the item is put directly in the wait queue.
@@ -297,37 +405,26 @@ log_queue_fifo_push_tail(LogQueue *s, LogMessage *msg, const LogPathOptions *pat
       return;
     }
 
-  /* slow path, put the pending item and the whole input queue to the wait_queue */
-
-  g_static_mutex_lock(&self->super.lock);
-
-  if (thread_id >= 0)
-    log_queue_fifo_move_input_unlocked(self, thread_id);
+  /* slow path, put the pending item to the wait_queue. The length check
+   * is racy the same way as in log_queue_fifo_move_input_to_wait() */
 
   if (log_queue_fifo_get_length(s) < self->qoverflow_size)
     {
+      struct iv_list_head items;
+
+      INIT_IV_LIST_HEAD(&items);
       node = log_msg_alloc_queue_node(msg, path_options);
+      iv_list_add_tail(&node->list, &items);
 
-      iv_list_add_tail(&node->list, &self->qoverflow_wait);
-      self->qoverflow_wait_len++;
-      log_queue_push_notify(&self->super);
       log_queue_queued_messages_inc(&self->super);
-
       log_queue_memory_usage_add(&self->super, log_msg_get_size(msg));
-      g_static_mutex_unlock(&self->super.lock);
+      log_queue_fifo_push_wait(self, &items, 1);
 
       log_msg_unref(msg);
     }
   else
     {
-      stats_counter_inc(self->super.dropped_messages);
-      g_static_mutex_unlock(&self->super.lock);
-
-      if (path_options->flow_control_requested)
-        log_msg_drop(msg, path_options, AT_SUSPENDED);
-      else
-        log_msg_drop(msg, path_options, AT_PROCESSED);
-
+      log_queue_fifo_drop_message(self, msg, path_options);
       msg_debug("Destination queue full, dropping message",
                 evt_tag_int("queue_len", log_queue_fifo_get_length(&self->super)),
                 evt_tag_int("log_fifo_size", self->qoverflow_size),
@@ -336,6 +433,57 @@ log_queue_fifo_push_tail(LogQueue *s, LogMessage *msg, const LogPathOptions *pat
   return;
 }
 
+/*
+ * Same as log_queue_fifo_push_tail(), but the batch is pushed to the wait
+ * queue as a single segment if the input thread can't be determined.
+ *
+ * NOTE: It consumes the references passed by the caller.
+ */
+static void
+log_queue_fifo_push_tail_batch(LogQueue *s, LogMessage **msgs, const LogPathOptions *path_options, gint num_msgs)
+{
+  LogQueueFifo *self = (LogQueueFifo *) s;
+  LogMessageQueueNode *node;
+  struct iv_list_head items;
+  gint num_queued, space;
+  gint i;
+
+  if (main_loop_worker_get_thread_id() >= 0)
+    {
+      /* fastpath, the per-thread input FIFOs are not locked anyway */
+      for (i = 0; i < num_msgs; i++)
+        log_queue_fifo_push_tail(s, msgs[i], &path_options[i]);
+      return;
+    }
+
+  INIT_IV_LIST_HEAD(&items);
+  space = self->qoverflow_size - log_queue_fifo_get_length(s);
+  for (i = 0; i < num_msgs && i < space; i++)
+    {
+      node = log_msg_alloc_queue_node(msgs[i], &path_options[i]);
+
+      iv_list_add_tail(&node->list, &items);
+      log_queue_memory_usage_add(&self->super, log_msg_get_size(msgs[i]));
+    }
+  num_queued = i;
+  log_queue_queued_messages_add(&self->super, num_queued);
+  log_queue_fifo_push_wait(self, &items, num_queued);
+
+  for (i = 0; i < num_queued; i++)
+    log_msg_unref(msgs[i]);
+
+  if (num_queued == num_msgs)
+    return;
+
+  for (i = num_queued; i < num_msgs; i++)
+    log_queue_fifo_drop_message(self, msgs[i], &path_options[i]);
+  msg_debug("Destination queue full, dropping messages",
+            evt_tag_int("queue_len", log_queue_fifo_get_length(&self->super)),
+            evt_tag_int("log_fifo_size", self->qoverflow_size),
+            evt_tag_int("count", num_msgs - num_queued),
+            evt_tag_str("persist_name", self->super.persist_name));
+}
+
 /*
  * Put an item back to the front of the queue.
  *
@@ -377,11 +525,7 @@ log_queue_fifo_pop_head(LogQueue *s, LogPathOptions *path_options)
   if (self->qoverflow_output_len == 0)
     {
       /* slow path, output queue is empty, get some elements from the wait queue */
-      g_static_mutex_lock(&self->super.lock);
-      iv_list_splice_tail_init(&self->qoverflow_wait, &self->qoverflow_output);
-      self->qoverflow_output_len = self->qoverflow_wait_len;
-      self->qoverflow_wait_len = 0;
-      g_static_mutex_unlock(&self->super.lock);
+      log_queue_fifo_move_wait(self);
     }
 
   if (self->qoverflow_output_len > 0)
@@ -426,6 +570,170 @@ log_queue_fifo_pop_head(LogQueue *s, LogPathOptions *path_options)
   return msg;
 }
 
+/*
+ * Can only run from the output thread.
+ *
+ * Same as log_queue_fifo_pop_head(), but the wait queue is moved to the
+ * output queue if the latter doesn't have enough items on its own.
+ *
+ * NOTE: this returns references which the caller must take care to free.
+ */
+static gint
+log_queue_fifo_pop_head_batch(LogQueue *s, LogMessage **msgs, LogPathOptions *path_options, gint max_msgs)
+{
+  LogQueueFifo *self = (LogQueueFifo *) s;
+  LogPathOptions initial_path_options = LOG_PATH_OPTIONS_INIT;
+  gsize popped_size = 0;
+  gint num_msgs;
+
+  if (self->qoverflow_output_len < max_msgs)
+    log_queue_fifo_move_wait(self);
+
+  for (num_msgs = 0; num_msgs < max_msgs && self->qoverflow_output_len > 0; num_msgs++)
+    {
+      LogMessageQueueNode *node = iv_list_entry(self->qoverflow_output.next, LogMessageQueueNode, list);
+      LogMessage *msg = node->msg;
+
+      path_options[num_msgs] = initial_path_options;
+      path_options[num_msgs].ack_needed = node->ack_needed;
+      msgs[num_msgs] = msg;
+      self->qoverflow_output_len--;
+      popped_size += log_msg_get_size(msg);
+
+      if (!self->super.use_backlog)
+        {
+          iv_list_del(&node->list);
+          log_msg_free_queue_node(node);
+        }
+      else
+        {
+          iv_list_del_init(&node->list);
+          log_msg_ref(msg);
+          iv_list_add_tail(&node->list, &self->qbacklog);
+          self->qbacklog_len++;
+        }
+    }
+
+  if (num_msgs > 0)
+    {
+      log_queue_queued_messages_sub(&self->super, num_msgs);
+      log_queue_memory_usage_sub(&self->super, popped_size);
+    }
+  return num_msgs;
+}
+
+/*
+ * Puts the segments taken by log_queue_fifo_steal_tail() but not stolen
+ * back to the wait queue.  The ones pushed in the meantime are newer, so
+ * they are taken again and @older is put under them.
+ *
+ * Must be called with qoverflow_wait_lock held, otherwise the output
+ * thread could move the newer segments ahead of @older.
+ */
+static void
+log_queue_fifo_push_back_wait(LogQueueFifo *self, LogQueueFifoSegment *older)
+{
+  LogQueueFifoSegment *newer, *last;
+
+  if (!older)
+    return;
+
+  while (!g_atomic_pointer_compare_and_exchange(&self->qoverflow_wait, NULL, older))
+    {
+      do
+        {
+          newer = g_atomic_pointer_get(&self->qoverflow_wait);
+        }
+      while (newer && !g_atomic_pointer_compare_and_exchange(&self->qoverflow_wait, newer, NULL));
+
+      if (!newer)
+        continue;
+
+      for (last = newer; last->next; last = last->next)
+        ;
+      last->next = older;
+      older = newer;
+    }
+
+  log_queue_fifo_notify(self);
+}
+
+/*
+ * Moves the newest half of the messages on the wait queue, but at least
+ * @min_msgs of them, to the front of @thief, as far as the size of @thief
+ * allows it.  The output queue and the backlog belong to the output thread
+ * of @self, the wait queue is the only part that can be taken safely from
+ * another thread.
+ *
+ * Can only run from the output thread of @thief.  The split happens with
+ * qoverflow_wait_lock held, so the remainder keeps its place in front of
+ * the messages pushed while it was detached.
+ */
+static gint
+log_queue_fifo_steal_tail(LogQueue *s, LogQueue *thief, gint min_msgs)
+{
+  LogQueueFifo *self = (LogQueueFifo *) s;
+  LogQueueFifoSegment *segment, *next;
+  gsize stolen_size = 0;
+  gint stolen = 0;
+  gint max_msgs, space;
+
+  /* the size limit of other queues is unknown */
+  if (thief->type != log_queue_fifo_type)
+    return 0;
+
+  space = ((LogQueueFifo *) thief)->qoverflow_size - log_queue_fifo_get_length(thief);
+  max_msgs = MIN(MAX(g_atomic_int_get(&self->qoverflow_wait_len) / 2, min_msgs), space);
+  if (max_msgs <= 0)
+    return 0;
+
+  g_static_mutex_lock(&self->qoverflow_wait_lock);
+  do
+    {
+      segment = g_atomic_pointer_get(&self->qoverflow_wait);
+    }
+  while (segment && !g_atomic_pointer_compare_and_exchange(&self->qoverflow_wait, segment, NULL));
+
+  /* segments are in reverse order, the newest message is the last one of
+   * the first segment, as push_head() prepends we start with that */
+  for (; segment && stolen < max_msgs; segment = next)
+    {
+      next = segment->next;
+      while (!iv_list_empty(&segment->items) && stolen < max_msgs)
+        {
+          LogMessageQueueNode *node = iv_list_entry(segment->items.prev, LogMessageQueueNode, list);
+          LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+          LogMessage *msg = node->msg;
+
+          path_options.ack_needed = node->ack_needed;
+          path_options.flow_control_requested = node->flow_control_requested;
+          iv_list_del(&node->list);
+          log_msg_free_queue_node(node);
+          segment->len--;
+
+          stolen_size += log_msg_get_size(msg);
+          stolen++;
+          log_queue_push_head(thief, msg, &path_options);
+        }
+
+      if (segment->len > 0)
+        break;
+      g_free(segment);
+    }
+
+  /* the older messages stay with @self */
+  log_queue_fifo_push_back_wait(self, segment);
+  g_static_mutex_unlock(&self->qoverflow_wait_lock);
+
+  if (stolen == 0)
+    return 0;
+
+  g_atomic_int_add(&self->qoverflow_wait_len, -stolen);
+  log_queue_queued_messages_sub(&self->super, stolen);
+  log_queue_memory_usage_sub(&self->super, stolen_size);
+  return stolen;
+}
+
 /*
  * Can only run from the output thread.
  */
@@ -535,9 +843,10 @@ log_queue_fifo_free(LogQueue *s)
       log_queue_fifo_free_queue(&self->qoverflow_input[i].items);
     }
 
-  log_queue_fifo_free_queue(&self->qoverflow_wait);
+  log_queue_fifo_move_wait(self);
   log_queue_fifo_free_queue(&self->qoverflow_output);
   log_queue_fifo_free_queue(&self->qbacklog);
+  g_static_mutex_free(&self->qoverflow_wait_lock);
   log_queue_free_method(s);
 }
 
@@ -558,6 +867,9 @@ log_queue_fifo_new(gint qoverflow_size, const gchar *persist_name)
   self->super.push_tail = log_queue_fifo_push_tail;
   self->super.push_head = log_queue_fifo_push_head;
   self->super.pop_head = log_queue_fifo_pop_head;
+  self->super.push_tail_batch = log_queue_fifo_push_tail_batch;
+  self->super.pop_head_batch = log_queue_fifo_pop_head_batch;
+  self->super.steal_tail = log_queue_fifo_steal_tail;
   self->super.ack_backlog = log_queue_fifo_ack_backlog;
   self->super.rewind_backlog = log_queue_fifo_rewind_backlog;
   self->super.rewind_backlog_all = log_queue_fifo_rewind_backlog_all;
@@ -571,9 +883,9 @@ log_queue_fifo_new(gint qoverflow_size, const gchar *persist_name)
       self->qoverflow_input[i].cb.func = log_queue_fifo_move_input;
       self->qoverflow_input[i].cb.user_data = self;
     }
-  INIT_IV_LIST_HEAD(&self->qoverflow_wait);
   INIT_IV_LIST_HEAD(&self->qoverflow_output);
   INIT_IV_LIST_HEAD(&self->qbacklog);
+  g_static_mutex_init(&self->qoverflow_wait_lock);
 
   self->qoverflow_size = qoverflow_size;
   return &self->super;
@@ -23,6 +23,7 @@
  */
 
 #include "logqueue.h"
+#include "logpipe.h"
 #include "stats/stats-registry.h"
 #include "messages.h"
 
@@ -70,6 +71,75 @@ log_queue_queued_messages_dec(LogQueue *self)
   atomic_gssize_dec(&self->stats_cache.queued_messages);
 }
 
+/*
+ * Puts @num_msgs messages to the queue, @path_options is an array of the
+ * same size.  Implementations that have a native version do this with a
+ * single lock round-trip, otherwise the messages are pushed one-by-one.
+ *
+ * NOTE: It consumes the references passed by the caller.
+ */
+void
+log_queue_push_tail_batch(LogQueue *self, LogMessage **msgs, const LogPathOptions *path_options, gint num_msgs)
+{
+  gint i;
+
+  if (self->push_tail_batch)
+    {
+      self->push_tail_batch(self, msgs, path_options, num_msgs);
+      return;
+    }
+
+  for (i = 0; i < num_msgs; i++)
+    self->push_tail(self, msgs[i], &path_options[i]);
+}
+
+gint
+log_queue_pop_head_batch_ignore_throttle(LogQueue *self, LogMessage **msgs, LogPathOptions *path_options,
+                                         gint max_msgs)
+{
+  LogPathOptions initial_path_options = LOG_PATH_OPTIONS_INIT;
+  gint num_msgs;
+
+  if (self->pop_head_batch)
+    return self->pop_head_batch(self, msgs, path_options, max_msgs);
+
+  for (num_msgs = 0; num_msgs < max_msgs; num_msgs++)
+    {
+      path_options[num_msgs] = initial_path_options;
+      msgs[num_msgs] = self->pop_head(self, &path_options[num_msgs]);
+      if (!msgs[num_msgs])
+        break;
+    }
+  return num_msgs;
+}
+
+/*
+ * Removes at most @max_msgs messages from the head of the queue, storing
+ * them in @msgs and their associated options in @path_options, both arrays
+ * must have room for @max_msgs elements.  Returns the number of messages
+ * removed, each of them a reference which the caller must take care to
+ * free.
+ */
+gint
+log_queue_pop_head_batch(LogQueue *self, LogMessage **msgs, LogPathOptions *path_options, gint max_msgs)
+{
+  gint num_msgs;
+
+  if (self->throttle)
+    {
+      if (self->throttle_buckets == 0)
+        return 0;
+      max_msgs = MIN(max_msgs, self->throttle_buckets);
+    }
+
+  num_msgs = log_queue_pop_head_batch_ignore_throttle(self, msgs, path_options, max_msgs);
+
+  if (self->throttle_buckets > 0)
+    self->throttle_buckets -= num_msgs;
+
+  return num_msgs;
+}
+
 /*
  * When this is called, it is assumed that the output thread is currently
  * not running (since this is the function that wakes it up), thus we can
@@ -149,8 +219,18 @@ log_queue_check_items(LogQueue *self, gint *timeout, LogQueuePushNotifyFunc para
       self->parallel_push_notify = parallel_push_notify;
       self->parallel_push_data = user_data;
       self->parallel_push_data_destroy = user_data_destroy;
-      g_static_mutex_unlock(&self->lock);
-      return FALSE;
+
+      /* queues may add items without holding the lock (see
+       * log_queue_fifo_push_wait()): those increase the length first
+       * and check the callback afterwards, while we do it the other way
+       * around, so either they see the callback or we see the items */
+      __sync_synchronize();
+      num_elements = log_queue_get_length(self);
+      if (num_elements == 0)
+        {
+          g_static_mutex_unlock(&self->lock);
+          return FALSE;
+        }
     }
 
   /* consume the user_data reference as we won't use the callback */
@@ -69,6 +69,9 @@ struct _LogQueue
   void (*push_tail)(LogQueue *self, LogMessage *msg, const LogPathOptions *path_options);
   void (*push_head)(LogQueue *self, LogMessage *msg, const LogPathOptions *path_options);
   LogMessage *(*pop_head)(LogQueue *self, LogPathOptions *path_options);
+  void (*push_tail_batch)(LogQueue *self, LogMessage **msgs, const LogPathOptions *path_options, gint num_msgs);
+  gint (*pop_head_batch)(LogQueue *self, LogMessage **msgs, LogPathOptions *path_options, gint max_msgs);
+  gint (*steal_tail)(LogQueue *self, LogQueue *thief, gint min_msgs);
   void (*ack_backlog)(LogQueue *self, gint n);
   void (*rewind_backlog)(LogQueue *self, guint rewind_count);
   void (*rewind_backlog_all)(LogQueue *self);
@@ -135,6 +138,21 @@ log_queue_pop_head_ignore_throttle(LogQueue *self, LogPathOptions *path_options)
   return self->pop_head(self, path_options);
 }
 
+/*
+ * Moves the newest part of the messages the consumer of @self hasn't seen
+ * yet, at least @min_msgs if there are that many, to the front of @thief
+ * and returns their number.  Can only be called from the output thread of
+ * @thief, queues that don't support it return 0.
+ */
+static inline gint
+log_queue_steal_tail(LogQueue *self, LogQueue *thief, gint min_msgs)
+{
+  if (!self->steal_tail)
+    return 0;
+
+  return self->steal_tail(self, thief, min_msgs);
+}
+
 static inline void
 log_queue_rewind_backlog(LogQueue *self, guint rewind_count)
 {
@@ -208,6 +226,11 @@ void log_queue_queued_messages_sub(LogQueue *self, gsize value);
 void log_queue_queued_messages_inc(LogQueue *self);
 void log_queue_queued_messages_dec(LogQueue *self);
 
+void log_queue_push_tail_batch(LogQueue *self, LogMessage **msgs, const LogPathOptions *path_options, gint num_msgs);
+gint log_queue_pop_head_batch(LogQueue *self, LogMessage **msgs, LogPathOptions *path_options, gint max_msgs);
+gint log_queue_pop_head_batch_ignore_throttle(LogQueue *self, LogMessage **msgs, LogPathOptions *path_options,
+                                              gint max_msgs);
+
 void log_queue_push_notify(LogQueue *self);
 void log_queue_reset_parallel_push(LogQueue *self);
 void log_queue_set_parallel_push(LogQueue *self, LogQueuePushNotifyFunc parallel_push_notify, gpointer user_data,
@@ -395,9 +395,10 @@ log_reader_handle_line(LogReader *self, const guchar *line, gint length, LogTran
   msg_debug("Incoming log entry",
             evt_tag_printf("line", "%.*s", length, line));
   /* use the current time to get the time zone offset */
-  m = log_msg_new((gchar *) line, length,
-                  aux->peer_addr ? : self->peer_addr,
-                  &self->options->parse_options);
+  m = log_msg_new_with_size_hint((gchar *) line, length,
+                                 aux->peer_addr ? : self->peer_addr,
+                                 &self->options->parse_options,
+                                 log_source_get_payload_size_hint(&self->super));
 
   log_msg_refcache_start_producer(m);
 
@@ -242,6 +242,7 @@ log_source_init(LogPipe *s)
   stats_register_counter(self->options->stats_level, &sc_key,
                          SC_TYPE_PROCESSED, &self->recvd_messages);
   stats_register_counter(self->options->stats_level, &sc_key, SC_TYPE_STAMP, &self->last_message_seen);
+  stats_register_counter(self->options->stats_level, &sc_key, SC_TYPE_PAYLOAD_REALLOCS, &self->payload_reallocs);
   stats_unlock();
 
   return TRUE;
@@ -257,11 +258,44 @@ log_source_deinit(LogPipe *s)
   stats_cluster_logpipe_key_set(&sc_key, self->options->stats_source | SCS_SOURCE, self->stats_id, self->stats_instance);
   stats_unregister_counter(&sc_key, SC_TYPE_PROCESSED, &self->recvd_messages);
   stats_unregister_counter(&sc_key, SC_TYPE_STAMP, &self->last_message_seen);
+  stats_unregister_counter(&sc_key, SC_TYPE_PAYLOAD_REALLOCS, &self->payload_reallocs);
   stats_unlock();
 
   return TRUE;
 }
 
+/*
+ * Tracks the 90th percentile of the final payload sizes of the messages
+ * posted by this source, which is then used to presize the payload of new
+ * messages, so that parsers (json-parser, kv-parser & co) extracting a lot
+ * of name-value pairs don't have to grow the NVTable over and over again.
+ *
+ * The estimate is increased by 9 units if the sample is larger and
+ * decreased by 1 unit if it is smaller, which means that it settles where
+ * 10% of the samples are above the estimate.  The unit is proportional to
+ * the current estimate, so it adapts quickly to the order of magnitude.
+ *
+ * NOTE: the update is not atomic, as a source posts its messages from one
+ * thread at a time. Even if it didn't, losing an update only delays the
+ * adaptation.
+ */
+static void
+_update_payload_size_hint(LogSource *self, LogMessage *msg)
+{
+  gsize sample = log_msg_get_payload_length(msg);
+  gsize hint = self->payload_size_hint;
+
+  if (hint == 0)
+    hint = sample;
+  else if (sample > hint)
+    hint += MAX(hint / 160, 1) * 9;
+  else if (sample < hint)
+    hint -= MAX(hint / 160, 1);
+
+  self->payload_size_hint = hint;
+  stats_counter_add(self->payload_reallocs, msg->num_payload_reallocs);
+}
+
 void
 log_source_post(LogSource *self, LogMessage *msg)
 {
@@ -294,7 +328,13 @@ log_source_post(LogSource *self, LogMessage *msg)
    */
 
   g_assert(old_window_size > 0);
+
+  /* the message is processed synchronously up to the point it gets queued,
+   * keep it alive until we learn its final size */
+  log_msg_ref(msg);
   log_pipe_queue(&self->super, msg, &path_options);
+  _update_payload_size_hint(self, msg);
+  log_msg_unref(msg);
 }
 
 static gboolean
@@ -70,6 +70,8 @@ struct _LogSource
   WindowSizeCounter window_size;
   StatsCounterItem *last_message_seen;
   StatsCounterItem *recvd_messages;
+  StatsCounterItem *payload_reallocs;
+  gsize payload_size_hint;
   guint32 last_ack_count;
   guint32 ack_count;
   glong window_full_sleep_nsec;
@@ -92,6 +94,13 @@ log_source_get_init_window_size(LogSource *self)
   return self->options->init_window_size;
 }
 
+/* initial payload size for new messages, follows the 90th percentile of final payload sizes */
+static inline gsize
+log_source_get_payload_size_hint(LogSource *self)
+{
+  return self->payload_size_hint;
+}
+
 gboolean log_source_init(LogPipe *s);
 gboolean log_source_deinit(LogPipe *s);
 
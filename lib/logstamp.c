@@ -27,7 +27,7 @@
 #include "timeutils.h"
 #include "str-format.h"
 
-static void
+void
 log_stamp_append_frac_digits(const LogStamp *stamp, GString *target, gint frac_digits)
 {
   glong usecs;
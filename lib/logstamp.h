@@ -49,6 +49,7 @@ log_stamp_is_timezone_set(const LogStamp *self)
   return self->zone_offset != -1;
 }
 
+void log_stamp_append_frac_digits(const LogStamp *stamp, GString *target, gint frac_digits);
 void log_stamp_format(LogStamp *stamp, GString *target, gint ts_format, glong zone_offset, gint frac_digits);
 void log_stamp_append_format(const LogStamp *stamp, GString *target, gint ts_format, glong zone_offset,
                              gint frac_digits);
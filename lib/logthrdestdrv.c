@@ -28,6 +28,18 @@
 #include "scratch-buffers.h"
 
 #define MAX_RETRIES_OF_FAILED_INSERT_DEFAULT 3
+/* the most messages fetched from the queue with a single call */
+#define LOG_THREADED_DEST_POP_BATCH_MAX 256
+
+typedef struct _LogThreadedDestBatch
+{
+  guint32 id;
+  gint size;
+  worker_insert_result_t result;
+  /* for batch-latency-target(), see _tune_batch() */
+  struct timespec batch_start;
+  struct timespec delivery_start;
+} LogThreadedDestBatch;
 
 static void _init_stats_key(LogThreadedDestDriver *self, StatsClusterKey *sc_key);
 
@@ -49,33 +61,196 @@ log_threaded_dest_driver_set_flush_timeout(LogDriver *s, gint flush_timeout)
   self->flush_timeout = flush_timeout;
 }
 
+void
+log_threaded_dest_driver_set_batch_latency_target(LogDriver *s, gint batch_latency_target)
+{
+  LogThreadedDestDriver *self = (LogThreadedDestDriver *) s;
+
+  self->batch_latency_target = batch_latency_target;
+}
+
+void
+log_threaded_dest_driver_set_batch_lines_min(LogDriver *s, gint batch_lines_min)
+{
+  LogThreadedDestDriver *self = (LogThreadedDestDriver *) s;
+
+  self->batch_lines_min = batch_lines_min;
+}
+
+void
+log_threaded_dest_driver_set_max_inflight_batches(LogDriver *s, gint max_inflight_batches)
+{
+  LogThreadedDestDriver *self = (LogThreadedDestDriver *) s;
+
+  self->max_inflight_batches = max_inflight_batches;
+}
+
+/* With batch-latency-target() set, the size of the batches follows the
+ * load: a batch that was filled up and delivered well within the target
+ * lets the next one grow, one that took longer than the target makes it
+ * shrink.  The time spent waiting for more messages is limited to what
+ * remains of the target after the delivery itself, so at low rates
+ * messages are not held back longer than the target either.  Batches
+ * delivered in flight are measured once they are acked, in order.
+ *
+ * NOTE: runs in the worker thread */
+static void
+_tune_batch(LogThreadedDestWorker *self, gint batch_size, const struct timespec *batch_start,
+            const struct timespec *delivery_start)
+{
+  LogThreadedDestDriver *owner = self->owner;
+  glong latency;
+
+  iv_invalidate_now();
+  iv_validate_now();
+  latency = timespec_diff_msec(&iv_now, batch_start);
+  self->delivery_time = (3 * self->delivery_time + timespec_diff_msec(&iv_now, delivery_start)) / 4;
+
+  if (latency > owner->batch_latency_target)
+    self->flush_lines = MAX(self->flush_lines * 3 / 4, owner->batch_lines_min);
+  else if (batch_size >= self->flush_lines && latency < owner->batch_latency_target * 3 / 4)
+    self->flush_lines = MIN(self->flush_lines + MAX(self->flush_lines / 4, 1), owner->flush_lines);
+
+  self->flush_timeout = CLAMP(owner->batch_latency_target - self->delivery_time, 0, owner->flush_timeout);
+
+  stats_counter_set(self->batch_lines, self->flush_lines);
+  stats_counter_set(self->flush_latency, latency);
+}
+
+static void
+_ack_backlog(LogThreadedDestWorker *self, gint num_msgs)
+{
+  log_queue_ack_backlog(self->queue, num_msgs);
+  stats_counter_add(self->owner->written_messages, num_msgs);
+  self->retries_counter = 0;
+}
+
+static void
+_drop_backlog(LogThreadedDestWorker *self, gint num_msgs)
+{
+  log_queue_ack_backlog(self->queue, num_msgs);
+  stats_counter_add(self->owner->dropped_messages, num_msgs);
+  self->retries_counter = 0;
+}
+
 /* this should be used in combination with WORKER_INSERT_RESULT_EXPLICIT_ACK_MGMT to actually confirm message delivery. */
 void
 log_threaded_dest_worker_ack_messages(LogThreadedDestWorker *self, gint batch_size)
 {
-  log_queue_ack_backlog(self->queue, batch_size);
-  stats_counter_add(self->owner->written_messages, batch_size);
-  self->retries_counter = 0;
+  _ack_backlog(self, batch_size);
   self->batch_size -= batch_size;
+
+  if (self->owner->batch_latency_target > 0 && batch_size > 0)
+    _tune_batch(self, batch_size, &self->batch_start, &self->delivery_start);
 }
 
 void
 log_threaded_dest_worker_drop_messages(LogThreadedDestWorker *self, gint batch_size)
 {
-  log_queue_ack_backlog(self->queue, batch_size);
-  stats_counter_add(self->owner->dropped_messages, batch_size);
-  self->retries_counter = 0;
+  _drop_backlog(self, batch_size);
   self->batch_size -= batch_size;
 }
 
+/* Puts messages that were fetched from the queue ahead of the current batch
+ * back, so that only the batch itself remains on the tail of the backlog.
+ *
+ * NOTE: runs in the worker thread */
+static void
+_return_popped_ahead(LogThreadedDestWorker *self)
+{
+  if (self->popped_ahead == 0)
+    return;
+
+  log_queue_rewind_backlog(self->queue, self->popped_ahead);
+  self->popped_ahead = 0;
+}
+
 void
 log_threaded_dest_worker_rewind_messages(LogThreadedDestWorker *self, gint batch_size)
 {
+  _return_popped_ahead(self);
   log_queue_rewind_backlog(self->queue, batch_size);
   self->rewound_batch_size = self->batch_size;
   self->batch_size -= batch_size;
 }
 
+static gboolean
+_is_inflight_window_full(LogThreadedDestWorker *self)
+{
+  return g_queue_get_length(&self->inflight_batches) >= self->owner->max_inflight_batches;
+}
+
+/* Moves the batch being built to the list of batches in flight.  As the
+ * backlog can only be acked in order, this is also where batches finished
+ * right away end up while earlier ones are still in flight.
+ *
+ * NOTE: runs in the worker thread */
+static void
+_start_inflight_batch(LogThreadedDestWorker *self, worker_insert_result_t result)
+{
+  LogThreadedDestBatch *batch;
+
+  if (self->batch_size == 0)
+    return;
+
+  batch = g_new0(LogThreadedDestBatch, 1);
+  batch->id = self->batch_id;
+  batch->size = self->batch_size;
+  batch->result = result;
+  batch->batch_start = self->batch_start;
+  batch->delivery_start = self->delivery_start;
+  g_queue_push_tail(&self->inflight_batches, batch);
+
+  self->batch_id++;
+  self->inflight_messages += self->batch_size;
+  self->batch_size = 0;
+}
+
+/* Puts back the batches in flight along with the one being built, as the
+ * backlog can only be rewound starting with the newest message.  Should
+ * any of these batches finish later, they are delivered once more.
+ *
+ * NOTE: runs in the worker thread */
+static void
+_rewind_inflight_batches(LogThreadedDestWorker *self)
+{
+  LogThreadedDestBatch *batch = g_queue_peek_head(&self->inflight_batches);
+
+  if (!batch)
+    return;
+
+  _return_popped_ahead(self);
+  log_queue_rewind_backlog(self->queue, self->inflight_messages + self->batch_size);
+
+  /* the oldest one is retried on its own */
+  self->rewound_batch_size = batch->size;
+  self->batch_size = 0;
+  self->inflight_messages = 0;
+  while ((batch = g_queue_pop_head(&self->inflight_batches)))
+    g_free(batch);
+}
+
+/* NOTE: runs in the worker thread, the result is processed by _perform_work() */
+void
+log_threaded_dest_worker_batch_finished(LogThreadedDestWorker *self, guint32 batch_id, worker_insert_result_t result)
+{
+  GList *l;
+
+  for (l = self->inflight_batches.head; l; l = l->next)
+    {
+      LogThreadedDestBatch *batch = (LogThreadedDestBatch *) l->data;
+
+      if (batch->id == batch_id && batch->result == WORKER_INSERT_RESULT_PENDING)
+        {
+          batch->result = result;
+          iv_event_post(&self->wake_up_event);
+          return;
+        }
+    }
+
+  /* unknown batches were rewound in the meantime */
+}
+
 static const gchar *
 _format_queue_persist_name(LogThreadedDestWorker *self)
 {
@@ -97,14 +272,22 @@ _format_queue_persist_name(LogThreadedDestWorker *self)
 }
 
 
+static gint
+_get_flush_timeout(LogThreadedDestWorker *self)
+{
+  if (self->owner->batch_latency_target > 0)
+    return self->flush_timeout;
+  return self->owner->flush_timeout;
+}
+
 static gboolean
 _should_flush_now(LogThreadedDestWorker *self)
 {
   struct timespec now;
   glong diff;
 
-  if (self->owner->flush_timeout <= 0 ||
-      self->owner->flush_lines <= 1 ||
+  if (_get_flush_timeout(self) <= 0 ||
+      log_threaded_dest_worker_get_flush_lines(self) <= 1 ||
       !self->enable_flush_timeout)
     return TRUE;
 
@@ -112,7 +295,18 @@ _should_flush_now(LogThreadedDestWorker *self)
   now = iv_now;
   diff = timespec_diff_msec(&now, &self->last_flush_time);
 
-  return (diff >= self->owner->flush_timeout);
+  return (diff >= _get_flush_timeout(self));
+}
+
+static void
+_init_batching(LogThreadedDestWorker *self)
+{
+  LogThreadedDestDriver *owner = self->owner;
+
+  /* start small, the batch grows as long as the target is met */
+  self->flush_lines = MIN(owner->batch_lines_min, owner->flush_lines);
+  self->flush_timeout = MIN(owner->batch_latency_target, owner->flush_timeout);
+  self->delivery_time = 0;
 }
 
 static void
@@ -188,6 +382,7 @@ static void
 _disconnect(LogThreadedDestWorker *self)
 {
   log_threaded_dest_worker_disconnect(self);
+  _rewind_inflight_batches(self);
 }
 
 /* NOTE: runs in the worker thread */
@@ -225,6 +420,16 @@ _rewind_batch(LogThreadedDestWorker *self)
 static void
 _process_result(LogThreadedDestWorker *self, gint result)
 {
+  /* with earlier batches still in flight, the result of this one can only
+   * be processed after theirs, see _finish_inflight_batches() */
+  if (!g_queue_is_empty(&self->inflight_batches) && self->batch_size > 0 &&
+      result != WORKER_INSERT_RESULT_QUEUED &&
+      result != WORKER_INSERT_RESULT_EXPLICIT_ACK_MGMT)
+    {
+      _start_inflight_batch(self, result);
+      return;
+    }
+
   switch (result)
     {
     case WORKER_INSERT_RESULT_DROP:
@@ -282,21 +487,168 @@ _process_result(LogThreadedDestWorker *self, gint result)
       self->enable_flush_timeout = TRUE;
       break;
 
+    case WORKER_INSERT_RESULT_PENDING:
+      _start_inflight_batch(self, result);
+      break;
+
     default:
       break;
     }
 
 }
 
+static void
+_pop_inflight_batch(LogThreadedDestWorker *self)
+{
+  LogThreadedDestBatch *batch = g_queue_pop_head(&self->inflight_batches);
+
+  self->inflight_messages -= batch->size;
+  g_free(batch);
+}
+
+/* Processes the results of the batches in flight in the order they were
+ * started, stopping at the first one that is still being delivered.
+ * Returns FALSE if one of them failed and the worker got suspended.
+ *
+ * NOTE: runs in the worker thread */
+static gboolean
+_finish_inflight_batches(LogThreadedDestWorker *self)
+{
+  LogThreadedDestBatch *batch;
+
+  while (!self->suspended &&
+         (batch = g_queue_peek_head(&self->inflight_batches)) &&
+         batch->result != WORKER_INSERT_RESULT_PENDING)
+    {
+      switch (batch->result)
+        {
+        case WORKER_INSERT_RESULT_SUCCESS:
+          _ack_backlog(self, batch->size);
+          if (self->owner->batch_latency_target > 0)
+            _tune_batch(self, batch->size, &batch->batch_start, &batch->delivery_start);
+          _pop_inflight_batch(self);
+          break;
+
+        case WORKER_INSERT_RESULT_DROP:
+          msg_error("Message(s) dropped while sending message to destination",
+                    evt_tag_str("driver", self->owner->super.super.id),
+                    evt_tag_int("batch_size", batch->size));
+
+          _drop_backlog(self, batch->size);
+          _pop_inflight_batch(self);
+          _disconnect_and_suspend(self);
+          break;
+
+        case WORKER_INSERT_RESULT_ERROR:
+          self->retries_counter++;
+
+          if (self->retries_counter >= self->owner->retries_max)
+            {
+              msg_error("Multiple failures while sending message(s) to destination, message(s) dropped",
+                        evt_tag_str("driver", self->owner->super.super.id),
+                        log_expr_node_location_tag(self->owner->super.super.super.expr_node),
+                        evt_tag_int("retries", self->retries_counter),
+                        evt_tag_int("batch_size", batch->size));
+
+              _drop_backlog(self, batch->size);
+              _pop_inflight_batch(self);
+            }
+          else
+            {
+              msg_error("Error occurred while trying to send a message, trying again",
+                        evt_tag_str("driver", self->owner->super.super.id),
+                        log_expr_node_location_tag(self->owner->super.super.super.expr_node),
+                        evt_tag_int("retries", self->retries_counter),
+                        evt_tag_int("batch_size", batch->size));
+
+              /* rewinds this batch along with the ones after it */
+              _disconnect_and_suspend(self);
+            }
+          break;
+
+        default:
+          msg_info("Server disconnected while sending messages, trying again",
+                   evt_tag_str("driver", self->owner->super.super.id),
+                   log_expr_node_location_tag(self->owner->super.super.super.expr_node),
+                   evt_tag_int("batch_size", batch->size));
+          _disconnect_and_suspend(self);
+          break;
+        }
+    }
+
+  return !self->suspended;
+}
+
+/* NOTE: runs in the worker thread */
+static gint
+_get_pop_batch_size(LogThreadedDestWorker *self)
+{
+  gint max_msgs = log_threaded_dest_worker_get_flush_lines(self) - self->batch_size;
+
+  /* a rewound batch is retried on its own */
+  if (self->rewound_batch_size)
+    max_msgs = self->rewound_batch_size;
+
+  return CLAMP(max_msgs, 1, LOG_THREADED_DEST_POP_BATCH_MAX);
+}
+
+/* Inserts a single message, returns FALSE if we shouldn't continue with
+ * the rest.
+ *
+ * NOTE: runs in the worker thread */
+static gboolean
+_perform_insert(LogThreadedDestWorker *self, LogMessage *msg, LogPathOptions *path_options)
+{
+  worker_insert_result_t result;
+
+  msg_set_context(msg);
+  log_msg_refcache_start_consumer(msg, path_options);
+
+  if (self->owner->batch_latency_target > 0)
+    {
+      iv_validate_now();
+      self->delivery_start = iv_now;
+      if (self->batch_size == 0)
+        self->batch_start = iv_now;
+    }
+
+  self->batch_size++;
+  ScratchBuffersMarker mark;
+  scratch_buffers_mark(&mark);
+
+  result = log_threaded_dest_worker_insert(self, msg);
+  scratch_buffers_reclaim_marked(mark);
+
+  _process_result(self, result);
+
+  log_msg_unref(msg);
+  msg_set_context(NULL);
+  log_msg_refcache_stop();
+
+  iv_invalidate_now();
+
+  if (self->rewound_batch_size)
+    {
+      self->rewound_batch_size--;
+      if (self->rewound_batch_size == 0)
+        return FALSE;
+    }
+
+  return G_LIKELY(!self->owner->under_termination) && !self->suspended && !_is_inflight_window_full(self);
+}
+
 /* NOTE: runs in the worker thread, whenever items on our queue are
  * available. It iterates all elements on the queue, however will terminate
- * if the mainloop requests that we exit. */
+ * if the mainloop requests that we exit. Messages are fetched from the
+ * queue a batch at a time, the ones not inserted when we stop are put
+ * back. */
 static void
 _perform_inserts(LogThreadedDestWorker *self)
 {
-  LogMessage *msg;
-  worker_insert_result_t result;
-  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msgs[LOG_THREADED_DEST_POP_BATCH_MAX];
+  LogPathOptions path_options[LOG_THREADED_DEST_POP_BATCH_MAX];
+  gboolean more = TRUE;
+  gint num_msgs, i;
 
   if (self->batch_size == 0)
     {
@@ -308,34 +660,24 @@ _perform_inserts(LogThreadedDestWorker *self)
       self->last_flush_time = iv_now;
     }
 
-  while (G_LIKELY(!self->owner->under_termination) &&
+  while (more &&
+         G_LIKELY(!self->owner->under_termination) &&
          !self->suspended &&
-         (msg = log_queue_pop_head(self->queue, &path_options)) != NULL)
+         !_is_inflight_window_full(self) &&
+         (num_msgs = log_queue_pop_head_batch(self->queue, msgs, path_options, _get_pop_batch_size(self))) > 0)
     {
-      msg_set_context(msg);
-      log_msg_refcache_start_consumer(msg, &path_options);
-
-      self->batch_size++;
-      ScratchBuffersMarker mark;
-      scratch_buffers_mark(&mark);
-
-      result = log_threaded_dest_worker_insert(self, msg);
-      scratch_buffers_reclaim_marked(mark);
-
-      _process_result(self, result);
-
-      log_msg_unref(msg);
-      msg_set_context(NULL);
-      log_msg_refcache_stop();
-
-      if (self->rewound_batch_size)
+      self->popped_ahead = num_msgs;
+      for (i = 0; i < num_msgs && self->popped_ahead > 0; i++)
         {
-          self->rewound_batch_size--;
-          if (self->rewound_batch_size == 0)
-            break;
+          self->popped_ahead--;
+          more = _perform_insert(self, msgs[i], &path_options[i]);
+          if (!more)
+            _return_popped_ahead(self);
         }
 
-      iv_invalidate_now();
+      /* these went back to the queue, either above or by a rewind */
+      for (; i < num_msgs; i++)
+        log_msg_unref(msgs[i]);
     }
   self->rewound_batch_size = 0;
 }
@@ -349,7 +691,7 @@ _perform_flush(LogThreadedDestWorker *self)
    * flush() being called always, even if WORKER_INSERT_RESULT_SUCCESS is
    * returned, in which case batch_size is already zero at this point.
    */
-  if (!self->suspended)
+  if (!self->suspended && !_is_inflight_window_full(self))
     {
       msg_trace("flushing batch",
                 evt_tag_str("driver", self->owner->super.super.id),
@@ -391,7 +733,7 @@ static void
 _schedule_restart_on_flush_timeout(LogThreadedDestWorker *self)
 {
   self->timer_flush.expires = self->last_flush_time;
-  timespec_add_msec(&self->timer_flush.expires, self->owner->flush_timeout);
+  timespec_add_msec(&self->timer_flush.expires, _get_flush_timeout(self));
   iv_timer_register(&self->timer_flush);
 }
 
@@ -424,6 +766,62 @@ _schedule_restart_on_throttle_timeout(LogThreadedDestWorker *self, gint timeout_
   iv_timer_register(&self->timer_throttle);
 }
 
+static gboolean
+_is_stealing_allowed(LogThreadedDestWorker *self)
+{
+  /* stealing doesn't keep the order of the messages with the same key */
+  return self->owner->num_workers > 1 &&
+         !self->owner->worker_partition_key &&
+         G_LIKELY(!self->owner->under_termination);
+}
+
+/* Takes over the newest part of the messages queued for the busiest
+ * sibling, which it hasn't started to work on, so that one slow worker
+ * doesn't hold back messages while the others are idle.  Siblings with at
+ * most one of our batches queued are left alone.
+ *
+ * NOTE: runs in the worker thread, when its queue is empty */
+static gboolean
+_steal_from_siblings(LogThreadedDestWorker *self)
+{
+  LogThreadedDestDriver *owner = self->owner;
+  LogThreadedDestWorker *victim = NULL;
+  gint flush_lines = MAX(log_threaded_dest_worker_get_flush_lines(self), 1);
+  gint64 victim_length = flush_lines;
+  gint stolen;
+
+  for (gint i = 0; i < owner->workers_started; i++)
+    {
+      LogThreadedDestWorker *sibling = owner->workers[i];
+      gint64 length;
+
+      if (sibling == self || !sibling || !sibling->queue)
+        continue;
+
+      length = log_queue_get_length(sibling->queue);
+      if (length > victim_length)
+        {
+          victim = sibling;
+          victim_length = length;
+        }
+    }
+
+  if (!victim)
+    return FALSE;
+
+  stolen = log_queue_steal_tail(victim->queue, self->queue, flush_lines);
+  if (stolen == 0)
+    return FALSE;
+
+  msg_trace("Messages taken over from a sibling worker",
+            evt_tag_str("driver", owner->super.super.id),
+            evt_tag_int("index", self->worker_index),
+            evt_tag_int("sibling", victim->worker_index),
+            evt_tag_int("messages", stolen));
+  stats_counter_add(self->stolen_batches, (stolen + flush_lines - 1) / flush_lines);
+  return TRUE;
+}
+
 static void
 _perform_work(gpointer data)
 {
@@ -440,6 +838,18 @@ _perform_work(gpointer data)
       _connect(self);
       _schedule_restart(self);
     }
+  else if (!_finish_inflight_batches(self))
+    {
+      _schedule_restart(self);
+    }
+  else if (_is_inflight_window_full(self))
+    {
+      /* as many batches are in flight as we allow, we are woken up by
+       * log_threaded_dest_worker_batch_finished() */
+      msg_trace("waiting for batches in flight",
+                evt_tag_str("driver", self->owner->super.super.id),
+                evt_tag_int("inflight_batches", g_queue_get_length(&self->inflight_batches)));
+    }
   else if (log_queue_check_items(self->queue, &timeout_msec,
                                  _message_became_available_callback,
                                  self, NULL))
@@ -487,6 +897,12 @@ _perform_work(gpointer data)
       _schedule_restart_on_throttle_timeout(self, timeout_msec);
 
     }
+  else if (_is_stealing_allowed(self) && _steal_from_siblings(self))
+    {
+      /* our queue was empty, but a sibling had plenty of messages waiting,
+       * some of which are now ours, start working on them */
+      _schedule_restart(self);
+    }
   else
     {
       /* NOTE: at this point we are not doing anything but keep the
@@ -589,14 +1005,48 @@ _wait_for_startup_finished(LogThreadedDestWorker *self)
   g_mutex_unlock(self->owner->lock);
 }
 
+/* the queues of all workers are accounted for in the counters of the
+ * driver, to make an uneven distribution visible each worker gets its own
+ * cluster too, with the worker index appended to the instance name.  With
+ * a single worker, its counters go to the cluster of the driver. */
+static void
+_init_worker_stats_key(LogThreadedDestWorker *self, StatsClusterKey *sc_key, gchar *instance, gsize instance_size)
+{
+  LogThreadedDestDriver *owner = self->owner;
+
+  if (owner->num_workers == 1)
+    {
+      _init_stats_key(owner, sc_key);
+      return;
+    }
+
+  g_snprintf(instance, instance_size, "%s#%d", owner->format_stats_instance(owner), self->worker_index);
+  stats_cluster_logpipe_key_set(sc_key, owner->stats_source | SCS_DESTINATION, owner->super.super.id, instance);
+}
+
 static void
 _register_worker_stats(LogThreadedDestWorker *self)
 {
   StatsClusterKey sc_key;
+  gchar instance[256];
 
   stats_lock();
   _init_stats_key(self->owner, &sc_key);
   log_queue_register_stats_counters(self->queue, 0, &sc_key);
+
+  _init_worker_stats_key(self, &sc_key, instance, sizeof(instance));
+  if (self->owner->num_workers > 1)
+    {
+      stats_register_counter(0, &sc_key, SC_TYPE_PROCESSED, &self->processed_messages);
+      stats_register_counter(0, &sc_key, SC_TYPE_STOLEN_BATCHES, &self->stolen_batches);
+    }
+
+  if (self->owner->batch_latency_target > 0)
+    {
+      stats_register_counter(0, &sc_key, SC_TYPE_BATCH_LINES, &self->batch_lines);
+      stats_register_counter(0, &sc_key, SC_TYPE_FLUSH_LATENCY, &self->flush_latency);
+      stats_counter_set(self->batch_lines, self->flush_lines);
+    }
   stats_unlock();
 }
 
@@ -604,10 +1054,24 @@ static void
 _unregister_worker_stats(LogThreadedDestWorker *self)
 {
   StatsClusterKey sc_key;
+  gchar instance[256];
 
   stats_lock();
   _init_stats_key(self->owner, &sc_key);
   log_queue_unregister_stats_counters(self->queue, &sc_key);
+
+  _init_worker_stats_key(self, &sc_key, instance, sizeof(instance));
+  if (self->owner->num_workers > 1)
+    {
+      stats_unregister_counter(&sc_key, SC_TYPE_PROCESSED, &self->processed_messages);
+      stats_unregister_counter(&sc_key, SC_TYPE_STOLEN_BATCHES, &self->stolen_batches);
+    }
+
+  if (self->owner->batch_latency_target > 0)
+    {
+      stats_unregister_counter(&sc_key, SC_TYPE_BATCH_LINES, &self->batch_lines);
+      stats_unregister_counter(&sc_key, SC_TYPE_FLUSH_LATENCY, &self->flush_latency);
+    }
   stats_unlock();
 }
 
@@ -682,6 +1146,10 @@ log_threaded_dest_worker_deinit_method(LogThreadedDestWorker *self)
 void
 log_threaded_dest_worker_free_method(LogThreadedDestWorker *self)
 {
+  LogThreadedDestBatch *batch;
+
+  while ((batch = g_queue_pop_head(&self->inflight_batches)))
+    g_free(batch);
   g_cond_free(self->started_up);
 }
 
@@ -694,6 +1162,7 @@ log_threaded_dest_worker_init_instance(LogThreadedDestWorker *self, LogThreadedD
   self->free_fn = log_threaded_dest_worker_free_method;
   self->owner = owner;
   self->started_up = g_cond_new();
+  g_queue_init(&self->inflight_batches);
   _init_watches(self);
 }
 
@@ -715,6 +1184,15 @@ log_threaded_dest_driver_set_num_workers(LogDriver *s, gint num_workers)
   self->num_workers = num_workers;
 }
 
+void
+log_threaded_dest_driver_set_worker_partition_key(LogDriver *s, LogTemplate *worker_partition_key)
+{
+  LogThreadedDestDriver *self = (LogThreadedDestDriver *) s;
+
+  log_template_unref(self->worker_partition_key);
+  self->worker_partition_key = worker_partition_key;
+}
+
 /* compatibility bridge between LogThreadedDestWorker */
 
 static gboolean
@@ -819,6 +1297,8 @@ _start_worker_thread(LogThreadedDestDriver *self)
   g_assert(self->workers[worker_index] == NULL);
   self->workers[worker_index] = dw;
   self->workers_started++;
+  if (self->batch_latency_target > 0)
+    _init_batching(dw);
 
   main_loop_create_worker_thread(_worker_thread,
                                  _request_worker_exit,
@@ -835,15 +1315,34 @@ log_threaded_dest_driver_set_max_retries(LogDriver *s, gint max_retries)
   self->retries_max = max_retries;
 }
 
-LogThreadedDestWorker *
+static gint
+_partition_worker_index(LogThreadedDestDriver *self, LogMessage *msg)
+{
+  GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
+  ScratchBuffersMarker mark;
+  GString *key = scratch_buffers_alloc_and_mark(&mark);
+  gint worker_index;
+
+  log_template_format(self->worker_partition_key, msg, &cfg->template_options, LTZ_SEND, 0, NULL, key);
+  worker_index = g_str_hash(key->str) % self->num_workers;
+  scratch_buffers_reclaim_marked(mark);
+  return worker_index;
+}
+
+static LogThreadedDestWorker *
 _lookup_worker(LogThreadedDestDriver *self, LogMessage *msg)
 {
   static gint last_worker = 0;
+  gint worker_index;
 
-  gint worker_index = last_worker % self->num_workers;
-  last_worker++;
+  if (self->num_workers == 1)
+    return self->workers[0];
+
+  if (self->worker_partition_key)
+    return self->workers[_partition_worker_index(self, msg)];
 
-  /* here would come the lookup mechanism that maps msg -> worker that doesn't exist yet. */
+  worker_index = last_worker % self->num_workers;
+  last_worker++;
   return self->workers[worker_index];
 }
 
@@ -865,6 +1364,7 @@ log_threaded_dest_driver_queue(LogPipe *s, LogMessage *msg,
   log_queue_push_tail(dw->queue, log_msg_ref(msg), path_options);
 
   stats_counter_inc(self->processed_messages);
+  stats_counter_inc(dw->processed_messages);
 
   log_dest_driver_queue_method(s, msg, path_options);
 }
@@ -978,6 +1478,7 @@ log_threaded_dest_driver_free(LogPipe *s)
   log_threaded_dest_worker_free_method(&self->worker.instance);
   g_mutex_free(self->lock);
   g_free(self->workers);
+  log_template_unref(self->worker_partition_key);
   log_dest_driver_free((LogPipe *)self);
 }
 
@@ -995,6 +1496,8 @@ log_threaded_dest_driver_init_instance(LogThreadedDestDriver *self, GlobalConfig
   self->time_reopen = -1;
   self->flush_lines = -1;
   self->flush_timeout = -1;
+  self->batch_lines_min = 1;
+  self->max_inflight_batches = 1;
   self->num_workers = 1;
 
   self->retries_max = MAX_RETRIES_OF_FAILED_INSERT_DEFAULT;
@@ -31,6 +31,7 @@
 #include "logqueue.h"
 #include "mainloop-worker.h"
 #include "seqnum.h"
+#include "template/templates.h"
 
 #include <iv.h>
 #include <iv_event.h>
@@ -42,7 +43,10 @@ typedef enum
   WORKER_INSERT_RESULT_EXPLICIT_ACK_MGMT,
   WORKER_INSERT_RESULT_SUCCESS,
   WORKER_INSERT_RESULT_QUEUED,
-  WORKER_INSERT_RESULT_NOT_CONNECTED
+  WORKER_INSERT_RESULT_NOT_CONNECTED,
+  /* the batch is being delivered asynchronously, its result is reported
+   * by log_threaded_dest_worker_batch_finished() */
+  WORKER_INSERT_RESULT_PENDING
 } worker_insert_result_t;
 
 typedef struct _LogThreadedDestDriver LogThreadedDestDriver;
@@ -61,12 +65,31 @@ struct _LogThreadedDestWorker
   LogThreadedDestDriver *owner;
 
   gint worker_index;
+  /* messages routed to this worker, only registered with multiple workers */
+  StatsCounterItem *processed_messages;
+  StatsCounterItem *stolen_batches;
   gboolean connected;
   gint batch_size;
   gint rewound_batch_size;
+  /* popped from the queue, but not yet passed to insert() */
+  gint popped_ahead;
   gint retries_counter;
   gint32 seq_num;
   struct timespec last_flush_time;
+  /* the batching parameters tuned after each batch, only used if
+   * batch-latency-target() is set */
+  gint flush_lines;
+  gint flush_timeout;
+  struct timespec batch_start;
+  struct timespec delivery_start;
+  /* moving average of the time it takes to deliver a batch, in msec */
+  glong delivery_time;
+  StatsCounterItem *batch_lines;
+  StatsCounterItem *flush_latency;
+  /* batches being delivered asynchronously, oldest first */
+  GQueue inflight_batches;
+  gint inflight_messages;
+  guint32 batch_id;
   gboolean enable_flush_timeout;
   gboolean suspended;
   gboolean startup_finished;
@@ -93,6 +116,11 @@ struct _LogThreadedDestDriver
 
   gint flush_lines;
   gint flush_timeout;
+  /* batches are sized between batch_lines_min and flush_lines to be
+   * delivered within batch_latency_target msecs, 0 disables tuning */
+  gint batch_latency_target;
+  gint batch_lines_min;
+  gint max_inflight_batches;
   gboolean under_termination;
   time_t time_reopen;
   gint retries_max;
@@ -117,6 +145,8 @@ struct _LogThreadedDestDriver
   LogThreadedDestWorker **workers;
   gint num_workers;
   gint workers_started;
+  /* messages with the same key are always delivered by the same worker */
+  LogTemplate *worker_partition_key;
 
   gint stats_source;
 
@@ -175,11 +205,42 @@ log_threaded_dest_worker_insert(LogThreadedDestWorker *self, LogMessage *msg)
   return self->insert(self, msg);
 }
 
+/* Identifies the batch being built.  Drivers delivering batches
+ * asynchronously return WORKER_INSERT_RESULT_PENDING from insert() or
+ * flush() and report the result of the batch with this id using
+ * log_threaded_dest_worker_batch_finished(), up to max-inflight-batches()
+ * batches may be in flight at the same time.  Their results may arrive in
+ * any order, the messages are acked in order.  If a batch fails, the
+ * worker is disconnected and all the batches in flight (as well as the one
+ * being built) are put back to the queue, the driver should forget about
+ * them in disconnect(). */
+static inline guint32
+log_threaded_dest_worker_get_batch_id(LogThreadedDestWorker *self)
+{
+  return self->batch_id;
+}
+
+/* the number of messages to be batched before flushing them */
+static inline gint
+log_threaded_dest_worker_get_flush_lines(LogThreadedDestWorker *self)
+{
+  if (self->owner->batch_latency_target > 0)
+    return self->flush_lines;
+  return self->owner->flush_lines;
+}
+
 static inline worker_insert_result_t
 log_threaded_dest_worker_flush(LogThreadedDestWorker *self)
 {
   worker_insert_result_t result = WORKER_INSERT_RESULT_SUCCESS;
 
+  if (self->owner->batch_latency_target > 0)
+    {
+      iv_invalidate_now();
+      iv_validate_now();
+      self->delivery_start = iv_now;
+    }
+
   if (self->flush)
     result = self->flush(self);
   iv_validate_now();
@@ -194,6 +255,8 @@ log_threaded_dest_driver_flush(LogThreadedDestDriver *self)
   return log_threaded_dest_worker_flush(&self->worker.instance);
 }
 
+void log_threaded_dest_worker_batch_finished(LogThreadedDestWorker *self, guint32 batch_id,
+                                             worker_insert_result_t result);
 void log_threaded_dest_worker_ack_messages(LogThreadedDestWorker *self, gint batch_size);
 void log_threaded_dest_worker_drop_messages(LogThreadedDestWorker *self, gint batch_size);
 void log_threaded_dest_worker_rewind_messages(LogThreadedDestWorker *self, gint batch_size);
@@ -212,7 +275,11 @@ void log_threaded_dest_driver_free(LogPipe *s);
 
 void log_threaded_dest_driver_set_max_retries(LogDriver *s, gint max_retries);
 void log_threaded_dest_driver_set_num_workers(LogDriver *s, gint num_workers);
+void log_threaded_dest_driver_set_worker_partition_key(LogDriver *s, LogTemplate *worker_partition_key);
 void log_threaded_dest_driver_set_flush_lines(LogDriver *s, gint flush_lines);
 void log_threaded_dest_driver_set_flush_timeout(LogDriver *s, gint flush_timeout);
+void log_threaded_dest_driver_set_batch_latency_target(LogDriver *s, gint batch_latency_target);
+void log_threaded_dest_driver_set_batch_lines_min(LogDriver *s, gint batch_lines_min);
+void log_threaded_dest_driver_set_max_inflight_batches(LogDriver *s, gint max_inflight_batches);
 
 #endif
@@ -47,6 +47,9 @@
 #include <iv_event.h>
 #include <iv_work.h>
 
+/* the most messages fetched from the queue with a single call */
+#define LOG_WRITER_POP_BATCH_MAX 256
+
 typedef enum
 {
   /* flush modes */
@@ -1196,13 +1199,52 @@ log_writer_write_message(LogWriter *self, LogMessage *msg, LogPathOptions *path_
     }
 }
 
-static inline LogMessage *
-log_writer_queue_pop_message(LogWriter *self, LogPathOptions *path_options, gboolean force_flush)
+static inline gint
+log_writer_queue_pop_messages(LogWriter *self, LogMessage **msgs, LogPathOptions *path_options, gboolean force_flush)
 {
+  gint max_msgs = CLAMP(self->options->flush_lines, 1, LOG_WRITER_POP_BATCH_MAX);
+
   if (force_flush)
-    return log_queue_pop_head_ignore_throttle(self->queue, path_options);
+    return log_queue_pop_head_batch_ignore_throttle(self->queue, msgs, path_options, max_msgs);
   else
-    return log_queue_pop_head(self->queue, path_options);
+    return log_queue_pop_head_batch(self->queue, msgs, path_options, max_msgs);
+}
+
+/*
+ * Writes the messages popped by log_writer_queue_pop_messages(). If one of
+ * them can't be sent, it has already been put back to the queue by
+ * log_writer_write_message(), the ones following it are returned here.
+ * As rewinding the backlog works from its tail, this restores the
+ * original order.
+ */
+static gboolean
+log_writer_write_messages(LogWriter *self, LogMessage **msgs, LogPathOptions *path_options, gint num_msgs,
+                          gboolean *write_error)
+{
+  gint i;
+
+  for (i = 0; i < num_msgs; i++)
+    {
+      ScratchBuffersMarker mark;
+      scratch_buffers_mark(&mark);
+      if (!log_writer_write_message(self, msgs[i], &path_options[i], write_error))
+        {
+          scratch_buffers_reclaim_marked(mark);
+          break;
+        }
+      scratch_buffers_reclaim_marked(mark);
+
+      if (!*write_error)
+        stats_counter_inc(self->written_messages);
+    }
+
+  if (i == num_msgs)
+    return TRUE;
+
+  log_queue_rewind_backlog(self->queue, num_msgs - i - 1);
+  for (i++; i < num_msgs; i++)
+    log_msg_unref(msgs[i]);
+  return FALSE;
 }
 
 static inline gboolean
@@ -1245,23 +1287,15 @@ log_writer_flush(LogWriter *self, LogWriterFlushMode flush_mode)
 
   while ((!main_loop_worker_job_quit() || flush_mode == LW_FLUSH_FORCE) && !write_error)
     {
-      LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
-      LogMessage *msg = log_writer_queue_pop_message(self, &path_options, flush_mode == LW_FLUSH_FORCE);
+      LogMessage *msgs[LOG_WRITER_POP_BATCH_MAX];
+      LogPathOptions path_options[LOG_WRITER_POP_BATCH_MAX];
+      gint num_msgs = log_writer_queue_pop_messages(self, msgs, path_options, flush_mode == LW_FLUSH_FORCE);
 
-      if (!msg)
+      if (num_msgs == 0)
         break;
 
-      ScratchBuffersMarker mark;
-      scratch_buffers_mark(&mark);
-      if (!log_writer_write_message(self, msg, &path_options, &write_error))
-        {
-          scratch_buffers_reclaim_marked(mark);
-          break;
-        }
-      scratch_buffers_reclaim_marked(mark);
-
-      if (!write_error)
-        stats_counter_inc(self->written_messages);
+      if (!log_writer_write_messages(self, msgs, path_options, num_msgs, &write_error))
+        break;
     }
 
   if (write_error)
@@ -73,6 +73,8 @@ list_scanner_input_gstring_array(ListScanner *self, gint argc, GString *argv[])
 {
   gint i;
 
+  _free_input(self);
+
   for (i = 0; i < argc; i++)
     {
       g_ptr_array_add(self->argv_buffer, argv[i]->str);
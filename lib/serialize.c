@@ -50,6 +50,36 @@ typedef struct _SerializeBufferArchive
   gchar *buff;
 } SerializeBufferArchive;
 
+/*
+ * The IOV archive collects the serialized data as a list of segments that
+ * can be passed to writev()/pwritev() as is.  Small writes (integers,
+ * length prefixes) are copied into a scratch buffer and coalesced,
+ * whereas larger blobs written through serialize_write_blob_ref() are
+ * referenced in place.
+ */
+#define SERIALIZE_IOV_ARCHIVE_MIN_REF_SIZE 64
+
+typedef struct _SerializeIOVSegment
+{
+  /* NULL means that the data is stored in the scratch buffer at offset */
+  const gchar *base;
+  gsize offset;
+  gsize len;
+} SerializeIOVSegment;
+
+typedef struct _SerializeIOVArchive
+{
+  SerializeArchive super;
+  GArray *segments;
+  GString *scratch;
+  GArray *iov;
+  gsize length;
+
+  /* read position */
+  guint read_segment;
+  gsize read_offset;
+} SerializeIOVArchive;
+
 void
 _serialize_handle_errors(SerializeArchive *self, const gchar *error_desc, GError *error)
 {
@@ -67,6 +97,8 @@ _serialize_handle_errors(SerializeArchive *self, const gchar *error_desc, GError
 void
 serialize_archive_free(SerializeArchive *self)
 {
+  if (self->free_fn)
+    self->free_fn(self);
   g_clear_error(&self->error);
   g_slice_free1(self->len, self);
 }
@@ -130,6 +162,7 @@ serialize_string_archive_reset(SerializeArchive *sa)
   SerializeStringArchive *self = (SerializeStringArchive *) sa;
 
   self->pos = 0;
+  g_clear_error(&self->super.error);
 }
 
 static gboolean
@@ -232,3 +265,164 @@ serialize_buffer_archive_new(gchar *buff, gsize len)
   self->len = len;
   return &self->super;
 }
+
+static inline const gchar *
+_iov_segment_get_data(SerializeIOVArchive *self, SerializeIOVSegment *segment)
+{
+  if (segment->base)
+    return segment->base;
+  return self->scratch->str + segment->offset;
+}
+
+static gboolean
+serialize_iov_archive_read_bytes(SerializeArchive *s, gchar *buf, gsize buflen, GError **error)
+{
+  SerializeIOVArchive *self = (SerializeIOVArchive *) s;
+
+  g_return_val_if_fail(error == NULL || (*error) == NULL, FALSE);
+
+  while (buflen > 0)
+    {
+      SerializeIOVSegment *segment;
+      gsize chunk;
+
+      if (self->read_segment >= self->segments->len)
+        {
+          g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_IO, "Error reading from iovec, stored data too short");
+          return FALSE;
+        }
+
+      segment = &g_array_index(self->segments, SerializeIOVSegment, self->read_segment);
+      chunk = MIN(buflen, segment->len - self->read_offset);
+      memcpy(buf, _iov_segment_get_data(self, segment) + self->read_offset, chunk);
+
+      buf += chunk;
+      buflen -= chunk;
+      self->read_offset += chunk;
+      if (self->read_offset == segment->len)
+        {
+          self->read_segment++;
+          self->read_offset = 0;
+        }
+    }
+  return TRUE;
+}
+
+static gboolean
+serialize_iov_archive_write_bytes(SerializeArchive *s, const gchar *buf, gsize buflen, GError **error)
+{
+  SerializeIOVArchive *self = (SerializeIOVArchive *) s;
+  SerializeIOVSegment *last = NULL;
+
+  g_return_val_if_fail(error == NULL || (*error) == NULL, FALSE);
+
+  if (buflen == 0)
+    return TRUE;
+
+  if (self->segments->len > 0)
+    last = &g_array_index(self->segments, SerializeIOVSegment, self->segments->len - 1);
+
+  if (last && !last->base && last->offset + last->len == self->scratch->len)
+    {
+      last->len += buflen;
+    }
+  else
+    {
+      SerializeIOVSegment segment = { NULL, self->scratch->len, buflen };
+
+      g_array_append_val(self->segments, segment);
+    }
+
+  g_string_append_len(self->scratch, buf, buflen);
+  self->length += buflen;
+  return TRUE;
+}
+
+static gboolean
+serialize_iov_archive_write_bytes_ref(SerializeArchive *s, const gchar *buf, gsize buflen, GError **error)
+{
+  SerializeIOVArchive *self = (SerializeIOVArchive *) s;
+  SerializeIOVSegment segment = { buf, 0, buflen };
+
+  g_return_val_if_fail(error == NULL || (*error) == NULL, FALSE);
+
+  /* copying small chunks is cheaper than an additional iovec entry */
+  if (buflen < SERIALIZE_IOV_ARCHIVE_MIN_REF_SIZE)
+    return serialize_iov_archive_write_bytes(s, buf, buflen, error);
+
+  g_array_append_val(self->segments, segment);
+  self->length += buflen;
+  return TRUE;
+}
+
+/*
+ * Returns the collected data as an array of iovecs, valid until the next
+ * write to the archive.  Referenced blobs must still be valid at the time
+ * the array is used.
+ */
+const struct iovec *
+serialize_iov_archive_get_iov(SerializeArchive *s, gint *iovcnt)
+{
+  SerializeIOVArchive *self = (SerializeIOVArchive *) s;
+  guint i;
+
+  g_array_set_size(self->iov, self->segments->len);
+  for (i = 0; i < self->segments->len; i++)
+    {
+      SerializeIOVSegment *segment = &g_array_index(self->segments, SerializeIOVSegment, i);
+      struct iovec *iov = &g_array_index(self->iov, struct iovec, i);
+
+      iov->iov_base = (gchar *) _iov_segment_get_data(self, segment);
+      iov->iov_len = segment->len;
+    }
+
+  *iovcnt = self->iov->len;
+  return (const struct iovec *) self->iov->data;
+}
+
+gsize
+serialize_iov_archive_get_length(SerializeArchive *s)
+{
+  SerializeIOVArchive *self = (SerializeIOVArchive *) s;
+
+  return self->length;
+}
+
+void
+serialize_iov_archive_reset(SerializeArchive *s)
+{
+  SerializeIOVArchive *self = (SerializeIOVArchive *) s;
+
+  g_array_set_size(self->segments, 0);
+  g_string_truncate(self->scratch, 0);
+  self->length = 0;
+  self->read_segment = 0;
+  self->read_offset = 0;
+  g_clear_error(&self->super.error);
+}
+
+static void
+serialize_iov_archive_free(SerializeArchive *s)
+{
+  SerializeIOVArchive *self = (SerializeIOVArchive *) s;
+
+  g_array_free(self->segments, TRUE);
+  g_array_free(self->iov, TRUE);
+  g_string_free(self->scratch, TRUE);
+}
+
+SerializeArchive *
+serialize_iov_archive_new(void)
+{
+  SerializeIOVArchive *self = g_slice_new0(SerializeIOVArchive);
+
+  self->super.read_bytes = serialize_iov_archive_read_bytes;
+  self->super.write_bytes = serialize_iov_archive_write_bytes;
+  self->super.write_bytes_ref = serialize_iov_archive_write_bytes_ref;
+  self->super.free_fn = serialize_iov_archive_free;
+  self->super.len = sizeof(SerializeIOVArchive);
+  self->segments = g_array_sized_new(FALSE, FALSE, sizeof(SerializeIOVSegment), 8);
+  self->iov = g_array_sized_new(FALSE, FALSE, sizeof(struct iovec), 8);
+  self->scratch = g_string_sized_new(256);
+  return &self->super;
+}
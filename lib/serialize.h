@@ -29,6 +29,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <sys/uio.h>
 
 typedef struct _SerializeArchive SerializeArchive;
 
@@ -40,6 +41,12 @@ struct _SerializeArchive
 
   gboolean (*read_bytes)(SerializeArchive *archive, gchar *buf, gsize count, GError **error);
   gboolean (*write_bytes)(SerializeArchive *archive, const gchar *buf, gsize count, GError **error);
+
+  /* optional: store a reference to buf instead of copying it, buf must
+   * remain valid and unchanged for as long as the archive contents are
+   * used.  Archives without this method copy the data */
+  gboolean (*write_bytes_ref)(SerializeArchive *archive, const gchar *buf, gsize count, GError **error);
+  void (*free_fn)(SerializeArchive *archive);
 };
 
 /* this is private and is only published so that the inline functions below can invoke it */
@@ -65,6 +72,19 @@ serialize_archive_write_bytes(SerializeArchive *self, const gchar *buf, gsize bu
   return self->error == NULL;
 }
 
+static inline gboolean
+serialize_archive_write_bytes_ref(SerializeArchive *self, const gchar *buf, gsize buflen)
+{
+  GError *error = NULL;
+
+  if (!self->write_bytes_ref)
+    return serialize_archive_write_bytes(self, buf, buflen);
+
+  if ((self->error == NULL) && !self->write_bytes_ref(self, buf, buflen, &error))
+    _serialize_handle_errors(self, "Error writing serialized data", error);
+  return self->error == NULL;
+}
+
 static inline gboolean
 serialize_write_uint32(SerializeArchive *archive, guint32 value)
 {
@@ -211,6 +231,14 @@ serialize_write_blob(SerializeArchive *archive, const void *blob, gsize len)
   return serialize_archive_write_bytes(archive, blob, len);
 }
 
+/* same as serialize_write_blob(), but blob may be referenced by the archive
+ * instead of copied, see write_bytes_ref above */
+static inline gboolean
+serialize_write_blob_ref(SerializeArchive *archive, const void *blob, gsize len)
+{
+  return serialize_archive_write_bytes_ref(archive, blob, len);
+}
+
 static inline gboolean
 serialize_read_blob(SerializeArchive *archive, void *blob, gsize len)
 {
@@ -260,6 +288,16 @@ serialize_write_cstring(SerializeArchive *archive, const gchar *str, gssize len)
          (len == 0 || serialize_archive_write_bytes(archive, str, len));
 }
 
+static inline gboolean
+serialize_write_cstring_ref(SerializeArchive *archive, const gchar *str, gssize len)
+{
+  if (len < 0)
+    len = strlen(str);
+
+  return serialize_write_uint32(archive, len) &&
+         (len == 0 || serialize_archive_write_bytes_ref(archive, str, len));
+}
+
 static inline gboolean
 serialize_read_cstring(SerializeArchive *archive, gchar **str, gsize *str_len)
 {
@@ -285,6 +323,10 @@ SerializeArchive *serialize_string_archive_new(GString *str);
 void serialize_string_archive_reset(SerializeArchive *sa);
 SerializeArchive *serialize_buffer_archive_new(gchar *buff, gsize len);
 gsize serialize_buffer_archive_get_pos(SerializeArchive *self);
+SerializeArchive *serialize_iov_archive_new(void);
+const struct iovec *serialize_iov_archive_get_iov(SerializeArchive *self, gint *iovcnt);
+gsize serialize_iov_archive_get_length(SerializeArchive *self);
+void serialize_iov_archive_reset(SerializeArchive *self);
 void serialize_archive_free(SerializeArchive *self);
 
 #endif
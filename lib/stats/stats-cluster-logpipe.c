@@ -37,6 +37,10 @@ static const gchar *tag_names[SC_TYPE_MAX] =
   /* [SC_TYPE_MATCHED] = */ "matched",
   /* [SC_TYPE_NOT_MATCHED] = */ "not_matched",
   /* [SC_TYPE_WRITTEN] = */ "written",
+  /* [SC_TYPE_PAYLOAD_REALLOCS] = */ "payload_reallocs",
+  /* [SC_TYPE_BATCH_LINES] = */ "batch_lines",
+  /* [SC_TYPE_FLUSH_LATENCY] = */ "flush_latency",
+  /* [SC_TYPE_STOLEN_BATCHES] = */ "stolen_batches",
 };
 
 static void
@@ -39,6 +39,10 @@ typedef enum
   SC_TYPE_MATCHED, /* discarded messages of filter */
   SC_TYPE_NOT_MATCHED, /* discarded messages of filter */
   SC_TYPE_WRITTEN, /* number of sent messages */
+  SC_TYPE_PAYLOAD_REALLOCS, /* number of times message payloads had to be grown */
+  SC_TYPE_BATCH_LINES, /* current batch size of a destination */
+  SC_TYPE_FLUSH_LATENCY, /* time it took to deliver the last batch, in msec */
+  SC_TYPE_STOLEN_BATCHES, /* batches worth of messages taken over from another worker */
   SC_TYPE_MAX
 } StatsCounterGroupLogPipe;
 
@@ -38,6 +38,8 @@ _reset_counter_if_needed(StatsCluster *sc, gint type, StatsCounterItem *counter,
     {
     case SC_TYPE_QUEUED:
     case SC_TYPE_MEMORY_USAGE:
+    case SC_TYPE_BATCH_LINES:
+    case SC_TYPE_FLUSH_LATENCY:
       return;
     default:
       _reset_counter(sc, type, counter, user_data);
@@ -63,7 +63,14 @@ struct _LogTemplateFunction
                       GError **error);
 
   /* evaluate arguments, storing argument buffers in arg_bufs in case it
-   * makes sense to reuse those buffers */
+   * makes sense to reuse those buffers.
+   *
+   * Lazy evaluation: eval is optional, if it is NULL, call() is invoked
+   * directly, with args->argv unset, and the function evaluates the
+   * arguments it actually needs itself.  Conditionals and other functions
+   * that only use some of their arguments should use this, see
+   * TEMPLATE_FUNCTION_SIMPLE_LAZY() for the TFSimpleFuncState based
+   * implementation. */
   void (*eval)(LogTemplateFunction *self, gpointer state, LogTemplateInvokeArgs *args);
 
   /* call the function */
@@ -36,6 +36,7 @@
 #include "hostname.h"
 #include "template/templates.h"
 #include "cfg.h"
+#include "tls-support.h"
 
 #include <string.h>
 
@@ -209,6 +210,43 @@ LogMacroDef macros[] =
 };
 
 
+/*
+ * Messages in a burst mostly share the same second, so the broken down
+ * time and the rendered timestamps are cached per-thread, keyed by the
+ * second and the zone offset.  The fraction of the second is not part of
+ * the cached string, it is rendered for each expansion, so the cache is
+ * independent of frac_digits().
+ */
+#define LOG_MACRO_TIME_CACHE_SIZE 4
+#define LOG_MACRO_TIME_CACHE_FORMATS (TS_FMT_UNIX + 1)
+
+typedef struct _LogMacroFormattedDate
+{
+  /* the part before and after the fraction of the second */
+  guint8 head_len;
+  guint8 tail_len;
+  gchar head[32];
+  gchar tail[8];
+} LogMacroFormattedDate;
+
+typedef struct _LogMacroTimeCacheEntry
+{
+  gboolean valid;
+  time_t tv_sec;
+  glong zone_ofs;
+  struct tm tm;
+  guint8 formatted_mask;
+  LogMacroFormattedDate formatted[LOG_MACRO_TIME_CACHE_FORMATS];
+} LogMacroTimeCacheEntry;
+
+TLS_BLOCK_START
+{
+  LogMacroTimeCacheEntry log_macro_time_cache[LOG_MACRO_TIME_CACHE_SIZE];
+}
+TLS_BLOCK_END;
+
+#define log_macro_time_cache  __tls_deref(log_macro_time_cache)
+
 static GTimeVal app_uptime;
 static GHashTable *macro_hash;
 static LogTemplateOptions template_options_for_macro_expand;
@@ -237,6 +275,78 @@ _is_message_source_an_ip_address(const LogMessage *msg)
   return FALSE;
 }
 
+static LogMacroTimeCacheEntry *
+_lookup_time_cache(const LogStamp *stamp, glong zone_ofs)
+{
+  LogMacroTimeCacheEntry *entry = &log_macro_time_cache[(stamp->tv_sec ^ zone_ofs) & (LOG_MACRO_TIME_CACHE_SIZE - 1)];
+
+  if (!entry->valid || entry->tv_sec != stamp->tv_sec || entry->zone_ofs != zone_ofs)
+    {
+      time_t t = stamp->tv_sec + zone_ofs;
+
+      cached_gmtime(&t, &entry->tm);
+      entry->tv_sec = stamp->tv_sec;
+      entry->zone_ofs = zone_ofs;
+      entry->formatted_mask = 0;
+      entry->valid = TRUE;
+    }
+  return entry;
+}
+
+static gboolean
+_cache_formatted_date(LogMacroTimeCacheEntry *entry, gint format, const gchar *rendered, gsize rendered_len)
+{
+  LogMacroFormattedDate *formatted = &entry->formatted[format];
+  gsize tail_len = 0;
+
+  /* zone_ofs can only be -1 if the timestamp has no zone either, so it is
+   * the same zone offset log_stamp_append_format() uses */
+  if (format == TS_FMT_ISO)
+    tail_len = format_zone_info(formatted->tail, sizeof(formatted->tail), entry->zone_ofs);
+
+  if (tail_len > rendered_len || rendered_len - tail_len > sizeof(formatted->head))
+    return FALSE;
+
+  formatted->head_len = rendered_len - tail_len;
+  formatted->tail_len = tail_len;
+  memcpy(formatted->head, rendered, formatted->head_len);
+  entry->formatted_mask |= (1 << format);
+  return TRUE;
+}
+
+static void
+_append_formatted_date(GString *result, const LogStamp *stamp, LogMacroTimeCacheEntry *entry, gint format,
+                       gint frac_digits)
+{
+  LogMacroFormattedDate *formatted;
+
+  if (format < 0 || format >= LOG_MACRO_TIME_CACHE_FORMATS)
+    {
+      log_stamp_append_format(stamp, result, format, entry->zone_ofs, frac_digits);
+      return;
+    }
+
+  if (!(entry->formatted_mask & (1 << format)))
+    {
+      gsize start = result->len;
+
+      /* render without the fraction into the result, and remember it */
+      log_stamp_append_format(stamp, result, format, entry->zone_ofs, 0);
+      if (!_cache_formatted_date(entry, format, result->str + start, result->len - start))
+        {
+          g_string_truncate(result, start);
+          log_stamp_append_format(stamp, result, format, entry->zone_ofs, frac_digits);
+          return;
+        }
+      g_string_truncate(result, start);
+    }
+
+  formatted = &entry->formatted[format];
+  g_string_append_len(result, formatted->head, formatted->head_len);
+  log_stamp_append_frac_digits(stamp, result, frac_digits);
+  g_string_append_len(result, formatted->tail, formatted->tail_len);
+}
+
 gboolean
 log_macro_expand(GString *result, gint id, gboolean escape, const LogTemplateOptions *opts, gint tz, gint32 seq_num,
                  const gchar *context_id, const LogMessage *msg)
@@ -463,10 +573,10 @@ log_macro_expand(GString *result, gint id, gboolean escape, const LogTemplateOpt
     default:
     {
       /* year, month, day */
-      struct tm *tm, tm_storage;
+      LogMacroTimeCacheEntry *time_cache;
+      struct tm *tm;
       gchar buf[64];
       gint length;
-      time_t t;
       const LogStamp *stamp;
       LogStamp sstamp;
       glong zone_ofs;
@@ -518,10 +628,8 @@ log_macro_expand(GString *result, gint id, gboolean escape, const LogTemplateOpt
       if (zone_ofs == -1)
         zone_ofs = stamp->zone_offset;
 
-      t = stamp->tv_sec + zone_ofs;
-
-      cached_gmtime(&t, &tm_storage);
-      tm  = &tm_storage;
+      time_cache = _lookup_time_cache(stamp, zone_ofs);
+      tm = &time_cache->tm;
 
       switch (id)
         {
@@ -598,7 +706,7 @@ log_macro_expand(GString *result, gint id, gboolean escape, const LogTemplateOpt
                         id == M_UNIXTIME ? TS_FMT_UNIX :
                         opts->ts_format;
 
-          log_stamp_append_format(stamp, result, format, zone_ofs, opts->frac_digits);
+          _append_formatted_date(result, stamp, time_cache, format, opts->frac_digits);
           break;
         }
         case M_TZ:
@@ -23,6 +23,9 @@
  */
 
 #include "template/repr.h"
+#include "template/macros.h"
+
+#include <string.h>
 
 void
 log_template_elem_free(LogTemplateElem *e)
@@ -59,3 +62,107 @@ log_template_elem_free_list(GList *l)
     }
   g_list_free(l);
 }
+
+static inline gboolean
+_elem_is_literal(LogTemplateElem *e)
+{
+  return e->type == LTE_MACRO && e->macro == M_NONE && !e->default_value;
+}
+
+/* these macros do nothing but append a single name-value pair */
+static void
+_lower_macro_to_value(LogTemplateElem *e)
+{
+  if (e->type != LTE_MACRO || e->default_value)
+    return;
+
+  switch (e->macro)
+    {
+    case M_MESSAGE:
+      e->type = LTE_VALUE;
+      e->value_handle = LM_V_MESSAGE;
+      break;
+    default:
+      break;
+    }
+}
+
+static guint8
+_determine_shape(LogTemplateProgram *self)
+{
+  LogTemplateElem *first = &self->elems[0];
+
+  if (self->num_elems == 0 ||
+      (self->num_elems == 1 && first->type == LTE_LITERAL))
+    return LTP_LITERAL;
+
+  if (first->type == LTE_VALUE && first->msg_ref == 0 &&
+      (self->num_elems == 1 ||
+       (self->num_elems == 2 && self->elems[1].type == LTE_LITERAL)))
+    return LTP_SINGLE_VALUE;
+
+  return LTP_GENERIC;
+}
+
+LogTemplateProgram *
+log_template_program_new(GList *compiled_template)
+{
+  LogTemplateProgram *self;
+  GList *l;
+  gsize literals_len = 0, pos = 0, literal_start = 0;
+  gboolean literal_pending = FALSE;
+
+  for (l = compiled_template; l; l = l->next)
+    literals_len += ((LogTemplateElem *) l->data)->text_len;
+
+  self = g_malloc0(sizeof(LogTemplateProgram) + g_list_length(compiled_template) * sizeof(LogTemplateElem));
+  self->literals = g_malloc(literals_len + 1);
+
+  for (l = compiled_template; l; l = l->next)
+    {
+      LogTemplateElem *e = (LogTemplateElem *) l->data;
+      LogTemplateElem *target;
+
+      if (!literal_pending)
+        {
+          literal_start = pos;
+          literal_pending = TRUE;
+        }
+      if (e->text_len)
+        memcpy(self->literals + pos, e->text, e->text_len);
+      pos += e->text_len;
+
+      /* merge the text of pure literals into the prefix of the next element */
+      if (_elem_is_literal(e))
+        continue;
+
+      target = &self->elems[self->num_elems++];
+      *target = *e;
+      target->text = self->literals + literal_start;
+      target->text_len = pos - literal_start;
+      literal_pending = FALSE;
+      _lower_macro_to_value(target);
+    }
+
+  if (literal_pending && pos > literal_start)
+    {
+      LogTemplateElem *target = &self->elems[self->num_elems++];
+
+      target->type = LTE_LITERAL;
+      target->text = self->literals + literal_start;
+      target->text_len = pos - literal_start;
+    }
+  self->literals[pos] = 0;
+
+  self->shape = _determine_shape(self);
+  return self;
+}
+
+void
+log_template_program_free(LogTemplateProgram *self)
+{
+  if (!self)
+    return;
+  g_free(self->literals);
+  g_free(self);
+}
@@ -32,7 +32,9 @@ enum
 {
   LTE_MACRO,
   LTE_VALUE,
-  LTE_FUNC
+  LTE_FUNC,
+  /* literal text only, never produced by the compiler, only used in LogTemplateProgram */
+  LTE_LITERAL,
 };
 
 typedef struct _LogTemplateElem
@@ -56,5 +58,37 @@ typedef struct _LogTemplateElem
 
 void log_template_elem_free_list(GList *el);
 
+/*
+ * LogTemplateProgram is the flattened form of the compiled template, used
+ * for formatting.  Elements are stored in a contiguous array, their literal
+ * text in a single buffer, adjacent literals are merged and simple macros
+ * are turned into value lookups.
+ *
+ * The shape of the program is determined in advance, so that the most
+ * common templates (literals only, or a single value with an optional
+ * literal prefix and suffix, like "$MSG\n") can be formatted without
+ * walking the elements.
+ *
+ * Elements are shallow copies: default values and function states are
+ * owned by the LogTemplateElem list the program was created from.
+ */
+enum
+{
+  LTP_GENERIC,
+  LTP_LITERAL,
+  LTP_SINGLE_VALUE,
+};
+
+struct _LogTemplateProgram
+{
+  guint8 shape;
+  guint num_elems;
+  gchar *literals;
+  LogTemplateElem elems[0];
+};
+
+LogTemplateProgram *log_template_program_new(GList *compiled_template);
+void log_template_program_free(LogTemplateProgram *self);
+
 
 #endif
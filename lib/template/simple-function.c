@@ -86,6 +86,35 @@ tf_simple_func_call(LogTemplateFunction *self, gpointer s, const LogTemplateInvo
   simple_func(args->messages[args->num_messages-1], state->argc, (GString **) args->argv, result);
 }
 
+GString *
+tf_simple_func_lazy_arg(TFSimpleFuncLazyArgs *args, gint ndx)
+{
+  g_assert(ndx < args->state->argc);
+
+  if (!(args->evaluated & ((guint64) 1 << ndx)))
+    {
+      args->argv[ndx] = scratch_buffers_alloc();
+      log_template_append_format_recursive(args->state->argv_templates[ndx], args->invoke_args, args->argv[ndx]);
+      args->evaluated |= ((guint64) 1 << ndx);
+    }
+  return args->argv[ndx];
+}
+
+void
+tf_simple_func_lazy_call(LogTemplateFunction *self, gpointer s, const LogTemplateInvokeArgs *args, GString *result)
+{
+  TFSimpleLazyFunc lazy_func = (TFSimpleLazyFunc) self->arg;
+  TFSimpleFuncState *state = (TFSimpleFuncState *) s;
+  TFSimpleFuncLazyArgs lazy_args;
+
+  g_assert(state->argc <= TEMPLATE_INVOKE_MAX_ARGS);
+
+  lazy_args.state = state;
+  lazy_args.invoke_args = args;
+  lazy_args.evaluated = 0;
+  lazy_func(args->messages[args->num_messages-1], state->argc, &lazy_args, result);
+}
+
 void
 tf_simple_func_free_state(gpointer s)
 {
@@ -37,12 +37,29 @@ typedef struct _TFSimpleFuncState
 
 typedef void (*TFSimpleFunc)(LogMessage *msg, gint argc, GString *argv[], GString *result);
 
+/* arguments of lazily evaluated simple functions, each argument is
+ * evaluated when first accessed using tf_simple_func_lazy_arg() */
+typedef struct _TFSimpleFuncLazyArgs
+{
+  TFSimpleFuncState *state;
+  const LogTemplateInvokeArgs *invoke_args;
+  guint64 evaluated;
+  GString *argv[TEMPLATE_INVOKE_MAX_ARGS];
+} TFSimpleFuncLazyArgs;
+
+typedef void (*TFSimpleLazyFunc)(LogMessage *msg, gint argc, TFSimpleFuncLazyArgs *args, GString *result);
+
 gboolean tf_simple_func_prepare(LogTemplateFunction *self, gpointer state, LogTemplate *parent, gint argc,
                                 gchar *argv[], GError **error);
 void tf_simple_func_eval(LogTemplateFunction *self, gpointer state, LogTemplateInvokeArgs *args);
 void tf_simple_func_call(LogTemplateFunction *self, gpointer state, const LogTemplateInvokeArgs *args, GString *result);
 void tf_simple_func_free_state(gpointer state);
 
+GString *tf_simple_func_lazy_arg(TFSimpleFuncLazyArgs *args, gint ndx);
+void tf_simple_func_lazy_call(LogTemplateFunction *self, gpointer state, const LogTemplateInvokeArgs *args,
+                              GString *result);
+
 #define TEMPLATE_FUNCTION_SIMPLE(x) TEMPLATE_FUNCTION(TFSimpleFuncState, x, tf_simple_func_prepare, tf_simple_func_eval, tf_simple_func_call, tf_simple_func_free_state, x)
+#define TEMPLATE_FUNCTION_SIMPLE_LAZY(x) TEMPLATE_FUNCTION(TFSimpleFuncState, x, tf_simple_func_prepare, NULL, tf_simple_func_lazy_call, tf_simple_func_free_state, x)
 
 #endif
@@ -31,6 +31,8 @@
 static void
 log_template_reset_compiled(LogTemplate *self)
 {
+  log_template_program_free(self->program);
+  self->program = NULL;
   log_template_elem_free_list(self->compiled_template);
   self->compiled_template = NULL;
 }
@@ -51,6 +53,9 @@ log_template_compile(LogTemplate *self, const gchar *template, GError **error)
   log_template_compiler_init(&compiler, self);
   result = log_template_compiler_compile(&compiler, &self->compiled_template, error);
   log_template_compiler_clear(&compiler);
+
+  /* NOTE: failed templates produce the error message, so they need a program too */
+  self->program = log_template_program_new(self->compiled_template);
   return result;
 }
 
@@ -69,22 +74,32 @@ log_template_set_type_hint(LogTemplate *self, const gchar *type_hint, GError **e
 }
 
 
-void
-log_template_append_format_with_context(LogTemplate *self, LogMessage **messages, gint num_messages,
-                                        const LogTemplateOptions *opts, gint tz, gint32 seq_num, const gchar *context_id, GString *result)
+static inline void
+_append_value(LogTemplate *self, LogTemplateElem *e, LogMessage *msg, GString *result)
 {
-  GList *p;
-  LogTemplateElem *e;
+  const gchar *value = NULL;
+  gssize value_len = -1;
+
+  value = log_msg_get_value(msg, e->value_handle, &value_len);
+  if (value && value[0])
+    result_append(result, value, value_len, self->escape);
+  else if (e->default_value)
+    result_append(result, e->default_value, -1, self->escape);
+}
 
-  if (!opts)
-    opts = &self->cfg->template_options;
+static void
+_append_format_generic(LogTemplate *self, LogMessage **messages, gint num_messages,
+                       const LogTemplateOptions *opts, gint tz, gint32 seq_num, const gchar *context_id, GString *result)
+{
+  LogTemplateProgram *program = self->program;
+  guint i;
 
-  for (p = self->compiled_template; p; p = g_list_next(p))
+  for (i = 0; i < program->num_elems; i++)
     {
+      LogTemplateElem *e = &program->elems[i];
       gint msg_ndx;
 
-      e = (LogTemplateElem *) p->data;
-      if (e->text)
+      if (e->text_len)
         {
           g_string_append_len(result, e->text, e->text_len);
         }
@@ -105,16 +120,11 @@ log_template_append_format_with_context(LogTemplate *self, LogMessage **messages
 
       switch (e->type)
         {
+        case LTE_LITERAL:
+          break;
         case LTE_VALUE:
         {
-          const gchar *value = NULL;
-          gssize value_len = -1;
-
-          value = log_msg_get_value(messages[msg_ndx], e->value_handle, &value_len);
-          if (value && value[0])
-            result_append(result, value, value_len, self->escape);
-          else if (e->default_value)
-            result_append(result, e->default_value, -1, self->escape);
+          _append_value(self, e, messages[msg_ndx], result);
           break;
         }
         case LTE_MACRO:
@@ -123,7 +133,7 @@ log_template_append_format_with_context(LogTemplate *self, LogMessage **messages
 
           if (e->macro)
             {
-              log_macro_expand(result, e->macro, self->escape, opts ? opts : &self->cfg->template_options, tz, seq_num, context_id,
+              log_macro_expand(result, e->macro, self->escape, opts, tz, seq_num, context_id,
                                messages[msg_ndx]);
               if (len == result->len && e->default_value)
                 g_string_append(result, e->default_value);
@@ -163,6 +173,41 @@ log_template_append_format_with_context(LogTemplate *self, LogMessage **messages
     }
 }
 
+void
+log_template_append_format_with_context(LogTemplate *self, LogMessage **messages, gint num_messages,
+                                        const LogTemplateOptions *opts, gint tz, gint32 seq_num, const gchar *context_id, GString *result)
+{
+  LogTemplateProgram *program = self->program;
+  LogTemplateElem *e;
+
+  if (!opts)
+    opts = &self->cfg->template_options;
+
+  if (!program)
+    return;
+
+  switch (program->shape)
+    {
+    case LTP_LITERAL:
+      if (program->num_elems)
+        g_string_append_len(result, program->elems[0].text, program->elems[0].text_len);
+      break;
+
+    case LTP_SINGLE_VALUE:
+      e = &program->elems[0];
+      if (e->text_len)
+        g_string_append_len(result, e->text, e->text_len);
+      _append_value(self, e, messages[num_messages - 1], result);
+      if (program->num_elems > 1)
+        g_string_append_len(result, program->elems[1].text, program->elems[1].text_len);
+      break;
+
+    default:
+      _append_format_generic(self, messages, num_messages, opts, tz, seq_num, context_id, result);
+      break;
+    }
+}
+
 void
 log_template_format_with_context(LogTemplate *self, LogMessage **messages, gint num_messages,
                                  const LogTemplateOptions *opts, gint tz, gint32 seq_num, const gchar *context_id, GString *result)
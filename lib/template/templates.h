@@ -53,6 +53,8 @@ typedef enum
   ON_ERROR_SILENT              = 0x08
 } LogTemplateOnError;
 
+typedef struct _LogTemplateProgram LogTemplateProgram;
+
 /* structure that represents an expandable syslog-ng template */
 typedef struct _LogTemplate
 {
@@ -60,6 +62,7 @@ typedef struct _LogTemplate
   gchar *name;
   gchar *template;
   GList *compiled_template;
+  LogTemplateProgram *program;
   gboolean escape;
   gboolean def_inline;
   GlobalConfig *cfg;
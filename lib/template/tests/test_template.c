@@ -235,6 +235,24 @@ Test(template, test_macros)
   assert_template_format("$UNIQID", "cafebabe@000000000000022b");
 }
 
+Test(template, test_date_macros_render_fractions_of_cached_seconds)
+{
+  LogMessage *msg = create_sample_message();
+
+  msg->timestamps[LM_TS_STAMP].tv_usec = 123000;
+  assert_template_format_msg("$ISODATE", "2006-02-11T10:34:56.123+01:00", msg);
+  assert_template_format_msg("$DATE", "Feb 11 10:34:56.123", msg);
+
+  msg->timestamps[LM_TS_STAMP].tv_usec = 456000;
+  assert_template_format_msg("$ISODATE $DATE", "2006-02-11T10:34:56.456+01:00 Feb 11 10:34:56.456", msg);
+
+  msg->timestamps[LM_TS_STAMP].tv_sec++;
+  assert_template_format_msg("$ISODATE $SEC", "2006-02-11T10:34:57.456+01:00 57", msg);
+  assert_template_format_msg("$UNIXTIME", "1139650497.456", msg);
+
+  log_msg_unref(msg);
+}
+
 Test(template, test_nvpairs)
 {
   assert_template_format("$PROGRAM/var/log/messages/$HOST/$HOST_FROM/$MONTH$DAY${QQQQQ}valami",
@@ -247,6 +265,25 @@ Test(template, test_nvpairs)
   assert_template_format("$$$1$$", "$first-match$");
 }
 
+Test(template, test_compiled_program_shapes)
+{
+  /* literals only */
+  assert_template_format("", "");
+  assert_template_format("literal text only", "literal text only");
+  assert_template_format("$$literal$$", "$literal$");
+
+  /* a single value with an optional prefix and suffix */
+  assert_template_format("$MSG", "árvíztűrőtükörfúrógép");
+  assert_template_format("prefix: $MSG\n", "prefix: árvíztűrőtükörfúrógép\n");
+  assert_template_format("[${APP.VALUE99:-ures}]", "[ures]");
+  assert_template_format_with_escaping("pre ${APP.QVALUE} post", TRUE, "pre \\\"value\\\" post");
+
+  /* everything else */
+  assert_template_format("${APP.VALUE}@0 suffix", "value suffix");
+  assert_template_format("$HOST $MSG", "bzorp árvíztűrőtükörfúrógép");
+  assert_template_format("${MSG:-default} $PID", "árvíztűrőtükörfúrógép 23323");
+}
+
 Test(template, test_template_functions)
 {
   /* template functions */
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "logmpx.h"
+#include "apphook.h"
+#include "cfg.h"
+#include "syslog-names.h"
+#include "filter/filter-pipe.h"
+#include "filter/filter-re.h"
+#include "filter/filter-pri.h"
+#include "filter/filter-op.h"
+
+#define INDEXED_BRANCHES 10
+
+typedef struct _RecordingPipe
+{
+  LogPipe super;
+  gint branch;
+} RecordingPipe;
+
+static GString *delivered;
+
+static void
+_recording_pipe_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options)
+{
+  RecordingPipe *self = (RecordingPipe *) s;
+
+  g_string_append_printf(delivered, "%d,", self->branch);
+  log_msg_drop(msg, path_options, AT_PROCESSED);
+}
+
+static FilterExprNode *
+_create_program_filter(const gchar *type, const gchar *pattern)
+{
+  FilterRE *filter = filter_re_new(LM_V_PROGRAM);
+
+  if (type)
+    cr_assert(log_matcher_options_set_type(&filter->matcher_options, type));
+  cr_assert(filter_re_compile_pattern(filter, configuration, pattern, NULL));
+  return &filter->super;
+}
+
+static LogFilterPipe *
+_add_branch(LogMultiplexer *mpx, FilterExprNode *filter, gint branch, gint flags)
+{
+  LogFilterPipe *filter_pipe = (LogFilterPipe *) log_filter_pipe_new(filter, configuration);
+  RecordingPipe *recorder = g_new0(RecordingPipe, 1);
+
+  log_pipe_init_instance(&recorder->super, configuration);
+  recorder->super.queue = _recording_pipe_queue;
+  recorder->branch = branch;
+
+  filter_pipe->super.flags |= flags;
+  log_pipe_append(&filter_pipe->super, &recorder->super);
+  log_multiplexer_add_next_hop(mpx, &filter_pipe->super);
+  return filter_pipe;
+}
+
+static LogMultiplexer *
+_create_indexed_mpx(LogFilterPipe **filter_pipes)
+{
+  LogMultiplexer *mpx = log_multiplexer_new(configuration);
+  gint i;
+
+  for (i = 0; i < INDEXED_BRANCHES; i++)
+    {
+      gchar pattern[32];
+
+      g_snprintf(pattern, sizeof(pattern), "prog%d", i);
+      filter_pipes[i] = _add_branch(mpx, _create_program_filter("string", pattern), i, 0);
+    }
+  return mpx;
+}
+
+static void
+_init_branches(LogMultiplexer *mpx)
+{
+  gint i;
+
+  for (i = 0; i < mpx->next_hops->len; i++)
+    {
+      LogPipe *filter_pipe = g_ptr_array_index(mpx->next_hops, i);
+
+      cr_assert(log_pipe_init(filter_pipe));
+      cr_assert(log_pipe_init(filter_pipe->pipe_next));
+    }
+  cr_assert(log_pipe_init(&mpx->super));
+}
+
+static void
+_free_mpx(LogMultiplexer *mpx)
+{
+  gint i;
+
+  log_pipe_deinit(&mpx->super);
+  for (i = 0; i < mpx->next_hops->len; i++)
+    {
+      LogPipe *filter_pipe = g_ptr_array_index(mpx->next_hops, i);
+
+      log_pipe_deinit(filter_pipe->pipe_next);
+      log_pipe_deinit(filter_pipe);
+      log_pipe_unref(filter_pipe->pipe_next);
+      log_pipe_unref(filter_pipe);
+    }
+  log_pipe_unref(&mpx->super);
+}
+
+static const gchar *
+_queue_message(LogMultiplexer *mpx, const gchar *program, gint facility)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg = log_msg_new_empty();
+
+  log_msg_set_value(msg, LM_V_PROGRAM, program, -1);
+  msg->pri = facility | LOG_NOTICE;
+
+  g_string_truncate(delivered, 0);
+  log_pipe_queue(&mpx->super, msg, &path_options);
+  return delivered->str;
+}
+
+Test(logmpx, messages_are_only_dispatched_to_branches_that_can_match)
+{
+  LogFilterPipe *filter_pipes[INDEXED_BRANCHES];
+  LogMultiplexer *mpx = _create_indexed_mpx(filter_pipes);
+  gint i;
+
+  _init_branches(mpx);
+  cr_assert_not_null(mpx->dispatch);
+
+  cr_assert_str_eq(_queue_message(mpx, "prog3", LOG_USER), "3,");
+  cr_assert_str_eq(_queue_message(mpx, "prog7", LOG_USER), "7,");
+  cr_assert_str_eq(_queue_message(mpx, "unknown", LOG_USER), "");
+
+  for (i = 0; i < INDEXED_BRANCHES; i++)
+    {
+      gboolean expected = (i == 3 || i == 7);
+
+      cr_assert_eq(stats_counter_get(filter_pipes[i]->matched), expected,
+                   "Unexpected matched counter for branch %d", i);
+      cr_assert_eq(stats_counter_get(filter_pipes[i]->not_matched), 0,
+                   "Branch %d was evaluated even though it can't match", i);
+    }
+  _free_mpx(mpx);
+}
+
+Test(logmpx, unindexed_branches_are_visited_in_order)
+{
+  LogFilterPipe *filter_pipes[INDEXED_BRANCHES];
+  LogMultiplexer *mpx = log_multiplexer_new(configuration);
+  gint i;
+
+  _add_branch(mpx, filter_facility_new(1 << (LOG_MAIL >> 3)), 100, 0);
+  for (i = 0; i < INDEXED_BRANCHES; i++)
+    {
+      gchar pattern[32];
+
+      g_snprintf(pattern, sizeof(pattern), "^prog%d$", i);
+      filter_pipes[i] = _add_branch(mpx, _create_program_filter(NULL, pattern), i, 0);
+    }
+  _add_branch(mpx, _create_program_filter(NULL, "prog"), 101, 0);
+  _add_branch(mpx, fop_or_new(_create_program_filter("string", "prog5"),
+                              filter_level_new(1 << LOG_NOTICE)), 102, 0);
+
+  _init_branches(mpx);
+  cr_assert_not_null(mpx->dispatch);
+
+  cr_assert_str_eq(_queue_message(mpx, "prog5", LOG_MAIL), "100,5,101,102,");
+  cr_assert_str_eq(_queue_message(mpx, "prog2", LOG_USER), "2,101,102,");
+  cr_assert_str_eq(_queue_message(mpx, "prog2\n", LOG_USER), "2,101,102,");
+  cr_assert_eq(stats_counter_get(filter_pipes[1]->not_matched), 0);
+  _free_mpx(mpx);
+}
+
+Test(logmpx, final_and_fallback_flags_are_honoured)
+{
+  LogFilterPipe *filter_pipes[INDEXED_BRANCHES];
+  LogMultiplexer *mpx = _create_indexed_mpx(filter_pipes);
+
+  _add_branch(mpx, _create_program_filter("string", "prog4"), 100, PIF_BRANCH_FINAL);
+  _add_branch(mpx, _create_program_filter("string", "prog4"), 101, 0);
+  _add_branch(mpx, fop_and_new(_create_program_filter("string", "prog8"),
+                               filter_facility_new(1 << (LOG_MAIL >> 3))), 102, PIF_BRANCH_FINAL);
+  _add_branch(mpx, _create_program_filter("string", "prog8"), 103, 0);
+  _add_branch(mpx, filter_facility_new(1 << (LOG_USER >> 3)), 104, PIF_BRANCH_FALLBACK);
+
+  _init_branches(mpx);
+  cr_assert_not_null(mpx->dispatch);
+
+  cr_assert_str_eq(_queue_message(mpx, "prog4", LOG_USER), "4,100,");
+  cr_assert_str_eq(_queue_message(mpx, "prog8", LOG_USER), "8,103,");
+  cr_assert_str_eq(_queue_message(mpx, "prog8", LOG_MAIL), "8,102,");
+  cr_assert_str_eq(_queue_message(mpx, "unknown", LOG_USER), "104,");
+  cr_assert_str_eq(_queue_message(mpx, "unknown", LOG_MAIL), "");
+  _free_mpx(mpx);
+}
+
+Test(logmpx, negated_and_inexact_filters_are_not_indexed)
+{
+  LogMultiplexer *mpx = log_multiplexer_new(configuration);
+  FilterExprNode *negated = _create_program_filter("string", "prog0");
+  gint i;
+
+  negated->comp = TRUE;
+  _add_branch(mpx, negated, 0, 0);
+  _add_branch(mpx, _create_program_filter("string", "prog1"), 1, PIF_DROP_UNMATCHED);
+  for (i = 2; i < INDEXED_BRANCHES; i++)
+    _add_branch(mpx, _create_program_filter("pcre", "^prog.$"), i, 0);
+
+  _init_branches(mpx);
+  cr_assert_null(mpx->dispatch);
+  _free_mpx(mpx);
+}
+
+static void
+setup(void)
+{
+  app_startup();
+
+  configuration = cfg_new_snippet();
+  configuration->stats_options.level = 1;
+  cfg_init(configuration);
+  delivered = g_string_new("");
+}
+
+static void
+teardown(void)
+{
+  g_string_free(delivered, TRUE);
+  cfg_deinit(configuration);
+  cfg_free(configuration);
+  app_shutdown();
+}
+
+TestSuite(logmpx, .init = setup, .fini = teardown);
@@ -25,6 +25,7 @@
 #include "apphook.h"
 
 #include <criterion/criterion.h>
+#include <stdlib.h>
 #include "grab-logging.h"
 #include "stopwatch.h"
 #include "cr_template.h"
@@ -769,6 +770,233 @@ Test(logthrdestdrv, test_explicit_ack_accept)
   cr_assert(dd->super.shared_seq_num == 11, "%d", dd->super.shared_seq_num);
 }
 
+static guint32 pending_batches[2];
+static gint num_pending_batches;
+static gboolean fail_first_batch;
+
+/* reports the batches in flight in the reverse order they were started */
+static void
+_finish_pending_batches(LogThreadedDestWorker *worker)
+{
+  while (num_pending_batches > 0)
+    {
+      worker_insert_result_t result = WORKER_INSERT_RESULT_SUCCESS;
+
+      num_pending_batches--;
+      if (fail_first_batch && pending_batches[num_pending_batches] == 0)
+        result = WORKER_INSERT_RESULT_ERROR;
+      log_threaded_dest_worker_batch_finished(worker, pending_batches[num_pending_batches], result);
+    }
+}
+
+static worker_insert_result_t
+_insert_pipelined_batch(LogThreadedDestDriver *s, LogMessage *msg)
+{
+  TestThreadedDestDriver *self = (TestThreadedDestDriver *) s;
+  LogThreadedDestWorker *worker = &s->worker.instance;
+
+  self->insert_counter++;
+  if (worker->batch_size == 1 && num_pending_batches == 2)
+    _finish_pending_batches(worker);
+
+  if (worker->batch_size < log_threaded_dest_worker_get_flush_lines(worker))
+    return WORKER_INSERT_RESULT_QUEUED;
+
+  pending_batches[num_pending_batches++] = log_threaded_dest_worker_get_batch_id(worker);
+  return WORKER_INSERT_RESULT_PENDING;
+}
+
+static worker_insert_result_t
+_flush_pipelined_batch(LogThreadedDestDriver *s)
+{
+  _finish_pending_batches(&s->worker.instance);
+  return WORKER_INSERT_RESULT_SUCCESS;
+}
+
+static void
+_disconnect_pipelined(LogThreadedDestDriver *s)
+{
+  /* the batches in flight are rewound */
+  num_pending_batches = 0;
+}
+
+Test(logthrdestdrv, batches_in_flight_finishing_out_of_order_are_acked_in_order)
+{
+  dd->super.worker.insert = _insert_pipelined_batch;
+  dd->super.worker.flush = _flush_pipelined_batch;
+  dd->super.worker.disconnect = _disconnect_pipelined;
+  dd->super.flush_lines = 5;
+  dd->super.max_inflight_batches = 3;
+  num_pending_batches = 0;
+  fail_first_batch = FALSE;
+
+  _generate_messages_and_wait_for_processing(dd, 20, dd->super.written_messages);
+  cr_assert(dd->insert_counter == 20, "%d", dd->insert_counter);
+
+  cr_assert(stats_counter_get(dd->super.processed_messages) == 20);
+  cr_assert(stats_counter_get(dd->super.dropped_messages) == 0);
+  cr_assert(stats_counter_get(dd->super.worker.instance.queue->queued_messages) == 0);
+  cr_assert(g_queue_is_empty(&dd->super.worker.instance.inflight_batches));
+}
+
+Test(logthrdestdrv, failed_batch_in_flight_rewinds_the_ones_after_it)
+{
+  dd->super.worker.insert = _insert_pipelined_batch;
+  dd->super.worker.flush = _flush_pipelined_batch;
+  dd->super.worker.disconnect = _disconnect_pipelined;
+  dd->super.flush_lines = 5;
+  dd->super.max_inflight_batches = 3;
+  dd->super.time_reopen = 0;
+  num_pending_batches = 0;
+  fail_first_batch = TRUE;
+
+  start_grabbing_messages();
+  _generate_messages_and_wait_for_processing(dd, 20, dd->super.written_messages);
+
+  /* batch #1 finished first, but it is delivered again along with #0 */
+  cr_assert(dd->insert_counter > 20, "%d", dd->insert_counter);
+  cr_assert(stats_counter_get(dd->super.processed_messages) == 20);
+  cr_assert(stats_counter_get(dd->super.dropped_messages) == 0);
+  cr_assert(stats_counter_get(dd->super.worker.instance.queue->queued_messages) == 0);
+  assert_grabbed_log_contains("Error occurred while");
+}
+
+static worker_insert_result_t
+_insert_adaptive_batch(LogThreadedDestDriver *s, LogMessage *msg)
+{
+  LogThreadedDestWorker *worker = &s->worker.instance;
+
+  if (worker->batch_size < log_threaded_dest_worker_get_flush_lines(worker))
+    return WORKER_INSERT_RESULT_QUEUED;
+  return WORKER_INSERT_RESULT_SUCCESS;
+}
+
+Test(logthrdestdrv, batch_latency_target_grows_the_batch_up_to_flush_lines)
+{
+  TestThreadedDestDriver *adaptive = test_threaded_dd_new(main_loop_get_current_config(main_loop));
+  LogPipe *s = &adaptive->super.super.super.super;
+  LogThreadedDestWorker *worker = &adaptive->super.worker.instance;
+
+  adaptive->super.worker.insert = _insert_adaptive_batch;
+  adaptive->super.worker.flush = _flush_batched_message_success;
+  adaptive->super.flush_lines = 100;
+  adaptive->super.flush_timeout = 10000;
+  log_threaded_dest_driver_set_batch_latency_target(&adaptive->super.super.super, 10000);
+  cr_assert(log_pipe_init(s));
+  cr_assert(log_threaded_dest_worker_get_flush_lines(worker) == 1);
+
+  /* the batch grows by a quarter after each one that was filled up: 1, 2,
+   * 3, ... 78, 97 which is 503 messages, the rest are batches of 100 */
+  _generate_messages_and_wait_for_processing(adaptive, 1003, adaptive->super.written_messages);
+  cr_assert(log_threaded_dest_worker_get_flush_lines(worker) == 100,
+            "batch size is expected to reach flush_lines(), found %d", worker->flush_lines);
+  cr_assert(stats_counter_get(worker->batch_lines) == 100);
+  cr_assert(stats_counter_get(worker->flush_latency) < 10000);
+
+  main_loop_sync_worker_startup_and_teardown();
+  log_pipe_deinit(s);
+  log_pipe_unref(s);
+}
+
+Test(logthrdestdrv, batch_latency_target_grows_the_batches_in_flight_up_to_flush_lines)
+{
+  TestThreadedDestDriver *adaptive = test_threaded_dd_new(main_loop_get_current_config(main_loop));
+  LogPipe *s = &adaptive->super.super.super.super;
+  LogThreadedDestWorker *worker = &adaptive->super.worker.instance;
+
+  adaptive->super.worker.insert = _insert_pipelined_batch;
+  adaptive->super.worker.flush = _flush_pipelined_batch;
+  adaptive->super.worker.disconnect = _disconnect_pipelined;
+  adaptive->super.flush_lines = 100;
+  /* the last batch is not expected to fill up */
+  adaptive->super.flush_timeout = 100;
+  adaptive->super.max_inflight_batches = 3;
+  log_threaded_dest_driver_set_batch_latency_target(&adaptive->super.super.super, 10000);
+  num_pending_batches = 0;
+  fail_first_batch = FALSE;
+  cr_assert(log_pipe_init(s));
+  cr_assert(log_threaded_dest_worker_get_flush_lines(worker) == 1);
+
+  /* batches are tuned as they are acked, those started before the last
+   * growth are smaller than the limit and do not count */
+  _generate_messages_and_wait_for_processing(adaptive, 5003, adaptive->super.written_messages);
+  cr_assert(log_threaded_dest_worker_get_flush_lines(worker) == 100,
+            "batch size is expected to reach flush_lines(), found %d", worker->flush_lines);
+  cr_assert(stats_counter_get(worker->batch_lines) == 100);
+  cr_assert(g_queue_is_empty(&worker->inflight_batches));
+
+  main_loop_sync_worker_startup_and_teardown();
+  log_pipe_deinit(s);
+  log_pipe_unref(s);
+}
+
+#define PARTITION_WORKERS 4
+#define PARTITION_KEYS 16
+
+static gint partition_key_workers[PARTITION_KEYS];
+static gint partition_key_mismatches;
+
+static worker_insert_result_t
+_insert_partitioned_message(LogThreadedDestWorker *self, LogMessage *msg)
+{
+  gint key = atoi(log_msg_get_value(msg, LM_V_PID, NULL));
+
+  g_atomic_int_compare_and_exchange(&partition_key_workers[key], -1, self->worker_index);
+  if (g_atomic_int_get(&partition_key_workers[key]) != self->worker_index)
+    g_atomic_int_inc(&partition_key_mismatches);
+  return WORKER_INSERT_RESULT_SUCCESS;
+}
+
+static LogThreadedDestWorker *
+_construct_partitioned_worker(LogThreadedDestDriver *s, gint worker_index)
+{
+  LogThreadedDestWorker *worker = g_new0(LogThreadedDestWorker, 1);
+
+  log_threaded_dest_worker_init_instance(worker, s, worker_index);
+  worker->insert = _insert_partitioned_message;
+  return worker;
+}
+
+Test(logthrdestdrv, worker_partition_key_delivers_the_same_key_through_the_same_worker)
+{
+  TestThreadedDestDriver *partitioned = test_threaded_dd_new(main_loop_get_current_config(main_loop));
+  LogPipe *s = &partitioned->super.super.super.super;
+  LogTemplate *key = log_template_new(log_pipe_get_config(s), NULL);
+  gssize processed = 0;
+  gint workers_used = 0;
+
+  cr_assert(log_template_compile(key, "$PID", NULL));
+  for (gint i = 0; i < PARTITION_KEYS; i++)
+    partition_key_workers[i] = -1;
+
+  partitioned->super.worker.construct = _construct_partitioned_worker;
+  log_threaded_dest_driver_set_num_workers(&partitioned->super.super.super, PARTITION_WORKERS);
+  log_threaded_dest_driver_set_worker_partition_key(&partitioned->super.super.super, key);
+  cr_assert(log_pipe_init(s));
+
+  _generate_messages(partitioned, PARTITION_KEYS);
+  _generate_messages(partitioned, PARTITION_KEYS);
+  _spin_for_counter_value(partitioned->super.written_messages, 2 * PARTITION_KEYS);
+  cr_assert(partition_key_mismatches == 0, "messages with the same key were delivered by different workers");
+
+  for (gint i = 0; i < PARTITION_WORKERS; i++)
+    {
+      gssize worker_processed = stats_counter_get(partitioned->super.workers[i]->processed_messages);
+
+      processed += worker_processed;
+      if (worker_processed > 0)
+        workers_used++;
+    }
+  cr_assert(processed == 2 * PARTITION_KEYS, "per-worker counters don't add up, found %" G_GSSIZE_FORMAT, processed);
+  cr_assert(workers_used > 1, "all keys were mapped to a single worker");
+
+  main_loop_sync_worker_startup_and_teardown();
+  log_pipe_deinit(s);
+  for (gint i = 0; i < PARTITION_WORKERS; i++)
+    log_threaded_dest_worker_free(partitioned->super.workers[i]);
+  log_pipe_unref(s);
+}
+
 MainLoopOptions main_loop_options = {0};
 
 static void
@@ -172,19 +172,22 @@ tf_if_call(LogTemplateFunction *self, gpointer s, const LogTemplateInvokeArgs *a
 
 TEMPLATE_FUNCTION(TFCondState, tf_if, tf_if_prepare, NULL, tf_if_call, tf_cond_free_state, NULL);
 
+/* arguments after the first non-empty one are not evaluated */
 static void
-tf_or (LogMessage *msg, gint argc, GString *argv[], GString *result)
+tf_or (LogMessage *msg, gint argc, TFSimpleFuncLazyArgs *args, GString *result)
 {
   gint i;
 
   for (i = 0; i < argc; i++)
     {
-      if (argv[i]->len == 0)
+      GString *arg = tf_simple_func_lazy_arg(args, i);
+
+      if (arg->len == 0)
         continue;
 
-      g_string_append_len (result, argv[i]->str, argv[i]->len);
+      g_string_append_len (result, arg->str, arg->len);
       break;
     }
 }
 
-TEMPLATE_FUNCTION_SIMPLE(tf_or);
+TEMPLATE_FUNCTION_SIMPLE_LAZY(tf_or);
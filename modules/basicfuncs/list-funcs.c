@@ -172,19 +172,68 @@ _list_nth(gint argc, GString *argv[], GString *result, gint ndx)
   list_scanner_deinit(&scanner);
 }
 
+/* evaluates all arguments starting with first_arg */
+static gint
+_lazy_args_collect(gint argc, TFSimpleFuncLazyArgs *args, gint first_arg)
+{
+  gint i;
+
+  for (i = first_arg; i < argc; i++)
+    tf_simple_func_lazy_arg(args, i);
+  return argc - first_arg;
+}
+
+/*
+ * Looks up a non-negative index, evaluating the arguments one-by-one, so
+ * that the ones after the item we are looking for are not evaluated at
+ * all.  List items never span arguments, so this is equivalent to
+ * scanning all arguments at once.
+ */
+static void
+_list_nth_lazy(gint argc, TFSimpleFuncLazyArgs *args, gint first_arg, GString *result, gint ndx)
+{
+  ListScanner scanner;
+  gint arg_ndx, i = 0;
+
+  if (ndx < 0)
+    {
+      _list_nth(_lazy_args_collect(argc, args, first_arg), &args->argv[first_arg], result, ndx);
+      return;
+    }
+
+  list_scanner_init(&scanner);
+  for (arg_ndx = first_arg; arg_ndx < argc; arg_ndx++)
+    {
+      GString *arg = tf_simple_func_lazy_arg(args, arg_ndx);
+
+      list_scanner_input_gstring_array(&scanner, 1, &arg);
+      while (list_scanner_scan_next(&scanner))
+        {
+          if (i == ndx)
+            {
+              g_string_append(result, list_scanner_get_current_value(&scanner));
+              goto exit;
+            }
+          i++;
+        }
+    }
+exit:
+  list_scanner_deinit(&scanner);
+}
+
 /*
  * Take off the first item of the list, unencoded.
  */
 static void
-tf_list_head(LogMessage *msg, gint argc, GString *argv[], GString *result)
+tf_list_head(LogMessage *msg, gint argc, TFSimpleFuncLazyArgs *args, GString *result)
 {
-  _list_nth(argc, argv, result, 0);
+  _list_nth_lazy(argc, args, 0, result, 0);
 }
 
-TEMPLATE_FUNCTION_SIMPLE(tf_list_head);
+TEMPLATE_FUNCTION_SIMPLE_LAZY(tf_list_head);
 
 static void
-tf_list_nth(LogMessage *msg, gint argc, GString *argv[], GString *result)
+tf_list_nth(LogMessage *msg, gint argc, TFSimpleFuncLazyArgs *args, GString *result)
 {
   gint64 ndx = 0;
   const gchar *ndx_spec;
@@ -192,7 +241,7 @@ tf_list_nth(LogMessage *msg, gint argc, GString *argv[], GString *result)
   if (argc < 1)
     return;
 
-  ndx_spec = argv[0]->str;
+  ndx_spec = tf_simple_func_lazy_arg(args, 0)->str;
   /* get start position from first argument */
   if (!parse_number(ndx_spec, &ndx))
     {
@@ -201,10 +250,10 @@ tf_list_nth(LogMessage *msg, gint argc, GString *argv[], GString *result)
       return;
     }
 
-  _list_nth(argc - 1, &argv[1], result, ndx);
+  _list_nth_lazy(argc, args, 1, result, ndx);
 }
 
-TEMPLATE_FUNCTION_SIMPLE(tf_list_nth);
+TEMPLATE_FUNCTION_SIMPLE_LAZY(tf_list_nth);
 
 static void
 tf_list_tail(LogMessage *msg, gint argc, GString *argv[], GString *result)
@@ -28,6 +28,19 @@
 #include "plugin.h"
 #include "cfg.h"
 #include "logmsg/logmsg.h"
+#include "template/simple-function.h"
+
+static gint tf_count_calls_invocations;
+
+static void
+tf_count_calls(LogMessage *msg, gint argc, GString *argv[], GString *result)
+{
+  tf_count_calls_invocations++;
+  g_string_append(result, "evaluated");
+}
+
+TEMPLATE_FUNCTION_SIMPLE(tf_count_calls);
+static Plugin count_calls_plugin = TEMPLATE_FUNCTION_PLUGIN(tf_count_calls, "count-calls");
 
 static void
 add_dummy_template_to_configuration(void)
@@ -75,6 +88,7 @@ setup(void)
   init_template_tests();
   add_dummy_template_to_configuration();
   cfg_load_module(configuration, "basicfuncs");
+  plugin_register(&configuration->plugin_context, &count_calls_plugin, 1);
 }
 
 void
@@ -127,6 +141,25 @@ Test(basicfuncs, test_cond_funcs)
   assert_template_format_with_context("$(or)", "");
 }
 
+Test(basicfuncs, test_unused_args_are_not_evaluated)
+{
+  tf_count_calls_invocations = 0;
+  assert_template_format("$(or foo $(count-calls))", "foo");
+  assert_template_format("$(if ('foo' == 'foo') foo $(count-calls))", "foo");
+  assert_template_format("$(list-head foo,bar $(count-calls))", "foo");
+  assert_template_format("$(list-nth 1 foo,bar $(count-calls))", "bar");
+  cr_assert_eq(tf_count_calls_invocations, 0);
+
+  assert_template_format("$(or '' $(count-calls))", "evaluated");
+  assert_template_format("$(list-head '' $(count-calls))", "evaluated");
+  assert_template_format("$(list-nth 2 foo,bar $(count-calls))", "evaluated");
+  cr_assert_eq(tf_count_calls_invocations, 3);
+
+  /* negative indices need the length of the whole list */
+  assert_template_format("$(list-nth -2 foo,bar $(count-calls))", "bar");
+  cr_assert_eq(tf_count_calls_invocations, 4);
+}
+
 Test(basicfuncs, test_str_funcs)
 {
   assert_template_format("$(ipv4-to-int $SOURCEIP)", "168496141");
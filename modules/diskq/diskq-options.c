@@ -72,9 +72,55 @@ disk_queue_options_mem_buf_length_set(DiskQueueOptions *self, gint mem_buf_lengt
   self->mem_buf_length = mem_buf_length;
 }
 
+void
+disk_queue_options_write_buf_size_set(DiskQueueOptions *self, gint write_buf_size)
+{
+  self->write_buf_size = write_buf_size;
+}
+
+void
+disk_queue_options_fsync_set(DiskQueueOptions *self, gboolean fsync)
+{
+  self->fsync = fsync;
+}
+
+void
+disk_queue_options_compression_set(DiskQueueOptions *self, gboolean compression)
+{
+  self->compression = compression;
+}
+
+void
+disk_queue_options_segment_size_set(DiskQueueOptions *self, gint64 segment_size)
+{
+  if (segment_size > 0 && segment_size < MIN_SEGMENT_SIZE)
+    {
+      msg_warning("WARNING: The configured disk buffer segment size is smaller than the minimum allowed",
+                  evt_tag_long("configured_size", segment_size),
+                  evt_tag_long("minimum_allowed_size", MIN_SEGMENT_SIZE),
+                  evt_tag_long("new_size", MIN_SEGMENT_SIZE));
+      segment_size = MIN_SEGMENT_SIZE;
+    }
+  else if (segment_size > MAX_SEGMENT_SIZE)
+    {
+      msg_warning("WARNING: The configured disk buffer segment size is larger than the maximum allowed",
+                  evt_tag_long("configured_size", segment_size),
+                  evt_tag_long("maximum_allowed_size", MAX_SEGMENT_SIZE),
+                  evt_tag_long("new_size", MAX_SEGMENT_SIZE));
+      segment_size = MAX_SEGMENT_SIZE;
+    }
+  self->segment_size = segment_size;
+}
+
 void
 disk_queue_options_check_plugin_settings(DiskQueueOptions *self)
 {
+  if (self->compression && !SYSLOG_NG_HAVE_LZ4)
+    {
+      msg_warning("WARNING: compression parameter was ignored as syslog-ng was compiled without LZ4 support");
+      self->compression = FALSE;
+    }
+
   if (self->reliable)
     {
       if (self->mem_buf_length > 0)
@@ -88,6 +134,10 @@ disk_queue_options_check_plugin_settings(DiskQueueOptions *self)
         {
           msg_warning("WARNING: mem-buf-size parameter was ignored as it is not compatible with non-reliable queue. Did you mean mem-buf-length?");
         }
+      if (self->fsync)
+        {
+          msg_warning("WARNING: fsync parameter was ignored as it is only supported by the reliable queue");
+        }
     }
 }
 
@@ -121,6 +171,10 @@ disk_queue_options_set_default_options(DiskQueueOptions *self)
   self->reliable = FALSE;
   self->mem_buf_size = -1;
   self->qout_size = -1;
+  self->write_buf_size = -1;
+  self->fsync = FALSE;
+  self->compression = FALSE;
+  self->segment_size = 0;
   self->dir = g_strdup(get_installation_path_for(SYSLOG_NG_PATH_LOCALSTATEDIR));
 }
 
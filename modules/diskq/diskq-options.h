@@ -28,6 +28,9 @@
 #include "logmsg/logmsg-serialize.h"
 
 #define MIN_DISK_BUF_SIZE 1024*1024
+#define DEFAULT_WRITE_BUF_SIZE 64*1024
+#define MIN_SEGMENT_SIZE 1024*1024
+#define MAX_SEGMENT_SIZE 1024*1024*1024
 
 typedef struct _DiskQueueOptions
 {
@@ -37,6 +40,10 @@ typedef struct _DiskQueueOptions
   gboolean reliable;
   gint mem_buf_size;
   gint mem_buf_length;
+  gint write_buf_size;
+  gboolean fsync;
+  gboolean compression;
+  gint64 segment_size;
   gchar *dir;
 } DiskQueueOptions;
 
@@ -45,6 +52,10 @@ void disk_queue_options_disk_buf_size_set(DiskQueueOptions *self, gint64 disk_bu
 void disk_queue_options_reliable_set(DiskQueueOptions *self, gboolean reliable);
 void disk_queue_options_mem_buf_size_set(DiskQueueOptions *self, gint mem_buf_size);
 void disk_queue_options_mem_buf_length_set(DiskQueueOptions *self, gint mem_buf_length);
+void disk_queue_options_write_buf_size_set(DiskQueueOptions *self, gint write_buf_size);
+void disk_queue_options_fsync_set(DiskQueueOptions *self, gboolean fsync);
+void disk_queue_options_compression_set(DiskQueueOptions *self, gboolean compression);
+void disk_queue_options_segment_size_set(DiskQueueOptions *self, gint64 segment_size);
 void disk_queue_options_check_plugin_settings(DiskQueueOptions *self);
 void disk_queue_options_set_dir(DiskQueueOptions *self, const gchar *dir);
 void disk_queue_options_set_default_options(DiskQueueOptions *self);
@@ -37,6 +37,10 @@ static CfgLexerKeyword diskq_keywords[] =
   { "mem_buf_size",      KW_MEM_BUF_SIZE },
   { "qout_size",         KW_QOUT_SIZE },
   { "dir",               KW_DIR },
+  { "write_buf_size",    KW_WRITE_BUF_SIZE },
+  { "fsync",             KW_FSYNC },
+  { "compression",       KW_COMPRESSION },
+  { "segment_size",      KW_SEGMENT_SIZE },
   { NULL }
 };
 
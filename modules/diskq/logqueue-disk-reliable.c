@@ -36,24 +36,10 @@ _start(LogQueueDisk *s, const gchar *filename)
 static gboolean
 _skip_message(LogQueueDisk *self)
 {
-  GString *serialized;
-  SerializeArchive *sa;
-
   if (!qdisk_initialized(self->qdisk))
     return FALSE;
 
-  serialized = g_string_sized_new(64);
-  if (!qdisk_pop_head(self->qdisk, serialized))
-    {
-      g_string_free(serialized, TRUE);
-      return FALSE;
-    }
-
-  sa = serialize_string_archive_new(serialized);
-  serialize_archive_free(sa);
-
-  g_string_free(serialized, TRUE);
-  return TRUE;
+  return qdisk_pop_head(self->qdisk, self->read_buffer);
 }
 
 static void
@@ -288,6 +274,32 @@ _push_tail(LogQueueDisk *s, LogMessage *msg, LogPathOptions *local_options, cons
   return TRUE;
 }
 
+/* forgets the in-memory copies of the records dropped by a failed flush,
+ * as their positions are reused by the records written next */
+static void
+_drop_unwritten(LogQueueDisk *s, gint64 from, gint64 to)
+{
+  LogQueueDiskReliable *self = (LogQueueDiskReliable *) s;
+
+  while (self->qreliable->length > 0)
+    {
+      LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+      gint64 *temppos = g_queue_peek_nth(self->qreliable, self->qreliable->length - 3);
+      LogMessage *msg;
+
+      if (*temppos < from || *temppos >= to)
+        break;
+
+      POINTER_TO_LOG_PATH_OPTIONS(g_queue_pop_tail(self->qreliable), &path_options);
+      msg = g_queue_pop_tail(self->qreliable);
+      g_queue_pop_tail(self->qreliable);
+
+      log_queue_memory_usage_sub(&self->super.super, log_msg_get_size(msg));
+      g_free(temppos);
+      log_msg_drop(msg, &path_options, path_options.flow_control_requested ? AT_SUSPENDED : AT_PROCESSED);
+    }
+}
+
 static void
 _free_queue(LogQueueDisk *s)
 {
@@ -323,6 +335,7 @@ _set_virtual_functions(LogQueueDisk *self)
   self->get_length = _get_length;
   self->ack_backlog = _ack_backlog;
   self->rewind_backlog = _rewind_backlog;
+  self->drop_unwritten = _drop_unwritten;
   self->pop_head = _pop_head;
   self->push_tail = _push_tail;
   self->free_fn = _free_queue;
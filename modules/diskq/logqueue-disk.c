@@ -29,6 +29,7 @@
 #include "stats/stats-registry.h"
 #include "reloc.h"
 #include "qdisk.h"
+#include "mainloop-worker.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -42,6 +43,19 @@
 
 QueueType log_queue_disk_type = "DISK";
 
+/*
+ * Records are staged in the write buffer of the QDisk and written
+ * together.  Messages are only acked once their records are written: the
+ * buffer is flushed when it gets full, when the output thread pops from
+ * the queue, and at the end of the batch of the input thread that pushed
+ * the records.
+ */
+struct _LogQueueDiskFlushCallback
+{
+  WorkerBatchCallback cb;
+  gboolean registered;
+};
+
 static gint64
 _get_length(LogQueue *s)
 {
@@ -55,31 +69,143 @@ _get_length(LogQueue *s)
   return qdisk_length;
 }
 
+/* acks or drops the messages in qpending once the write buffer was flushed
+ *
+ * NOTE: must be called with the queue lock held */
 static void
-_push_tail(LogQueue *s, LogMessage *msg, const LogPathOptions *path_options)
+_complete_pending_acks(LogQueueDisk *self)
 {
-  LogQueueDisk *self = (LogQueueDisk *) s;
-  LogPathOptions local_options = *path_options;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  gint64 dropped_from, dropped_to;
+  gint dropped = qdisk_take_dropped_records(self->qdisk, &dropped_from, &dropped_to);
+  LogMessage *msg;
+
+  if (dropped > 0)
+    {
+      stats_counter_add(self->super.dropped_messages, dropped);
+      log_queue_queued_messages_sub(&self->super, dropped);
+      if (self->drop_unwritten)
+        self->drop_unwritten(self, dropped_from, dropped_to);
+    }
+
+  if (qdisk_get_buffered_records(self->qdisk) > 0)
+    return;
+
+  while ((msg = g_queue_pop_head(self->qpending)))
+    {
+      POINTER_TO_LOG_PATH_OPTIONS(g_queue_pop_head(self->qpending), &path_options);
+      if (dropped > 0)
+        log_msg_drop(msg, &path_options, path_options.flow_control_requested ? AT_SUSPENDED : AT_PROCESSED);
+      else
+        {
+          log_msg_ack(msg, &path_options, AT_PROCESSED);
+          log_msg_unref(msg);
+        }
+    }
+}
+
+/* NOTE: must be called with the queue lock held */
+static void
+_flush_locked(LogQueueDisk *self)
+{
+  if (qdisk_initialized(self->qdisk))
+    qdisk_flush(self->qdisk);
+  _complete_pending_acks(self);
+}
+
+static gpointer
+_flush_at_the_end_of_batch(gpointer user_data)
+{
+  LogQueueDisk *self = (LogQueueDisk *) user_data;
+  gint thread_id = main_loop_worker_get_thread_id();
+
   g_static_mutex_lock(&self->super.lock);
+  _flush_locked(self);
+  g_static_mutex_unlock(&self->super.lock);
+
+  self->flush_callbacks[thread_id].registered = FALSE;
+  log_queue_unref(&self->super);
+  return NULL;
+}
+
+/* records pushed by input threads are flushed at the end of their batch,
+ * the ones pushed by other threads at the end of the push call */
+static gboolean
+_register_flush_callback(LogQueueDisk *self)
+{
+  gint thread_id = main_loop_worker_get_thread_id();
+
+  if (thread_id < 0 || thread_id >= log_queue_max_threads)
+    return FALSE;
+
+  if (!self->flush_callbacks[thread_id].registered)
+    {
+      main_loop_worker_register_batch_callback(&self->flush_callbacks[thread_id].cb);
+      self->flush_callbacks[thread_id].registered = TRUE;
+      log_queue_ref(&self->super);
+    }
+  return TRUE;
+}
+
+/* NOTE: must be called with the queue lock held */
+static void
+_push_tail_locked(LogQueueDisk *self, LogMessage *msg, const LogPathOptions *path_options)
+{
+  LogPathOptions local_options = *path_options;
+
   if (self->push_tail)
     {
       if (self->push_tail(self, msg, &local_options, path_options))
         {
           log_queue_push_notify (&self->super);
           log_queue_queued_messages_inc(&self->super);
-          log_msg_ack(msg, &local_options, AT_PROCESSED);
-          log_msg_unref(msg);
-          g_static_mutex_unlock(&self->super.lock);
+          if (local_options.ack_needed && qdisk_get_buffered_records(self->qdisk) > 0)
+            {
+              /* the record of the message is still in the write buffer */
+              g_queue_push_tail(self->qpending, msg);
+              g_queue_push_tail(self->qpending, LOG_PATH_OPTIONS_TO_POINTER(&local_options));
+            }
+          else
+            {
+              log_msg_ack(msg, &local_options, AT_PROCESSED);
+              log_msg_unref(msg);
+            }
+          _complete_pending_acks(self);
           return;
         }
     }
+  _complete_pending_acks(self);
   stats_counter_inc (self->super.dropped_messages);
 
   if (path_options->flow_control_requested)
     log_msg_ack(msg, path_options, AT_SUSPENDED);
   else
     log_msg_drop(msg, path_options, AT_PROCESSED);
+}
+
+static void
+_push_tail(LogQueue *s, LogMessage *msg, const LogPathOptions *path_options)
+{
+  LogQueueDisk *self = (LogQueueDisk *) s;
+
+  g_static_mutex_lock(&self->super.lock);
+  _push_tail_locked(self, msg, path_options);
+  if (!_register_flush_callback(self))
+    _flush_locked(self);
+  g_static_mutex_unlock(&self->super.lock);
+}
 
+static void
+_push_tail_batch(LogQueue *s, LogMessage **msgs, const LogPathOptions *path_options, gint num_msgs)
+{
+  LogQueueDisk *self = (LogQueueDisk *) s;
+  gint i;
+
+  g_static_mutex_lock(&self->super.lock);
+  for (i = 0; i < num_msgs; i++)
+    _push_tail_locked(self, msgs[i], &path_options[i]);
+  if (!_register_flush_callback(self))
+    _flush_locked(self);
   g_static_mutex_unlock(&self->super.lock);
 }
 
@@ -104,6 +230,7 @@ _pop_head(LogQueue *s, LogPathOptions *path_options)
 
   msg = NULL;
   g_static_mutex_lock(&self->super.lock);
+  _flush_locked(self);
   if (self->pop_head)
     {
       msg = self->pop_head(self, path_options);
@@ -112,16 +239,46 @@ _pop_head(LogQueue *s, LogPathOptions *path_options)
     {
       log_queue_queued_messages_dec(&self->super);
     }
+  _complete_pending_acks(self);
   g_static_mutex_unlock(&self->super.lock);
   return msg;
 }
 
+static gint
+_pop_head_batch(LogQueue *s, LogMessage **msgs, LogPathOptions *path_options, gint max_msgs)
+{
+  LogQueueDisk *self = (LogQueueDisk *) s;
+  LogPathOptions initial_path_options = LOG_PATH_OPTIONS_INIT;
+  gint num_msgs = 0;
+
+  g_static_mutex_lock(&self->super.lock);
+  _flush_locked(self);
+  if (self->pop_head)
+    {
+      for (; num_msgs < max_msgs; num_msgs++)
+        {
+          path_options[num_msgs] = initial_path_options;
+          msgs[num_msgs] = self->pop_head(self, &path_options[num_msgs]);
+          if (!msgs[num_msgs])
+            break;
+        }
+    }
+  if (num_msgs > 0)
+    {
+      log_queue_queued_messages_sub(&self->super, num_msgs);
+    }
+  _complete_pending_acks(self);
+  g_static_mutex_unlock(&self->super.lock);
+  return num_msgs;
+}
+
 static void
 _ack_backlog(LogQueue *s, gint num_msg_to_ack)
 {
   LogQueueDisk *self = (LogQueueDisk *) s;
 
   g_static_mutex_lock(&self->super.lock);
+  _flush_locked(self);
 
   if (self->ack_backlog)
     {
@@ -136,6 +293,7 @@ _rewind_backlog(LogQueue *s, guint rewind_count)
 {
   LogQueueDisk *self = (LogQueueDisk *) s;
   g_static_mutex_lock(&self->super.lock);
+  _flush_locked(self);
 
   if (self->rewind_backlog)
     {
@@ -151,6 +309,7 @@ _backlog_all(LogQueue *s)
   LogQueueDisk *self = (LogQueueDisk *) s;
 
   g_static_mutex_lock(&self->super.lock);
+  _flush_locked(self);
 
   if (self->rewind_backlog)
     {
@@ -171,6 +330,10 @@ log_queue_disk_save_queue(LogQueue *s, gboolean *persistent)
       return TRUE;
     }
 
+  g_static_mutex_lock(&self->super.lock);
+  _flush_locked(self);
+  g_static_mutex_unlock(&self->super.lock);
+
   if (self->save_queue)
     return self->save_queue(self, persistent);
   return FALSE;
@@ -210,40 +373,39 @@ _free(LogQueue *s)
 {
   LogQueueDisk *self = (LogQueueDisk *) s;
 
+  _flush_locked(self);
+  g_queue_free(self->qpending);
+  g_free(self->flush_callbacks);
+
   if (self->free_fn)
     self->free_fn(self);
 
   qdisk_deinit(self->qdisk);
   qdisk_free(self->qdisk);
 
+  serialize_archive_free(self->write_archive);
+  serialize_archive_free(self->read_archive);
+  g_string_free(self->read_buffer, TRUE);
+
   log_queue_free_method(s);
 }
 
 static gboolean
 _pop_disk(LogQueueDisk *self, LogMessage **msg)
 {
-  GString *serialized;
-  SerializeArchive *sa;
-
   *msg = NULL;
 
   if (!qdisk_initialized(self->qdisk))
     return FALSE;
 
-  serialized = g_string_sized_new(64);
-  if (!qdisk_pop_head(self->qdisk, serialized))
-    {
-      g_string_free(serialized, TRUE);
-      return FALSE;
-    }
+  if (!qdisk_pop_head(self->qdisk, self->read_buffer))
+    return FALSE;
 
-  sa = serialize_string_archive_new(serialized);
+  serialize_string_archive_reset(self->read_archive);
   *msg = log_msg_new_empty();
 
-  if (!log_msg_deserialize(*msg, sa))
+  if (!log_msg_deserialize(*msg, self->read_archive))
     {
-      g_string_free(serialized, TRUE);
-      serialize_archive_free(sa);
       log_msg_unref(*msg);
       *msg = NULL;
       msg_error("Can't read correct message from disk-queue file",
@@ -251,9 +413,6 @@ _pop_disk(LogQueueDisk *self, LogMessage **msg)
       return TRUE;
     }
 
-  serialize_archive_free(sa);
-
-  g_string_free(serialized, TRUE);
   return TRUE;
 }
 
@@ -282,20 +441,20 @@ _read_message(LogQueueDisk *self, LogPathOptions *path_options)
   return msg;
 }
 
+/* the message is serialized into an iovec that references its payload,
+ * which is then copied straight to the write buffer of the qdisk */
 static gboolean
 _write_message(LogQueueDisk *self, LogMessage *msg)
 {
-  GString *serialized;
-  SerializeArchive *sa;
+  const struct iovec *iov;
+  gint iovcnt;
   gboolean consumed = FALSE;
   if (qdisk_initialized(self->qdisk) && qdisk_is_space_avail(self->qdisk, 64))
     {
-      serialized = g_string_sized_new(64);
-      sa = serialize_string_archive_new(serialized);
-      log_msg_serialize(msg, sa);
-      consumed = qdisk_push_tail(self->qdisk, serialized);
-      serialize_archive_free(sa);
-      g_string_free(serialized, TRUE);
+      serialize_iov_archive_reset(self->write_archive);
+      log_msg_serialize(msg, self->write_archive);
+      iov = serialize_iov_archive_get_iov(self->write_archive, &iovcnt);
+      consumed = qdisk_push_tail_iov(self->qdisk, iov, iovcnt, serialize_iov_archive_get_length(self->write_archive));
     }
   return consumed;
 }
@@ -338,14 +497,30 @@ _restart_corrupted(LogQueueDisk *self)
 void
 log_queue_disk_init_instance(LogQueueDisk *self, const gchar *persist_name)
 {
+  gint i;
+
   log_queue_init_instance(&self->super, persist_name);
   self->qdisk = qdisk_new();
+  self->qpending = g_queue_new();
+  self->write_archive = serialize_iov_archive_new();
+  self->read_buffer = g_string_sized_new(256);
+  self->read_archive = serialize_string_archive_new(self->read_buffer);
+
+  self->flush_callbacks = g_new0(LogQueueDiskFlushCallback, log_queue_max_threads);
+  for (i = 0; i < log_queue_max_threads; i++)
+    {
+      worker_batch_callback_init(&self->flush_callbacks[i].cb);
+      self->flush_callbacks[i].cb.func = _flush_at_the_end_of_batch;
+      self->flush_callbacks[i].cb.user_data = self;
+    }
 
   self->super.type = log_queue_disk_type;
   self->super.get_length = _get_length;
   self->super.push_tail = _push_tail;
   self->super.push_head = _push_head;
   self->super.pop_head = _pop_head;
+  self->super.push_tail_batch = _push_tail_batch;
+  self->super.pop_head_batch = _pop_head_batch;
   self->super.ack_backlog = _ack_backlog;
   self->super.rewind_backlog = _rewind_backlog;
   self->super.rewind_backlog_all = _backlog_all;
@@ -30,11 +30,18 @@
 #include "logmsg/logmsg-serialize.h"
 
 typedef struct _LogQueueDisk LogQueueDisk;
+typedef struct _LogQueueDiskFlushCallback LogQueueDiskFlushCallback;
 
 struct _LogQueueDisk
 {
   LogQueue super;
   QDisk *qdisk;         /* disk based queue */
+  GQueue *qpending;     /* messages acked once their records are flushed */
+  LogQueueDiskFlushCallback *flush_callbacks; /* per input thread */
+  /* reused for every message, only accessed with the lock held */
+  SerializeArchive *write_archive;
+  GString *read_buffer;
+  SerializeArchive *read_archive;
   gint64 (*get_length)(LogQueueDisk *s);
   gboolean (*push_tail)(LogQueueDisk *s, LogMessage *msg, LogPathOptions *local_options,
                         const LogPathOptions *path_options);
@@ -42,6 +49,7 @@ struct _LogQueueDisk
   LogMessage *(*pop_head)(LogQueueDisk *s, LogPathOptions *path_options);
   void (*ack_backlog)(LogQueueDisk *s, guint num_msg_to_ack);
   void (*rewind_backlog)(LogQueueDisk *s, guint rewind_count);
+  void (*drop_unwritten)(LogQueueDisk *s, gint64 from, gint64 to);
   gboolean (*save_queue)(LogQueueDisk *s, gboolean *persistent);
   gboolean (*load_queue)(LogQueueDisk *s, const gchar *filename);
   gboolean (*start)(LogQueueDisk *s, const gchar *filename);
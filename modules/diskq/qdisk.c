@@ -37,6 +37,10 @@
 #include <unistd.h>
 #include <sys/types.h>
 
+#if SYSLOG_NG_HAVE_LZ4
+#include <lz4.h>
+#endif
+
 /* MADV_RANDOM not defined on legacy Linux systems. Could be removed in the
  * future, when support for Glibc 2.1.X drops.*/
 #ifndef MADV_RANDOM
@@ -47,6 +51,58 @@
 #define PESSIMISTIC_MEM_BUF_SIZE 10000 * 16 *1024
 
 #define MAX_RECORD_LENGTH 100 * 1024 * 1024
+#define MAX_BLOCK_LENGTH 2 * MAX_RECORD_LENGTH
+
+/* version 2 files have a valid compression field and record indexes */
+#define QDISK_VERSION_COMPRESSION 2
+
+/*
+ * Compressed files store blocks instead of records: a block header is
+ * followed by the compressed contents of the write buffer, that is a
+ * series of length prefixed records.  The length field of the header
+ * covers the rest of the block, just like the length of a record, and has
+ * its top bit set.
+ *
+ * Positions returned by the API identify records: the offset of their
+ * block is in the upper bits, their index within the block in the lower
+ * 16 bits.
+ */
+#define QDISK_BLOCK_FLAG 0x80000000
+#define QDISK_BLOCK_INDEX_BITS 16
+#define QDISK_MAX_BLOCK_RECORDS ((1 << QDISK_BLOCK_INDEX_BITS) - 1)
+
+/* version 3 files have valid segment fields */
+#define QDISK_VERSION_SEGMENTS 3
+
+/*
+ * Segmented files keep only the header and the saved in-memory queues in
+ * the main file, records are written to segment files next to it, named
+ * after the main file and the number of the segment.  Segments are used in
+ * a circle and removed as soon as the backlog head leaves them, so there
+ * is nothing to truncate or wrap around within a file.
+ *
+ * Heads hold the number of the segment in the upper bits and the offset
+ * within it in the lower 32 bits.  A segment is full once the offset
+ * reaches the segment size, the record filling it may extend beyond that.
+ * The segment numbers must leave room for the record index of compressed
+ * files.
+ */
+#define QDISK_SEGMENT_OFFSET_BITS 32
+#define QDISK_MAX_SEGMENTS ((1 << (63 - QDISK_SEGMENT_OFFSET_BITS - QDISK_BLOCK_INDEX_BITS)) - 1)
+#define QDISK_SEGMENT_FDS 4
+
+typedef struct _QDiskSegmentFd
+{
+  gint32 segment;
+  gint fd;
+} QDiskSegmentFd;
+
+typedef struct _QDiskBlockHeader
+{
+  guint32 len;
+  guint32 uncompressed_len;
+  guint32 records;
+} QDiskBlockHeader;
 
 #define PATH_QDISK              PATH_LOCALSTATEDIR
 
@@ -57,7 +113,7 @@ typedef union _QDiskFileHeader
     gchar magic[4];
     guint8 version;
     guint8 big_endian;
-    guint8 _pad1;
+    guint8 compression;
 
     gint64 read_head;
     gint64 write_head;
@@ -74,6 +130,10 @@ typedef union _QDiskFileHeader
     gint32 qoverflow_count;
     gint64 backlog_head;
     gint64 backlog_len;
+    gint32 read_index;
+    gint32 backlog_index;
+    gint64 segment_size;
+    gint32 segments;
   };
   gchar _pad2[QDISK_RESERVED_SPACE];
 } QDiskFileHeader;
@@ -86,6 +146,33 @@ struct _QDisk
   gint64 file_size;
   QDiskFileHeader *hdr;
   DiskQueueOptions *options;
+
+  /* where the next record goes: the header is only updated once the
+   * records before it are written, so that it never points past the data
+   * on disk, see qdisk_flush() */
+  gint64 write_head;
+
+  /* records pushed but not yet written, they end at write_head */
+  GString *write_buffer;
+  gint64 write_buffer_head;
+  gint write_buffer_records;
+  gint dropped_records;
+  /* positions of the dropped records, reused by the ones pushed next */
+  gint64 dropped_from;
+  gint64 dropped_to;
+
+  /* compressed files: the block under the read head, decompressed */
+  GString *read_block;
+  gint64 read_block_head;
+  guint32 read_block_length;
+  guint32 read_block_records;
+  guint32 read_block_index;
+  gsize read_block_offset;
+  GString *block_buffer;
+
+  /* segmented files: the write, read and backlog heads may all be in different segments */
+  QDiskSegmentFd segment_fds[QDISK_SEGMENT_FDS];
+  gint next_segment_fd;
 };
 
 static gboolean
@@ -154,22 +241,309 @@ _next_filename(QDisk *self)
   return g_strdup(tmpfname);
 }
 
+static inline gint64
+_position(QDisk *self, gint64 offset, gint32 index)
+{
+  if (!self->hdr->compression)
+    return offset;
+  return (offset << QDISK_BLOCK_INDEX_BITS) | index;
+}
+
+static inline gint64
+_position_offset(QDisk *self, gint64 position)
+{
+  if (!self->hdr->compression)
+    return position;
+  return position >> QDISK_BLOCK_INDEX_BITS;
+}
+
+static inline gint32
+_position_index(QDisk *self, gint64 position)
+{
+  if (!self->hdr->compression)
+    return 0;
+  return position & QDISK_MAX_BLOCK_RECORDS;
+}
+
+static inline gboolean
+_is_segmented(QDisk *self)
+{
+  return self->hdr->segment_size > 0;
+}
+
+static inline gint32
+_segment_of(gint64 head)
+{
+  return head >> QDISK_SEGMENT_OFFSET_BITS;
+}
+
+static inline gint64
+_segment_offset(gint64 head)
+{
+  return head & G_GINT64_CONSTANT(0xFFFFFFFF);
+}
+
+static inline gint64
+_segment_head(gint32 segment, gint64 offset)
+{
+  return ((gint64) segment << QDISK_SEGMENT_OFFSET_BITS) | offset;
+}
+
+static inline gint32
+_next_segment(QDisk *self, gint32 segment)
+{
+  return (segment + 1) % self->hdr->segments;
+}
+
+static gchar *
+_get_segment_filename(QDisk *self, gint32 segment)
+{
+  return g_strdup_printf("%s.%05d", self->filename, segment);
+}
+
+static gint
+_get_segment_fd(QDisk *self, gint32 segment)
+{
+  QDiskSegmentFd *segment_fd;
+  gchar *filename;
+  gint i;
+
+  for (i = 0; i < QDISK_SEGMENT_FDS; i++)
+    {
+      if (self->segment_fds[i].fd >= 0 && self->segment_fds[i].segment == segment)
+        return self->segment_fds[i].fd;
+    }
+
+  segment_fd = &self->segment_fds[self->next_segment_fd];
+  self->next_segment_fd = (self->next_segment_fd + 1) % QDISK_SEGMENT_FDS;
+  if (segment_fd->fd >= 0)
+    close(segment_fd->fd);
+
+  filename = _get_segment_filename(self, segment);
+  segment_fd->segment = segment;
+  segment_fd->fd = open(filename,
+                        self->options->read_only ? (O_RDONLY | O_LARGEFILE) : (O_RDWR | O_LARGEFILE | O_CREAT), 0600);
+  if (segment_fd->fd < 0)
+    {
+      msg_error("Error opening disk-queue segment",
+                evt_tag_str("filename", filename),
+                evt_tag_error("error"));
+    }
+  g_free(filename);
+  return segment_fd->fd;
+}
+
+static void
+_close_segments(QDisk *self)
+{
+  gint i;
+
+  for (i = 0; i < QDISK_SEGMENT_FDS; i++)
+    {
+      if (self->segment_fds[i].fd >= 0)
+        close(self->segment_fds[i].fd);
+      self->segment_fds[i].fd = -1;
+    }
+}
+
+static void
+_remove_segment(QDisk *self, gint32 segment)
+{
+  gchar *filename = _get_segment_filename(self, segment);
+  gint i;
+
+  for (i = 0; i < QDISK_SEGMENT_FDS; i++)
+    {
+      if (self->segment_fds[i].fd >= 0 && self->segment_fds[i].segment == segment)
+        {
+          close(self->segment_fds[i].fd);
+          self->segment_fds[i].fd = -1;
+        }
+    }
+
+  if (unlink(filename) < 0 && errno != ENOENT)
+    {
+      msg_error("Error removing disk-queue segment",
+                evt_tag_str("filename", filename),
+                evt_tag_error("error"));
+    }
+  g_free(filename);
+}
+
+/* empties the segment and allocates its space in one go */
+static gboolean
+_create_segment(QDisk *self, gint32 segment)
+{
+  gint fd = _get_segment_fd(self, segment);
+
+  if (fd < 0)
+    return FALSE;
+
+  if (ftruncate(fd, 0) < 0)
+    {
+      msg_error("Error truncating disk-queue segment",
+                evt_tag_str("filename", self->filename),
+                evt_tag_int("segment", segment),
+                evt_tag_error("error"));
+      return FALSE;
+    }
+
+#ifdef FALLOC_FL_KEEP_SIZE
+  /* the size of the file is kept, it tells how much is written to it */
+  fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, self->hdr->segment_size);
+#endif
+  return TRUE;
+}
+
+static void _move_backlog_head(QDisk *self, gint64 head, gint32 index);
+
+/* moves the write head to the next segment, unless the backlog is still there */
+static gboolean
+_start_next_segment(QDisk *self)
+{
+  gint64 old_head = self->write_head;
+  gint32 segment = _next_segment(self, _segment_of(old_head));
+
+  if (segment == _segment_of(self->hdr->backlog_head) || !_create_segment(self, segment))
+    return FALSE;
+
+  self->write_head = _segment_head(segment, 0);
+  self->hdr->write_head = self->write_head;
+
+  /* the end of the full segment is the same as the start of the new one */
+  if (self->hdr->read_head == old_head)
+    self->hdr->read_head = self->write_head;
+  if (self->hdr->backlog_head == old_head)
+    _move_backlog_head(self, self->write_head, 0);
+  return TRUE;
+}
+
+/* removes the segments the backlog head has left */
+static void
+_release_segments(QDisk *self, gint64 old_backlog_head)
+{
+  gint32 segment = _segment_of(old_backlog_head);
+
+  if (!_is_segmented(self) || self->options->read_only)
+    return;
+
+  while (segment != _segment_of(self->hdr->backlog_head))
+    {
+      _remove_segment(self, segment);
+      segment = _next_segment(self, segment);
+    }
+
+  /* a writer waiting at the end of a full segment may go on */
+  if (_segment_offset(self->write_head) >= self->hdr->segment_size)
+    _start_next_segment(self);
+}
+
+static void
+_move_backlog_head(QDisk *self, gint64 head, gint32 index)
+{
+  gint64 old_head = self->hdr->backlog_head;
+
+  self->hdr->backlog_head = head;
+  self->hdr->backlog_index = index;
+  _release_segments(self, old_head);
+}
+
+/* the reader entered a new segment, let the kernel read ahead the one after it */
+static void
+_prefetch_next_segment(QDisk *self)
+{
+#ifdef POSIX_FADV_WILLNEED
+  gint32 segment = _segment_of(self->hdr->read_head);
+  gint fd;
+
+  if (segment == _segment_of(self->write_head))
+    return;
+
+  fd = _get_segment_fd(self, _next_segment(self, segment));
+  if (fd >= 0)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+}
+
+static gssize
+_pread_data(QDisk *self, gpointer buffer, gsize count, gint64 head)
+{
+  gint fd;
+
+  if (!_is_segmented(self))
+    return pread(self->fd, buffer, count, head);
+
+  fd = _get_segment_fd(self, _segment_of(head));
+  if (fd < 0)
+    return -1;
+  return pread(fd, buffer, count, _segment_offset(head));
+}
+
+static gboolean
+_pwrite_data(QDisk *self, const void *buffer, gsize count, gint64 head)
+{
+  gint fd;
+
+  if (!_is_segmented(self))
+    return pwrite_strict(self->fd, buffer, count, head);
+
+  fd = _get_segment_fd(self, _segment_of(head));
+  if (fd < 0)
+    return FALSE;
+  return pwrite_strict(fd, buffer, count, _segment_offset(head));
+}
+
+/* returns where the record or block following the one ending at @head starts */
+static gint64
+_get_next_head(QDisk *self, gint64 head)
+{
+  if (_is_segmented(self))
+    {
+      if (head != self->write_head && _segment_offset(head) >= self->hdr->segment_size)
+        return _segment_head(_next_segment(self, _segment_of(head)), 0);
+      return head;
+    }
+
+  if (head > self->write_head)
+    head = _correct_position_if_eof(self, &head);
+  return head;
+}
+
 gboolean
 qdisk_initialized(QDisk *self)
 {
   return self->fd >= 0;
 }
 
+static gint
+_compress_bound(gint len)
+{
+#if SYSLOG_NG_HAVE_LZ4
+  return LZ4_compressBound(len);
+#else
+  return len;
+#endif
+}
+
+/* the most the block of the buffered records takes on disk once @len more
+ * bytes are buffered, the records of a compressed file only move the write
+ * head when the block is written */
+static inline gint64
+_block_size_bound(QDisk *self, gint64 len)
+{
+  return sizeof(QDiskBlockHeader) + _compress_bound(self->write_buffer->len + len);
+}
+
 static inline gboolean
 _is_backlog_head_prevent_write_head(QDisk *self)
 {
-  return self->hdr->backlog_head <= self->hdr->write_head;
+  return self->hdr->backlog_head <= self->write_head;
 }
 
 static inline gboolean
 _is_write_head_less_than_max_size(QDisk *self)
 {
-  return self->hdr->write_head < self->options->disk_buf_size;
+  return self->write_head < self->options->disk_buf_size;
 }
 
 static inline gboolean
@@ -181,7 +555,7 @@ _is_able_to_reset_write_head_to_beginning_of_qdisk(QDisk *self)
 static inline gboolean
 _is_free_space_between_write_head_and_backlog_head(QDisk *self, gint msg_len)
 {
-  return self->hdr->write_head + msg_len < self->hdr->backlog_head;
+  return self->write_head + msg_len < self->hdr->backlog_head;
 }
 
 
@@ -189,6 +563,12 @@ gboolean
 qdisk_is_space_avail(QDisk *self, gint at_least)
 {
   gint64 msg_len = at_least + sizeof(guint32);
+
+  if (_is_segmented(self))
+    return _segment_offset(self->write_head) < self->hdr->segment_size;
+
+  if (self->hdr->compression)
+    msg_len = _block_size_bound(self, msg_len);
   return (
            (_is_backlog_head_prevent_write_head(self)) &&
            (_is_write_head_less_than_max_size(self) || _is_able_to_reset_write_head_to_beginning_of_qdisk(self))
@@ -207,7 +587,7 @@ _truncate_file(QDisk *self, gint64 new_size)
       msg_error("Error truncating disk-queue file",
                 evt_tag_error("error"),
                 evt_tag_str("filename", self->filename),
-                evt_tag_long("newsize", self->hdr->write_head),
+                evt_tag_long("newsize", self->write_head),
                 evt_tag_int("fd", self->fd));
     }
 
@@ -217,50 +597,224 @@ _truncate_file(QDisk *self, gint64 new_size)
 gint64
 qdisk_get_empty_space(QDisk *self)
 {
-  gint64 wpos = qdisk_get_writer_head(self);
-  gint64 bpos = qdisk_get_backlog_head(self);
+  gint64 wpos = self->write_head;
+  gint64 bpos = self->hdr->backlog_head;
+  gint64 buffered = self->hdr->compression ? _block_size_bound(self, 0) : 0;
+
+  if (_is_segmented(self))
+    {
+      gint32 full_segments = (_segment_of(wpos) - _segment_of(bpos) + self->hdr->segments) % self->hdr->segments;
+
+      return (self->hdr->segments - full_segments) * self->hdr->segment_size - _segment_offset(wpos) - buffered;
+    }
 
   if (wpos > bpos)
     {
       return (qdisk_get_size(self) - wpos) +
-             (bpos - QDISK_RESERVED_SPACE);
+             (bpos - QDISK_RESERVED_SPACE) - buffered;
     }
 
-  return bpos - wpos;
+  return bpos - wpos - buffered;
 }
 
-gboolean
-qdisk_push_tail(QDisk *self, GString *record)
+/* drops the buffered records after a failed write, as if they were never pushed */
+static void
+_drop_write_buffer(QDisk *self)
 {
-  guint32 n = GUINT32_TO_BE(record->len);
+  msg_error("Error writing disk-queue file, dropping buffered messages",
+            evt_tag_str("filename", self->filename),
+            evt_tag_error("error"),
+            evt_tag_int("count", self->write_buffer_records));
+
+  if (self->dropped_records == 0)
+    self->dropped_from = _position(self, self->write_buffer_head, 0);
+  self->dropped_to = MAX(self->dropped_to, _position(self, self->write_head, self->write_buffer_records));
+
+  /* the header still points to the end of the data written */
+  self->write_head = self->hdr->write_head;
+  if (self->write_head > MAX(self->hdr->backlog_head, self->hdr->read_head) &&
+      self->file_size > self->write_head)
+    self->file_size = self->write_head;
+
+  self->dropped_records += self->write_buffer_records;
+  g_string_truncate(self->write_buffer, 0);
+  self->write_buffer_records = 0;
+}
 
-  /* write follows read (e.g. we are appending to the file) OR
-   * there's enough space between write and read.
-   *
-   * If write follows read we need to check two things:
-   *   - either we are below the maximum limit (GINT64_FROM_BE(self->hdr->write_head) < self->options->disk_buf_size)
-   *   - or we can wrap around (GINT64_FROM_BE(self->hdr->read_head) != QDISK_RESERVED_SPACE)
-   * If neither of the above is true, the buffer is full.
-   */
-  if (!qdisk_is_space_avail(self, record->len))
-    return FALSE;
+static gboolean _advance_write_head(QDisk *self, gint64 len);
 
-  if (n == 0)
+static gint
+_compress(const gchar *src, gchar *dst, gint src_len, gint dst_capacity)
+{
+#if SYSLOG_NG_HAVE_LZ4
+  return LZ4_compress_default(src, dst, src_len, dst_capacity);
+#else
+  return 0;
+#endif
+}
+
+static gint
+_decompress(const gchar *src, gchar *dst, gint src_len, gint dst_capacity)
+{
+#if SYSLOG_NG_HAVE_LZ4
+  return LZ4_decompress_safe(src, dst, src_len, dst_capacity);
+#else
+  return -1;
+#endif
+}
+
+static inline gboolean
+_is_sync_requested(QDisk *self)
+{
+  return self->options->reliable && self->options->fsync;
+}
+
+/* the records of segmented files are not in the main file that holds the
+ * header, they are synced before the header is updated to point past them */
+static void
+_sync_segment(QDisk *self, gint64 head)
+{
+  gint fd;
+
+  if (!_is_segmented(self) || !_is_sync_requested(self))
+    return;
+
+  fd = _get_segment_fd(self, _segment_of(head));
+  if (fd >= 0 && fdatasync(fd) < 0)
     {
-      msg_error("Error writing empty message into the disk-queue file");
+      msg_error("Error syncing disk-queue segment",
+                evt_tag_str("filename", self->filename),
+                evt_tag_int("segment", _segment_of(head)),
+                evt_tag_error("error"));
+    }
+}
+
+/* compresses the write buffer into a single block and writes it at the write head */
+static gboolean
+_write_block(QDisk *self)
+{
+  gint bound = _compress_bound(self->write_buffer->len);
+  QDiskBlockHeader *header;
+  gint compressed_len;
+  gint64 block_len;
+  gint records;
+
+  g_string_set_size(self->block_buffer, sizeof(QDiskBlockHeader) + bound);
+  compressed_len = _compress(self->write_buffer->str, self->block_buffer->str + sizeof(QDiskBlockHeader),
+                             self->write_buffer->len, bound);
+  if (compressed_len <= 0)
+    {
+      errno = EINVAL;
       return FALSE;
     }
 
-  if (!pwrite_strict(self->fd, (gchar *) &n, sizeof(n), self->hdr->write_head) ||
-      !pwrite_strict(self->fd, record->str, record->len, self->hdr->write_head + sizeof(n)))
+  block_len = sizeof(QDiskBlockHeader) + compressed_len;
+  header = (QDiskBlockHeader *) self->block_buffer->str;
+  header->len = GUINT32_TO_BE(QDISK_BLOCK_FLAG | (block_len - sizeof(header->len)));
+  header->uncompressed_len = GUINT32_TO_BE(self->write_buffer->len);
+  header->records = GUINT32_TO_BE(self->write_buffer_records);
+
+  if (!_pwrite_data(self, self->block_buffer->str, block_len, self->write_head))
+    return FALSE;
+  _sync_segment(self, self->write_head);
+
+  /* drop the stale copy of an overwritten block */
+  if (self->read_block_head == self->write_head)
+    self->read_block_head = -1;
+
+  records = self->write_buffer_records;
+  g_string_truncate(self->write_buffer, 0);
+  self->write_buffer_records = 0;
+  if (!_advance_write_head(self, block_len))
+    return FALSE;
+
+  self->hdr->length += records;
+  return TRUE;
+}
+
+/*
+ * Writes the buffered records to the file with a single pwrite(), as one
+ * compressed block if the file is compressed, and, if requested, syncs
+ * them and the header.  The write head and the length in the header are only updated
+ * once the records are written.  Returns FALSE if the records could not be
+ * written, in which case they are dropped.
+ */
+gboolean
+qdisk_flush(QDisk *self)
+{
+  if (self->write_buffer_records == 0)
+    return TRUE;
+
+  if (self->hdr->compression)
+    {
+      if (!_write_block(self))
+        {
+          _drop_write_buffer(self);
+          return FALSE;
+        }
+    }
+  else
+    {
+      if (!_pwrite_data(self, self->write_buffer->str, self->write_buffer->len, self->write_buffer_head))
+        {
+          _drop_write_buffer(self);
+          return FALSE;
+        }
+      _sync_segment(self, self->write_buffer_head);
+      self->hdr->write_head = self->write_head;
+      self->hdr->length += self->write_buffer_records;
+    }
+
+  /* the header is mapped from the main file, along with the records unless segmented */
+  if (_is_sync_requested(self) && fdatasync(self->fd) < 0)
     {
-      msg_error("Error writing disk-queue file",
+      msg_error("Error syncing disk-queue file",
+                evt_tag_str("filename", self->filename),
                 evt_tag_error("error"));
-      return FALSE;
     }
 
-  self->hdr->write_head = self->hdr->write_head + record->len + sizeof(n);
+  g_string_truncate(self->write_buffer, 0);
+  self->write_buffer_records = 0;
+  return TRUE;
+}
+
+gint
+qdisk_get_buffered_records(QDisk *self)
+{
+  return self->write_buffer_records;
+}
+
+/* returns the number of records dropped by failed flushes since the last
+ * call, @from and @to are set to the range of positions they occupied */
+gint
+qdisk_take_dropped_records(QDisk *self, gint64 *from, gint64 *to)
+{
+  gint dropped = self->dropped_records;
+
+  *from = self->dropped_from;
+  *to = self->dropped_to;
+  self->dropped_records = 0;
+  self->dropped_from = 0;
+  self->dropped_to = 0;
+  return dropped;
+}
+
+static gboolean
+_move_write_head(QDisk *self, gint64 len)
+{
+  self->write_head = self->write_head + len;
+
+  if (_is_segmented(self))
+    {
+      if (_segment_offset(self->write_head) < self->hdr->segment_size)
+        return TRUE;
 
+      /* the write buffer can only hold a contiguous area */
+      if (!qdisk_flush(self))
+        return FALSE;
+      _start_next_segment(self);
+      return TRUE;
+    }
 
   /* NOTE: we only wrap around if the read head is before the write,
    * otherwise we'd truncate the data the read head is still processing, e.g.
@@ -283,17 +837,17 @@ qdisk_push_tail(QDisk *self, GString *record)
    * */
 
   /* NOTE: if these were equal, that'd mean the queue is empty, so we spoiled something */
-  g_assert(self->hdr->write_head != self->hdr->backlog_head);
+  g_assert(self->write_head != self->hdr->backlog_head);
 
-  if (self->hdr->write_head > MAX(self->hdr->backlog_head,self->hdr->read_head))
+  if (self->write_head > MAX(self->hdr->backlog_head,self->hdr->read_head))
     {
-      if (self->file_size > self->hdr->write_head)
+      if (self->file_size > self->write_head)
         {
-          _truncate_file(self, self->hdr->write_head);
+          _truncate_file(self, self->write_head);
         }
-      self->file_size = self->hdr->write_head;
+      self->file_size = self->write_head;
 
-      if (self->hdr->write_head > self->options->disk_buf_size && self->hdr->backlog_head  != QDISK_RESERVED_SPACE)
+      if (self->write_head > self->options->disk_buf_size && self->hdr->backlog_head  != QDISK_RESERVED_SPACE)
         {
           /* we were appending to the file, we are over the limit, and space
            * is available before the read head. truncate and wrap.
@@ -301,101 +855,351 @@ qdisk_push_tail(QDisk *self, GString *record)
            * Otherwise we let the write_head over size limits for a bit and
            * for the next message, the condition at the beginning of this
            * function will cause the push to fail */
-          self->hdr->write_head = QDISK_RESERVED_SPACE;
+
+          /* the write buffer can only hold a contiguous area */
+          if (!qdisk_flush(self))
+            return FALSE;
+          self->write_head = QDISK_RESERVED_SPACE;
         }
     }
-  self->hdr->length++;
+
   return TRUE;
 }
 
+/* moves the write head past @len bytes of freshly written (or buffered) data */
+static gboolean
+_advance_write_head(QDisk *self, gint64 len)
+{
+  gboolean result = _move_write_head(self, len);
+
+  /* buffered records are only made visible in the header by qdisk_flush() */
+  if (self->write_buffer_records == 0)
+    self->hdr->write_head = self->write_head;
+  return result;
+}
+
+/* @iov holds a single record of @len bytes, e.g. one serialized into an
+ * iovec archive, it is copied to the write buffer right away */
+gboolean
+qdisk_push_tail_iov(QDisk *self, const struct iovec *iov, gint iovcnt, gsize len)
+{
+  guint32 n = GUINT32_TO_BE(len);
+  gboolean written = TRUE;
+  gint i;
+
+  /* write follows read (e.g. we are appending to the file) OR
+   * there's enough space between write and read.
+   *
+   * If write follows read we need to check two things:
+   *   - either we are below the maximum limit (GINT64_FROM_BE(self->hdr->write_head) < self->options->disk_buf_size)
+   *   - or we can wrap around (GINT64_FROM_BE(self->hdr->read_head) != QDISK_RESERVED_SPACE)
+   * If neither of the above is true, the buffer is full.
+   */
+  if (!qdisk_is_space_avail(self, len))
+    return FALSE;
+
+  if (n == 0)
+    {
+      msg_error("Error writing empty message into the disk-queue file");
+      return FALSE;
+    }
+
+  /* records are staged in the write buffer and written together, see
+   * qdisk_flush(), the header only follows once they are on disk */
+  if (self->write_buffer_records == 0)
+    self->write_buffer_head = self->write_head;
+  g_string_append_len(self->write_buffer, (gchar *) &n, sizeof(n));
+  for (i = 0; i < iovcnt; i++)
+    g_string_append_len(self->write_buffer, iov[i].iov_base, iov[i].iov_len);
+  self->write_buffer_records++;
+
+  /* compressed files move the heads once the block is written */
+  if (!self->hdr->compression)
+    written = _advance_write_head(self, len + sizeof(n));
+
+  if (written && (self->write_buffer->len >= (gsize) self->options->write_buf_size ||
+                  self->write_buffer_records == QDISK_MAX_BLOCK_RECORDS))
+    written = qdisk_flush(self);
+
+  /* the write buffer was dropped along with this record, which is
+   * reported by the return value instead */
+  if (!written)
+    self->dropped_records--;
+  return written;
+}
+
+gboolean
+qdisk_push_tail(QDisk *self, GString *record)
+{
+  struct iovec iov = { record->str, record->len };
+
+  return qdisk_push_tail_iov(self, &iov, 1, record->len);
+}
+
 static inline gboolean
 _is_record_length_reached_hard_limit(guint32 record_length)
 {
   return record_length > MAX_RECORD_LENGTH;
 }
 
-gboolean
-qdisk_pop_head(QDisk *self, GString *record)
+static void
+_reset_read_block(QDisk *self)
 {
-  if (self->hdr->read_head != self->hdr->write_head)
+  self->read_block_head = -1;
+  self->read_block_records = 0;
+  self->read_block_index = 0;
+  self->read_block_offset = 0;
+}
+
+/* the queue is empty, start over at the beginning of the file or of the current segment */
+static void
+_reset_heads(QDisk *self)
+{
+  gint64 head = QDISK_RESERVED_SPACE;
+
+  if (_is_segmented(self))
+    {
+      head = _segment_head(_segment_of(self->write_head), 0);
+      _create_segment(self, _segment_of(head));
+    }
+  else
     {
-      guint32 n;
-      gssize res;
-      res = pread(self->fd, (gchar *) &n, sizeof(n), self->hdr->read_head);
+      _truncate_file(self, QDISK_RESERVED_SPACE);
+    }
 
-      if (res == 0)
-        {
-          /* hmm, we are either at EOF or at hdr->qout_ofs, we need to wrap */
-          self->hdr->read_head = QDISK_RESERVED_SPACE;
-          res = pread(self->fd, (gchar *) &n, sizeof(n), self->hdr->read_head);
-        }
-      if (res != sizeof(n))
-        {
-          msg_error("Error reading disk-queue file",
-                    evt_tag_str("error", res < 0 ? g_strerror(errno) : "short read"),
-                    evt_tag_str("filename", self->filename));
-          return FALSE;
-        }
+  self->hdr->read_head = head;
+  self->write_head = head;
+  self->hdr->write_head = head;
+  self->hdr->read_index = 0;
+  _move_backlog_head(self, head, 0);
+  _reset_read_block(self);
+}
 
-      n = GUINT32_FROM_BE(n);
-      if (_is_record_length_reached_hard_limit(n))
-        {
-          msg_warning("Disk-queue file contains possibly invalid record-length",
-                      evt_tag_int("rec_length", n),
-                      evt_tag_str("filename", self->filename));
-          return FALSE;
-        }
-      else if (n == 0)
-        {
-          msg_error("Disk-queue file contains empty record",
-                    evt_tag_int("rec_length", n),
-                    evt_tag_str("filename", self->filename));
-          return FALSE;
-        }
+static gboolean
+_pop_record(QDisk *self, GString *record)
+{
+  guint32 n;
+  gssize res;
+  res = _pread_data(self, (gchar *) &n, sizeof(n), self->hdr->read_head);
 
-      g_string_set_size(record, n);
-      res = pread(self->fd, record->str, n, self->hdr->read_head + sizeof(n));
-      if (res != n)
-        {
-          msg_error("Error reading disk-queue file",
-                    evt_tag_str("filename", self->filename),
-                    evt_tag_str("error", res < 0 ? g_strerror(errno) : "short read"),
-                    evt_tag_int("read_length", n));
-          return FALSE;
-        }
+  if (res == 0 && !_is_segmented(self))
+    {
+      /* hmm, we are either at EOF or at hdr->qout_ofs, we need to wrap */
+      self->hdr->read_head = QDISK_RESERVED_SPACE;
+      res = _pread_data(self, (gchar *) &n, sizeof(n), self->hdr->read_head);
+    }
+  if (res != sizeof(n))
+    {
+      msg_error("Error reading disk-queue file",
+                evt_tag_str("error", res < 0 ? g_strerror(errno) : "short read"),
+                evt_tag_str("filename", self->filename));
+      return FALSE;
+    }
 
-      self->hdr->read_head = self->hdr->read_head + record->len + sizeof(n);
+  n = GUINT32_FROM_BE(n);
+  if (_is_record_length_reached_hard_limit(n))
+    {
+      msg_warning("Disk-queue file contains possibly invalid record-length",
+                  evt_tag_int("rec_length", n),
+                  evt_tag_str("filename", self->filename));
+      return FALSE;
+    }
+  else if (n == 0)
+    {
+      msg_error("Disk-queue file contains empty record",
+                evt_tag_int("rec_length", n),
+                evt_tag_str("filename", self->filename));
+      return FALSE;
+    }
 
-      if (self->hdr->read_head > self->hdr->write_head)
-        {
-          self->hdr->read_head = _correct_position_if_eof(self, &self->hdr->read_head);
-        }
+  g_string_set_size(record, n);
+  res = _pread_data(self, record->str, n, self->hdr->read_head + sizeof(n));
+  if (res != n)
+    {
+      msg_error("Error reading disk-queue file",
+                evt_tag_str("filename", self->filename),
+                evt_tag_str("error", res < 0 ? g_strerror(errno) : "short read"),
+                evt_tag_int("read_length", n));
+      return FALSE;
+    }
 
-      self->hdr->length--;
-      if (!self->options->reliable)
-        {
-          self->hdr->backlog_head = self->hdr->read_head;
-        }
+  self->hdr->read_head = _get_next_head(self, self->hdr->read_head + record->len + sizeof(n));
+  return TRUE;
+}
 
-      if (self->hdr->length == 0 && !self->options->reliable)
-        {
-          msg_debug("Queue file became empty, truncating file",
-                    evt_tag_str("filename", self->filename));
-          self->hdr->read_head = QDISK_RESERVED_SPACE;
-          self->hdr->write_head = QDISK_RESERVED_SPACE;
-          if (!self->options->reliable)
-            {
-              self->hdr->backlog_head = self->hdr->read_head;
-            }
-          self->hdr->length = 0;
-          _truncate_file(self, self->hdr->write_head);
-        }
-      return TRUE;
+/* loads and decompresses the block at @offset, unless it is already cached */
+static gboolean
+_read_block(QDisk *self, gint64 offset)
+{
+  QDiskBlockHeader header;
+  guint32 block_len, uncompressed_len;
+  gssize res;
 
+  if (self->read_block_head == offset)
+    return TRUE;
+
+  _reset_read_block(self);
+  res = _pread_data(self, (gchar *) &header, sizeof(header), offset);
+  if (res != sizeof(header))
+    {
+      msg_error("Error reading disk-queue file",
+                evt_tag_str("error", res < 0 ? g_strerror(errno) : "short read"),
+                evt_tag_str("filename", self->filename));
+      return FALSE;
     }
+
+  block_len = GUINT32_FROM_BE(header.len);
+  uncompressed_len = GUINT32_FROM_BE(header.uncompressed_len);
+  if (!(block_len & QDISK_BLOCK_FLAG) ||
+      (block_len & ~QDISK_BLOCK_FLAG) <= sizeof(header) - sizeof(header.len) ||
+      (block_len & ~QDISK_BLOCK_FLAG) > MAX_BLOCK_LENGTH ||
+      uncompressed_len > MAX_BLOCK_LENGTH)
+    {
+      msg_warning("Disk-queue file contains possibly invalid block",
+                  evt_tag_long("offset", offset),
+                  evt_tag_int("block_length", block_len),
+                  evt_tag_int("uncompressed_length", uncompressed_len),
+                  evt_tag_str("filename", self->filename));
+      return FALSE;
+    }
+  block_len = (block_len & ~QDISK_BLOCK_FLAG) - (sizeof(header) - sizeof(header.len));
+
+  g_string_set_size(self->block_buffer, block_len);
+  res = _pread_data(self, self->block_buffer->str, block_len, offset + sizeof(header));
+  if (res != block_len)
+    {
+      msg_error("Error reading disk-queue file",
+                evt_tag_str("filename", self->filename),
+                evt_tag_str("error", res < 0 ? g_strerror(errno) : "short read"),
+                evt_tag_int("read_length", block_len));
+      return FALSE;
+    }
+
+  g_string_set_size(self->read_block, uncompressed_len);
+  if (_decompress(self->block_buffer->str, self->read_block->str, block_len, uncompressed_len) != uncompressed_len)
+    {
+      msg_error("Error decompressing disk-queue block",
+                evt_tag_long("offset", offset),
+                evt_tag_str("filename", self->filename));
+      return FALSE;
+    }
+
+  self->read_block_head = offset;
+  self->read_block_length = GUINT32_FROM_BE(header.len);
+  self->read_block_records = GUINT32_FROM_BE(header.records);
+  return TRUE;
+}
+
+/* copies record @index of the cached block, walking forward from the last one returned */
+static gboolean
+_get_block_record(QDisk *self, guint32 index, GString *record)
+{
+  guint32 n;
+
+  if (index < self->read_block_index)
+    {
+      self->read_block_index = 0;
+      self->read_block_offset = 0;
+    }
+
+  while (TRUE)
+    {
+      if (self->read_block_index >= self->read_block_records ||
+          self->read_block_offset + sizeof(n) > self->read_block->len)
+        goto invalid;
+
+      memcpy(&n, self->read_block->str + self->read_block_offset, sizeof(n));
+      n = GUINT32_FROM_BE(n);
+      if (n == 0 || self->read_block_offset + sizeof(n) + n > self->read_block->len)
+        goto invalid;
+
+      self->read_block_offset += sizeof(n);
+      if (self->read_block_index == index)
+        break;
+      self->read_block_offset += n;
+      self->read_block_index++;
+    }
+
+  g_string_truncate(record, 0);
+  g_string_append_len(record, self->read_block->str + self->read_block_offset, n);
+  self->read_block_offset += n;
+  self->read_block_index++;
+  return TRUE;
+
+invalid:
+  msg_error("Disk-queue file contains invalid block",
+            evt_tag_long("offset", self->read_block_head),
+            evt_tag_int("index", index),
+            evt_tag_str("filename", self->filename));
+  _reset_read_block(self);
   return FALSE;
 }
 
+/* @block_len is the length field of the block header */
+static gint64
+_get_next_block(QDisk *self, gint64 offset, guint32 block_len)
+{
+  return _get_next_head(self, offset + (block_len & ~QDISK_BLOCK_FLAG) + sizeof(guint32));
+}
+
+static gboolean
+_pop_block_record(QDisk *self, GString *record)
+{
+  if (!_is_segmented(self) &&
+      _is_position_eof(self, self->hdr->read_head) && self->hdr->read_head > self->write_head)
+    {
+      /* the writer has wrapped around since this block was reached */
+      self->hdr->read_head = QDISK_RESERVED_SPACE;
+      self->hdr->read_index = 0;
+    }
+
+  if (!_read_block(self, self->hdr->read_head) ||
+      !_get_block_record(self, self->hdr->read_index, record))
+    return FALSE;
+
+  self->hdr->read_index++;
+  if (self->hdr->read_index >= self->read_block_records)
+    {
+      self->hdr->read_head = _get_next_block(self, self->hdr->read_head, self->read_block_length);
+      self->hdr->read_index = 0;
+    }
+  return TRUE;
+}
+
+gboolean
+qdisk_pop_head(QDisk *self, GString *record)
+{
+  gint32 read_segment;
+
+  qdisk_flush(self);
+  if (self->hdr->read_head == self->write_head)
+    return FALSE;
+
+  read_segment = _segment_of(self->hdr->read_head);
+  if (self->hdr->compression)
+    {
+      if (!_pop_block_record(self, record))
+        return FALSE;
+    }
+  else if (!_pop_record(self, record))
+    return FALSE;
+
+  if (_is_segmented(self) && read_segment != _segment_of(self->hdr->read_head))
+    _prefetch_next_segment(self);
+
+  self->hdr->length--;
+  if (!self->options->reliable)
+    _move_backlog_head(self, self->hdr->read_head, self->hdr->read_index);
+
+  if (self->hdr->length == 0 && !self->options->reliable)
+    {
+      msg_debug("Queue file became empty, truncating file",
+                evt_tag_str("filename", self->filename));
+      _reset_heads(self);
+    }
+  return TRUE;
+}
+
 static gboolean
 _load_queue(QDisk *self, GQueue *q, gint64 q_ofs, gint32 q_len, gint32 q_count)
 {
@@ -445,6 +1249,13 @@ _load_queue(QDisk *self, GQueue *q, gint64 q_ofs, gint32 q_len, gint32 q_count)
   return TRUE;
 }
 
+/* the in-memory queues are saved to the end of the main file, after the records unless segmented */
+static inline gboolean
+_is_queue_overlapping_records(QDisk *self, gint64 q_ofs)
+{
+  return !_is_segmented(self) && q_ofs > 0 && q_ofs < self->hdr->write_head;
+}
+
 static gboolean
 _load_state(QDisk *self, GQueue *qout, GQueue *qbacklog, GQueue *qoverflow)
 {
@@ -473,8 +1284,9 @@ _load_state(QDisk *self, GQueue *qout, GQueue *qbacklog, GQueue *qoverflow)
   qoverflow_len = self->hdr->qoverflow_len;
   qoverflow_ofs = self->hdr->qoverflow_ofs;
 
-  if ((self->hdr->read_head < QDISK_RESERVED_SPACE) ||
-      (self->hdr->write_head < QDISK_RESERVED_SPACE) ||
+  if ((!_is_segmented(self) && self->hdr->read_head < QDISK_RESERVED_SPACE) ||
+      (!_is_segmented(self) && self->hdr->write_head < QDISK_RESERVED_SPACE) ||
+      (_is_segmented(self) && self->hdr->segments < 2) ||
       (self->hdr->read_head == self->hdr->write_head && self->hdr->length != 0))
     {
       msg_error("Inconsistent header data in disk-queue file, ignoring",
@@ -487,7 +1299,7 @@ _load_state(QDisk *self, GQueue *qout, GQueue *qbacklog, GQueue *qoverflow)
 
   if (!self->options->reliable)
     {
-      if (!(qout_ofs > 0 && qout_ofs < self->hdr->write_head))
+      if (!_is_queue_overlapping_records(self, qout_ofs))
         {
           if (!_load_queue(self, qout, qout_ofs, qout_len, qout_count))
             return !self->options->read_only;
@@ -500,7 +1312,7 @@ _load_state(QDisk *self, GQueue *qout, GQueue *qbacklog, GQueue *qoverflow)
                     evt_tag_long("qdisk_length",  self->hdr->length));
         }
 
-      if (!(qbacklog_ofs > 0 && qbacklog_ofs < self->hdr->write_head))
+      if (!_is_queue_overlapping_records(self, qbacklog_ofs))
         {
           if(!_load_queue(self, qbacklog, qbacklog_ofs, qbacklog_len, qbacklog_count))
             return !self->options->read_only;
@@ -513,7 +1325,7 @@ _load_state(QDisk *self, GQueue *qout, GQueue *qbacklog, GQueue *qoverflow)
                     evt_tag_long("qdisk_length",  self->hdr->length));
         }
 
-      if (!(qoverflow_ofs > 0 && qoverflow_ofs < self->hdr->write_head))
+      if (!_is_queue_overlapping_records(self, qoverflow_ofs))
         {
           if(!_load_queue(self, qoverflow, qoverflow_ofs, qoverflow_len, qoverflow_count))
             return !self->options->read_only;
@@ -547,7 +1359,9 @@ _load_state(QDisk *self, GQueue *qout, GQueue *qbacklog, GQueue *qoverflow)
                evt_tag_int("qout_length", qout_count),
                evt_tag_int("qbacklog_length", qbacklog_count),
                evt_tag_int("qoverflow_length", qoverflow_count),
-               evt_tag_long("qdisk_length", self->hdr->length));
+               evt_tag_long("qdisk_length", self->hdr->length),
+               evt_tag_int("compression", self->hdr->compression),
+               evt_tag_long("segment_size", self->hdr->segment_size));
     }
   else
     {
@@ -557,7 +1371,9 @@ _load_state(QDisk *self, GQueue *qout, GQueue *qbacklog, GQueue *qoverflow)
       msg_info("Reliable disk-buffer state loaded",
                evt_tag_str("filename", self->filename),
                evt_tag_long("queue_length", self->hdr->length),
-               evt_tag_long("size", self->hdr->write_head - self->hdr->read_head));
+               evt_tag_long("size", self->hdr->write_head - self->hdr->read_head),
+               evt_tag_int("compression", self->hdr->compression),
+               evt_tag_long("segment_size", self->hdr->segment_size));
 
       msg_debug("Reliable disk-buffer internal state",
                 evt_tag_str("filename", self->filename),
@@ -665,6 +1481,9 @@ qdisk_save_state(QDisk *self, GQueue *qout, GQueue *qbacklog, GQueue *qoverflow)
   gint32 qoverflow_len = 0;
   gint32 qoverflow_count = 0;
 
+  /* the in-memory queues are appended to the end of the file */
+  qdisk_flush(self);
+
   if (!self->options->reliable)
     {
       qout_count = qout->length / 2;
@@ -706,6 +1525,27 @@ qdisk_save_state(QDisk *self, GQueue *qout, GQueue *qbacklog, GQueue *qoverflow)
   return TRUE;
 }
 
+/* the segment size is raised if the buffer would need too many segments */
+static void
+_init_segments(QDisk *self)
+{
+  gint64 segment_size = self->options->segment_size;
+  gint64 segments;
+
+  if (segment_size <= 0)
+    return;
+
+  segments = self->options->disk_buf_size / segment_size;
+  if (segments > QDISK_MAX_SEGMENTS)
+    {
+      segments = QDISK_MAX_SEGMENTS;
+      segment_size = (self->options->disk_buf_size + segments - 1) / segments;
+    }
+
+  self->hdr->segment_size = segment_size;
+  self->hdr->segments = MAX(segments, 2);
+}
+
 static void
 _reset_backlog(QDisk *self)
 {
@@ -806,17 +1646,23 @@ qdisk_start(QDisk *self, const gchar *filename, GQueue *qout, GQueue *qbacklog,
           self->fd = -1;
           return FALSE;
         }
-      self->hdr->version = 1;
+      self->hdr->version = self->options->segment_size > 0 ? QDISK_VERSION_SEGMENTS :
+                           self->options->compression ? QDISK_VERSION_COMPRESSION : 1;
       self->hdr->big_endian = (G_BYTE_ORDER == G_BIG_ENDIAN);
+      self->hdr->compression = self->options->compression;
+      _init_segments(self);
 
-      self->hdr->read_head = QDISK_RESERVED_SPACE;
-      self->hdr->write_head = QDISK_RESERVED_SPACE;
+      self->hdr->read_head = _is_segmented(self) ? _segment_head(0, 0) : QDISK_RESERVED_SPACE;
+      self->hdr->write_head = self->hdr->read_head;
+      self->write_head = self->hdr->write_head;
       self->hdr->backlog_head = self->hdr->read_head;
       self->hdr->length = 0;
       self->file_size = self->hdr->write_head;
 
-      if (!qdisk_save_state(self, qout, qbacklog, qoverflow))
+      if (!qdisk_save_state(self, qout, qbacklog, qoverflow) ||
+          (_is_segmented(self) && !_create_segment(self, 0)))
         {
+          _close_segments(self);
           munmap((void *)self->hdr, sizeof(QDiskFileHeader));
           self->hdr = NULL;
           close(self->fd);
@@ -860,10 +1706,37 @@ qdisk_start(QDisk *self, const gchar *filename, GQueue *qout, GQueue *qbacklog,
           self->hdr->qoverflow_count = GUINT32_SWAP_LE_BE(self->hdr->qoverflow_count);
           self->hdr->backlog_head = GUINT64_SWAP_LE_BE(self->hdr->backlog_head);
           self->hdr->backlog_len = GUINT64_SWAP_LE_BE(self->hdr->backlog_len);
+          self->hdr->read_index = GUINT32_SWAP_LE_BE(self->hdr->read_index);
+          self->hdr->backlog_index = GUINT32_SWAP_LE_BE(self->hdr->backlog_index);
+          self->hdr->segment_size = GUINT64_SWAP_LE_BE(self->hdr->segment_size);
+          self->hdr->segments = GUINT32_SWAP_LE_BE(self->hdr->segments);
           self->hdr->big_endian = (G_BYTE_ORDER == G_BIG_ENDIAN);
         }
+      if (self->hdr->version < QDISK_VERSION_COMPRESSION)
+        {
+          self->hdr->compression = FALSE;
+          self->hdr->read_index = 0;
+          self->hdr->backlog_index = 0;
+        }
+      if (self->hdr->version < QDISK_VERSION_SEGMENTS)
+        {
+          self->hdr->segment_size = 0;
+          self->hdr->segments = 0;
+        }
+      if (self->hdr->compression && !SYSLOG_NG_HAVE_LZ4)
+        {
+          msg_error("Disk-queue file is compressed, but syslog-ng was compiled without LZ4 support",
+                    evt_tag_str("filename", self->filename));
+          munmap((void *)self->hdr, sizeof(QDiskFileHeader));
+          self->hdr = NULL;
+          close(self->fd);
+          self->fd = -1;
+          return FALSE;
+        }
+      self->write_head = self->hdr->write_head;
       if (!_load_state(self, qout, qbacklog, qoverflow))
         {
+          _close_segments(self);
           munmap((void *)self->hdr, sizeof(QDiskFileHeader));
           self->hdr = NULL;
           close(self->fd);
@@ -896,6 +1769,11 @@ qdisk_init(QDisk *self, DiskQueueOptions *options)
 void
 qdisk_deinit(QDisk *self)
 {
+  if (self->hdr && !self->options->read_only)
+    qdisk_flush(self);
+  _reset_read_block(self);
+  _close_segments(self);
+
   if (self->filename)
     {
       g_free(self->filename);
@@ -924,11 +1802,13 @@ gssize
 qdisk_read_from_backlog(QDisk *self, gpointer buffer, gsize bytes_to_read)
 {
   gssize res;
-  res = pread(self->fd, buffer, bytes_to_read, self->hdr->backlog_head);
-  if (res == 0)
+
+  qdisk_flush(self);
+  res = _pread_data(self, buffer, bytes_to_read, self->hdr->backlog_head);
+  if (res == 0 && !_is_segmented(self))
     {
       self->hdr->backlog_head = QDISK_RESERVED_SPACE;
-      res = pread(self->fd, buffer, bytes_to_read, self->hdr->backlog_head);
+      res = _pread_data(self, buffer, bytes_to_read, self->hdr->backlog_head);
     }
   if (res != bytes_to_read)
     {
@@ -936,10 +1816,7 @@ qdisk_read_from_backlog(QDisk *self, gpointer buffer, gsize bytes_to_read)
                 evt_tag_str("error", res < 0 ? g_strerror(errno) : "short read"),
                 evt_tag_str("filename", self->filename));
     }
-  if (self->hdr->backlog_head > self->hdr->write_head)
-    {
-      self->hdr->backlog_head = _correct_position_if_eof(self, &self->hdr->backlog_head);
-    }
+  self->hdr->backlog_head = _get_next_head(self, self->hdr->backlog_head);
   return res;
 }
 
@@ -947,7 +1824,9 @@ gssize
 qdisk_read(QDisk *self, gpointer buffer, gsize bytes_to_read, gint64 position)
 {
   gssize res;
-  res = pread(self->fd, buffer, bytes_to_read, position);
+
+  qdisk_flush(self);
+  res = _pread_data(self, buffer, bytes_to_read, position);
   if (res <= 0)
     {
       msg_error("Error reading disk-queue file",
@@ -957,19 +1836,40 @@ qdisk_read(QDisk *self, gpointer buffer, gsize bytes_to_read, gint64 position)
   return res;
 }
 
+static guint64
+_skip_block_record(QDisk *self, guint64 position)
+{
+  gint64 offset = _position_offset(self, position);
+  guint32 index = _position_index(self, position);
+  QDiskBlockHeader header;
+
+  if (offset == self->read_block_head)
+    {
+      header.len = GUINT32_TO_BE(self->read_block_length);
+      header.records = GUINT32_TO_BE(self->read_block_records);
+    }
+  else
+    {
+      qdisk_read(self, (gchar *) &header, sizeof(header), offset);
+    }
+
+  if (index + 1 < GUINT32_FROM_BE(header.records))
+    return _position(self, offset, index + 1);
+  return _position(self, _get_next_block(self, offset, GUINT32_FROM_BE(header.len)), 0);
+}
+
 guint64
 qdisk_skip_record(QDisk *self, guint64 position)
 {
   guint64 new_position = position;
   guint32 s;
+
+  if (self->hdr->compression)
+    return _skip_block_record(self, position);
+
   qdisk_read (self, (gchar *) &s, sizeof(s), position);
   s = GUINT32_FROM_BE(s);
-  new_position += s + sizeof(s);
-  if (new_position > self->hdr->write_head)
-    {
-      new_position = _correct_position_if_eof(self, (gint64 *)&new_position);
-    }
-  return new_position;
+  return _get_next_head(self, new_position + s + sizeof(s));
 }
 
 void
@@ -981,13 +1881,8 @@ qdisk_set_backlog_count(QDisk *self, gint64 new_value)
 void
 qdisk_reset_file_if_possible(QDisk *self)
 {
-  if (self->hdr->length == 0 && self->hdr->backlog_len == 0)
-    {
-      self->hdr->read_head = QDISK_RESERVED_SPACE;
-      self->hdr->write_head = QDISK_RESERVED_SPACE;
-      self->hdr->backlog_head = QDISK_RESERVED_SPACE;
-      _truncate_file (self, QDISK_RESERVED_SPACE);
-    }
+  if (qdisk_get_length(self) == 0 && self->hdr->backlog_len == 0)
+    _reset_heads(self);
 }
 
 DiskQueueOptions *
@@ -996,16 +1891,17 @@ qdisk_get_options(QDisk *self)
   return self->options;
 }
 
+/* the header only counts the records already written */
 gint64
 qdisk_get_length(QDisk *self)
 {
-  return self->hdr->length;
+  return self->hdr->length + self->write_buffer_records;
 }
 
 void
 qdisk_set_length(QDisk *self, gint64 new_value)
 {
-  self->hdr->length = new_value;
+  self->hdr->length = new_value - self->write_buffer_records;
 }
 
 gint64
@@ -1020,34 +1916,36 @@ qdisk_get_filename(QDisk *self)
   return self->filename;
 }
 
+/* the position of the next record pushed */
 gint64
 qdisk_get_writer_head(QDisk *self)
 {
-  return self->hdr->write_head;
+  return _position(self, self->write_head, self->write_buffer_records);
 }
 
 gint64
 qdisk_get_reader_head(QDisk *self)
 {
-  return self->hdr->read_head;
+  return _position(self, self->hdr->read_head, self->hdr->read_index);
 }
 
 void
 qdisk_set_reader_head(QDisk *self, gint64 new_value)
 {
-  self->hdr->read_head = new_value;
+  self->hdr->read_head = _position_offset(self, new_value);
+  self->hdr->read_index = _position_index(self, new_value);
 }
 
 gint64
 qdisk_get_backlog_head(QDisk *self)
 {
-  return self->hdr->backlog_head;
+  return _position(self, self->hdr->backlog_head, self->hdr->backlog_index);
 }
 
 void
 qdisk_set_backlog_head(QDisk *self, gint64 new_value)
 {
-  self->hdr->backlog_head = new_value;
+  _move_backlog_head(self, _position_offset(self, new_value), _position_index(self, new_value));
 }
 
 void
@@ -1083,6 +1981,9 @@ qdisk_is_read_only(QDisk *self)
 void
 qdisk_free(QDisk *self)
 {
+  g_string_free(self->write_buffer, TRUE);
+  g_string_free(self->read_block, TRUE);
+  g_string_free(self->block_buffer, TRUE);
   g_free(self);
 }
 
@@ -1090,5 +1991,13 @@ QDisk *
 qdisk_new(void)
 {
   QDisk *self = g_new0(QDisk, 1);
+  gint i;
+
+  self->write_buffer = g_string_sized_new(4096);
+  self->read_block = g_string_sized_new(0);
+  self->block_buffer = g_string_sized_new(0);
+  self->read_block_head = -1;
+  for (i = 0; i < QDISK_SEGMENT_FDS; i++)
+    self->segment_fds[i].fd = -1;
   return self;
 }
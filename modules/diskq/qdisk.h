@@ -26,16 +26,29 @@
 
 #include "syslog-ng.h"
 #include "diskq-options.h"
+#include "logpipe.h"
+
+#include <sys/uio.h>
 
 #define LOG_PATH_OPTIONS_FOR_BACKLOG GINT_TO_POINTER(0x80000000)
 #define QDISK_RESERVED_SPACE 4096
-#define LOG_PATH_OPTIONS_TO_POINTER(lpo) GUINT_TO_POINTER(0x80000000 | (lpo)->ack_needed)
+#define LOG_PATH_OPTIONS_TO_POINTER(lpo) \
+  GUINT_TO_POINTER(0x80000000 | ((lpo)->ack_needed ? 0x1 : 0) | ((lpo)->flow_control_requested ? 0x2 : 0))
+
+static inline void
+log_path_options_from_pointer(gpointer ptr, LogPathOptions *lpo)
+{
+  guint bits = GPOINTER_TO_UINT(ptr);
+
+  lpo->ack_needed = (bits & 0x1) != 0;
+  lpo->flow_control_requested = (bits & 0x2) != 0;
+}
 
 /* NOTE: this must not evaluate ptr multiple times, otherwise the code that
  * uses this breaks, as it passes the result of a g_queue_pop_head call,
  * which has side effects.
  */
-#define POINTER_TO_LOG_PATH_OPTIONS(ptr, lpo) (lpo)->ack_needed = (GPOINTER_TO_INT(ptr) & ~0x80000000)
+#define POINTER_TO_LOG_PATH_OPTIONS(ptr, lpo) log_path_options_from_pointer(ptr, lpo)
 
 typedef struct _QDisk QDisk;
 
@@ -44,7 +57,11 @@ QDisk *qdisk_new(void);
 gboolean qdisk_is_space_avail(QDisk *self, gint at_least);
 gint64 qdisk_get_empty_space(QDisk *self);
 gboolean qdisk_push_tail(QDisk *self, GString *record);
+gboolean qdisk_push_tail_iov(QDisk *self, const struct iovec *iov, gint iovcnt, gsize len);
 gboolean qdisk_pop_head(QDisk *self, GString *record);
+gboolean qdisk_flush(QDisk *self);
+gint qdisk_get_buffered_records(QDisk *self);
+gint qdisk_take_dropped_records(QDisk *self, gint64 *from, gint64 *to);
 gboolean qdisk_start(QDisk *self, const gchar *filename, GQueue *qout, GQueue *qbacklog, GQueue *qoverflow);
 void qdisk_init(QDisk *self, DiskQueueOptions *options);
 void qdisk_deinit(QDisk *self);
@@ -43,6 +43,8 @@
 #include <iv.h>
 #include <iv_thread.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #define OVERFLOW_SIZE 10000
 #ifdef PATH_QDISK
@@ -537,6 +539,392 @@ testcase_diskq_statistics(diskq_tester_parameters_t parameters)
   disk_queue_options_destroy(&options);
 }
 
+static void
+testcase_batch_pop(LogQueue *(*constructor)(DiskQueueOptions *options, const gchar *persist_name),
+                   gboolean reliable)
+{
+  LogQueue *q;
+  LogMessage *msgs[10];
+  LogPathOptions path_options[10];
+  gint i;
+  GString *filename;
+  DiskQueueOptions options = {0};
+
+  _construct_options(&options, 10000000, 100000, reliable);
+
+  q = constructor(&options, NULL);
+  log_queue_set_use_backlog(q, TRUE);
+
+  filename = g_string_sized_new(32);
+  g_string_sprintf(filename,"test-batch_pop.qf");
+  unlink(filename->str);
+  log_queue_disk_load_queue(q,filename->str);
+  fed_messages = 0;
+  acked_messages = 0;
+  feed_some_messages(q, 10, &parse_options);
+
+  assert_gint(log_queue_pop_head_batch(q, msgs, path_options, 4), 4, "%s: unexpected batch size", __FUNCTION__);
+  assert_gint(log_queue_pop_head_batch(q, &msgs[4], &path_options[4], 10), 6, "%s: unexpected batch size",
+              __FUNCTION__);
+  assert_gint(log_queue_get_length(q), 0, "%s: queue is not empty", __FUNCTION__);
+
+  for (i = 0; i < 10; i++)
+    {
+      gchar expected[32];
+
+      g_snprintf(expected, sizeof(expected), "ID :%08d", i);
+      assert_true(strstr(log_msg_get_value(msgs[i], LM_V_MESSAGE, NULL), expected) != NULL,
+                  "%s: message %d was popped out of order", __FUNCTION__, i);
+      log_msg_unref(msgs[i]);
+    }
+
+  app_ack_some_messages(q, fed_messages);
+  assert_gint(fed_messages, acked_messages,
+              "%s: did not receive enough acknowledgements: fed_messages=%d, acked_messages=%d\n", __FUNCTION__, fed_messages,
+              acked_messages);
+
+  log_queue_unref(q);
+  unlink(filename->str);
+  g_string_free(filename,TRUE);
+  disk_queue_options_destroy(&options);
+}
+
+static void
+testcase_write_buffer_defers_acks(void)
+{
+  LogQueue *q;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg;
+  GString *filename;
+  DiskQueueOptions options = {0};
+  gint i;
+
+  _construct_options(&options, 10000000, 100000, TRUE);
+  options.write_buf_size = 1024 * 1024;
+
+  log_queue_set_max_threads(1);
+  q = log_queue_disk_reliable_new(&options, NULL);
+  log_queue_set_use_backlog(q, TRUE);
+
+  filename = g_string_sized_new(32);
+  g_string_sprintf(filename,"test-write_buffer.qf");
+  unlink(filename->str);
+  log_queue_disk_load_queue(q,filename->str);
+  fed_messages = 0;
+  acked_messages = 0;
+
+  iv_init();
+  main_loop_worker_thread_start(NULL);
+
+  feed_some_messages(q, 10, &parse_options);
+  assert_gint(acked_messages, 0, "%s: messages were acked before their records were written", __FUNCTION__);
+  assert_gint(log_queue_get_length(q), 10, "%s: buffered messages are not counted", __FUNCTION__);
+
+  main_loop_worker_invoke_batch_callbacks();
+  assert_gint(acked_messages, 10, "%s: the end of the batch did not flush the write buffer", __FUNCTION__);
+
+  feed_some_messages(q, 5, &parse_options);
+  assert_gint(acked_messages, 10, "%s: messages were acked before their records were written", __FUNCTION__);
+
+  for (i = 0; i < 15; i++)
+    {
+      gchar expected[32];
+
+      msg = log_queue_pop_head(q, &path_options);
+      assert_true(msg != NULL, "%s: message %d is missing", __FUNCTION__, i);
+      g_snprintf(expected, sizeof(expected), "ID :%08d", i % 10);
+      assert_true(strstr(log_msg_get_value(msg, LM_V_MESSAGE, NULL), expected) != NULL,
+                  "%s: message %d was popped out of order", __FUNCTION__, i);
+      log_msg_unref(msg);
+    }
+  assert_gint(acked_messages, 15, "%s: popping did not flush the write buffer", __FUNCTION__);
+
+  main_loop_worker_invoke_batch_callbacks();
+  main_loop_worker_thread_stop();
+  iv_deinit();
+
+  app_ack_some_messages(q, 15);
+  log_queue_unref(q);
+  unlink(filename->str);
+  g_string_free(filename,TRUE);
+  disk_queue_options_destroy(&options);
+}
+
+static void
+_pop_messages_in_order(LogQueue *q, gint n)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg;
+  gint i;
+
+  for (i = 0; i < n; i++)
+    {
+      gchar expected[32];
+
+      msg = log_queue_pop_head(q, &path_options);
+      assert_true(msg != NULL, "%s: message %d is missing", __FUNCTION__, i);
+      g_snprintf(expected, sizeof(expected), "ID :%08d", i);
+      assert_true(strstr(log_msg_get_value(msg, LM_V_MESSAGE, NULL), expected) != NULL,
+                  "%s: message %d was popped out of order", __FUNCTION__, i);
+      log_msg_unref(msg);
+    }
+}
+
+#if SYSLOG_NG_HAVE_LZ4
+
+/* returns the size of the file once all the messages are written */
+static gint64
+_feed_and_pop_messages(LogQueue *(*constructor)(DiskQueueOptions *options, const gchar *persist_name),
+                       gboolean reliable, gboolean compression)
+{
+  LogQueue *q;
+  GString *filename;
+  DiskQueueOptions options = {0};
+  struct stat st;
+
+  _construct_options(&options, 10000000, 100000, reliable);
+  options.write_buf_size = 4096;
+  options.compression = compression;
+
+  log_queue_set_max_threads(1);
+  q = constructor(&options, NULL);
+  log_queue_set_use_backlog(q, TRUE);
+
+  filename = g_string_sized_new(32);
+  g_string_sprintf(filename,"test-compression.qf");
+  unlink(filename->str);
+  log_queue_disk_load_queue(q,filename->str);
+  fed_messages = 0;
+  acked_messages = 0;
+
+  iv_init();
+  main_loop_worker_thread_start(NULL);
+
+  feed_some_messages(q, 1000, &parse_options);
+  main_loop_worker_invoke_batch_callbacks();
+  assert_gint(stat(filename->str, &st), 0, "%s: the queue file is missing", __FUNCTION__);
+
+  _pop_messages_in_order(q, 300);
+  log_queue_rewind_backlog_all(q);
+  _pop_messages_in_order(q, 1000);
+  assert_gint(log_queue_get_length(q), 0, "%s: queue is not empty", __FUNCTION__);
+
+  main_loop_worker_invoke_batch_callbacks();
+  main_loop_worker_thread_stop();
+  iv_deinit();
+
+  app_ack_some_messages(q, fed_messages);
+  assert_gint(fed_messages, acked_messages,
+              "%s: did not receive enough acknowledgements: fed_messages=%d, acked_messages=%d\n", __FUNCTION__, fed_messages,
+              acked_messages);
+
+  log_queue_unref(q);
+  unlink(filename->str);
+  g_string_free(filename,TRUE);
+  disk_queue_options_destroy(&options);
+  return st.st_size;
+}
+
+/* checks the fields following the magic of the file header, which
+ * dqtool relies on as well: version, big_endian and compression */
+static void
+_assert_compressed_file_header(const gchar *filename)
+{
+  guint8 fields[3];
+  gint fd = open(filename, O_RDONLY);
+
+  assert_true(fd >= 0, "%s: the queue file is missing", __FUNCTION__);
+  assert_gint(pread(fd, fields, sizeof(fields), 4), sizeof(fields), "%s: the file header is truncated", __FUNCTION__);
+  close(fd);
+
+  assert_gint(fields[0], 2, "%s: compressed files are expected to be version 2", __FUNCTION__);
+  assert_gint(fields[2], 1, "%s: the compression field is not set", __FUNCTION__);
+}
+
+/* the messages written to a compressed file are read back after a restart */
+static void
+_reload_compressed_messages(LogQueue *(*constructor)(DiskQueueOptions *options, const gchar *persist_name),
+                            gboolean reliable)
+{
+  LogQueue *q;
+  GString *filename;
+  DiskQueueOptions options = {0};
+  gboolean persistent;
+
+  _construct_options(&options, 10000000, 100000, reliable);
+  options.write_buf_size = 4096;
+  options.compression = TRUE;
+
+  log_queue_set_max_threads(1);
+  q = constructor(&options, NULL);
+  log_queue_set_use_backlog(q, TRUE);
+
+  filename = g_string_sized_new(32);
+  g_string_sprintf(filename,"test-compression-reload.qf");
+  unlink(filename->str);
+  log_queue_disk_load_queue(q,filename->str);
+  fed_messages = 0;
+  acked_messages = 0;
+
+  iv_init();
+  main_loop_worker_thread_start(NULL);
+  feed_some_messages(q, 1000, &parse_options);
+  main_loop_worker_invoke_batch_callbacks();
+  main_loop_worker_thread_stop();
+  iv_deinit();
+
+  assert_true(log_queue_disk_save_queue(q, &persistent), "%s: saving the queue failed", __FUNCTION__);
+  assert_true(persistent, "%s: the queue is not persistent", __FUNCTION__);
+  log_queue_unref(q);
+  _assert_compressed_file_header(filename->str);
+
+  q = constructor(&options, NULL);
+  log_queue_set_use_backlog(q, TRUE);
+  assert_true(log_queue_disk_load_queue(q,filename->str), "%s: reloading the queue failed", __FUNCTION__);
+  assert_gint64(log_queue_get_length(q), 1000, "%s: messages were lost by the restart", __FUNCTION__);
+
+  _pop_messages_in_order(q, 1000);
+  assert_gint64(log_queue_get_length(q), 0, "%s: queue is not empty", __FUNCTION__);
+  app_ack_some_messages(q, 1000);
+
+  log_queue_unref(q);
+  unlink(filename->str);
+  g_string_free(filename,TRUE);
+  disk_queue_options_destroy(&options);
+}
+
+static void
+testcase_compression(LogQueue *(*constructor)(DiskQueueOptions *options, const gchar *persist_name),
+                     gboolean reliable)
+{
+  gint64 compressed_size = _feed_and_pop_messages(constructor, reliable, TRUE);
+  gint64 plain_size = _feed_and_pop_messages(constructor, reliable, FALSE);
+
+  assert_true(compressed_size < plain_size, "%s: compression did not make the file smaller, compressed=%"
+              G_GINT64_FORMAT ", plain=%" G_GINT64_FORMAT, __FUNCTION__, compressed_size, plain_size);
+
+  _reload_compressed_messages(constructor, reliable);
+}
+
+/* every push is flushed on its own, so the blocks are tiny and their
+ * header takes a good part of them: once the writer wrapped around, a
+ * block must not overwrite the oldest one still in the queue */
+static void
+testcase_compression_wrapped_around(LogQueue *(*constructor)(DiskQueueOptions *options, const gchar *persist_name),
+                                    gboolean reliable)
+{
+  LogQueue *q;
+  GString *filename;
+  DiskQueueOptions options = {0};
+  gint64 length;
+  gint round, i;
+
+  _construct_options(&options, QDISK_RESERVED_SPACE + 16384, 0, reliable);
+  options.compression = TRUE;
+
+  log_queue_set_max_threads(1);
+  q = constructor(&options, NULL);
+  log_queue_set_use_backlog(q, TRUE);
+
+  filename = g_string_sized_new(32);
+  g_string_sprintf(filename,"test-compression-wrap.qf");
+  unlink(filename->str);
+  log_queue_disk_load_queue(q,filename->str);
+  fed_messages = 0;
+  acked_messages = 0;
+
+  for (round = 0; round < 10; round++)
+    {
+      /* more than what fits, the rest is dropped */
+      feed_some_messages(q, 200, &parse_options);
+      length = log_queue_get_length(q);
+      assert_true(length > 1 && length < 200, "%s: the queue was expected to fill up, length=%" G_GINT64_FORMAT,
+                  __FUNCTION__, length);
+
+      send_some_messages(q, length / 2);
+      app_ack_some_messages(q, length / 2);
+      assert_gint64(log_queue_get_length(q), length - length / 2, "%s: the queue got corrupted in round %d",
+                    __FUNCTION__, round);
+    }
+
+  length = log_queue_get_length(q);
+  for (i = 0; i < length; i++)
+    {
+      LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+      LogMessage *msg = log_queue_pop_head(q, &path_options);
+
+      assert_true(msg != NULL, "%s: message %d of %" G_GINT64_FORMAT " is missing", __FUNCTION__, i, length);
+      log_msg_unref(msg);
+    }
+  assert_gint64(log_queue_get_length(q), 0, "%s: queue is not empty", __FUNCTION__);
+  app_ack_some_messages(q, length);
+
+  log_queue_unref(q);
+  unlink(filename->str);
+  g_string_free(filename,TRUE);
+  disk_queue_options_destroy(&options);
+}
+
+#endif
+
+static gboolean
+_segment_exists(const gchar *filename, gint segment)
+{
+  gchar *segment_filename = g_strdup_printf("%s.%05d", filename, segment);
+  gboolean result = g_file_test(segment_filename, G_FILE_TEST_EXISTS);
+
+  g_free(segment_filename);
+  return result;
+}
+
+static void
+testcase_segments(LogQueue *(*constructor)(DiskQueueOptions *options, const gchar *persist_name),
+                  gboolean reliable)
+{
+  LogQueue *q;
+  GString *filename;
+  DiskQueueOptions options = {0};
+  gint i;
+
+  _construct_options(&options, 16 * MIN_SEGMENT_SIZE, 100000, reliable);
+  options.segment_size = MIN_SEGMENT_SIZE;
+
+  q = constructor(&options, NULL);
+  log_queue_set_use_backlog(q, TRUE);
+
+  filename = g_string_sized_new(32);
+  g_string_sprintf(filename,"test-segments.qf");
+  unlink(filename->str);
+  log_queue_disk_load_queue(q,filename->str);
+  fed_messages = 0;
+  acked_messages = 0;
+
+  feed_some_messages(q, 10000, &parse_options);
+  assert_true(_segment_exists(filename->str, 0), "%s: the first segment is missing", __FUNCTION__);
+  assert_true(_segment_exists(filename->str, 1), "%s: the messages did not fill the first segment", __FUNCTION__);
+
+  _pop_messages_in_order(q, 10000);
+  assert_gint(log_queue_get_length(q), 0, "%s: queue is not empty", __FUNCTION__);
+
+  app_ack_some_messages(q, fed_messages);
+  assert_gint(fed_messages, acked_messages,
+              "%s: did not receive enough acknowledgements: fed_messages=%d, acked_messages=%d\n", __FUNCTION__, fed_messages,
+              acked_messages);
+  assert_false(_segment_exists(filename->str, 0), "%s: an acknowledged segment was not removed", __FUNCTION__);
+
+  log_queue_unref(q);
+  unlink(filename->str);
+  for (i = 0; i < 16; i++)
+    {
+      gchar *segment_filename = g_strdup_printf("%s.%05d", filename->str, i);
+
+      unlink(segment_filename);
+      g_free(segment_filename);
+    }
+  g_string_free(filename,TRUE);
+  disk_queue_options_destroy(&options);
+}
+
 int
 main(void)
 {
@@ -593,6 +981,17 @@ main(void)
   testcase_zero_diskbuf_alternating_send_acks();
   testcase_zero_diskbuf_and_normal_acks();
   testcase_diskbuffer_restart_corrupted();
+  testcase_batch_pop(log_queue_disk_reliable_new, TRUE);
+  testcase_batch_pop(log_queue_disk_non_reliable_new, FALSE);
+  testcase_write_buffer_defers_acks();
+#if SYSLOG_NG_HAVE_LZ4
+  testcase_compression(log_queue_disk_reliable_new, TRUE);
+  testcase_compression(log_queue_disk_non_reliable_new, FALSE);
+  testcase_compression_wrapped_around(log_queue_disk_reliable_new, TRUE);
+  testcase_compression_wrapped_around(log_queue_disk_non_reliable_new, FALSE);
+#endif
+  testcase_segments(log_queue_disk_reliable_new, TRUE);
+  testcase_segments(log_queue_disk_non_reliable_new, FALSE);
 
   return 0;
 }
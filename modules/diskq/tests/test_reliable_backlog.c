@@ -28,7 +28,9 @@
 #include "logqueue-disk-reliable.h"
 #include "apphook.h"
 #include "plugin.h"
+#include "mainloop-worker.h"
 
+#include <iv.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -128,6 +130,7 @@ _prepare_eof_test(LogQueueDiskReliable *dq, LogMessage **msg1, LogMessage **msg2
   log_msg_add_ack(*msg2, &local_options);
 
   dq->super.qdisk->hdr->write_head = start_pos;
+  dq->super.qdisk->write_head = start_pos;
   dq->super.qdisk->hdr->read_head = QDISK_RESERVED_SPACE + mark_message_serialized_size + 1;
   dq->super.qdisk->hdr->backlog_head = dq->super.qdisk->hdr->read_head;
 
@@ -376,6 +379,61 @@ test_rewind_backlog(void)
   _common_cleanup(dq);
 }
 
+/*
+ * the messages of the records dropped by a failed flush must not stay in
+ * qreliable, as the records written next reuse their positions
+ */
+void
+test_failed_flush_drops_unwritten_messages(void)
+{
+  LogQueueDiskReliable *dq = _init_diskq_for_test(FILENAME, QDISK_RESERVED_SPACE + mark_message_serialized_size * 10,
+                                                  mark_message_serialized_size * 10);
+  LogPathOptions local_options = LOG_PATH_OPTIONS_INIT;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msgs[3];
+  LogMessage *msg;
+  gint64 start_pos = dq->super.qdisk->hdr->write_head;
+  gint fd = dq->super.qdisk->fd;
+  gint i;
+
+  options.write_buf_size = 1024 * 1024;
+  for (i = 0; i < 3; i++)
+    {
+      msgs[i] = log_msg_new_mark();
+      msgs[i]->ack_func = _dummy_ack;
+      log_msg_add_ack(msgs[i], &local_options);
+    }
+
+  iv_init();
+  main_loop_worker_thread_start(NULL);
+
+  log_queue_push_tail(&dq->super.super, msgs[0], &local_options);
+  log_queue_push_tail(&dq->super.super, msgs[1], &local_options);
+  assert_gint(dq->qreliable->length, NUMBER_MESSAGES_IN_QUEUE(2), ASSERTION_ERROR("Messages aren't in qreliable"));
+
+  dq->super.qdisk->fd = -1;
+  main_loop_worker_invoke_batch_callbacks();
+  dq->super.qdisk->fd = fd;
+
+  assert_gint(dq->qreliable->length, 0, ASSERTION_ERROR("Dropped messages are left in qreliable"));
+  assert_gint(num_of_ack, 2, ASSERTION_ERROR("Dropped messages aren't acked"));
+  assert_gint64(qdisk_get_length(dq->super.qdisk), 0, ASSERTION_ERROR("Dropped records are counted"));
+  assert_gint64(dq->super.qdisk->hdr->write_head, start_pos, ASSERTION_ERROR("Bad write head"));
+
+  log_queue_push_tail(&dq->super.super, msgs[2], &local_options);
+  main_loop_worker_invoke_batch_callbacks();
+
+  msg = log_queue_pop_head(&dq->super.super, &path_options);
+  assert_true(msg == msgs[2], ASSERTION_ERROR("A dropped message was popped"));
+  log_msg_unref(msg);
+  log_queue_ack_backlog(&dq->super.super, 1);
+  assert_gint(num_of_ack, 3, ASSERTION_ERROR("Message isn't acked"));
+
+  main_loop_worker_thread_stop();
+  iv_deinit();
+  _common_cleanup(dq);
+}
+
 gint
 main(gint argc, gchar **argv)
 {
@@ -394,6 +452,8 @@ main(gint argc, gchar **argv)
 
   test_rewind_backlog();
 
+  test_failed_flush_drops_unwritten_messages();
+
   cfg_free(configuration);
   app_shutdown();
 
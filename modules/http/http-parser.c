@@ -52,6 +52,7 @@ static CfgLexerKeyword http_keywords[] =
   { "body_suffix",  KW_BODY_SUFFIX },
   { "delimiter",    KW_DELIMITER },
   { "workers",      KW_WORKERS },
+  { "http2",        KW_HTTP2 },
   { NULL }
 };
 
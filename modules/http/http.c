@@ -23,6 +23,7 @@
 #include "http.h"
 #include "syslog-names.h"
 #include "scratch-buffers.h"
+#include "timeutils.h"
 
 /* HTTPDestinationWorker */
 
@@ -128,6 +129,20 @@ _setup_static_options_in_curl(HTTPDestinationWorker *self)
 
   curl_easy_setopt(self->curl, CURLOPT_TIMEOUT, owner->timeout);
 
+  if (owner->use_http2)
+    {
+#if LIBCURL_VERSION_NUM >= 0x072f00
+      curl_easy_setopt(self->curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+#elif LIBCURL_VERSION_NUM >= 0x072100
+      curl_easy_setopt(self->curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2_0);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072b00
+      /* wait for an existing connection to be multiplexed over, instead
+       * of opening a new one */
+      curl_easy_setopt(self->curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+    }
+
   if (owner->method_type == METHOD_TYPE_PUT)
     curl_easy_setopt(self->curl, CURLOPT_CUSTOMREQUEST, "PUT");
 }
@@ -272,45 +287,28 @@ _finish_request_body(HTTPDestinationWorker *self)
     g_string_append_len(self->request_body, owner->body_suffix->str, owner->body_suffix->len);
 }
 
-/* we flush the accumulated data if
- *   1) we reach batch_size,
- *   2) the message queue becomes empty
- */
 static worker_insert_result_t
-_flush(LogThreadedDestWorker *s)
+_evaluate_response(HTTPDestinationWorker *self, CURL *curl, CURLcode ret, gsize body_size, gint batch_size)
 {
-  HTTPDestinationWorker *self = (HTTPDestinationWorker *) s;
-  HTTPDestinationDriver *owner = (HTTPDestinationDriver *) s->owner;
-  CURLcode ret;
-  worker_insert_result_t retval;
-
-  if (self->super.batch_size == 0)
-    return WORKER_INSERT_RESULT_SUCCESS;
-
-  _finish_request_body(self);
-
-  curl_easy_setopt(self->curl, CURLOPT_HTTPHEADER, self->request_headers);
-  curl_easy_setopt(self->curl, CURLOPT_POSTFIELDS, self->request_body->str);
+  HTTPDestinationDriver *owner = (HTTPDestinationDriver *) self->super.owner;
 
-  if ((ret = curl_easy_perform(self->curl)) != CURLE_OK)
+  if (ret != CURLE_OK)
     {
       msg_error("curl: error sending HTTP request",
                 evt_tag_str("error", curl_easy_strerror(ret)),
                 log_pipe_location_tag(&owner->super.super.super.super));
-      retval = WORKER_INSERT_RESULT_NOT_CONNECTED;
-      goto exit;
+      return WORKER_INSERT_RESULT_NOT_CONNECTED;
     }
 
   glong http_code = 0;
 
-  CURLcode code = curl_easy_getinfo(self->curl, CURLINFO_RESPONSE_CODE, &http_code);
+  CURLcode code = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
   if (code != CURLE_OK)
     {
       msg_error("curl: error querying response code",
-                evt_tag_str("error", curl_easy_strerror(ret)),
+                evt_tag_str("error", curl_easy_strerror(code)),
                 log_pipe_location_tag(&owner->super.super.super.super));
-      retval = WORKER_INSERT_RESULT_NOT_CONNECTED;
-      goto exit;
+      return WORKER_INSERT_RESULT_NOT_CONNECTED;
     }
 
   if (debug_flag)
@@ -318,20 +316,254 @@ _flush(LogThreadedDestWorker *s)
       gdouble total_time = 0;
       glong redirect_count = 0;
 
-      curl_easy_getinfo(self->curl, CURLINFO_TOTAL_TIME, &total_time);
-      curl_easy_getinfo(self->curl, CURLINFO_REDIRECT_COUNT, &redirect_count);
+      curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &total_time);
+      curl_easy_getinfo(curl, CURLINFO_REDIRECT_COUNT, &redirect_count);
       msg_debug("curl: HTTP response received",
                 evt_tag_str("url", owner->url),
                 evt_tag_int("status_code", http_code),
-                evt_tag_int("body_size", self->request_body->len),
-                evt_tag_int("batch_size", self->super.batch_size),
+                evt_tag_int("body_size", body_size),
+                evt_tag_int("batch_size", batch_size),
                 evt_tag_int("redirected", redirect_count != 0),
                 evt_tag_printf("total_time", "%.3f", total_time),
                 log_pipe_location_tag(&owner->super.super.super.super));
     }
-  retval = _map_http_status_to_worker_status(self, http_code);
+  return _map_http_status_to_worker_status(self, http_code);
+}
+
+/* Requests sent via the multi interface.  Each of them carries a batch,
+ * the body and the headers are swapped in from the worker when the batch
+ * is flushed, the result is reported using
+ * log_threaded_dest_worker_batch_finished() once the response arrives.
+ */
+typedef struct _HTTPRequest
+{
+  CURL *curl;
+  GString *body;
+  struct curl_slist *headers;
+  guint32 batch_id;
+  gint batch_size;
+} HTTPRequest;
+
+typedef struct _HTTPSocket
+{
+  struct iv_fd fd;
+  HTTPDestinationWorker *worker;
+} HTTPSocket;
+
+static HTTPRequest *
+_request_new(HTTPDestinationWorker *self)
+{
+  HTTPRequest *request;
+  CURL *curl;
+
+  /* the static options were already set up on our own easy handle */
+  if (!(curl = curl_easy_duphandle(self->curl)))
+    return NULL;
+
+  request = g_new0(HTTPRequest, 1);
+  request->curl = curl;
+  request->body = g_string_sized_new(32768);
+  curl_easy_setopt(request->curl, CURLOPT_PRIVATE, request);
+  return request;
+}
+
+static void
+_request_free(HTTPRequest *request)
+{
+  curl_easy_cleanup(request->curl);
+  curl_slist_free_all(request->headers);
+  g_string_free(request->body, TRUE);
+  g_free(request);
+}
+
+static void
+_release_request(HTTPDestinationWorker *self, HTTPRequest *request)
+{
+  curl_multi_remove_handle(self->multi, request->curl);
+  g_queue_remove(&self->running_requests, request);
+
+  curl_slist_free_all(request->headers);
+  request->headers = NULL;
+  g_queue_push_tail(&self->idle_requests, request);
+}
+
+static void
+_collect_finished_requests(HTTPDestinationWorker *self)
+{
+  CURLMsg *msg;
+  gint msgs_left;
+
+  while ((msg = curl_multi_info_read(self->multi, &msgs_left)))
+    {
+      HTTPRequest *request = NULL;
+      CURLcode ret = msg->data.result;
+      worker_insert_result_t result;
+      guint32 batch_id;
+
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (gchar **) &request);
+      result = _evaluate_response(self, request->curl, ret, request->body->len, request->batch_size);
+      batch_id = request->batch_id;
+
+      _release_request(self, request);
+      log_threaded_dest_worker_batch_finished(&self->super, batch_id, result);
+    }
+}
+
+static void
+_multi_socket_action(HTTPDestinationWorker *self, curl_socket_t fd, gint ev_bitmask)
+{
+  gint running_handles;
+
+  curl_multi_socket_action(self->multi, fd, ev_bitmask, &running_handles);
+  _collect_finished_requests(self);
+}
+
+static void
+_socket_readable(gpointer cookie)
+{
+  HTTPSocket *sock = (HTTPSocket *) cookie;
+
+  _multi_socket_action(sock->worker, sock->fd.fd, CURL_CSELECT_IN);
+}
+
+static void
+_socket_writable(gpointer cookie)
+{
+  HTTPSocket *sock = (HTTPSocket *) cookie;
+
+  _multi_socket_action(sock->worker, sock->fd.fd, CURL_CSELECT_OUT);
+}
+
+static void
+_multi_timer_expired(gpointer cookie)
+{
+  HTTPDestinationWorker *self = (HTTPDestinationWorker *) cookie;
+
+  _multi_socket_action(self, CURL_SOCKET_TIMEOUT, 0);
+}
+
+/* maps the sockets libcurl is interested in to the ivykis loop of the worker */
+static gint
+_multi_socket_function(CURL *easy, curl_socket_t fd, gint what, gpointer userp, gpointer socketp)
+{
+  HTTPDestinationWorker *self = (HTTPDestinationWorker *) userp;
+  HTTPSocket *sock = (HTTPSocket *) socketp;
+
+  if (what == CURL_POLL_REMOVE)
+    {
+      if (sock)
+        {
+          iv_fd_unregister(&sock->fd);
+          g_free(sock);
+        }
+      return 0;
+    }
+
+  if (!sock)
+    {
+      sock = g_new0(HTTPSocket, 1);
+      IV_FD_INIT(&sock->fd);
+      sock->fd.fd = fd;
+      sock->fd.cookie = sock;
+      sock->worker = self;
+      iv_fd_register(&sock->fd);
+      curl_multi_assign(self->multi, fd, sock);
+    }
+
+  iv_fd_set_handler_in(&sock->fd, (what & CURL_POLL_IN) ? _socket_readable : NULL);
+  iv_fd_set_handler_out(&sock->fd, (what & CURL_POLL_OUT) ? _socket_writable : NULL);
+  return 0;
+}
+
+static gint
+_multi_timer_function(CURLM *multi, glong timeout_ms, gpointer userp)
+{
+  HTTPDestinationWorker *self = (HTTPDestinationWorker *) userp;
+
+  if (iv_timer_registered(&self->multi_timer))
+    iv_timer_unregister(&self->multi_timer);
+
+  if (timeout_ms < 0)
+    return 0;
+
+  iv_validate_now();
+  self->multi_timer.expires = iv_now;
+  timespec_add_msec(&self->multi_timer.expires, timeout_ms);
+  iv_timer_register(&self->multi_timer);
+  return 0;
+}
+
+static worker_insert_result_t
+_start_request(HTTPDestinationWorker *self)
+{
+  HTTPDestinationDriver *owner = (HTTPDestinationDriver *) self->super.owner;
+  HTTPRequest *request = g_queue_pop_head(&self->idle_requests);
+  GString *body;
+  CURLMcode mcode;
+
+  if (!request && !(request = _request_new(self)))
+    {
+      msg_error("curl: cannot initialize libcurl",
+                log_pipe_location_tag(&owner->super.super.super.super));
+      return WORKER_INSERT_RESULT_NOT_CONNECTED;
+    }
+
+  /* the request takes the body being built, we go on with its old one */
+  body = request->body;
+  request->body = self->request_body;
+  self->request_body = body;
+  request->headers = self->request_headers;
+  self->request_headers = NULL;
+  request->batch_id = log_threaded_dest_worker_get_batch_id(&self->super);
+  request->batch_size = self->super.batch_size;
+  _reinit_request_body(self);
+
+  curl_easy_setopt(request->curl, CURLOPT_HTTPHEADER, request->headers);
+  curl_easy_setopt(request->curl, CURLOPT_POSTFIELDS, request->body->str);
+
+  if ((mcode = curl_multi_add_handle(self->multi, request->curl)) != CURLM_OK)
+    {
+      msg_error("curl: error sending HTTP request",
+                evt_tag_str("error", curl_multi_strerror(mcode)),
+                log_pipe_location_tag(&owner->super.super.super.super));
+      curl_slist_free_all(request->headers);
+      request->headers = NULL;
+      g_queue_push_tail(&self->idle_requests, request);
+      return WORKER_INSERT_RESULT_NOT_CONNECTED;
+    }
+
+  g_queue_push_tail(&self->running_requests, request);
+  return WORKER_INSERT_RESULT_PENDING;
+}
+
+/* we flush the accumulated data if
+ *   1) we reach batch_size,
+ *   2) the message queue becomes empty
+ */
+static worker_insert_result_t
+_flush(LogThreadedDestWorker *s)
+{
+  HTTPDestinationWorker *self = (HTTPDestinationWorker *) s;
+  CURLcode ret;
+  worker_insert_result_t retval;
+
+  if (self->super.batch_size == 0)
+    return WORKER_INSERT_RESULT_SUCCESS;
+
+  _finish_request_body(self);
+
+  if (self->multi)
+    return _start_request(self);
+
+  curl_easy_setopt(self->curl, CURLOPT_HTTPHEADER, self->request_headers);
+  curl_easy_setopt(self->curl, CURLOPT_POSTFIELDS, self->request_body->str);
+
+  ret = curl_easy_perform(self->curl);
+  retval = _evaluate_response(self, self->curl, ret, self->request_body->len, self->super.batch_size);
 
-exit:
   _reinit_request_body(self);
   curl_slist_free_all(self->request_headers);
   self->request_headers = NULL;
@@ -344,7 +576,7 @@ _should_initiate_flush(HTTPDestinationWorker *self)
   HTTPDestinationDriver *owner = (HTTPDestinationDriver *) self->super.owner;
 
   return (owner->flush_bytes && self->request_body->len + owner->body_suffix->len >= owner->flush_bytes) ||
-         (owner->super.flush_lines && self->super.batch_size >= owner->super.flush_lines);
+         (owner->super.flush_lines && self->super.batch_size >= log_threaded_dest_worker_get_flush_lines(&self->super));
 
 }
 
@@ -390,14 +622,63 @@ _thread_init(LogThreadedDestWorker *s)
     }
   _setup_static_options_in_curl(self);
   _reinit_request_body(self);
+
+  if (owner->super.max_inflight_batches > 1)
+    {
+      if (!(self->multi = curl_multi_init()))
+        {
+          msg_error("curl: cannot initialize libcurl multi interface",
+                    log_pipe_location_tag(&owner->super.super.super.super));
+          return FALSE;
+        }
+
+      IV_TIMER_INIT(&self->multi_timer);
+      self->multi_timer.cookie = self;
+      self->multi_timer.handler = _multi_timer_expired;
+
+      curl_multi_setopt(self->multi, CURLMOPT_SOCKETFUNCTION, _multi_socket_function);
+      curl_multi_setopt(self->multi, CURLMOPT_SOCKETDATA, self);
+      curl_multi_setopt(self->multi, CURLMOPT_TIMERFUNCTION, _multi_timer_function);
+      curl_multi_setopt(self->multi, CURLMOPT_TIMERDATA, self);
+#ifdef CURLPIPE_MULTIPLEX
+      if (owner->use_http2)
+        curl_multi_setopt(self->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+    }
   return log_threaded_dest_worker_init_method(s);
 }
 
+/* the batches of the requests in flight are rewound by LogThreadedDestWorker */
+static void
+_disconnect(LogThreadedDestWorker *s)
+{
+  HTTPDestinationWorker *self = (HTTPDestinationWorker *) s;
+  HTTPRequest *request;
+
+  if (!self->multi)
+    return;
+
+  while ((request = g_queue_peek_head(&self->running_requests)))
+    _release_request(self, request);
+}
+
 static void
 _thread_deinit(LogThreadedDestWorker *s)
 {
   HTTPDestinationWorker *self = (HTTPDestinationWorker *) s;
 
+  if (self->multi)
+    {
+      HTTPRequest *request;
+
+      _disconnect(s);
+      while ((request = g_queue_pop_head(&self->idle_requests)))
+        _request_free(request);
+      curl_multi_cleanup(self->multi);
+      if (iv_timer_registered(&self->multi_timer))
+        iv_timer_unregister(&self->multi_timer);
+    }
+
   g_string_free(self->request_body, TRUE);
   curl_easy_cleanup(self->curl);
   log_threaded_dest_worker_deinit_method(s);
@@ -412,6 +693,7 @@ http_dw_new(HTTPDestinationDriver *owner, gint worker_index)
   self->super.thread_init = _thread_init;
   self->super.thread_deinit = _thread_deinit;
   self->super.flush = _flush;
+  self->super.disconnect = _disconnect;
 
   if (owner->super.flush_lines > 0 || owner->flush_bytes > 0)
     self->super.insert = _insert_batched;
@@ -621,6 +903,14 @@ http_dd_set_peer_verify(LogDriver *d, gboolean verify)
   self->peer_verify = verify;
 }
 
+void
+http_dd_set_http2(LogDriver *d, gboolean enable)
+{
+  HTTPDestinationDriver *self = (HTTPDestinationDriver *) d;
+
+  self->use_http2 = enable;
+}
+
 void
 http_dd_set_timeout(LogDriver *d, glong timeout)
 {
@@ -686,11 +976,31 @@ _construct_worker(LogThreadedDestDriver  *s, gint worker_index)
   return &http_dw_new(self, worker_index)->super;
 }
 
+/* HTTP/2 appeared in libcurl 7.33.0, it also has to be enabled at build time */
+static gboolean
+_is_http2_supported(curl_version_info_data *curl_info)
+{
+#if LIBCURL_VERSION_NUM >= 0x072100
+  return (curl_info->features & CURL_VERSION_HTTP2) != 0;
+#else
+  return FALSE;
+#endif
+}
+
 gboolean
 http_dd_init(LogPipe *s)
 {
   HTTPDestinationDriver *self = (HTTPDestinationDriver *)s;
   GlobalConfig *cfg = log_pipe_get_config(s);
+  curl_version_info_data *curl_info = curl_version_info(CURLVERSION_NOW);
+
+  if (self->use_http2 && !_is_http2_supported(curl_info))
+    {
+      msg_error("http2() is enabled, but libcurl does not support HTTP/2",
+                evt_tag_str("libcurl_version", curl_info->version),
+                log_pipe_location_tag(s));
+      return FALSE;
+    }
 
   if (!log_dest_driver_init_method(s))
     return FALSE;
@@ -702,12 +1012,10 @@ http_dd_init(LogPipe *s)
       self->url = g_strdup(HTTP_DEFAULT_URL);
     }
 
-  curl_version_info_data *curl_info = curl_version_info(CURLVERSION_NOW);
   if (!self->user_agent)
     self->user_agent = g_strdup_printf("syslog-ng %s/libcurl %s",
                                        SYSLOG_NG_VERSION, curl_info->version);
 
-
   return log_threaded_dest_driver_init_method(s);
 }
 
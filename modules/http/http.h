@@ -30,6 +30,8 @@
 
 #include "logthrdestdrv.h"
 
+#include <iv.h>
+
 #define CURL_NO_OLDIES 1
 #include <curl/curl.h>
 
@@ -39,6 +41,12 @@ typedef struct _HTTPDestinationWorker
   CURL *curl;
   GString *request_body;
   struct curl_slist *request_headers;
+  /* with max-inflight-batches() > 1 requests are sent via the multi
+   * interface, each of them with its own easy handle */
+  CURLM *multi;
+  struct iv_timer multi_timer;
+  GQueue running_requests;
+  GQueue idle_requests;
 } HTTPDestinationWorker;
 
 typedef struct
@@ -59,6 +67,7 @@ typedef struct
   GString *delimiter;
   int ssl_version;
   gboolean peer_verify;
+  gboolean use_http2;
   short int method_type;
   glong timeout;
   glong flush_bytes;
@@ -83,6 +92,7 @@ void http_dd_set_key_file(LogDriver *d, const gchar *key_file);
 void http_dd_set_cipher_suite(LogDriver *d, const gchar *ciphers);
 void http_dd_set_ssl_version(LogDriver *d, const gchar *value);
 void http_dd_set_peer_verify(LogDriver *d, gboolean verify);
+void http_dd_set_http2(LogDriver *d, gboolean enable);
 void http_dd_set_timeout(LogDriver *d, glong timeout);
 void http_dd_set_flush_bytes(LogDriver *d, glong flush_bytes);
 void http_dd_set_body_prefix(LogDriver *d, const gchar *body_prefix);
@@ -615,7 +615,9 @@ _insert_batch(LogThreadedDestDriver *s, LogMessage *msg)
        */
     }
 
-  if (self->super.flush_lines > 1 && self->super.worker.instance.batch_size >= self->super.flush_lines)
+  if (self->super.flush_lines > 1 &&
+      self->super.worker.instance.batch_size >=
+      log_threaded_dest_worker_get_flush_lines(&self->super.worker.instance))
     {
       return log_threaded_dest_driver_flush(&self->super);
     }
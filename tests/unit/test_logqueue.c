@@ -309,3 +309,276 @@ Test(logqueue, log_queue_fifo_rewind_all_and_memory_usage)
 
   log_queue_unref(q);
 }
+
+static void
+_create_messages(LogMessage **msgs, LogPathOptions *path_options, gint n)
+{
+  LogPathOptions initial_path_options = LOG_PATH_OPTIONS_INIT;
+  gint i;
+
+  for (i = 0; i < n; i++)
+    {
+      path_options[i] = initial_path_options;
+      path_options[i].flow_control_requested = TRUE;
+
+      msgs[i] = log_msg_new_empty();
+      log_msg_add_ack(msgs[i], &path_options[i]);
+      msgs[i]->ack_func = test_ack;
+    }
+}
+
+Test(logqueue, log_queue_fifo_batches_keep_the_order_of_messages)
+{
+  LogQueue *q = log_queue_fifo_new(OVERFLOW_SIZE, NULL);
+  LogMessage *pushed[10], *popped[10];
+  LogPathOptions path_options[10];
+  gint i;
+
+  log_queue_set_use_backlog(q, TRUE);
+  acked_messages = 0;
+
+  _create_messages(pushed, path_options, 10);
+  log_queue_push_tail_batch(q, pushed, path_options, 10);
+  cr_assert_eq(log_queue_get_length(q), 10);
+
+  cr_assert_eq(log_queue_pop_head_batch(q, popped, path_options, 4), 4);
+  cr_assert_eq(log_queue_pop_head_batch(q, &popped[4], &path_options[4], 10), 6);
+  cr_assert_eq(log_queue_pop_head_batch(q, popped, path_options, 10), 0);
+  cr_assert_eq(log_queue_get_length(q), 0);
+
+  for (i = 0; i < 10; i++)
+    {
+      cr_assert_eq(popped[i], pushed[i], "Message %d was popped out of order", i);
+      cr_assert(path_options[i].ack_needed);
+      log_msg_unref(popped[i]);
+    }
+
+  log_queue_rewind_backlog(q, 3);
+  cr_assert_eq(log_queue_pop_head_batch(q, popped, path_options, 10), 3);
+  cr_assert_eq(popped[0], pushed[7]);
+  for (i = 0; i < 3; i++)
+    log_msg_unref(popped[i]);
+
+  log_queue_ack_backlog(q, 10);
+  cr_assert_eq(acked_messages, 10);
+
+  log_queue_unref(q);
+}
+
+Test(logqueue, log_queue_fifo_batches_honour_size_and_throttle)
+{
+  LogQueue *q = log_queue_fifo_new(5, NULL);
+  LogMessage *msgs[8];
+  LogPathOptions path_options[8];
+  gint i;
+
+  log_queue_set_use_backlog(q, TRUE);
+  acked_messages = 0;
+
+  _create_messages(msgs, path_options, 8);
+  log_queue_push_tail_batch(q, msgs, path_options, 8);
+  cr_assert_eq(log_queue_get_length(q), 5);
+  cr_assert_eq(acked_messages, 3, "Messages beyond the size of the queue were not dropped");
+
+  log_queue_set_throttle(q, 2);
+  cr_assert_eq(log_queue_pop_head_batch(q, msgs, path_options, 8), 2);
+  cr_assert_eq(log_queue_pop_head_batch(q, &msgs[2], &path_options[2], 8), 0);
+  cr_assert_eq(log_queue_pop_head_batch_ignore_throttle(q, &msgs[2], &path_options[2], 8), 3);
+
+  for (i = 0; i < 5; i++)
+    log_msg_unref(msgs[i]);
+  log_queue_ack_backlog(q, 5);
+  cr_assert_eq(acked_messages, 8);
+
+  log_queue_unref(q);
+}
+
+Test(logqueue, log_queue_fifo_steal_tail_moves_the_newest_unseen_messages_in_order)
+{
+  LogQueue *victim = log_queue_fifo_new(OVERFLOW_SIZE, NULL);
+  LogQueue *thief = log_queue_fifo_new(4, NULL);
+  LogMessage *pushed[10], *popped[10];
+  LogPathOptions path_options[10], popped_path_options[10];
+  gint i;
+
+  log_queue_set_use_backlog(victim, TRUE);
+  log_queue_set_use_backlog(thief, TRUE);
+  acked_messages = 0;
+
+  _create_messages(pushed, path_options, 10);
+  log_queue_push_tail_batch(victim, pushed, path_options, 4);
+  cr_assert_eq(log_queue_pop_head_batch(victim, popped, popped_path_options, 2), 2);
+  for (i = 0; i < 2; i++)
+    log_msg_unref(popped[i]);
+
+  log_queue_push_tail_batch(victim, &pushed[4], &path_options[4], 3);
+  log_queue_push_tail_batch(victim, &pushed[7], &path_options[7], 3);
+
+  /* half of the wait queue, then a batch of 2 limited by the size of the thief */
+  cr_assert_eq(log_queue_steal_tail(victim, thief, 2), 3);
+  cr_assert_eq(log_queue_steal_tail(victim, thief, 2), 1);
+  cr_assert_eq(log_queue_steal_tail(victim, thief, 2), 0);
+  cr_assert_eq(log_queue_get_length(victim), 4);
+  cr_assert_eq(log_queue_get_length(thief), 4);
+
+  cr_assert_eq(log_queue_pop_head_batch(thief, popped, popped_path_options, 10), 4);
+  for (i = 0; i < 4; i++)
+    {
+      cr_assert_eq(popped[i], pushed[6 + i], "Message %d was stolen out of order", i);
+      cr_assert(popped_path_options[i].ack_needed);
+      log_msg_unref(popped[i]);
+    }
+
+  cr_assert_eq(log_queue_pop_head_batch(victim, popped, popped_path_options, 10), 4);
+  for (i = 0; i < 4; i++)
+    {
+      cr_assert_eq(popped[i], pushed[2 + i], "Message %d was left out of order", i);
+      log_msg_unref(popped[i]);
+    }
+
+  log_queue_ack_backlog(victim, 6);
+  log_queue_ack_backlog(thief, 4);
+  cr_assert_eq(acked_messages, 10);
+
+  log_queue_unref(victim);
+  log_queue_unref(thief);
+}
+
+#define STRESS_WORKER_PRODUCERS 8
+#define STRESS_EXTERNAL_PRODUCERS 4
+#define STRESS_PRODUCERS (STRESS_WORKER_PRODUCERS + STRESS_EXTERNAL_PRODUCERS)
+#define STRESS_MESSAGES_PER_PRODUCER 5000
+#define STRESS_BATCH_SIZE 16
+
+typedef struct _StressProducer
+{
+  LogQueue *q;
+  gint id;
+  gboolean external;
+} StressProducer;
+
+static LogMessage *
+_create_tagged_message(gint producer, gint seq)
+{
+  LogMessage *msg = log_msg_new_empty();
+
+  msg->pri = producer;
+  msg->rcptid = seq;
+  return msg;
+}
+
+static gpointer
+_stress_produce(gpointer args)
+{
+  StressProducer *producer = (StressProducer *) args;
+  WorkerOptions wo = { .is_output_thread = FALSE, .is_external_input = producer->external };
+  LogPathOptions path_options[STRESS_BATCH_SIZE];
+  LogMessage *msgs[STRESS_BATCH_SIZE];
+  gint i, j;
+
+  iv_init();
+  main_loop_worker_thread_start(&wo);
+
+  for (i = 0; i < STRESS_MESSAGES_PER_PRODUCER; i += STRESS_BATCH_SIZE)
+    {
+      gint n = MIN(STRESS_BATCH_SIZE, STRESS_MESSAGES_PER_PRODUCER - i);
+
+      for (j = 0; j < n; j++)
+        {
+          LogPathOptions initial_path_options = LOG_PATH_OPTIONS_INIT;
+
+          path_options[j] = initial_path_options;
+          msgs[j] = _create_tagged_message(producer->id, i + j);
+        }
+
+      if ((i / STRESS_BATCH_SIZE) % 2 == 0)
+        log_queue_push_tail_batch(producer->q, msgs, path_options, n);
+      else
+        {
+          for (j = 0; j < n; j++)
+            log_queue_push_tail(producer->q, msgs[j], &path_options[j]);
+        }
+      main_loop_worker_invoke_batch_callbacks();
+    }
+
+  main_loop_worker_thread_stop();
+  iv_deinit();
+  return NULL;
+}
+
+static void
+_stress_consume(LogQueue *q)
+{
+  LogPathOptions path_options[STRESS_BATCH_SIZE];
+  LogMessage *msgs[STRESS_BATCH_SIZE];
+  gint next_seq[STRESS_PRODUCERS] = { 0 };
+  gint msg_count = 0;
+  gint slept = 0;
+  gint i, n;
+
+  while (msg_count < STRESS_PRODUCERS * STRESS_MESSAGES_PER_PRODUCER)
+    {
+      if (msg_count % 2 == 0)
+        n = log_queue_pop_head_batch(q, msgs, path_options, STRESS_BATCH_SIZE);
+      else
+        n = (msgs[0] = log_queue_pop_head(q, &path_options[0])) ? 1 : 0;
+
+      if (n == 0)
+        {
+          struct timespec ns = { .tv_sec = 0, .tv_nsec = 1000000 };
+
+          nanosleep(&ns, NULL);
+          cr_assert_lt(slept++, 10000, "The wait for messages took too much time, msg_count=%d", msg_count);
+          continue;
+        }
+
+      for (i = 0; i < n; i++)
+        {
+          gint producer = msgs[i]->pri;
+
+          cr_assert_eq(msgs[i]->rcptid, next_seq[producer],
+                       "Message of producer %d was popped out of order", producer);
+          next_seq[producer]++;
+          log_msg_ack(msgs[i], &path_options[i], AT_PROCESSED);
+          log_msg_unref(msgs[i]);
+        }
+      msg_count += n;
+    }
+}
+
+Test(logqueue, log_queue_fifo_multiple_producers_keep_their_order)
+{
+  StressProducer producers[STRESS_PRODUCERS];
+  GThread *threads[STRESS_PRODUCERS];
+  LogQueue *q;
+  gint i;
+
+  log_queue_set_max_threads(STRESS_WORKER_PRODUCERS);
+  q = log_queue_fifo_new(STRESS_PRODUCERS * STRESS_MESSAGES_PER_PRODUCER, NULL);
+
+  StatsClusterKey sc_key;
+  stats_lock();
+  stats_cluster_logpipe_key_set(&sc_key, SCS_DESTINATION, q->persist_name, NULL );
+  stats_register_counter(0, &sc_key, SC_TYPE_QUEUED, &q->queued_messages);
+  stats_register_counter(1, &sc_key, SC_TYPE_MEMORY_USAGE, &q->memory_usage);
+  stats_unlock();
+
+  for (i = 0; i < STRESS_PRODUCERS; i++)
+    {
+      producers[i].q = q;
+      producers[i].id = i;
+      producers[i].external = (i >= STRESS_WORKER_PRODUCERS);
+      threads[i] = g_thread_create(_stress_produce, &producers[i], TRUE, NULL);
+    }
+
+  _stress_consume(q);
+
+  for (i = 0; i < STRESS_PRODUCERS; i++)
+    g_thread_join(threads[i]);
+
+  cr_assert_eq(log_queue_get_length(q), 0);
+  cr_assert_eq(stats_counter_get(q->queued_messages), 0);
+  cr_assert_eq(stats_counter_get(q->memory_usage), 0);
+
+  log_queue_unref(q);
+}
@@ -264,3 +264,61 @@ Test(matcher, pcre812_incompatibility, .description = "tests a pcre 8.12 incompa
   testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: wikiwiki",
                    "([[:digit:]]{1,3}\\.){3}[[:digit:]]{1,3}", "foo", "wikiwiki", _construct_matcher(LMF_GLOBAL, log_matcher_pcre_re_new));
 }
+
+#if SYSLOG_NG_HAVE_PCRE2
+
+Test(matcher, pcre2_regexp)
+{
+  testcase_match("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: árvíztűrőtükörfúrógép", "tűrő",
+                 TRUE, _construct_matcher(0, log_matcher_pcre2_re_new));
+  testcase_match("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: árvíztűrőtükörfúrógép", "^tűrő",
+                 FALSE, _construct_matcher(0, log_matcher_pcre2_re_new));
+  testcase_match("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: ÁRVÍZTŰRŐ", "árvíztűrő",
+                 TRUE, _construct_matcher(LMF_ICASE | LMF_UTF8, log_matcher_pcre2_re_new));
+
+  testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: árvíztűrőtükörfúrógép", "árvíz",
+                   "favíz", "favíztűrőtükörfúrógép", _construct_matcher(0, log_matcher_pcre2_re_new));
+  testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: árvíztűrőtükörfúrógép", "^tűrő",
+                   "faró", "árvíztűrőtükörfúrógép", _construct_matcher(0, log_matcher_pcre2_re_new));
+  testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: wikiwiki", "wi", "kuku", "kukukikukuki",
+                   _construct_matcher(LMF_GLOBAL, log_matcher_pcre2_re_new));
+  testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: wikiwiki", "(wiki).+", "#$1#", "#wiki#",
+                   _construct_matcher(0, log_matcher_pcre2_re_new));
+  testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: wikiwiki", "(?<first>wi)ki", "${first}",
+                   "wiwi", _construct_matcher(LMF_GLOBAL, log_matcher_pcre2_re_new));
+}
+
+Test(matcher, pcre2_empty_global, .description = "empty match with global flag")
+{
+  testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: aa bb", "c*", "#", "#a#a# #b#b#",
+                   _construct_matcher(LMF_GLOBAL, log_matcher_pcre2_re_new));
+  testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: aa bb", "a*", "#", "## #b#b#",
+                   _construct_matcher(LMF_GLOBAL, log_matcher_pcre2_re_new));
+  testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: aa", "aa|b*", "@", "@@",
+                   _construct_matcher(LMF_GLOBAL, log_matcher_pcre2_re_new));
+  testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: aa", "b*|aa", "@", "@@@",
+                   _construct_matcher(LMF_GLOBAL, log_matcher_pcre2_re_new));
+  testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: aa", "b*|aa", "@", "@aa",
+                   _construct_matcher(0, log_matcher_pcre2_re_new));
+}
+
+Test(matcher, pcre2_match_data_grows_with_the_number_of_groups)
+{
+  testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: abc", "a", "x", "xbc",
+                   _construct_matcher(0, log_matcher_pcre2_re_new));
+  testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: abcdef", "(a)(b)(c)(d)(e)(f)", "$6$5$4$3$2$1",
+                   "fedcba", _construct_matcher(0, log_matcher_pcre2_re_new));
+  testcase_replace("<155>2006-02-11T10:34:56+01:00 bzorp syslog-ng[23323]: abc", "(a)", "$1$1", "aabc",
+                   _construct_matcher(0, log_matcher_pcre2_re_new));
+}
+
+Test(matcher, pcre2_type_is_registered)
+{
+  LogMatcherOptions options;
+
+  log_matcher_options_defaults(&options);
+  cr_assert(log_matcher_options_set_type(&options, "pcre2"));
+  log_matcher_options_destroy(&options);
+}
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+
+#include "logmatcher.h"
+#include "apphook.h"
+#include "cfg.h"
+#include "libtest/stopwatch.h"
+
+#define ITERATIONS 100000
+
+typedef LogMatcher *(*MatcherConstructFunc)(GlobalConfig *cfg, const LogMatcherOptions *options);
+
+static const gchar *message =
+  "Accepted publickey for admin from 10.12.0.15 port 51234 ssh2: RSA SHA256:8XhJ0yR4gW3cX0qU1w5kPq";
+
+static LogMatcher *
+_compile_matcher(MatcherConstructFunc construct, gint flags, const gchar *pattern)
+{
+  LogMatcherOptions options;
+  LogMatcher *matcher;
+
+  log_matcher_options_defaults(&options);
+  options.flags = flags;
+  matcher = construct(configuration, &options);
+  cr_assert(log_matcher_compile(matcher, pattern, NULL), "failed to compile pattern: %s", pattern);
+  return matcher;
+}
+
+static void
+_perftest_match(const gchar *type, MatcherConstructFunc construct, gint flags, const gchar *pattern)
+{
+  LogMatcher *matcher = _compile_matcher(construct, flags, pattern);
+  LogMessage *msg = log_msg_new_empty();
+  gssize message_len = strlen(message);
+  gint i;
+
+  log_msg_set_value(msg, LM_V_MESSAGE, message, message_len);
+
+  start_stopwatch();
+  for (i = 0; i < ITERATIONS; i++)
+    log_matcher_match(matcher, msg, LM_V_MESSAGE, message, message_len);
+  stop_stopwatch_and_display_result(ITERATIONS, "%s match, flags=%d, pattern=%s", type, flags, pattern);
+
+  log_msg_unref(msg);
+  log_matcher_unref(matcher);
+}
+
+static void
+_perftest_replace(const gchar *type, MatcherConstructFunc construct, gint flags, const gchar *pattern,
+                  const gchar *replacement)
+{
+  LogMatcher *matcher = _compile_matcher(construct, flags, pattern);
+  LogTemplate *template = log_template_new(configuration, NULL);
+  LogMessage *msg = log_msg_new_empty();
+  gssize message_len = strlen(message);
+  gssize new_length;
+  gint i;
+
+  cr_assert(log_template_compile(template, replacement, NULL));
+  log_msg_set_value(msg, LM_V_MESSAGE, message, message_len);
+
+  start_stopwatch();
+  for (i = 0; i < ITERATIONS; i++)
+    g_free(log_matcher_replace(matcher, msg, LM_V_NONE, message, message_len, template, &new_length));
+  stop_stopwatch_and_display_result(ITERATIONS, "%s replace, flags=%d, pattern=%s", type, flags, pattern);
+
+  log_msg_unref(msg);
+  log_template_unref(template);
+  log_matcher_unref(matcher);
+}
+
+static void
+_perftest_backend(const gchar *type, MatcherConstructFunc construct)
+{
+  _perftest_match(type, construct, 0, "publickey");
+  _perftest_match(type, construct, 0, "^Accepted (publickey|password) for (\\S+) from (\\S+)");
+  _perftest_match(type, construct, LMF_STORE_MATCHES,
+                  "^Accepted (?<method>\\S+) for (?<user>\\S+) from (?<addr>\\S+) port (?<port>\\d+)");
+  _perftest_match(type, construct, LMF_ICASE, "ACCEPTED PUBLICKEY");
+  _perftest_match(type, construct, 0, "no such pattern in the message");
+
+  _perftest_replace(type, construct, 0, "\\d+\\.\\d+\\.\\d+\\.\\d+", "x.x.x.x");
+  _perftest_replace(type, construct, LMF_GLOBAL, "[0-9]", "#");
+  _perftest_replace(type, construct, LMF_GLOBAL, "(\\S+) (\\S+)", "$2 $1");
+}
+
+Test(matcher_speed, test_pcre_matcher_speed)
+{
+  _perftest_backend("pcre", log_matcher_pcre_re_new);
+}
+
+#if SYSLOG_NG_HAVE_PCRE2
+Test(matcher_speed, test_pcre2_matcher_speed)
+{
+  _perftest_backend("pcre2", log_matcher_pcre2_re_new);
+}
+#endif
+
+static void
+setup(void)
+{
+  app_startup();
+  configuration = cfg_new_snippet();
+}
+
+static void
+teardown(void)
+{
+  cfg_free(configuration);
+  app_shutdown();
+}
+
+TestSuite(matcher_speed, .init = setup, .fini = teardown);
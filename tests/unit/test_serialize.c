@@ -56,3 +56,137 @@ Test(serialize, test_serialize)
   serialize_read_string(a, value);
   cr_assert_str_eq(value->str, "tarkabarka");
 }
+
+static void
+_write_test_data(SerializeArchive *a, const gchar *large_blob, gsize large_blob_len)
+{
+  serialize_write_blob(a, "MAGIC", 5);
+  serialize_write_uint32(a, 0xdeadbeaf);
+  serialize_write_blob_ref(a, large_blob, large_blob_len);
+  serialize_write_cstring_ref(a, "kismacska", -1);
+  serialize_write_uint16(a, 0x1234);
+}
+
+static void
+_assert_test_data_read_back(SerializeArchive *a, const gchar *large_blob, gsize large_blob_len)
+{
+  GString *value = g_string_new("");
+  gchar buf[1024];
+  guint32 num = 0;
+  guint16 num16 = 0;
+
+  cr_assert(serialize_read_blob(a, buf, 5));
+  cr_assert_arr_eq(buf, "MAGIC", 5);
+
+  cr_assert(serialize_read_uint32(a, &num));
+  cr_assert_eq(num, 0xdeadbeaf);
+
+  cr_assert(serialize_read_blob(a, buf, large_blob_len));
+  cr_assert_arr_eq(buf, large_blob, large_blob_len);
+
+  cr_assert(serialize_read_string(a, value));
+  cr_assert_str_eq(value->str, "kismacska");
+
+  cr_assert(serialize_read_uint16(a, &num16));
+  cr_assert_eq(num16, 0x1234);
+
+  /* the stream is exhausted */
+  a->silent = TRUE;
+  cr_assert_not(serialize_read_uint16(a, &num16));
+
+  g_string_free(value, TRUE);
+}
+
+Test(serialize, test_blob_references_are_copied_by_the_string_archive)
+{
+  GString *stream = g_string_new("");
+  gchar large_blob[512];
+  gchar expected[512];
+  SerializeArchive *a;
+
+  memset(large_blob, 'x', sizeof(large_blob));
+  memset(expected, 'x', sizeof(expected));
+  a = serialize_string_archive_new(stream);
+  _write_test_data(a, large_blob, sizeof(large_blob));
+  serialize_archive_free(a);
+
+  /* modifying the original does not change the archive */
+  memset(large_blob, 'y', sizeof(large_blob));
+
+  a = serialize_string_archive_new(stream);
+  _assert_test_data_read_back(a, expected, sizeof(expected));
+  serialize_archive_free(a);
+  g_string_free(stream, TRUE);
+}
+
+Test(serialize, test_iov_archive_references_large_blobs_and_coalesces_small_writes)
+{
+  gchar large_blob[512];
+  const struct iovec *iov;
+  gint iovcnt;
+  SerializeArchive *a;
+
+  memset(large_blob, 'x', sizeof(large_blob));
+  a = serialize_iov_archive_new();
+  _write_test_data(a, large_blob, sizeof(large_blob));
+
+  iov = serialize_iov_archive_get_iov(a, &iovcnt);
+  cr_assert_eq(iovcnt, 3);
+  cr_assert_eq(iov[0].iov_len, 5 + 4);
+  cr_assert_eq(iov[1].iov_base, large_blob);
+  cr_assert_eq(iov[1].iov_len, sizeof(large_blob));
+  cr_assert_eq(iov[2].iov_len, 4 + 9 + 2);
+  cr_assert_eq(serialize_iov_archive_get_length(a), 5 + 4 + sizeof(large_blob) + 4 + 9 + 2);
+
+  _assert_test_data_read_back(a, large_blob, sizeof(large_blob));
+  serialize_archive_free(a);
+}
+
+Test(serialize, test_iov_archive_matches_string_archive)
+{
+  GString *stream = g_string_new("");
+  GString *gathered = g_string_new("");
+  gchar large_blob[512];
+  const struct iovec *iov;
+  gint iovcnt, i;
+  SerializeArchive *string_archive, *iov_archive;
+
+  memset(large_blob, 'x', sizeof(large_blob));
+  string_archive = serialize_string_archive_new(stream);
+  iov_archive = serialize_iov_archive_new();
+
+  _write_test_data(string_archive, large_blob, sizeof(large_blob));
+  _write_test_data(iov_archive, large_blob, sizeof(large_blob));
+
+  iov = serialize_iov_archive_get_iov(iov_archive, &iovcnt);
+  for (i = 0; i < iovcnt; i++)
+    g_string_append_len(gathered, iov[i].iov_base, iov[i].iov_len);
+
+  cr_assert_eq(gathered->len, stream->len);
+  cr_assert_arr_eq(gathered->str, stream->str, stream->len);
+
+  serialize_archive_free(string_archive);
+  serialize_archive_free(iov_archive);
+  g_string_free(gathered, TRUE);
+  g_string_free(stream, TRUE);
+}
+
+Test(serialize, test_iov_archive_reset)
+{
+  gchar large_blob[512];
+  gint iovcnt;
+  SerializeArchive *a;
+
+  memset(large_blob, 'x', sizeof(large_blob));
+  a = serialize_iov_archive_new();
+  _write_test_data(a, large_blob, sizeof(large_blob));
+
+  serialize_iov_archive_reset(a);
+  serialize_iov_archive_get_iov(a, &iovcnt);
+  cr_assert_eq(iovcnt, 0);
+  cr_assert_eq(serialize_iov_archive_get_length(a), 0);
+
+  _write_test_data(a, large_blob, sizeof(large_blob));
+  _assert_test_data_read_back(a, large_blob, sizeof(large_blob));
+  serialize_archive_free(a);
+}